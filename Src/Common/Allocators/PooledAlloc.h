@@ -26,6 +26,16 @@ public:
   // Return an object to the pool
   void Free(T * pFree);
 
+  // Number of objects allocated and not freed
+  size_t GetNumLive() const {
+    return m_Alloc.GetNumAllocated() - m_vpFree.size();
+  }
+
+  // Bytes held in blocks (whether in use or free), plus the free list
+  size_t GetBytesReserved() const {
+    return m_Alloc.GetBytesReserved() + m_vpFree.capacity() * sizeof(T *);
+  }
+
 private:
 
   // Use simple pooled alloc for the blocked allocation
@@ -22,6 +22,16 @@ public:
   // Return an uninitialized object
   T *Alloc();
 
+  // Number of objects handed out by Alloc
+  std::size_t GetNumAllocated() const {
+    return (m_vPool.size() - 1) * m_iBlockSize + m_vPool.back()->Used();
+  }
+
+  // Bytes held in blocks, whether handed out or not
+  std::size_t GetBytesReserved() const {
+    return m_vPool.size() * m_iBlockSize * sizeof(T);
+  }
+
 private:
   class CPool {
   public:
@@ -36,6 +46,9 @@ private:
         return &m_pData[m_iCurrent++];
       return NULL;
     }
+    std::size_t Used() const {
+      return m_iCurrent;
+    }
   private:
     mutable std::size_t m_iCurrent;
     std::size_t m_iSize;
@@ -0,0 +1,106 @@
+// SlabAlloc.h
+//
+// Copyright (c) 2024 The Dasher Team
+
+#pragma once
+
+// CSlabAlloc allocates raw memory for objects of assorted (small) sizes, e.g. the
+// various subclasses of some base class, from slabs holding a fixed number of
+// objects of each size class (multiples of 16 bytes).
+// Alloc(size) returns uninitialized memory; Free(p, size) returns it to the free list
+// for that size class, for reuse by the next Alloc of the same class. Slabs are only
+// freed on destruction of the allocator. Requests larger than MAX_SIZE are passed
+// to the global operator new/delete.
+// Not thread-safe.
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+class CSlabAlloc {
+public:
+  static const std::size_t GRANULE = 16;
+  static const std::size_t MAX_SIZE = 512;
+
+  // Construct with given number of objects per slab
+  CSlabAlloc(std::size_t iObjectsPerSlab)
+  : m_iObjectsPerSlab(iObjectsPerSlab), m_iLive(0), m_iPeak(0), m_iAllocated(0), m_iBytesLive(0), m_iBytesReserved(0) {
+    for (std::size_t i = 0; i < NUM_CLASSES; i++) m_pFree[i] = NULL;
+  }
+
+  ~CSlabAlloc() {
+    for (std::size_t i = 0; i < m_vSlabs.size(); i++)
+      ::operator delete(m_vSlabs[i]);
+  }
+
+  // Return uninitialized memory for an object of iSize bytes
+  void *Alloc(std::size_t iSize) {
+    ++m_iAllocated;
+    if (++m_iLive > m_iPeak) m_iPeak = m_iLive;
+    if (iSize > MAX_SIZE) {
+      m_iBytesLive += iSize;
+      return ::operator new(iSize);
+    }
+    const std::size_t iClass = ClassOf(iSize);
+    m_iBytesLive += (iClass + 1) * GRANULE;
+    if (!m_pFree[iClass]) NewSlab(iClass);
+    SFree *pRes = m_pFree[iClass];
+    m_pFree[iClass] = pRes->pNext;
+    return pRes;
+  }
+
+  // Return memory from Alloc(iSize) to the pool
+  void Free(void *p, std::size_t iSize) {
+    --m_iLive;
+    if (iSize > MAX_SIZE) {
+      m_iBytesLive -= iSize;
+      ::operator delete(p);
+      return;
+    }
+    const std::size_t iClass = ClassOf(iSize);
+    m_iBytesLive -= (iClass + 1) * GRANULE;
+    SFree *pFree = static_cast<SFree *>(p);
+    pFree->pNext = m_pFree[iClass];
+    m_pFree[iClass] = pFree;
+  }
+
+  // Number of objects allocated and not yet freed
+  std::size_t GetLive() const {return m_iLive;}
+  // Highest value GetLive() has reached
+  std::size_t GetPeak() const {return m_iPeak;}
+  // Number of calls to Alloc ever made (so GetAllocated() - GetLive() have been freed)
+  std::size_t GetAllocated() const {return m_iAllocated;}
+  // Bytes occupied by live objects (rounded up to their size class)
+  std::size_t GetBytesLive() const {return m_iBytesLive;}
+  // Bytes held in slabs, whether live or free
+  std::size_t GetBytesReserved() const {return m_iBytesReserved;}
+
+private:
+  static const std::size_t NUM_CLASSES = MAX_SIZE / GRANULE;
+
+  struct SFree {
+    SFree *pNext;
+  };
+
+  static std::size_t ClassOf(std::size_t iSize) {
+    return (iSize == 0) ? 0 : (iSize - 1) / GRANULE;
+  }
+
+  // Carve a new slab into the (empty) free list for a size class
+  void NewSlab(std::size_t iClass) {
+    const std::size_t iObjSize = (iClass + 1) * GRANULE;
+    char *pSlab = static_cast<char *>(::operator new(iObjSize * m_iObjectsPerSlab));
+    m_vSlabs.push_back(pSlab);
+    m_iBytesReserved += iObjSize * m_iObjectsPerSlab;
+    for (std::size_t i = m_iObjectsPerSlab; i-- > 0;) {
+      SFree *pFree = reinterpret_cast<SFree *>(pSlab + i * iObjSize);
+      pFree->pNext = m_pFree[iClass];
+      m_pFree[iClass] = pFree;
+    }
+  }
+
+  const std::size_t m_iObjectsPerSlab;
+  SFree *m_pFree[NUM_CLASSES];
+  std::vector<char *> m_vSlabs;
+  std::size_t m_iLive, m_iPeak, m_iAllocated, m_iBytesLive, m_iBytesReserved;
+};
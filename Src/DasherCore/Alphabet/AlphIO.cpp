@@ -19,19 +19,24 @@
 // Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "AlphIO.h"
+#include "../TraceRecorder.h"
 
 #include <string>
 #include <cstring>
 #include <algorithm>
 #include <sstream>
+#include <fstream>
+#include <iterator>
+#include <cctype>
+#include <cstdlib>
 
 using namespace Dasher;
 
-CAlphIO::CAlphIO(CMessageDisplay *pMsgs) : AbstractXMLParser(pMsgs) {
-	Alphabets["Default"] = CreateDefault();
+CAlphIO::CAlphIO(CMessageDisplay *pMsgs) : AbstractXMLParser(pMsgs), m_pCache(NULL) {
+	AddAlphabet(CreateDefault());
 }
 
-SGroupInfo* CAlphIO::ParseGroupRecursive(pugi::xml_node& group_node, CAlphInfo* CurrentAlphabet, SGroupInfo* previous_sibling, std::vector<SGroupInfo*> ancestors)
+SGroupInfo* CAlphIO::ParseGroupRecursive(pugi::xml_node& group_node, CAlphInfo* CurrentAlphabet, SGroupInfo* previous_sibling, std::vector<SGroupInfo*> ancestors) const
 {
 	SGroupInfo* pNewGroup = new SGroupInfo();
     pNewGroup->iNumChildNodes = 0;
@@ -87,10 +92,17 @@ SGroupInfo* CAlphIO::ParseGroupRecursive(pugi::xml_node& group_node, CAlphInfo*
 
 bool Dasher::CAlphIO::Parse(pugi::xml_document & document, const std::string, bool bUser)
 {
+	DASHER_TRACE_SPAN("CAlphIO::Parse", "io");
 	pugi::xml_node alphabet = document.document_element();
 
 	if(std::strcmp(alphabet.name(), "alphabet") != 0) return false; // a non <alphabet ...> node
 
+	AddAlphabet(ParseAlphabet(alphabet));
+	return true;
+}
+
+CAlphInfo* CAlphIO::ParseAlphabet(pugi::xml_node alphabet) const
+{
 	CAlphInfo* CurrentAlphabet = new CAlphInfo();
 	CurrentAlphabet->AlphID = alphabet.attribute("name").as_string();
 	CurrentAlphabet->TrainingFile = alphabet.attribute("trainingFilename").as_string();
@@ -143,16 +155,159 @@ bool Dasher::CAlphIO::Parse(pugi::xml_document & document, const std::string, bo
 	//child groups were added (to linked list) in reverse order. Put them in (iStart/iEnd) order...
 	ReverseChildList(CurrentAlphabet->pChild);
 
-	Alphabets[CurrentAlphabet->AlphID] = CurrentAlphabet;
+	return CurrentAlphabet;
+}
+
+void CAlphIO::AddAlphabet(const CAlphInfo* pInfo) const {
+	SAlphabet& entry(Alphabets[pInfo->AlphID]);
+	if (entry.pInfo && entry.pInfo != pInfo) delete entry.pInfo;
+	entry.strPath.clear();
+	entry.pInfo = pInfo;
+}
+
+namespace {
+	///Appends a code point to a string, as UTF-8
+	void AppendUTF8(std::string& str, unsigned long c) {
+		if (c < 0x80) str += static_cast<char>(c);
+		else if (c < 0x800) {
+			str += static_cast<char>(0xC0 | (c >> 6));
+			str += static_cast<char>(0x80 | (c & 0x3F));
+		} else if (c < 0x10000) {
+			str += static_cast<char>(0xE0 | (c >> 12));
+			str += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+			str += static_cast<char>(0x80 | (c & 0x3F));
+		} else {
+			str += static_cast<char>(0xF0 | (c >> 18));
+			str += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+			str += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+			str += static_cast<char>(0x80 | (c & 0x3F));
+		}
+	}
+
+	///Replaces the predefined and numeric character references in an attribute value
+	/// (as pugixml would); false if there is one we don't know (e.g. a DTD entity)
+	bool DecodeReferences(const std::string& strIn, std::string& strOut) {
+		strOut.clear();
+		for (std::string::size_type i = 0; i < strIn.size(); i++) {
+			if (strIn[i] != '&') {
+				strOut += strIn[i];
+				continue;
+			}
+			const std::string::size_type iEnd = strIn.find(';', i);
+			if (iEnd == std::string::npos) return false;
+			const std::string strRef(strIn.substr(i + 1, iEnd - i - 1));
+			if (strRef == "amp") strOut += '&';
+			else if (strRef == "lt") strOut += '<';
+			else if (strRef == "gt") strOut += '>';
+			else if (strRef == "quot") strOut += '"';
+			else if (strRef == "apos") strOut += '\'';
+			else if (strRef.size() > 1 && strRef[0] == '#') {
+				char* szEnd;
+				const bool bHex = strRef[1] == 'x';
+				const unsigned long c = strtoul(strRef.c_str() + (bHex ? 2 : 1), &szEnd, bHex ? 16 : 10);
+				if (*szEnd || c == 0 || c > 0x10FFFF) return false;
+				AppendUTF8(strOut, c);
+			} else return false;
+			i = iEnd;
+		}
+		return true;
+	}
+}
+
+bool CAlphIO::ReadAlphabetID(std::istream& in, std::string& strID) {
+	std::istreambuf_iterator<char> it(in), end;
+	//Reads up to (and including) the given terminator; false at EOF
+	auto skipPast = [&](const char* szEnd) {
+		const size_t iLen = strlen(szEnd);
+		size_t iMatched = 0;
+		while (it != end) {
+			const char c = *it++;
+			iMatched = (c == szEnd[iMatched]) ? iMatched + 1 : (c == szEnd[0] ? 1 : 0);
+			if (iMatched == iLen) return true;
+		}
+		return false;
+	};
+	for (;;) {
+		if (!skipPast("<") || it == end) return false;
+		if (*it == '?') {
+			if (!skipPast("?>")) return false;
+		} else if (*it == '!') {
+			++it;
+			if (it != end && *it == '-') {
+				if (!skipPast("-->")) return false;
+			} else {
+				//DOCTYPE, possibly with an internal subset [...] containing '>'s
+				int iDepth = 0;
+				for (; it != end; ++it) {
+					if (*it == '[') iDepth++;
+					else if (*it == ']') iDepth--;
+					else if (*it == '>' && iDepth <= 0) break;
+				}
+				if (it == end) return false;
+				++it;
+			}
+		} else break;
+	}
+	//the first element: read its start tag
+	std::string strTag;
+	char cQuote = 0;
+	for (; it != end; ++it) {
+		const char c = *it;
+		if (cQuote) {
+			if (c == cQuote) cQuote = 0;
+		} else if (c == '"' || c == '\'') cQuote = c;
+		else if (c == '>') break;
+		strTag += c;
+	}
+	if (it == end || strTag.compare(0, 8, "alphabet") != 0 || (strTag.size() > 8 && !isspace(static_cast<unsigned char>(strTag[8])) && strTag[8] != '/'))
+		return false;
+	//find name = "value" (or 'value') among the attributes
+	for (std::string::size_type i = 8; i < strTag.size();) {
+		while (i < strTag.size() && isspace(static_cast<unsigned char>(strTag[i]))) i++;
+		const std::string::size_type iName = i;
+		while (i < strTag.size() && strTag[i] != '=' && !isspace(static_cast<unsigned char>(strTag[i]))) i++;
+		const std::string strName(strTag.substr(iName, i - iName));
+		while (i < strTag.size() && isspace(static_cast<unsigned char>(strTag[i]))) i++;
+		if (i >= strTag.size() || strTag[i] != '=') return false;
+		i++;
+		while (i < strTag.size() && isspace(static_cast<unsigned char>(strTag[i]))) i++;
+		if (i >= strTag.size() || (strTag[i] != '"' && strTag[i] != '\'')) return false;
+		const std::string::size_type iValueEnd = strTag.find(strTag[i], i + 1);
+		if (iValueEnd == std::string::npos) return false;
+		if (strName == "name")
+			return DecodeReferences(strTag.substr(i + 1, iValueEnd - i - 1), strID) && !strID.empty();
+		i = iValueEnd + 1;
+	}
+	return false;
+}
 
+bool CAlphIO::ParseFile(const std::string& strPath, bool bUser) {
+	std::string strID;
+	{
+		std::ifstream in(strPath.c_str(), std::ios::binary);
+		if (!in) return false;
+		if (!ReadAlphabetID(in, strID))
+			return AbstractXMLParser::ParseFile(strPath, bUser);
+	}
+	SAlphabet& entry(Alphabets[strID]);
+	delete entry.pInfo;
+	entry.strPath = strPath;
+	entry.pInfo = NULL;
 	return true;
 }
 
+unsigned int CAlphIO::GetNumParsed() const {
+	unsigned int iParsed = 0;
+	for (const auto& [AlphabetID, entry] : Alphabets)
+		if (entry.pInfo) iParsed++;
+	return iParsed;
+}
+
 void CAlphIO::GetAlphabets(std::vector<std::string>* AlphabetList) const {
 	AlphabetList->clear();
 
-	for (auto [AlphabetID, Alphabet] : Alphabets){
-		AlphabetList->push_back(Alphabet->AlphID);
+	for (const auto& [AlphabetID, entry] : Alphabets){
+		AlphabetList->push_back(AlphabetID);
 	}
 }
 
@@ -167,9 +322,45 @@ std::string CAlphIO::GetDefault() const {
 
 const CAlphInfo *CAlphIO::GetInfo(const std::string &AlphabetID) const {
 	auto it = Alphabets.find(AlphabetID);
-	if (it == Alphabets.end()) //if we don't have the alphabet they ask for,
-		it = Alphabets.find(GetDefault()); //give them default - it's better than nothing
-	return it->second;
+	if (it != Alphabets.end() && !it->second.pInfo) {
+		//indexed but not yet parsed
+		const std::string strPath(it->second.strPath);
+		const CAlphInfo* pInfo = m_pCache ? m_pCache->Load(strPath) : NULL;
+		if (!pInfo) {
+			DASHER_TRACE_SPAN("CAlphIO::Parse", "io");
+			std::ifstream in(strPath.c_str(), std::ios::binary);
+			pugi::xml_document document;
+			if (in && document.load(in)) {
+				pugi::xml_node alphabet = document.document_element();
+				if (std::strcmp(alphabet.name(), "alphabet") == 0) {
+					pInfo = ParseAlphabet(alphabet);
+					if (m_pCache) m_pCache->Store(strPath, pInfo);
+				}
+			}
+		}
+		if (pInfo) {
+			if (pInfo->AlphID != AlphabetID) {
+				//the header scan and pugixml disagree; trust the latter
+				AddAlphabet(pInfo);
+				Alphabets.erase(AlphabetID);
+				return GetInfo(pInfo->AlphID);
+			}
+			it->second.pInfo = pInfo;
+			it->second.strPath.clear();
+		} else {
+			m_pMsgs->FormatMessage("Could not parse alphabet \"%s\" from %s", AlphabetID.c_str(), strPath.c_str());
+			Alphabets.erase(it);
+			it = Alphabets.end();
+		}
+	}
+	if (it == Alphabets.end()) { //if we don't have the alphabet they ask for,
+		const std::string strDefault(GetDefault()); //give them default - it's better than nothing
+		if (strDefault != AlphabetID) return GetInfo(strDefault);
+		//the default itself failed to parse (i.e. a file replaced the built-in one)
+		AddAlphabet(CreateDefault());
+		return GetInfo(strDefault);
+	}
+	return it->second.pInfo;
 }
 
 CAlphInfo *CAlphIO::CreateDefault() {
@@ -187,12 +378,17 @@ CAlphInfo *CAlphIO::CreateDefault() {
 
 	std::string Chars = "abcdefghijklmnopqrstuvwxyz";
 	Default->m_vCharacters.resize(Chars.size());
+	Default->m_vCharacterDoActions.resize(Chars.size());
+	Default->m_vCharacterUndoActions.resize(Chars.size());
 	//fill in structs for characters in Chars...
 	for(int i = 0; i < Chars.size(); i++) {
 		Default->m_vCharacters[i].Text = Chars[i];
 		Default->m_vCharacters[i].Display = Chars[i];
 		Default->m_vCharacters[i].ColorGroupOffset = i;
 		Default->m_vCharacters[i].parentGroup = Default;
+		//as ReadCharAttributes, for a character that just outputs its text
+		Default->m_vCharacterDoActions[i].push_back(new TextCharAction());
+		Default->m_vCharacterUndoActions[i].push_back(new TextCharUndoAction());
 	}
 
 	Default->iStart=1;
@@ -240,7 +436,7 @@ inline std::vector<std::vector<unsigned short>> parseKeyArray(const std::string&
 	return keyArray;
 }
 
-void CAlphIO::ReadCharAttributes(pugi::xml_node xml_node, CAlphInfo::character& alphabet_character, SGroupInfo* parentGroup, std::vector<Action*>& DoActions, std::vector<Action*>& UndoActions) {
+void CAlphIO::ReadCharAttributes(pugi::xml_node xml_node, CAlphInfo::character& alphabet_character, SGroupInfo* parentGroup, std::vector<Action*>& DoActions, std::vector<Action*>& UndoActions) const {
 
 	if(xml_node.type() == pugi::node_null) return;
 
@@ -350,7 +546,7 @@ void CAlphIO::ReadCharAttributes(pugi::xml_node xml_node, CAlphInfo::character&
 // Reverses the internal linked list for the given SGroupInfo
 // input given GroupInfo eg. pointer to G_1 with [G_1->G_2->G_3->G_4->Null]
 // result [G_4->G_3->G_2->G_1->Null]
-void CAlphIO::ReverseChildList(SGroupInfo *&pList) {
+void CAlphIO::ReverseChildList(SGroupInfo *&pList) const {
 	SGroupInfo *pFirst = pList;
 	SGroupInfo *pPrev = NULL;
 	while (pFirst) {
@@ -362,8 +558,14 @@ void CAlphIO::ReverseChildList(SGroupInfo *&pList) {
 	pList=pPrev;
 }
 
+void CAlphIO::SetCacheDirectory(const std::string& strDirectory) {
+	delete m_pCache;
+	m_pCache = strDirectory.empty() ? NULL : new CAlphabetCache(strDirectory);
+}
+
 CAlphIO::~CAlphIO() {
-	for (auto [AlphabetID, Alphabet] : Alphabets) {
-		delete Alphabet;
+	delete m_pCache;
+	for (const auto& [AlphabetID, entry] : Alphabets) {
+		delete entry.pInfo;
 	}
 }
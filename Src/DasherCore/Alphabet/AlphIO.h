@@ -24,6 +24,7 @@
 
 #include "../DasherTypes.h"
 #include "AlphInfo.h"
+#include "AlphabetCache.h"
 
 #include <map>
 #include <pugixml.hpp>
@@ -36,30 +37,68 @@ namespace Dasher {
 /// \ingroup Alphabet
 /// @{
 
-/// This class is used to read in alphabet definitions from all files
-/// alphabet.*.xml at startup (realization) time; it creates one CAlphInfo
-/// object per alphabet at this time, and stores them in a map from AlphID
-/// string until shutdown/destruction. (CAlphIO is a friend of CAlphInfo,
-/// so can create/manipulate instances.)
+/// This class is used to find alphabet definitions in all files alphabet.*.xml
+/// at startup (realization) time. To keep startup cheap, each file is only read
+/// as far as its <alphabet> element, to index the alphabet's ID (name) and file;
+/// the file is parsed in full, creating a CAlphInfo, the first time that alphabet
+/// is asked for (e.g. when selected), and the CAlphInfo is then kept until
+/// shutdown/destruction. (CAlphIO is a friend of CAlphInfo, so can
+/// create/manipulate instances.) If given a cache directory, the full parse
+/// is skipped in favour of the compiled copy (see CAlphabetCache) written the
+/// last time that file was parsed, so long as the file hasn't changed since.
 class Dasher::CAlphIO : public AbstractXMLParser {
 public:
 	CAlphIO(CMessageDisplay* pMsgs);
 	virtual ~CAlphIO();
 
+	///Indexes the alphabet in a file, without parsing it; if the ID can't be found
+	/// that way (see ReadAlphabetID), parses the whole file at once instead.
+	/// As with parsing, a later file with the same ID replaces an earlier one.
+	bool ParseFile(const std::string& strPath, bool bUser) override;
+
+	///Parses a whole alphabet document, replacing any alphabet of the same ID
 	virtual bool Parse(pugi::xml_document& document, const std::string filePath, bool bUser) override;
 
 	void GetAlphabets(std::vector< std::string >* AlphabetList) const;
+	///Gets an alphabet, parsing its file if that hasn't been done yet. If the alphabet
+	/// doesn't exist, or its file can't be parsed, returns the default instead.
+	/// Not thread-safe.
 	const CAlphInfo *GetInfo(const std::string& AlphID) const;
 	std::string GetDefault() const;
 
+	///Keep compiled copies of alphabets in the given directory, loading from them in
+	/// preference to parsing XML; empty to stop using compiled copies (the default).
+	void SetCacheDirectory(const std::string& strDirectory);
+
+	///Number of alphabets indexed, and of those parsed in full so far (inc. the built-in default)
+	unsigned int GetNumAlphabets() const {return static_cast<unsigned int>(Alphabets.size());}
+	unsigned int GetNumParsed() const;
+
+	///Reads the start of an alphabet file, as far as the <alphabet> element (skipping
+	/// the XML declaration, comments and DOCTYPE), to find its name attribute.
+	/// \return false if the first element isn't <alphabet> or has no name
+	static bool ReadAlphabetID(std::istream& in, std::string& strID);
+
 private:
-	std::map < std::string, const CAlphInfo* > Alphabets; // map AlphabetID to AlphabetInfo. 
+	struct SAlphabet {
+		///File to parse, or empty if parsed (or built in)
+		std::string strPath;
+		///NULL until parsed
+		const CAlphInfo* pInfo;
+	};
+	mutable std::map < std::string, SAlphabet > Alphabets; // map AlphabetID to file and AlphabetInfo.
+	///Compiled alphabets, or NULL if not caching
+	CAlphabetCache* m_pCache;
 	static CAlphInfo *CreateDefault();         // Give the user an English alphabet rather than nothing if anything goes horribly wrong.
 
+	///Creates the CAlphInfo for an <alphabet> element
+	CAlphInfo* ParseAlphabet(pugi::xml_node alphabet) const;
+	///Stores a fully-parsed alphabet under its ID, deleting any it replaces
+	void AddAlphabet(const CAlphInfo* pInfo) const;
 	void ReadCharAttributes(pugi::xml_node xml_node, CAlphInfo::character& alphabet_character, SGroupInfo* parentGroup, std::vector<Action*>&
-                            DoActions, std::vector<Action*>& UndoActions);
-	SGroupInfo* ParseGroupRecursive(pugi::xml_node& group_node, CAlphInfo* CurrentAlphabet, SGroupInfo* previous_sibling, std::vector<SGroupInfo*> ancestors);
-    void ReverseChildList(SGroupInfo*& pList);
+                            DoActions, std::vector<Action*>& UndoActions) const;
+	SGroupInfo* ParseGroupRecursive(pugi::xml_node& group_node, CAlphInfo* CurrentAlphabet, SGroupInfo* previous_sibling, std::vector<SGroupInfo*> ancestors) const;
+    void ReverseChildList(SGroupInfo*& pList) const;
 	// Alphabet types:
 	std::map<std::string, Options::AlphabetTypes> AlphabetStringToType;
 };
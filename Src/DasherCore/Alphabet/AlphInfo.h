@@ -32,6 +32,7 @@
 namespace Dasher {
   class CAlphInfo;
   class CAlphIO;
+  class CAlphabetCache;
 }
 
 /// \ingroup Alphabet
@@ -133,6 +134,7 @@ public:
 
 private:
   friend class CAlphIO;
+  friend class CAlphabetCache;
   CAlphInfo();
   // Basic information
   std::string AlphID;
@@ -0,0 +1,424 @@
+// AlphabetCache.cpp
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// This file is part of Dasher.
+//
+// Dasher is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Dasher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Dasher; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include "AlphabetCache.h"
+#include "../MappedFile.h"
+#include "../TraceRecorder.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <typeinfo>
+
+using namespace Dasher;
+
+namespace {
+  const char szMagic[4] = {'D','A','L','F'};
+  const size_t iHeaderSize = 24;
+
+  ///Tags identifying the class of each serialized Action
+  enum ActionTag : uint8_t {
+    TAG_TEXT_CHAR = 1, TAG_TEXT_CHAR_UNDO, TAG_DELETE, TAG_MOVE, TAG_FIXED_SPEECH, TAG_CONTEXT_SPEECH,
+    TAG_COPY, TAG_STOP, TAG_PAUSE, TAG_ATSPI, TAG_SPEAK_CANCEL, TAG_KEYBOARD, TAG_SOCKET_OUTPUT, TAG_CHANGE_SETTING
+  };
+
+  class CWriter {
+  public:
+    std::string m_strData;
+    void U8(uint8_t i) {m_strData += static_cast<char>(i);}
+    void U16(uint16_t i) {U8(static_cast<uint8_t>(i)); U8(static_cast<uint8_t>(i >> 8));}
+    void U32(uint32_t i) {U16(static_cast<uint16_t>(i)); U16(static_cast<uint16_t>(i >> 16));}
+    void U64(uint64_t i) {U32(static_cast<uint32_t>(i)); U32(static_cast<uint32_t>(i >> 32));}
+    void I32(int i) {U32(static_cast<uint32_t>(i));}
+    void F32(float f) {uint32_t i; memcpy(&i, &f, 4); U32(i);}
+    void Str(const std::string &str) {U32(static_cast<uint32_t>(str.size())); m_strData += str;}
+  };
+
+  ///Reads from a mapped file; any read past the end (or failed Check) sets m_bFailed,
+  /// after which reads return zeros, so callers need only test once at the end.
+  class CReader {
+  public:
+    CReader(const unsigned char *pData, size_t iSize) : m_bFailed(false), m_p(pData), m_pEnd(pData + iSize) {}
+    bool m_bFailed;
+    bool Check(bool b) {if (!b) m_bFailed = true; return !m_bFailed;}
+    uint8_t U8() {return Check(m_p < m_pEnd) ? *m_p++ : 0;}
+    uint16_t U16() {const uint16_t i = U8(); return static_cast<uint16_t>(i | (U8() << 8));}
+    uint32_t U32() {const uint32_t i = U16(); return i | (static_cast<uint32_t>(U16()) << 16);}
+    uint64_t U64() {const uint64_t i = U32(); return i | (static_cast<uint64_t>(U32()) << 32);}
+    int I32() {return static_cast<int>(U32());}
+    float F32() {const uint32_t i = U32(); float f; memcpy(&f, &i, 4); return f;}
+    std::string Str() {
+      const uint32_t iLen = U32();
+      if (!Check(static_cast<size_t>(m_pEnd - m_p) >= iLen)) return std::string();
+      const char *p = reinterpret_cast<const char *>(m_p);
+      m_p += iLen;
+      return std::string(p, iLen);
+    }
+    bool AtEnd() const {return m_p == m_pEnd;}
+  private:
+    const unsigned char *m_p, * const m_pEnd;
+  };
+
+  void WriteGroupFields(CWriter &out, const SGroupInfo *pGroup) {
+    out.Str(pGroup->strLabel);
+    out.Str(pGroup->strName);
+    out.Str(pGroup->colorGroup);
+    out.I32(pGroup->iStart);
+    out.I32(pGroup->iEnd);
+    out.I32(pGroup->iNumChildNodes);
+  }
+
+  void ReadGroupFields(CReader &in, SGroupInfo *pGroup) {
+    pGroup->strLabel = in.Str();
+    pGroup->strName = in.Str();
+    pGroup->colorGroup = in.Str();
+    pGroup->iStart = in.I32();
+    pGroup->iEnd = in.I32();
+    pGroup->iNumChildNodes = in.I32();
+  }
+
+  ///Numbers the groups below pGroup in pre-order (the alphabet itself being 0),
+  /// recording each one's parent
+  void NumberGroups(const SGroupInfo *pGroup, std::map<const SGroupInfo *, uint32_t> &mapIdx,
+                    std::vector<const SGroupInfo *> &vGroups, std::vector<uint32_t> &vParents) {
+    const uint32_t iParent = mapIdx[pGroup];
+    for (const SGroupInfo *pChild = pGroup->pChild; pChild; pChild = pChild->pNext) {
+      mapIdx[pChild] = static_cast<uint32_t>(vGroups.size());
+      vGroups.push_back(pChild);
+      vParents.push_back(iParent);
+      NumberGroups(pChild, mapIdx, vGroups, vParents);
+    }
+  }
+
+  bool IsDistance(uint32_t i) {return i <= EDIT_NONE;}
+
+  ///false if the action is of a class we don't know how to write
+  bool WriteAction(CWriter &out, const Action *pAction) {
+    const std::type_info &type(typeid(*pAction));
+    if (type == typeid(TextCharAction)) out.U8(TAG_TEXT_CHAR);
+    else if (type == typeid(TextCharUndoAction)) out.U8(TAG_TEXT_CHAR_UNDO);
+    else if (type == typeid(DeleteAction) || type == typeid(MoveAction)) {
+      const bool bDelete = (type == typeid(DeleteAction));
+      out.U8(bDelete ? TAG_DELETE : TAG_MOVE);
+      out.U8(bDelete ? static_cast<const DeleteAction *>(pAction)->m_bForwards : static_cast<const MoveAction *>(pAction)->m_bForwards);
+      out.U32(bDelete ? static_cast<const DeleteAction *>(pAction)->m_dist : static_cast<const MoveAction *>(pAction)->m_dist);
+    } else if (type == typeid(FixedSpeechAction)) {
+      out.U8(TAG_FIXED_SPEECH);
+      out.Str(static_cast<const FixedSpeechAction *>(pAction)->text);
+    } else if (type == typeid(ContextSpeechAction) || type == typeid(CopyAction)) {
+      const TextAction *pText = static_cast<const TextAction *>(pAction);
+      out.U8(type == typeid(CopyAction) ? TAG_COPY : TAG_CONTEXT_SPEECH);
+      out.U32(pText->context);
+      out.U32(pText->m_dist);
+    } else if (type == typeid(StopDasherAction)) out.U8(TAG_STOP);
+    else if (type == typeid(PauseDasherAction)) {
+      out.U8(TAG_PAUSE);
+      out.U64(static_cast<uint64_t>(static_cast<int64_t>(static_cast<const PauseDasherAction *>(pAction)->time)));
+    } else if (type == typeid(ATSPIAction)) {
+      out.U8(TAG_ATSPI);
+      out.Str(static_cast<const ATSPIAction *>(pAction)->action);
+    } else if (type == typeid(SpeakCancelAction)) out.U8(TAG_SPEAK_CANCEL);
+    else if (type == typeid(KeyboardAction)) {
+      const KeyboardAction *pKeys = static_cast<const KeyboardAction *>(pAction);
+      out.U8(TAG_KEYBOARD);
+      out.U32(pKeys->type);
+      out.U32(static_cast<uint32_t>(pKeys->keycodes.size()));
+      for (const std::vector<unsigned short> &vCodes : pKeys->keycodes) {
+        out.U32(static_cast<uint32_t>(vCodes.size()));
+        for (unsigned short iCode : vCodes) out.U16(iCode);
+      }
+    } else if (type == typeid(SocketOutputAction)) {
+      const SocketOutputAction *pSocket = static_cast<const SocketOutputAction *>(pAction);
+      out.U8(TAG_SOCKET_OUTPUT);
+      out.Str(pSocket->socketName);
+      out.Str(pSocket->action);
+      out.U8(pSocket->addNewLine);
+    } else if (type == typeid(ChangeSettingsAction)) {
+      //by name, as parameter numbers may change between versions of Dasher
+      const ChangeSettingsAction *pChange = static_cast<const ChangeSettingsAction *>(pAction);
+      out.U8(TAG_CHANGE_SETTING);
+      out.Str(Settings::GetParameterName(pChange->parameter));
+      out.U8(static_cast<uint8_t>(pChange->newValue.index()));
+      if (const bool *pBool = std::get_if<bool>(&pChange->newValue)) out.U8(*pBool);
+      else if (const long *pLong = std::get_if<long>(&pChange->newValue)) out.U64(static_cast<uint64_t>(static_cast<int64_t>(*pLong)));
+      else out.Str(std::get<std::string>(pChange->newValue));
+    } else return false;
+    return true;
+  }
+
+  ///NULL (with in.m_bFailed set) if the data isn't a valid action
+  Action *ReadAction(CReader &in) {
+    const uint8_t iTag = in.U8();
+    switch (iTag) {
+      case TAG_TEXT_CHAR: return new TextCharAction();
+      case TAG_TEXT_CHAR_UNDO: return new TextCharUndoAction();
+      case TAG_DELETE:
+      case TAG_MOVE: {
+        const bool bForwards = in.U8() != 0;
+        const uint32_t iDist = in.U32();
+        if (!in.Check(IsDistance(iDist))) return NULL;
+        if (iTag == TAG_DELETE) return new DeleteAction(bForwards, static_cast<EditDistance>(iDist));
+        return new MoveAction(bForwards, static_cast<EditDistance>(iDist));
+      }
+      case TAG_FIXED_SPEECH: return new FixedSpeechAction(in.Str());
+      case TAG_CONTEXT_SPEECH:
+      case TAG_COPY: {
+        const uint32_t iContext = in.U32(), iDist = in.U32();
+        if (!in.Check(iContext <= TextAction::Distance && IsDistance(iDist))) return NULL;
+        const TextAction::ActionContext context = static_cast<TextAction::ActionContext>(iContext);
+        if (iTag == TAG_COPY) return new CopyAction(context, static_cast<EditDistance>(iDist));
+        return new ContextSpeechAction(context, static_cast<EditDistance>(iDist));
+      }
+      case TAG_STOP: return new StopDasherAction();
+      case TAG_PAUSE: return new PauseDasherAction(static_cast<long>(static_cast<int64_t>(in.U64())));
+      case TAG_ATSPI: return new ATSPIAction(in.Str());
+      case TAG_SPEAK_CANCEL: return new SpeakCancelAction();
+      case TAG_KEYBOARD: {
+        const uint32_t iType = in.U32();
+        if (!in.Check(iType <= KeyboardAction::KEY_PRESS_RELEASE)) return NULL;
+        std::vector<std::vector<unsigned short>> vKeycodes;
+        for (uint32_t i = in.U32(); i > 0 && !in.m_bFailed; i--) {
+          vKeycodes.emplace_back();
+          for (uint32_t j = in.U32(); j > 0 && !in.m_bFailed; j--) vKeycodes.back().push_back(in.U16());
+        }
+        if (in.m_bFailed) return NULL;
+        return new KeyboardAction(static_cast<KeyboardAction::pressType>(iType), vKeycodes);
+      }
+      case TAG_SOCKET_OUTPUT: {
+        const std::string strSocket(in.Str()), strAction(in.Str());
+        return new SocketOutputAction(strSocket, strAction, in.U8() != 0);
+      }
+      case TAG_CHANGE_SETTING: {
+        const std::pair<Parameter, Settings::ParameterType> param = Settings::GetParameter(in.Str());
+        const uint8_t iIndex = in.U8();
+        if (iIndex == 0 && in.Check(param.second == Settings::PARAM_BOOL))
+          return new ChangeSettingsAction(param.first, in.U8() != 0);
+        if (iIndex == 1 && in.Check(param.second == Settings::PARAM_LONG))
+          return new ChangeSettingsAction(param.first, static_cast<long>(static_cast<int64_t>(in.U64())));
+        if (iIndex == 2 && in.Check(param.second == Settings::PARAM_STRING))
+          return new ChangeSettingsAction(param.first, in.Str());
+        in.Check(false);
+        return NULL;
+      }
+      default:
+        in.Check(false);
+        return NULL;
+    }
+  }
+
+  void WriteActions(CWriter &out, const std::vector<Action *> &vActions, bool &bOk) {
+    out.U32(static_cast<uint32_t>(vActions.size()));
+    for (const Action *pAction : vActions)
+      if (!WriteAction(out, pAction)) bOk = false;
+  }
+
+  void ReadActions(CReader &in, std::vector<Action *> &vActions) {
+    for (uint32_t i = in.U32(); i > 0 && !in.m_bFailed; i--)
+      if (Action *pAction = ReadAction(in)) vActions.push_back(pAction);
+  }
+
+  ///FNV-1a, so that file names are the same whichever compiler built Dasher
+  uint64_t HashPath(const std::string &strPath) {
+    uint64_t iHash = 14695981039346656037ull;
+    for (unsigned char c : strPath) {
+      iHash ^= c;
+      iHash *= 1099511628211ull;
+    }
+    return iHash;
+  }
+}
+
+CAlphabetCache::CAlphabetCache(const std::string &strDirectory) : m_strDirectory(strDirectory) {
+}
+
+std::string CAlphabetCache::GetCacheFile(const std::string &strXmlPath) const {
+  //the XML's name, for people looking in the directory; the hash of its path, to
+  // tell apart files of the same name in different places
+  char szHash[17];
+  snprintf(szHash, sizeof(szHash), "%016llx", static_cast<unsigned long long>(HashPath(strXmlPath)));
+  const std::filesystem::path xml(strXmlPath);
+  return (std::filesystem::path(m_strDirectory) / (xml.stem().string() + "." + szHash + ".alph")).string();
+}
+
+bool CAlphabetCache::GetStamp(const std::string &strXmlPath, uint64_t &iSize, int64_t &iModified) {
+  std::error_code ec;
+  iSize = std::filesystem::file_size(strXmlPath, ec);
+  if (ec) return false;
+  const std::filesystem::file_time_type tModified = std::filesystem::last_write_time(strXmlPath, ec);
+  if (ec) return false;
+  iModified = static_cast<int64_t>(tModified.time_since_epoch().count());
+  return true;
+}
+
+CAlphInfo *CAlphabetCache::Load(const std::string &strXmlPath) const {
+  DASHER_TRACE_SPAN("CAlphabetCache::Load", "io");
+  uint64_t iSize;
+  int64_t iModified;
+  if (!GetStamp(strXmlPath, iSize, iModified)) return NULL;
+
+  CMappedFile file;
+  if (!file.Open(GetCacheFile(strXmlPath)) || file.Size() < iHeaderSize
+      || memcmp(file.Data(), szMagic, sizeof(szMagic)) != 0)
+    return NULL;
+  CReader in(file.Data() + sizeof(szMagic), file.Size() - sizeof(szMagic));
+  const uint16_t iVersion = in.U16();
+  in.U16(); //reserved
+  if (iVersion != VERSION || in.U64() != iSize || static_cast<int64_t>(in.U64()) != iModified
+      || in.Str() != strXmlPath)
+    return NULL;
+
+  CAlphInfo *pInfo = new CAlphInfo();
+  pInfo->AlphID = in.Str();
+  pInfo->TrainingFile = in.Str();
+  pInfo->PreferredColors = in.Str();
+  pInfo->m_strDefaultContext = in.Str();
+  pInfo->m_strCtxChar = in.Str();
+  pInfo->m_strConversionTrainStart = in.Str();
+  pInfo->m_strConversionTrainStop = in.Str();
+  const uint32_t iOrientation = in.U32(), iConversion = in.U32();
+  in.Check(iOrientation <= Options::BottomToTop);
+  in.Check(iConversion == CAlphInfo::None || iConversion == CAlphInfo::Mandarin
+           || iConversion == CAlphInfo::RoutingContextInsensitive || iConversion == CAlphInfo::RoutingContextSensitive);
+  pInfo->Orientation = static_cast<Options::ScreenOrientations>(iOrientation);
+  pInfo->m_iConversionID = static_cast<CAlphInfo::alphabetConversion>(iConversion);
+  ReadGroupFields(in, pInfo);
+
+  //groups in pre-order, each appended to its parent's (so far) last child; linking
+  // each in as soon as it's created means deleting pInfo frees them on failure
+  std::vector<SGroupInfo *> vGroups(1, pInfo), vLastChild(1, nullptr);
+  for (uint32_t i = in.U32(); i > 0 && !in.m_bFailed; i--) {
+    const uint32_t iParent = in.U32();
+    if (!in.Check(iParent < vGroups.size())) break;
+    SGroupInfo *pGroup = new SGroupInfo();
+    pGroup->pChild = pGroup->pNext = nullptr;
+    ReadGroupFields(in, pGroup);
+    if (vLastChild[iParent]) vLastChild[iParent]->pNext = pGroup;
+    else vGroups[iParent]->pChild = pGroup;
+    vLastChild[iParent] = pGroup;
+    vGroups.push_back(pGroup);
+    vLastChild.push_back(nullptr);
+  }
+
+  const uint32_t iNumChars = in.U32();
+  //each character takes well over a byte, so this bounds the allocation below
+  if (in.Check(iNumChars <= file.Size())) {
+    pInfo->m_vCharacters.resize(iNumChars);
+    pInfo->m_vCharacterDoActions.resize(iNumChars);
+    pInfo->m_vCharacterUndoActions.resize(iNumChars);
+  }
+  for (uint32_t i = 0; i < pInfo->m_vCharacters.size() && !in.m_bFailed; i++) {
+    CAlphInfo::character &ch(pInfo->m_vCharacters[i]);
+    ch.Display = in.Str();
+    ch.Text = in.Str();
+    const uint32_t iParent = in.U32();
+    if (!in.Check(iParent < vGroups.size())) break;
+    ch.parentGroup = vGroups[iParent];
+    ch.ColorGroupOffset = in.I32();
+    ch.fixedProbability = in.F32();
+    ch.speedFactor = in.F32();
+    ReadActions(in, pInfo->m_vCharacterDoActions[i]);
+    ReadActions(in, pInfo->m_vCharacterUndoActions[i]);
+  }
+
+  if (in.m_bFailed || !in.AtEnd()) {
+    delete pInfo;
+    return NULL;
+  }
+  return pInfo;
+}
+
+bool CAlphabetCache::Store(const std::string &strXmlPath, const CAlphInfo *pInfo) const {
+  uint64_t iSize;
+  int64_t iModified;
+  if (!GetStamp(strXmlPath, iSize, iModified)) return false;
+
+  std::map<const SGroupInfo *, uint32_t> mapIdx;
+  mapIdx[pInfo] = 0;
+  std::vector<const SGroupInfo *> vGroups(1, pInfo);
+  std::vector<uint32_t> vParents(1, 0);
+  NumberGroups(pInfo, mapIdx, vGroups, vParents);
+
+  CWriter out;
+  out.m_strData.append(szMagic, sizeof(szMagic));
+  out.U16(VERSION);
+  out.U16(0);
+  out.U64(iSize);
+  out.U64(static_cast<uint64_t>(iModified));
+  out.Str(strXmlPath);
+
+  out.Str(pInfo->AlphID);
+  out.Str(pInfo->TrainingFile);
+  out.Str(pInfo->PreferredColors);
+  out.Str(pInfo->m_strDefaultContext);
+  out.Str(pInfo->m_strCtxChar);
+  out.Str(pInfo->m_strConversionTrainStart);
+  out.Str(pInfo->m_strConversionTrainStop);
+  out.U32(static_cast<uint32_t>(pInfo->Orientation));
+  out.U32(static_cast<uint32_t>(pInfo->m_iConversionID));
+  WriteGroupFields(out, pInfo);
+  out.U32(static_cast<uint32_t>(vGroups.size() - 1));
+  for (size_t i = 1; i < vGroups.size(); i++) {
+    out.U32(vParents[i]);
+    WriteGroupFields(out, vGroups[i]);
+  }
+
+  bool bOk = pInfo->m_vCharacters.size() == pInfo->m_vCharacterDoActions.size()
+    && pInfo->m_vCharacters.size() == pInfo->m_vCharacterUndoActions.size();
+  out.U32(static_cast<uint32_t>(pInfo->m_vCharacters.size()));
+  for (size_t i = 0; i < pInfo->m_vCharacters.size() && bOk; i++) {
+    const CAlphInfo::character &ch(pInfo->m_vCharacters[i]);
+    out.Str(ch.Display);
+    out.Str(ch.Text);
+    //a character outside the group tree can't be written
+    const auto it = mapIdx.find(ch.parentGroup);
+    if (it == mapIdx.end()) return false;
+    out.U32(it->second);
+    out.I32(ch.ColorGroupOffset);
+    out.F32(ch.fixedProbability);
+    out.F32(ch.speedFactor);
+    WriteActions(out, pInfo->m_vCharacterDoActions[i], bOk);
+    WriteActions(out, pInfo->m_vCharacterUndoActions[i], bOk);
+  }
+  if (!bOk) return false;
+
+  //write to a temporary file and rename it over the old one, so that another
+  // process never maps a half-written file
+  std::error_code ec;
+  std::filesystem::create_directories(m_strDirectory, ec);
+  const std::string strFile(GetCacheFile(strXmlPath)), strTemp(strFile + ".tmp");
+  {
+    std::ofstream file(strTemp.c_str(), std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return false;
+    file.write(out.m_strData.data(), static_cast<std::streamsize>(out.m_strData.size()));
+    file.close();
+    if (file.fail()) {
+      std::filesystem::remove(strTemp, ec);
+      return false;
+    }
+  }
+  std::filesystem::rename(strTemp, strFile, ec);
+  if (ec) {
+    std::filesystem::remove(strTemp, ec);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,79 @@
+// AlphabetCache.h
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// This file is part of Dasher.
+//
+// Dasher is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Dasher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Dasher; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+#pragma once
+
+#include "AlphInfo.h"
+
+#include <cstdint>
+#include <string>
+
+namespace Dasher {
+  class CAlphabetCache;
+}
+
+/// \ingroup Alphabet
+/// @{
+
+/// A directory of compiled (binary) copies of alphabets, one per alphabet XML file,
+/// so that CAlphIO can rebuild a CAlphInfo from a memory-mapped file instead of
+/// loading and walking the XML DOM (which, for the large CJK and conversion alphabets,
+/// is most of the cost of selecting one).
+///
+/// Each compiled file records the path, size and modification time of the XML it was
+/// compiled from, and is only used while all three still match; so editing (or
+/// replacing) the XML invalidates it without any explicit step. A compiled file that
+/// is stale, truncated or from another version of this format is just ignored (and
+/// overwritten when the XML has been parsed again).
+///
+/// Layout (all integers little-endian): magic "DALF", version u16, 2 reserved bytes,
+/// XML size u64, XML modification time i64, then the XML path and the alphabet -
+/// strings as a u32 length then bytes, the group tree in pre-order with each group's
+/// parent, then each character with its parent group and its do/undo actions.
+class Dasher::CAlphabetCache {
+public:
+  ///\param strDirectory where to keep compiled alphabets; created when first needed
+  CAlphabetCache(const std::string &strDirectory);
+
+  const std::string &GetDirectory() const {return m_strDirectory;}
+
+  ///The file the compiled form of an alphabet XML file is kept in
+  std::string GetCacheFile(const std::string &strXmlPath) const;
+
+  ///Rebuilds the alphabet compiled from an XML file, if that file hasn't changed since.
+  /// \return the new CAlphInfo (owned by the caller), or NULL if there's no valid,
+  /// up-to-date compiled copy.
+  CAlphInfo *Load(const std::string &strXmlPath) const;
+
+  ///Writes the compiled form of an alphabet just parsed from an XML file. Fails
+  /// (writing nothing) if the alphabet has an action, or a group structure, that
+  /// the format can't represent, or the directory can't be written.
+  bool Store(const std::string &strXmlPath, const CAlphInfo *pInfo) const;
+
+  static const uint16_t VERSION = 1;
+
+private:
+  ///Size and modification time of the XML file, as stored in the header; false if it
+  /// doesn't exist
+  static bool GetStamp(const std::string &strXmlPath, uint64_t &iSize, int64_t &iModified);
+
+  const std::string m_strDirectory;
+};
+/// @}
@@ -8,6 +8,8 @@
 
 
 #include "AlphabetMap.h"
+#include "../MemoryReport.h"
+#include <algorithm>
 #include <limits>
 #include <iostream>
 #include <sstream>
@@ -58,29 +60,61 @@ int utf8_length::operator[](const unsigned char i) const
   return utf8_count_array[i];
 }
 
+///Code point of the iLength-octet UTF-8 character at pKey, or -1 if those octets are
+/// not the shortest encoding of a single code point (so CAlphabetMap must hash them).
+static int DecodeCodePoint(const char *pKey, int iLength) {
+  static const unsigned int leadMask[] = {0, 0x7f, 0x1f, 0x0f, 0x07};
+  static const unsigned int minCodePoint[] = {0, 0, 0x80, 0x800, 0x10000};
+  if (iLength < 1 || iLength > 4) return -1;
+  unsigned int cp = static_cast<unsigned char>(pKey[0]) & leadMask[iLength];
+  for (int i = 1; i < iLength; i++) {
+    const unsigned char c = static_cast<unsigned char>(pKey[i]);
+    if ((c & 0xc0) != 0x80) return -1; //not a continuation octet
+    cp = (cp << 6) | (c & 0x3f);
+  }
+  if (cp < minCodePoint[iLength] || cp > 0x10ffff) return -1;
+  return static_cast<int>(cp);
+}
+
 ////////////////////////////////////////////////////////////////////////////
 
 CAlphabetMap::SymbolStream::SymbolStream(std::istream &_in, CMessageDisplay *pMsgs)
-: pos(0), len(0), in(_in), m_pMsgs(pMsgs) {
+: m_pBuf(buf), pos(0), len(0), in(&_in), m_iReported(0), m_iFastEnd(0), m_pMsgs(pMsgs) {
   readMore();
 }
 
+///When reading from memory, how often to call bytesRead
+static const off_t REPORT_BYTES = 1 << 16;
+
+CAlphabetMap::SymbolStream::SymbolStream(const char *pData, size_t iLength, CMessageDisplay *pMsgs)
+: m_pBuf(pData), pos(0), len(static_cast<off_t>(iLength)), in(NULL), m_iReported(0),
+  m_iFastEnd(std::min(len, REPORT_BYTES)), m_pMsgs(pMsgs) {
+}
+
 void CAlphabetMap::SymbolStream::readMore() {
   //len is first unfilled byte
-  in.read(&buf[len], 1024-len);
-  if (in.good()) {
-    DASHER_ASSERT(in.gcount() == 1024-len);
+  in->read(&buf[len], 1024-len);
+  if (in->good()) {
+    DASHER_ASSERT(in->gcount() == 1024-len);
     len = 1024;
   } else {
-    len+= static_cast<off_t>(in.gcount());
+    len+= static_cast<off_t>(in->gcount());
     DASHER_ASSERT(len<1024);
     //next attempt to read more will fail.
   }
+  m_iFastEnd = len;
 }
 
 inline int CAlphabetMap::SymbolStream::findNext() {
   for (;;) {
-    if (pos + m_utf8_count_array.max_length > len) {
+    if (!in) {
+      //reading from memory: everything is there already, just report progress
+      if (pos - m_iReported >= REPORT_BYTES || (pos == len && pos > m_iReported)) {
+        bytesRead(pos - m_iReported);
+        m_iReported = pos;
+        m_iFastEnd = std::min(len, m_iReported + REPORT_BYTES);
+      }
+    } else if (pos + m_utf8_count_array.max_length > len) {
       //may need more bytes for next char
       if (pos) {
         //shift remaining bytes to beginning
@@ -94,75 +128,78 @@ inline int CAlphabetMap::SymbolStream::findNext() {
     }
     //if still don't have any chars after attempting to read more...EOF!
     if (pos==len) return 0; //EOF
-    if (int numChars = m_utf8_count_array[buf[pos]]) {
+    if (int numChars = m_utf8_count_array[m_pBuf[pos]]) {
       if (pos+numChars > len) {
         //no more bytes in file (would have tried to read earlier), but not enough for char
-        if(m_pMsgs) m_pMsgs->FormatMessage("File ends with incomplete UTF-8 character beginning 0x%x (expecting %i bytes but only %i)", static_cast<unsigned int>(buf[pos] & 0xff), numChars, len-pos);
+        if(m_pMsgs) m_pMsgs->FormatMessage("File ends with incomplete UTF-8 character beginning 0x%x (expecting %i bytes but only %i)", static_cast<unsigned int>(m_pBuf[pos] & 0xff), numChars, static_cast<int>(len-pos));
+        if (!in && len > m_iReported) {
+          bytesRead(len - m_iReported);
+          m_iReported = len;
+        }
         return 0;
       }
       return numChars;
     }
-    if (m_pMsgs) m_pMsgs->FormatMessage("Read invalid UTF-8 character 0x%x", static_cast<unsigned int>(buf[pos] & 0xff));
+    if (m_pMsgs) m_pMsgs->FormatMessage("Read invalid UTF-8 character 0x%x", static_cast<unsigned int>(m_pBuf[pos] & 0xff));
     ++pos;
   }
 }
 
 std::string CAlphabetMap::SymbolStream::peekAhead() {
   int numChars=findNext();
-  return std::string(&buf[pos],numChars);
+  return std::string(&m_pBuf[pos],numChars);
 }
 
 std::string CAlphabetMap::SymbolStream::peekBack() {
   bool bSeenHighBit=false;
-  for(int i=pos-1; i>=0; i--) {
-    if (buf[i] & 0x80) {
+  for(off_t i=pos-1; i>=0; i--) {
+    if (m_pBuf[i] & 0x80) {
       //multibyte character...
       bSeenHighBit=true;
-      if (buf[i] & 0x40) {
+      if (m_pBuf[i] & 0x40) {
         //START of multibyte character
-        int numChars = m_utf8_count_array[buf[i]];
+        int numChars = m_utf8_count_array[m_pBuf[i]];
         if (i+numChars>pos) {
           //last (attempt to read a) symbol was an incomplete UTF8 character (!).
           // We'll have reported an error already when we saw it the first time, so for now just:
           return "";
         }
         DASHER_ASSERT(i+numChars==pos);
-        return std::string(&buf[i],numChars);
+        return std::string(&m_pBuf[i],numChars);
       }
       //in middle of multibyte, keep going back...
     } else {
       //high bit not set -> single-byte char
       if (bSeenHighBit) return ""; //followed by a "continuation of multibyte char" without a "first byte of multibyte char" before it. (Malformed!)
-      return std::string(&buf[i],1);
+      return std::string(&m_pBuf[i],1);
     }
   }
   //fail...relatively gracefully ;-)
   return "";
 }
 
-symbol CAlphabetMap::SymbolStream::next(const CAlphabetMap *map)
+symbol CAlphabetMap::SymbolStream::nextChar(const CAlphabetMap *map)
 {
   int numChars=findNext();
   if (numChars==0) return -1; //EOF
   if (numChars == 1) {
-    if (map->m_ParagraphSymbol!=UNKNOWN_SYMBOL && buf[pos]=='\r') {
-      DASHER_ASSERT(pos+1<len || len<1024); //there are more characters (we should have read utf8...max_length), or else input is exhausted
-      if (pos+1<len && buf[pos+1]=='\n') {
+    if (map->m_ParagraphSymbol!=UNKNOWN_SYMBOL && m_pBuf[pos]=='\r') {
+      DASHER_ASSERT(pos+1<len || len<1024 || !in); //there are more characters (we should have read utf8...max_length), or else input is exhausted
+      if (pos+1<len && m_pBuf[pos+1]=='\n') {
         pos+=2;
         return map->m_ParagraphSymbol;
       }
     }
-    return map->GetSingleChar(buf[pos++]);
+    return map->GetSingleChar(m_pBuf[pos++]);
   }
-  int sym=map->Get(std::string(&buf[pos], numChars));
+  int sym=map->Get(&m_pBuf[pos], numChars);
   pos+=numChars;
   return sym;
 }
 
 void CAlphabetMap::GetSymbols(std::vector<symbol>& Symbols, const std::string& Input) const
 {
-  std::istringstream in(Input);
-  SymbolStream syms(in);
+  SymbolStream syms(Input.data(), Input.size());
   for (symbol sym; (sym=syms.next(this))!=-1;)
     Symbols.push_back(sym);
 }
@@ -177,8 +214,18 @@ CAlphabetMap::CAlphabetMap(unsigned int InitialTableSize)
   for (int i = 0; i<numChars; i++) m_pSingleChars[i] = UNKNOWN_SYMBOL;
 }
 
+size_t CAlphabetMap::GetMemoryUsage() const {
+  size_t iBytes = CMemoryReport::VectorBytes(Entries) + CMemoryReport::VectorBytes(HashTable)
+    + (std::numeric_limits<char>::max() + 1) * sizeof(symbol) + CMemoryReport::VectorBytes(m_vPages);
+  for (const Entry &e : Entries) iBytes += CMemoryReport::StringBytes(e.Key);
+  for (const symbol *pPage : m_vPages)
+    if (pPage) iBytes += (1 << PAGE_BITS) * sizeof(symbol);
+  return iBytes;
+}
+
 CAlphabetMap::~CAlphabetMap() {
   delete[] m_pSingleChars;
+  for (symbol *pPage : m_vPages) delete[] pPage;
 }
 
 void CAlphabetMap::AddParagraphSymbol(symbol Value) {
@@ -192,6 +239,19 @@ void CAlphabetMap::Add(const std::string &Key, symbol Value) {
     m_pSingleChars[Key[0]] = Value;
     return;
   }
+  const int cp = DecodeCodePoint(Key.data(), static_cast<int>(Key.length()));
+  if (cp >= 0) {
+    const size_t iPage = cp >> PAGE_BITS;
+    if (iPage >= m_vPages.size()) m_vPages.resize(iPage + 1, NULL);
+    symbol *&pPage = m_vPages[iPage];
+    if (!pPage) {
+      pPage = new symbol[1 << PAGE_BITS];
+      for (int i = 0; i < (1 << PAGE_BITS); i++) pPage[i] = UNKNOWN_SYMBOL;
+    }
+    DASHER_ASSERT(pPage[cp & ((1 << PAGE_BITS) - 1)] == UNKNOWN_SYMBOL);
+    pPage[cp & ((1 << PAGE_BITS) - 1)] = Value;
+    return;
+  }
   Entry *&HashEntry = HashTable[Hash(Key)];
 
   //Loop through Entries with the correct Hash value,
@@ -225,13 +285,23 @@ void CAlphabetMap::Add(const std::string &Key, symbol Value) {
 }
 
 symbol CAlphabetMap::Get(const std::string &Key) const {
-  DASHER_ASSERT(m_utf8_count_array[Key[0]]==Key.length());
-  if (Key.length() == 1) {
-	return GetSingleChar(Key[0]);
+  return Get(Key.data(), static_cast<int>(Key.length()));
+}
+
+symbol CAlphabetMap::Get(const char *pKey, int iLength) const {
+  DASHER_ASSERT(m_utf8_count_array[pKey[0]]==iLength);
+  if (iLength == 1) {
+	return GetSingleChar(pKey[0]);
+  }
+  const int cp = DecodeCodePoint(pKey, iLength);
+  if (cp >= 0) {
+    const size_t iPage = cp >> PAGE_BITS;
+    if (iPage < m_vPages.size() && m_vPages[iPage]) return m_vPages[iPage][cp & ((1 << PAGE_BITS) - 1)];
+    return UNKNOWN_SYMBOL;
   }
   // Loop through Entries with the correct Hash value.
-  for(Entry * i = HashTable[Hash(Key)]; i; i = i->Next) {
-    if(i->Key == Key) {
+  for(Entry * i = HashTable[Hash(pKey, iLength)]; i; i = i->Next) {
+    if(i->Key.length() == static_cast<size_t>(iLength) && memcmp(i->Key.data(), pKey, iLength) == 0) {
       return i->Symbol;
     }
   }
@@ -239,4 +309,3 @@ symbol CAlphabetMap::Get(const std::string &Key) const {
   return UNKNOWN_SYMBOL;
 }
 
-symbol CAlphabetMap::GetSingleChar(char key) const {return m_pSingleChars[key];}
@@ -43,6 +43,12 @@ namespace Dasher {
 /// fast-casing single-octet characters to avoid using a hash etc. - this makes
 /// many common alphabets substantially faster!
 ///
+/// Multi-octet characters are now looked up by code point, in a table of pages
+/// of 256 symbols each, allocated only for the blocks the alphabet uses; so,
+/// Cyrillic, Devanagari, CJK etc. text is mapped in constant time, without hashing
+/// or comparing strings. (The hash table remains only for keys that are not the
+/// shortest UTF-8 encoding of a single code point.)
+///
 /// Anyway, Ian writes:
 ///
 /// If I were just using GCC, which comes with the CGI "STL" implementation, I would
@@ -80,16 +86,33 @@ public:
 
   // Return the symbol associated with Key or Undefined.
   symbol Get(const std::string & Key) const;
-  symbol GetSingleChar(char key) const;
+  ///As Get(std::string), for the iLength octets (one unicode character) at pKey,
+  /// without constructing a string
+  symbol Get(const char *pKey, int iLength) const;
+  symbol GetSingleChar(char key) const {return m_pSingleChars[key];}
 
   class SymbolStream {
   public:
     ///pMsgs used for reporting errors in utf8 encoding
     SymbolStream(std::istream &_in, CMessageDisplay *pMsgs=NULL);
+    ///Reads symbols straight out of a block of memory (e.g. a memory-mapped file),
+    /// which must outlive the stream; no copying or buffering is done.
+    SymbolStream(const char *pData, size_t iLength, CMessageDisplay *pMsgs=NULL);
     ///Gets the next symbol in the stream, using the specified AlphabetMap
     /// to convert unicode characters to symbols.
     /// \return 0 for unknown symbol (not in map); -1 for EOF; else symbol#.
-    symbol next(const CAlphabetMap *map);
+    symbol next(const CAlphabetMap *map) {
+      //Inline fast path for the common case, a single-octet character already in the
+      // buffer (but not \r, which may begin a paragraph break).
+      if (pos < m_iFastEnd) {
+        const char c = m_pBuf[pos];
+        if (!(c & 0x80) && c != '\r') {
+          pos++;
+          return map->GetSingleChar(c);
+        }
+      }
+      return nextChar(map);
+    }
     
     ///Finds the next complete character in the stream,  but does not advance past it.
     /// Hence, repeated calls will return the same string. (Always constructs a string,
@@ -114,10 +137,20 @@ public:
     /// \return the number of octets representing the next character, or 0 for EOF
     /// (inc. where the file ends with an incomplete character)
     inline int findNext();
+    ///next(), for any character
+    symbol nextChar(const CAlphabetMap *map);
     void readMore();
     char buf[1024];
+    ///Characters being decoded: buf, or the block of memory passed in
+    const char *m_pBuf;
     off_t pos, len;
-    std::istream &in;
+    ///Stream to fill buf from, or NULL if reading from memory
+    std::istream * const in;
+    ///Position up to which bytesRead has been called, if reading from memory
+    off_t m_iReported;
+    ///next() may take single-octet characters before this position without calling
+    /// findNext: the end of buf, or (from memory) where bytesRead is next due.
+    off_t m_iFastEnd;
     CMessageDisplay * const m_pMsgs;
   };
   
@@ -133,6 +166,9 @@ public:
   /// \param Key text of the symbol; must not be present already
   /// \param Value symbol number to which that text should be mapped
   void Add(const std::string & Key, symbol Value);
+
+  ///Heap bytes used by the map (entries, their keys, and lookup tables)
+  size_t GetMemoryUsage() const;
   
 private:
   class Entry {
@@ -146,11 +182,13 @@ private:
 
   // A standard hash -- could try and research something specific.
   inline unsigned int Hash(const std::string & Input) const {
+    return Hash(Input.data(), Input.size());
+  }
+  inline unsigned int Hash(const char *pInput, size_t iLength) const {
     unsigned int Result = 0;
 
-    typedef std::string::const_iterator CI;
-    CI Cur = Input.begin();
-    CI end = Input.end();
+    const char *Cur = pInput;
+    const char *end = pInput + iLength;
 
     while(Cur != end)
       Result = (Result << 1) ^ *Cur++;
@@ -169,6 +207,13 @@ private:
   } std::vector < Entry > Entries;
   std::vector < Entry * >HashTable;
   symbol *m_pSingleChars;
+
+  ///Code points per page of m_vPages
+  static const int PAGE_BITS = 8;
+  ///Symbol for each multi-octet character, by code point: page (code point >> PAGE_BITS)
+  /// is NULL if no character in it has been added, else holds 1<<PAGE_BITS symbols
+  /// (UNKNOWN_SYMBOL for those not added). Only as long as the highest page used.
+  std::vector<symbol *> m_vPages;
   /// both "\r\n" and "\n" are mapped to this (if not Undefined).
   /// This is the only case where >1 character can map to a symbol.
   symbol m_ParagraphSymbol;
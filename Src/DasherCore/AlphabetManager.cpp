@@ -27,11 +27,17 @@
 #include "DasherNode.h"
 #include "NodeCreationManager.h"
 #include "LanguageModelling/PPMLanguageModel.h"
+#include "LanguageModelling/PPMSnapshotLanguageModel.h"
 #include "LanguageModelling/WordLanguageModel.h"
 #include "LanguageModelling/MixtureLanguageModel.h"
 #include "LanguageModelling/CTWLanguageModel.h"
+#include "LanguageModelling/CompactPPMLanguageModel.h"
 #include "FileWordGenerator.h"
+#include "ExpansionWorker.h"
+#include "MemoryReport.h"
+#include "TraceRecorder.h"
 
+#include <algorithm>
 #include <vector>
 
 using namespace Dasher;
@@ -46,8 +52,14 @@ CDasherInterfaceBase* Dasher::CSymbolNode::GetInterface()
 CAlphabetManager::CAlphabetManager(CSettingsStore *pSettingsStore, CDasherInterfaceBase *pInterface, CNodeCreationManager *pNCManager, const CAlphInfo *pAlphabet)
     : m_pBaseGroup(NULL), m_pInterface(pInterface), m_pLanguageModel(nullptr), m_pNCManager(pNCManager),
       m_pAlphabet(pAlphabet), m_pLastOutput(NULL),
-      m_pSettingsStore(pSettingsStore)
+      m_pSettingsStore(pSettingsStore), m_iProbCacheVersion(0), m_iProbCacheHits(0), m_iProbCacheMisses(0), m_iNumProbsCalls(0)
 {
+    m_pSettingsStore->OnParameterChanged.Subscribe(this, [this](Parameter parameter)
+    {
+      //these change what GetProbs computes for the same LM state
+      if (parameter == LP_UNIFORM || parameter == LP_LM_ALPHA || parameter == LP_LM_BETA)
+        ClearProbCache();
+    });
     m_pSettingsStore->OnPreParameterChange.Subscribe(this, [this](Parameter parameter, const std::variant<bool, long, std::string>& newValue)
     {
       if(parameter == SP_ALPHABET_ID){
@@ -121,23 +133,25 @@ void CAlphabetManager::InitMap() {
 }
 
 void CAlphabetManager::CreateLanguageModel() {
+  m_pLanguageModel = NewLanguageModel(m_pSettingsStore->GetLongParameter(LP_LANGUAGE_MODEL_ID), m_pSettingsStore, m_pAlphabet, &m_map);
+}
+
+CLanguageModel *CAlphabetManager::NewLanguageModel(long iModelID, CSettingsStore *pSettingsStore, const CAlphInfo *pAlphabet, const CAlphabetMap *pAlphMap) {
   // FIXME - return to using enum here
-  switch (m_pSettingsStore->GetLongParameter(LP_LANGUAGE_MODEL_ID)) {
+  switch (iModelID) {
     default:
       // If there is a bogus value for the language model ID, we'll default
       // to our trusty old PPM language model.
     case 0:
-      m_pLanguageModel = new CPPMLanguageModel(m_pSettingsStore, m_pAlphabet->iEnd-1);
-      break;
+      return new CPPMLanguageModel(pSettingsStore, pAlphabet->iEnd-1);
     case 2:
-      m_pLanguageModel = new CWordLanguageModel(m_pSettingsStore, m_pAlphabet, &m_map);
-      break;
+      return new CWordLanguageModel(pSettingsStore, pAlphabet, pAlphMap);
     case 3:
-      m_pLanguageModel = new CMixtureLanguageModel(m_pSettingsStore, m_pAlphabet, &m_map);
-      break;
+      return new CMixtureLanguageModel(pSettingsStore, pAlphabet, pAlphMap);
     case 4:
-      m_pLanguageModel = new CCTWLanguageModel(m_pAlphabet->iEnd-1);
-      break;
+      return new CCTWLanguageModel(pAlphabet->iEnd-1);
+    case 5:
+      return new CCompactPPMLanguageModel(pSettingsStore, pAlphabet->iEnd-1);
   }
 }
 
@@ -145,6 +159,19 @@ CTrainer *CAlphabetManager::GetTrainer() {
   return new CTrainer(m_pInterface, m_pLanguageModel, m_pAlphabet, &m_map);
 }
 
+bool CAlphabetManager::LoadModelSnapshot(const std::string &strFile) {
+  //Only plain PPM writes its trie in the snapshot format (subclasses of CAbstractPPM do not)
+  if (!dynamic_cast<CPPMLanguageModel *>(m_pLanguageModel)) return false;
+  CPPMSnapshotLanguageModel *pSnapshot = new CPPMSnapshotLanguageModel(m_pSettingsStore, m_pAlphabet->iEnd-1);
+  if (!pSnapshot->ReadFromFile(strFile)) {
+    delete pSnapshot;
+    return false;
+  }
+  delete m_pLanguageModel;
+  m_pLanguageModel = pSnapshot;
+  return true;
+}
+
 void CAlphabetManager::MakeLabels(CDasherScreen *pScreen) {
   if(m_pBaseGroup){
     delete m_pBaseGroup;
@@ -249,6 +276,7 @@ CAlphabetManager::~CAlphabetManager() {
   //the alphabet belongs to the AlphIO, and may be reused later
   delete m_pLanguageModel;
   m_pSettingsStore->OnPreParameterChange.Unsubscribe(this);
+  m_pSettingsStore->OnParameterChanged.Unsubscribe(this);
 }
 
 void CAlphabetManager::WriteTrainFileFull(CDasherInterfaceBase *pInterface) {
@@ -404,7 +432,7 @@ int CAlphNode::ExpectedNumChildren() {
   return m_pMgr->m_pBaseGroup->iNumChildNodes;
 }
 
-void CAlphabetManager::GetProbs(vector<unsigned int> *pProbInfo, CLanguageModel::Context context) {
+unsigned long CAlphabetManager::NonUniformNorm(long lUniform, unsigned int &iUniformAdd) const {
   const unsigned int iSymbols = m_pBaseGroup->iEnd-1;
   
   // TODO - sort out size of control node - for the timebeing I'll fix the control node at 5%
@@ -413,16 +441,13 @@ void CAlphabetManager::GetProbs(vector<unsigned int> *pProbInfo, CLanguageModel:
   const unsigned long iNorm(CDasherModel::NORMALIZATION);
   //the case for control mode on, generalizes to handle control mode off also,
   // as then iNorm - control_space == iNorm...
-  const unsigned int iUniformAdd = max(1ul, ((iNorm * m_pSettingsStore->GetLongParameter(LP_UNIFORM)) / 1000) / iSymbols);
-  const unsigned long iNonUniformNorm = iNorm - iSymbols * iUniformAdd;
+  iUniformAdd = max(1ul, ((iNorm * lUniform) / 1000) / iSymbols);
   //  m_pLanguageModel->GetProbs(context, Probs, iNorm, ((iNorm * uniform) / 1000));
+  return iNorm - iSymbols * iUniformAdd;
+}
 
-  //ACL used to test explicitly for MandarinDasher and if so called GetPYProbs instead
-  // (by statically casting to PPMPYLanguageModel). However, have renamed PPMPYLanguageModel::GetPYProbs
-  // to GetProbs as per ordinary language model, so no need to test....
-  m_pLanguageModel->GetProbs(context, *pProbInfo, iNonUniformNorm, 0);
-
-  DASHER_ASSERT(pProbInfo->size() == iSymbols+1);//initial 0
+void CAlphabetManager::AddUniform(vector<unsigned int> *pProbInfo, unsigned int iUniformAdd) const {
+  DASHER_ASSERT(pProbInfo->size() == static_cast<unsigned int>(m_pBaseGroup->iEnd));//initial 0
 
   for(unsigned int k(1); k < pProbInfo->size(); ++k)
     (*pProbInfo)[k] += iUniformAdd;
@@ -432,26 +457,233 @@ void CAlphabetManager::GetProbs(vector<unsigned int> *pProbInfo, CLanguageModel:
     unsigned long iTotal = 0;
     for(unsigned int k = 0; k < pProbInfo->size(); ++k)
       iTotal += (*pProbInfo)[k];
-    DASHER_ASSERT(iTotal == iNorm);
+    DASHER_ASSERT(iTotal == CDasherModel::NORMALIZATION);
   }
 #endif
 }
 
-std::vector<unsigned int>* CAlphNode::GetProbInfo() {
-  if (!m_pProbInfo) {
-    m_pProbInfo = new std::vector<unsigned int>();
-    m_pMgr->GetProbs(m_pProbInfo, iContext);
+void CAlphabetManager::MakeCumulative(vector<unsigned int> *pProbs) {
+  // work out cumulative probs in place
+  for(unsigned int i = 1; i < pProbs->size(); i++) {
+    (*pProbs)[i] += (*pProbs)[i - 1];
+  }
+}
+
+void CAlphabetManager::GetProbs(vector<unsigned int> *pProbInfo, CLanguageModel::Context context, long lUniform) const {
+  unsigned int iUniformAdd;
+  const unsigned long iNonUniformNorm = NonUniformNorm(lUniform, iUniformAdd);
 
-    // work out cumulative probs in place
-    for(unsigned int i = 1; i < m_pProbInfo->size(); i++) {
-      (*m_pProbInfo)[i] += (*m_pProbInfo)[i - 1];
+  //ACL used to test explicitly for MandarinDasher and if so called GetPYProbs instead
+  // (by statically casting to PPMPYLanguageModel). However, have renamed PPMPYLanguageModel::GetPYProbs
+  // to GetProbs as per ordinary language model, so no need to test....
+  ++m_iNumProbsCalls;
+  {
+    DASHER_TRACE_SPAN("GetProbs", "lm");
+    m_pLanguageModel->GetProbs(context, *pProbInfo, iNonUniformNorm, 0);
+  }
+
+  AddUniform(pProbInfo, iUniformAdd);
+}
+
+void CAlphabetManager::ComputeCumulativeProbs(vector<unsigned int> *pProbs, CLanguageModel::Context context, long lUniform) const {
+  GetProbs(pProbs, context, lUniform);
+  MakeCumulative(pProbs);
+}
+
+bool CAlphabetManager::HasCachedProbs(CLanguageModel::Context context) const {
+  CLanguageModel::ContextKey key;
+  return m_pLanguageModel->GetContextKey(context, key)
+      && m_pLanguageModel->GetVersion() == m_iProbCacheVersion
+      && m_mapProbCache.count(key);
+}
+
+void CAlphabetManager::CheckProbCacheVersion() {
+  if (m_pLanguageModel->GetVersion() != m_iProbCacheVersion) {
+    ClearProbCache();
+    m_iProbCacheVersion = m_pLanguageModel->GetVersion();
+  }
+}
+
+void CAlphabetManager::CacheProbs(const CLanguageModel::ContextKey &key, const std::shared_ptr<const std::vector<unsigned int> > &pProbs, size_t iCapacity) {
+  m_lProbCache.emplace_front(key, pProbs);
+  m_mapProbCache[key] = m_lProbCache.begin();
+  while (m_lProbCache.size() > iCapacity) {
+    m_mapProbCache.erase(m_lProbCache.back().first);
+    m_lProbCache.pop_back();
+  }
+}
+
+std::shared_ptr<const std::vector<unsigned int> > CAlphabetManager::GetCumulativeProbs(CLanguageModel::Context context) {
+  CLanguageModel::ContextKey key;
+  const size_t iCapacity = static_cast<size_t>(max(0l, m_pSettingsStore->GetLongParameter(LP_PROB_CACHE_SIZE)));
+  const bool bCacheable = iCapacity > 0 && m_pLanguageModel->GetContextKey(context, key);
+  if (bCacheable) {
+    CheckProbCacheVersion();
+    auto it = m_mapProbCache.find(key);
+    if (it != m_mapProbCache.end()) {
+      ++m_iProbCacheHits;
+      m_lProbCache.splice(m_lProbCache.begin(), m_lProbCache, it->second);
+      return it->second->second;
     }
+    ++m_iProbCacheMisses;
   }
-  return m_pProbInfo;
+
+  std::shared_ptr<std::vector<unsigned int> > pProbs = std::make_shared<std::vector<unsigned int> >();
+  ComputeCumulativeProbs(pProbs.get(), context, m_pSettingsStore->GetLongParameter(LP_UNIFORM));
+
+  if (bCacheable) CacheProbs(key, pProbs, iCapacity);
+  return pProbs;
+}
+
+void CAlphabetManager::PrefetchChildren(const std::vector<CDasherNode *> &vNodes) {
+  const size_t iCapacity = static_cast<size_t>(max(0l, m_pSettingsStore->GetLongParameter(LP_PROB_CACHE_SIZE)));
+  m_vBatchNodes.clear();
+  m_vBatchContexts.clear();
+  m_vBatchKeys.clear();
+  for (CDasherNode *pNode : vNodes) {
+    CAlphNode *pAlphNode = dynamic_cast<CAlphNode *>(pNode);
+    //leave GetProbInfo to deal with anything not simply computed from the node's own context
+    if (!pAlphNode || pAlphNode->m_pProbInfo || pAlphNode->m_pProbsJob || pAlphNode->UsesParentProbs()
+        || HasCachedProbs(pAlphNode->iContext)) continue;
+    CLanguageModel::ContextKey key;
+    if (iCapacity > 0 && m_pLanguageModel->GetContextKey(pAlphNode->iContext, key)) {
+      //in the same state as another node of the batch: will find its probabilities in the cache
+      if (std::find(m_vBatchKeys.begin(), m_vBatchKeys.end(), key) != m_vBatchKeys.end()) continue;
+      m_vBatchKeys.push_back(key);
+    }
+    m_vBatchNodes.push_back(pAlphNode);
+    m_vBatchContexts.push_back(pAlphNode->iContext);
+  }
+  //a single node is computed just the same by GetProbInfo
+  if (m_vBatchNodes.size() < 2) return;
+
+  unsigned int iUniformAdd;
+  const unsigned long iNonUniformNorm = NonUniformNorm(m_pSettingsStore->GetLongParameter(LP_UNIFORM), iUniformAdd);
+  m_iNumProbsCalls += m_vBatchNodes.size();
+  size_t iRowLen;
+  {
+    DASHER_TRACE_SPAN("GetProbsBatch", "lm");
+    iRowLen = m_pLanguageModel->GetProbsBatch(m_vBatchContexts.data(), m_vBatchContexts.size(), m_vBatchProbs, iNonUniformNorm, 0);
+  }
+
+  if (!m_vBatchKeys.empty()) CheckProbCacheVersion();
+  for (size_t i = 0; i < m_vBatchNodes.size(); i++) {
+    const std::vector<unsigned int>::const_iterator itRow = m_vBatchProbs.begin() + i * iRowLen;
+    std::shared_ptr<std::vector<unsigned int> > pProbs = std::make_shared<std::vector<unsigned int> >(itRow, itRow + iRowLen);
+    AddUniform(pProbs.get(), iUniformAdd);
+    MakeCumulative(pProbs.get());
+    CLanguageModel::ContextKey key;
+    if (iCapacity > 0 && m_pLanguageModel->GetContextKey(m_vBatchContexts[i], key)) {
+      ++m_iProbCacheMisses;
+      CacheProbs(key, pProbs, iCapacity);
+    }
+    m_vBatchNodes[i]->m_pProbInfo = pProbs;
+  }
+}
+
+void CAlphabetManager::ClearProbCache() {
+  //nodes keep their own references to any vectors they're using
+  m_mapProbCache.clear();
+  m_lProbCache.clear();
+}
+
+void CAlphabetManager::ReportGroups(CMemoryReport &report, const SGroupInfo *pGroup) {
+  for (; pGroup; pGroup = pGroup->pNext) {
+    report.Add(CMemoryReport::MEM_ALPHABET, "SGroupInfo", 1, sizeof(SGroupInfo) + CMemoryReport::StringBytes(pGroup->strLabel)
+               + CMemoryReport::StringBytes(pGroup->colorGroup) + CMemoryReport::StringBytes(pGroup->strName));
+    ReportGroups(report, pGroup->pChild);
+  }
+}
+
+void CAlphabetManager::ReportLabel(CMemoryReport &report, const CDasherScreen::Label *pLabel) {
+  //platform subclasses of Label may hold more (e.g. rendered text), which we can't see
+  if (pLabel)
+    report.Add(CMemoryReport::MEM_LABELS, "CDasherScreen::Label", 1, sizeof(CDasherScreen::Label) + CMemoryReport::StringBytes(pLabel->m_strText));
+}
+
+void CAlphabetManager::ReportMemory(CMemoryReport &report) const {
+  report.Add(CMemoryReport::MEM_ALPHABET, "CAlphabetMap", 1, m_map.GetMemoryUsage());
+  ReportGroups(report, m_pBaseGroup);
+
+  for (const CDasherScreen::Label *pLabel : m_vLabels) ReportLabel(report, pLabel);
+  for (const auto &it : m_mGroupLabels) ReportLabel(report, it.second);
+  report.Add(CMemoryReport::MEM_LABELS, "CAlphabetManager label tables", 0, CMemoryReport::VectorBytes(m_vLabels)
+             + m_mGroupLabels.size() * CMemoryReport::TreeNodeBytes<std::pair<const SGroupInfo *, CDasherScreen::Label *> >());
+
+  //each entry: list node, hash map node, and a vector allocated together with its shared_ptr control block
+  size_t iCacheBytes = m_mapProbCache.bucket_count() * sizeof(void *);
+  for (const auto &entry : m_lProbCache)
+    iCacheBytes += CMemoryReport::TreeNodeBytes<ProbCacheList::value_type>()
+      + sizeof(std::pair<const CLanguageModel::ContextKey, ProbCacheList::iterator>) + 2 * sizeof(void *)
+      + sizeof(std::vector<unsigned int>) + 2 * sizeof(void *) + CMemoryReport::VectorBytes(*entry.second);
+  report.Add(CMemoryReport::MEM_PROB_CACHE, "CAlphabetManager probability cache", m_lProbCache.size(), iCacheBytes);
+
+  report.Add(CMemoryReport::MEM_USER_LOG, "CAlphabetManager training text buffer", 0,
+             CMemoryReport::StringBytes(strTrainfileBuffer) + CMemoryReport::StringBytes(strTrainfileContext));
+
+  if (m_pLanguageModel) m_pLanguageModel->ReportMemory(report);
+}
+
+///Computes a node's probabilities on the CExpansionWorker thread
+class CAlphNode::CProbsJob : public CExpansionWorker::Job {
+public:
+  CProbsJob(CAlphNode *pNode, long lUniform)
+  : Job(pNode), m_pNode(pNode), m_context(pNode->iContext), m_lUniform(lUniform),
+    m_pProbs(std::make_shared<std::vector<unsigned int> >()) {
+  }
+  void Compute() override {
+    m_pNode->m_pMgr->ComputeCumulativeProbs(m_pProbs.get(), m_context, m_lUniform);
+  }
+  void Link() override {
+    m_pNode->m_pProbInfo = m_pProbs;
+    m_pNode->m_pProbsJob.reset(); //the worker still holds a reference to us
+  }
+private:
+  CAlphNode * const m_pNode;
+  const CLanguageModel::Context m_context;
+  //read on the main thread, as the worker mustn't touch the settings store
+  const long m_lUniform;
+  const std::shared_ptr<std::vector<unsigned int> > m_pProbs;
+};
+
+bool CAlphNode::PrefetchChildren(CExpansionWorker *pWorker) {
+  if (m_pProbInfo) return false; //nothing costly left to do
+  if (m_pProbsJob) {
+    if (!m_pProbsJob->IsCancelled()) return true; //already queued
+    m_pProbsJob.reset(); //worker was destroyed
+  }
+  //cache hits are cheap enough to expand at once
+  if (m_pMgr->HasCachedProbs(iContext)) return false;
+  m_pProbsJob = std::make_shared<CProbsJob>(this, m_pMgr->m_pSettingsStore->GetLongParameter(LP_UNIFORM));
+  pWorker->Queue(m_pProbsJob);
+  return true;
+}
+
+const std::vector<unsigned int>* CAlphNode::GetProbInfo() {
+  if (!m_pProbInfo) {
+    if (m_pProbsJob) {
+      //needed before the worker's result has been linked in (e.g. expanded during rendering):
+      // just compute them here.
+      m_pProbsJob->Cancel();
+      m_pProbsJob.reset();
+    }
+    m_pProbInfo = m_pMgr->GetCumulativeProbs(iContext);
+  }
+  return m_pProbInfo.get();
 }
 
-std::vector<unsigned int>* CGroupNode::GetProbInfo() {
-  if (Parent() && Parent()->mgr() == mgr() && Parent()->offset()==offset()) {
+bool CGroupNode::UsesParentProbs() {
+  return Parent() && Parent()->mgr() == mgr() && Parent()->offset()==offset();
+}
+
+bool CGroupNode::PrefetchChildren(CExpansionWorker *pWorker) {
+  //as GetProbInfo: if sharing the parent's probabilities, there's nothing to compute
+  if (UsesParentProbs()) return false;
+  return CAlphNode::PrefetchChildren(pWorker);
+}
+
+const std::vector<unsigned int>* CGroupNode::GetProbInfo() {
+  if (UsesParentProbs()) {
     return (static_cast<CAlphNode *>(Parent()))->GetProbInfo();
   }
   //nope, no usable parent. compute here...
@@ -593,7 +825,7 @@ const ColorPalette::Color& CSymbolNode::getNodeColor(const ColorPalette* colorPa
 }
 
 void CAlphabetManager::IterateChildGroups(CAlphNode *pParent, const SGroupInfo *pParentGroup, CAlphBase *buildAround) {
-  std::vector<unsigned int> *pCProb(pParent->GetProbInfo());
+  const std::vector<unsigned int> *pCProb(pParent->GetProbInfo());
   DASHER_ASSERT((*pCProb)[0] == 0);
   const int iMin(pParentGroup->iStart);
   const int iMax(pParentGroup->iEnd);
@@ -638,7 +870,7 @@ void CAlphabetManager::IterateChildGroups(CAlphNode *pParent, const SGroupInfo *
 }
 
 CAlphNode::~CAlphNode() {
-  delete m_pProbInfo;
+  if (m_pProbsJob) m_pProbsJob->Cancel();
   m_pMgr->m_pLanguageModel->ReleaseContext(iContext);
 }
 
@@ -767,7 +999,10 @@ void CSymbolNode::SetFlag(int iFlag, bool bValue) {
       CLanguageModel *pLM(m_pMgr->m_pLanguageModel);
       // (Note: for first symbol after startup: parent is (root) group node, which'll have the alphabet default context)
       CLanguageModel::Context ctx = pLM->CloneContext(static_cast<CAlphNode *>(Parent())->iContext);
-      pLM->LearnSymbol(ctx, iSymbol);
+      {
+        DASHER_TRACE_SPAN("LearnSymbol", "lm");
+        pLM->LearnSymbol(ctx, iSymbol);
+      }
       //could: pLM->ReleaseContext(ctx);
       //however, seems better to replace this node's context (i.e. which it uses to create its own children)
       // with the new (learned) context: the former was obtained by EnterSymbol rather than LearnSymbol, so
@@ -20,7 +20,11 @@
 
 #pragma once
 
+#include <atomic>
+#include <list>
 #include <map>
+#include <memory>
+#include <unordered_map>
 
 #include "LanguageModelling/LanguageModel.h"
 #include "DasherNode.h"
@@ -119,10 +123,22 @@ namespace Dasher {
       ///
       virtual ~CAlphNode();
       ///Have to call this from CAlphabetManager, and from CGroupNode on a _different_ CAlphNode, hence public...
-      virtual std::vector<unsigned int> *GetProbInfo();
+      /// Cumulative probabilities; may be shared with other nodes (via the manager's cache), so read-only.
+      virtual const std::vector<unsigned int> *GetProbInfo();
       virtual int ExpectedNumChildren();
+      ///Queues the computation of GetProbInfo on the worker, unless the probabilities are
+      /// known already or cached by the manager.
+      bool PrefetchChildren(CExpansionWorker *pWorker) override;
+    protected:
+      ///Whether GetProbInfo returns the probabilities of the parent, rather than of this node's
+      /// own context. The default returns false.
+      virtual bool UsesParentProbs() {return false;}
     private:
-      std::vector<unsigned int> *m_pProbInfo;
+      friend class CAlphabetManager; //to fill in m_pProbInfo for several nodes at once
+      class CProbsJob;
+      std::shared_ptr<const std::vector<unsigned int> > m_pProbInfo;
+      ///Computation of m_pProbInfo queued on a CExpansionWorker, until linked in
+      std::shared_ptr<CProbsJob> m_pProbsJob;
     };
 
     class CSymbolNode : public CAlphNode {
@@ -130,6 +146,8 @@ namespace Dasher {
       ///Standard constructor, gets colour from GetColour(symbol,offset) and label from current alphabet
       /// Note we treat GetColour() as always returning an opaque color.
       CSymbolNode(int iOffset, CDasherScreen::Label *pLabel, CAlphabetManager *pMgr, symbol iSymbol);
+      const char *ClassName() const override {return "CSymbolNode";}
+      std::size_t ObjectSize() const override {return sizeof(CSymbolNode);}
 
       ///Create the children of this node, by starting traversal of the alphabet from the top
       void PopulateChildren() override;
@@ -181,6 +199,8 @@ namespace Dasher {
     class CGroupNode : public CAlphNode {
     public:
       CGroupNode(int iOffset, CDasherScreen::Label* pLabel, CAlphabetManager* pMgr, const SGroupInfo* pGroup);
+      const char *ClassName() const override {return "CGroupNode";}
+      std::size_t ObjectSize() const override {return sizeof(CGroupNode);}
 
       ///Override: if m_pGroup==NULL, i.e. whole/root-of alphabet, cannot rebuild.
       virtual CDasherNode *RebuildParent() override;
@@ -191,12 +211,16 @@ namespace Dasher {
       virtual int ExpectedNumChildren() override;
                  
       virtual bool GameSearchNode(symbol sym) override;
-      std::vector<unsigned int> *GetProbInfo() override;
+      const std::vector<unsigned int> *GetProbInfo() override;
+      bool PrefetchChildren(CExpansionWorker *pWorker) override;
       ///Override: if the group to create is the same as this node's group, return this node instead of creating a new one
       virtual CDasherNode *RebuildGroup(CAlphNode* pParent, const SGroupInfo* pInfo) override;
     protected:
       ///Override: true if pGroup encloses this one (by start/end symbol#)
       bool isInGroup(const SGroupInfo *pGroup) override;
+      ///Override: true if the parent is from the same manager, at the same offset
+      /// (i.e. this group is inside the parent's range of symbols)
+      bool UsesParentProbs() override;
 
   public:
       const ColorPalette::Color& getLabelColor(const ColorPalette* colorPalette) override;
@@ -225,6 +249,23 @@ namespace Dasher {
     /// trainer later.
     virtual CTrainer *GetTrainer();
 
+    ///Computes the probabilities of all the given nodes that will need them (i.e. the
+    /// CAlphNodes whose GetProbInfo would not find them known already or in the cache)
+    /// with one call to the language model's GetProbsBatch, and caches them as
+    /// GetProbInfo would.
+    void PrefetchChildren(const std::vector<CDasherNode *> &vNodes) override;
+
+    ///Replaces a plain PPM language model (as LP_LANGUAGE_MODEL_ID 0 creates) with a
+    /// CPPMSnapshotLanguageModel predicting straight from a file it saved (WriteToFile),
+    /// rather than rebuilding the trie in memory - but the model can no longer learn.
+    /// Must be called after Setup(), before GetTrainer or any nodes are created.
+    /// \return false, leaving the model unchanged, if it is not plain PPM or the file
+    /// could not be loaded.
+    bool LoadModelSnapshot(const std::string &strFile);
+    ///True if the language model can be saved (CLanguageModel::CanWriteToFile), so
+    /// that a trained copy is worth caching
+    bool CanSaveModel() const {return m_pLanguageModel->CanWriteToFile();}
+
     /// Gets a (Game) Word Generator to make target sentences for the current alphabet
     CWordGeneratorBase *GetGameWords();
 
@@ -232,7 +273,34 @@ namespace Dasher {
     /// Flush to the user's training file everything written in this AlphMgr
     /// \param pInterface to use for I/O by calling WriteTrainFile(fname,txt)
     void WriteTrainFileFull(CDasherInterfaceBase *pInterface);
+
+    ///Number of node probability lookups answered from the cache (see GetCumulativeProbs)
+    unsigned long GetProbCacheHits() const {return m_iProbCacheHits;}
+    ///Number of cacheable node probability lookups that had to call the language model
+    unsigned long GetProbCacheMisses() const {return m_iProbCacheMisses;}
+    ///Number of times the language model has been asked for probabilities (whether
+    /// for the cache, or not, or by a CExpansionWorker)
+    unsigned long GetNumProbsCalls() const {return m_iNumProbsCalls;}
+    ///Forget all cached probabilities; done automatically when the LM changes, or
+    /// LP_UNIFORM, LP_LM_ALPHA or LP_LM_BETA do.
+    void ClearProbCache();
+
+    ///Adds the alphabet map and groups, labels, probability cache, training text
+    /// buffer and language model to a memory report. Subclasses with further
+    /// tables should extend.
+    virtual void ReportMemory(CMemoryReport &report) const;
+
+    ///Creates a new language model of the type given by an LP_LANGUAGE_MODEL_ID value
+    /// (PPM for unknown values), for the symbols of an alphabet; the model will read
+    /// its parameters from the settings store. Caller is responsible for deallocation.
+    /// \param pAlphMap map of the alphabet's characters (the word-based models use it)
+    static CLanguageModel *NewLanguageModel(long iModelID, CSettingsStore *pSettingsStore, const CAlphInfo *pAlphabet, const CAlphabetMap *pAlphMap);
     protected:
+    ///Adds a tree of groups (following both pChild and pNext) to a memory report
+    static void ReportGroups(CMemoryReport &report, const SGroupInfo *pGroup);
+    ///Adds a label (if non-null) to a memory report
+    static void ReportLabel(CMemoryReport &report, const CDasherScreen::Label *pLabel);
+
         friend CGroupNode;
         friend CSymbolNode;
         friend CAlphNode;
@@ -244,7 +312,7 @@ namespace Dasher {
     virtual void InitMap();
 
     ///Creates the LM, and stores in m_pLanguageModel.
-    /// Default implementation switches on LP_LANGUAGE_MODEL_ID.
+    /// Default implementation calls NewLanguageModel with LP_LANGUAGE_MODEL_ID.
     /// Note subclasses changing the interpretation of the AlphInfo, should override
     /// this to take account of its new meaning.
     virtual void CreateLanguageModel();
@@ -317,10 +385,59 @@ namespace Dasher {
 
     private:
         friend CAlphBase;
+    ///Norm to ask the language model for, leaving room to add iUniformAdd to every
+    /// symbol's probability, so as to implement LP_UNIFORM (=lUniform)
+    unsigned long NonUniformNorm(long lUniform, unsigned int &iUniformAdd) const;
+    ///Adds iUniformAdd to the probability of every symbol (not the initial 0) given by the LM
+    void AddUniform(std::vector<unsigned int> *pProbs, unsigned int iUniformAdd) const;
+    ///Turns probabilities into cumulative probabilities, in place
+    static void MakeCumulative(std::vector<unsigned int> *pProbs);
+
     ///Wraps m_pLanguageModel->GetProbs to implement nonuniformity
     /// (also leaves space for NCManager::AddExtras to add control node)
     /// Returns array of non-cumulative probs. Should this be protected and/or virtual???
-    void GetProbs(std::vector<unsigned int> *pProbs, CLanguageModel::Context iContext);
+    /// Only reads the LM (and not the settings store, hence lUniform = LP_UNIFORM),
+    /// so can be called from a CExpansionWorker job.
+    void GetProbs(std::vector<unsigned int> *pProbs, CLanguageModel::Context iContext, long lUniform) const;
+
+    ///GetProbs, made cumulative; likewise safe to call from a CExpansionWorker job.
+    void ComputeCumulativeProbs(std::vector<unsigned int> *pProbs, CLanguageModel::Context iContext, long lUniform) const;
+
+    ///Whether GetCumulativeProbs would find the context's probabilities in the cache
+    bool HasCachedProbs(CLanguageModel::Context iContext) const;
+
+    ///Cumulative probabilities (from GetProbs) for a context. If the LM can identify the
+    /// context's state (CLanguageModel::GetContextKey), the result is shared with other
+    /// nodes in the same state, via a least-recently-used cache of up to LP_PROB_CACHE_SIZE
+    /// entries; otherwise it is computed afresh.
+    std::shared_ptr<const std::vector<unsigned int> > GetCumulativeProbs(CLanguageModel::Context iContext);
+    ///Clears the cache if the LM has changed since the cached entries were computed
+    void CheckProbCacheVersion();
+    ///Adds an entry to the cache, as most-recently-used, evicting others to keep within iCapacity
+    void CacheProbs(const CLanguageModel::ContextKey &key, const std::shared_ptr<const std::vector<unsigned int> > &pProbs, size_t iCapacity);
+
+    struct ContextKeyHash {
+      size_t operator()(const CLanguageModel::ContextKey &key) const {
+        return std::hash<size_t>()(key.iState) * 31 + key.iOrder;
+      }
+    };
+    typedef std::list<std::pair<CLanguageModel::ContextKey, std::shared_ptr<const std::vector<unsigned int> > > > ProbCacheList;
+    ///Cached probabilities, most-recently-used first
+    ProbCacheList m_lProbCache;
+    ///Index into the above
+    std::unordered_map<CLanguageModel::ContextKey, ProbCacheList::iterator, ContextKeyHash> m_mapProbCache;
+    ///LM version (CLanguageModel::GetVersion) from which the cached entries were computed
+    unsigned long m_iProbCacheVersion;
+    unsigned long m_iProbCacheHits, m_iProbCacheMisses;
+    ///Calls to GetProbs (counting each context of a batch); atomic as those may be made by a CExpansionWorker
+    mutable std::atomic<unsigned long> m_iNumProbsCalls;
+    ///For PrefetchChildren, kept to avoid reallocating: the nodes whose probabilities are
+    /// to be computed, their contexts, the cache keys of those that have them, and the
+    /// probabilities from GetProbsBatch
+    std::vector<CAlphNode *> m_vBatchNodes;
+    std::vector<CLanguageModel::Context> m_vBatchContexts;
+    std::vector<CLanguageModel::ContextKey> m_vBatchKeys;
+    std::vector<unsigned int> m_vBatchProbs;
 
     ///Constructs child nodes under the specified parent according to provided group.
     /// Nodes are created by calling CreateSymbolNode and CreateGroupNode, unless buildAround is non-null.
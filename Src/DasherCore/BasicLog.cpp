@@ -9,6 +9,7 @@
 #include <iostream>
 
 #include "FileUtils.h"
+#include "MemoryReport.h"
 
 
 using namespace Dasher;
@@ -51,6 +52,11 @@ void CBasicLog::KeyDown(Dasher::Keys::VirtualKey Key, int iType, int iEffect) {
   ++m_iKeyCount;
 }
 
+void CBasicLog::ReportMemory(CMemoryReport &report) const {
+  CUserLogBase::ReportMemory(report);
+  report.Add(CMemoryReport::MEM_USER_LOG, "CBasicLog", 1, sizeof(CBasicLog) + CMemoryReport::StringBytes(m_strStartDate));
+}
+
 void CBasicLog::StartTrial() {
   m_iSymbolCount = 0;
   m_iKeyCount = 0;
@@ -28,6 +28,7 @@ class CBasicLog : public CUserLogBase {
   virtual void SetOuputFilename(const std::string& strFilename = "") {};
   virtual int  GetLogLevelMask() {return 0;};
   virtual void KeyDown(Dasher::Keys::VirtualKey Key, int iType, int iEffect);
+  virtual void ReportMemory(Dasher::CMemoryReport &report) const;
 protected:
   Dasher::CSettingsStore* m_pSettingsStore;
  private:
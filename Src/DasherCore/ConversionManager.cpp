@@ -23,6 +23,7 @@
 #include "NodeCreationManager.h"
 #include "DasherModel.h"
 #include "DasherInterfaceBase.h"
+#include "TraceRecorder.h"
 
 #include <cstring>
 #include <string>
@@ -306,8 +307,10 @@ void CConversionManager::CConvNode::SetFlag(int iFlag, bool bValue) {
         symbol s =pSCENode ->Symbol;
         
         
-        if(s!=-1)
+        if(s!=-1) {
+          DASHER_TRACE_SPAN("LearnSymbol", "lm");
           mgr()->m_pLanguageModel->LearnSymbol(mgr()->m_iLearnContext, s);
+        }
       }
       break;
   }
@@ -84,6 +84,8 @@ namespace Dasher {
     public:
       CConversionManager *mgr() const override {return m_pMgr;}
       CConvNode(int iOffset, CDasherScreen::Label *pLabel, CConversionManager *pMgr);
+      const char *ClassName() const override {return "CConvNode";}
+      std::size_t ObjectSize() const override {return sizeof(CConvNode);}
     ///
     /// Provide children for the supplied node
     ///
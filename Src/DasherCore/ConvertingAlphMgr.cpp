@@ -9,6 +9,7 @@
 
 #include "ConvertingAlphMgr.h"
 #include "NodeCreationManager.h"
+#include "MemoryReport.h"
 
 using namespace Dasher;
 
@@ -21,13 +22,22 @@ void CConvertingAlphMgr::MakeLabels(CDasherScreen *pScreen) {
   m_pConvMgr->ChangeScreen(pScreen);
 }
 
+void CConvertingAlphMgr::ReportMemory(CMemoryReport &report) const {
+  CAlphabetManager::ReportMemory(report);
+  for (const auto &it : m_pConvMgr->m_vLabels) {
+    ReportLabel(report, it.second);
+    report.Add(CMemoryReport::MEM_LABELS, "CConversionManager label table", 0,
+               CMemoryReport::TreeNodeBytes<std::pair<const std::string, CDasherScreen::Label *> >() + CMemoryReport::StringBytes(it.first));
+  }
+}
+
 CConvertingAlphMgr::~CConvertingAlphMgr() {
 }
 
 CDasherNode *CConvertingAlphMgr::CreateSymbolNode(CAlphNode *pParent, symbol iSymbol) {
   //int i=m_pAlphabet->iEnd;
   if (iSymbol == m_pAlphabet->iEnd) {
-    std::vector<unsigned int> *pCProb(pParent->GetProbInfo());
+    const std::vector<unsigned int> *pCProb(pParent->GetProbInfo());
     DASHER_ASSERT(pCProb->size() == m_pAlphabet->iEnd+1);//initial 0, final conversion prob
 
     //this used to be the "CloneAlphContext" method. Why it uses the
@@ -24,6 +24,8 @@ namespace Dasher {
     CConvertingAlphMgr(CSettingsStore* pSettingsStore, CDasherInterfaceBase *pInterface, CNodeCreationManager *pNCManager, CConversionManager *pConvMgr, const CAlphInfo *pAlphabet);
     ///Override to also tell the ConversionManager that the screen has changed.
     void MakeLabels(CDasherScreen *pScreen);
+    ///Override to also report the ConversionManager's labels
+    void ReportMemory(CMemoryReport &report) const override;
     virtual ~CConvertingAlphMgr();
   protected:
     ///Override to return a conversion root for iSymbol==(one beyond last alphabet symbol)
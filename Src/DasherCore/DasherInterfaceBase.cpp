@@ -25,6 +25,8 @@
 #include "DasherView.h"
 #include "DasherInput.h"
 #include "DasherModel.h"
+#include "ExpansionWorker.h"
+#include "TrainingJournal.h"
 #include "Event.h"
 #include "NodeCreationManager.h"
 #include "UserLog.h"
@@ -92,6 +94,14 @@ CDasherInterfaceBase::CDasherInterfaceBase(CSettingsStore *pSettingsStore) :
   m_pUserLog = NULL;
   m_pNCManager = NULL;
   m_defaultPolicy = NULL;
+  m_pExpansionWorker = NULL;
+  m_pTrainingJournal = NULL;
+  m_pBudgetController = NULL;
+#ifdef DASHER_FRAME_PROFILER
+  m_pFrameProfiler = new CFrameProfiler();
+#else
+  m_pFrameProfiler = NULL;
+#endif
   m_pWordSpeaker = NULL;
   m_pGameModule = NULL;
 
@@ -183,8 +193,14 @@ void CDasherInterfaceBase::Realize(unsigned long ulTime) {
   srand(ulTime);
  
   m_AlphIO = new CAlphIO(this);
+  const std::string strCacheDir(GetCacheDirectory());
+  if (!strCacheDir.empty()) m_AlphIO->SetCacheDirectory(strCacheDir + "/alphabets");
   ScanFiles(m_AlphIO, "alphabet.*.xml");
 
+  //Replays any text a crash left in the journal, before we train on the files
+  const std::string strJournal(GetTrainingJournalFile());
+  if (!strJournal.empty()) m_pTrainingJournal = new CTrainingJournal(strJournal);
+
   m_ColorIO = new CColorIO(this);
   ScanFiles(m_ColorIO, "color.*.xml");
   m_ColorIO->RelinkParents();
@@ -216,7 +232,8 @@ void CDasherInterfaceBase::Realize(unsigned long ulTime) {
   // it to realize there's now an inputfilter (which may provide more actions).
   // So tell it the setting has changed...
 
-  HandleParameterChange(LP_NODE_BUDGET);
+  HandleParameterChange(BP_BACKGROUND_EXPANSION); //also creates the default policy
+  HandleParameterChange(BP_ADAPTIVE_NODE_BUDGET);
   HandleParameterChange(BP_SPEAK_WORDS);
 
   // FIXME - need to rationalise this sort of thing.
@@ -236,6 +253,10 @@ CDasherInterfaceBase::~CDasherInterfaceBase() {
   GetActionManager()->UnsubscribeAll(this);
 
   //WriteTrainFileFull();???
+  delete m_pTrainingJournal;    // Writes out, and syncs, any text still queued
+  delete m_pExpansionWorker;    // Before the nodes and LM it works on
+  delete m_pBudgetController;
+  delete m_pFrameProfiler;
   delete m_pDasherModel;        // The order of some of these deletions matters
   delete m_pDasherView;
   delete m_ColorIO;
@@ -292,6 +313,11 @@ void CDasherInterfaceBase::HandleParameterChange(Parameter parameter) {
   case LP_LANGUAGE_MODEL_ID:
     CreateNCManager();
     break;
+  case BP_LM_ADAPTIVE:
+    //the model may have been loaded read-only, while it was not to learn
+    if (m_pNCManager && m_pNCManager->IsModelReadOnly() && m_pSettingsStore->GetBoolParameter(BP_LM_ADAPTIVE))
+      CreateNCManager();
+    break;
   case LP_LINE_WIDTH:
     ScheduleRedraw();
     break;
@@ -312,9 +338,30 @@ void CDasherInterfaceBase::HandleParameterChange(Parameter parameter) {
   case LP_SHAPE_TYPE: //for platforms which actually have this as a GUI pref!
       ScheduleRedraw();
       break;
+  case BP_BACKGROUND_EXPANSION:
+    delete m_pExpansionWorker;
+    m_pExpansionWorker = m_pSettingsStore->GetBoolParameter(BP_BACKGROUND_EXPANSION) ? new CExpansionWorker() : NULL;
+    //...and the default policy must use the new worker
+  case BP_HEAP_EXPANSION_POLICY:
   case LP_NODE_BUDGET:
     delete m_defaultPolicy;
-    m_defaultPolicy = new AmortizedPolicy(m_pDasherModel,m_pSettingsStore->GetLongParameter(LP_NODE_BUDGET));
+    if (m_pSettingsStore->GetBoolParameter(BP_HEAP_EXPANSION_POLICY))
+      m_defaultPolicy = new HeapPolicy(m_pDasherModel,m_pSettingsStore->GetLongParameter(LP_NODE_BUDGET),m_pExpansionWorker);
+    else
+      m_defaultPolicy = new AmortizedPolicy(m_pDasherModel,m_pSettingsStore->GetLongParameter(LP_NODE_BUDGET),m_pExpansionWorker);
+    //restart adapting from the new budget
+    if (m_pBudgetController) m_pBudgetController->Reset(m_pSettingsStore->GetLongParameter(LP_NODE_BUDGET));
+    break;
+  case BP_ADAPTIVE_NODE_BUDGET:
+    delete m_pBudgetController;
+    m_pBudgetController = NULL;
+    if (m_pSettingsStore->GetBoolParameter(BP_ADAPTIVE_NODE_BUDGET))
+      m_pBudgetController = new CNodeBudgetController(m_pSettingsStore->GetLongParameter(LP_NODE_BUDGET), m_pSettingsStore->GetLongParameter(LP_TARGET_FRAME_TIME));
+    else if (m_defaultPolicy)
+      HandleParameterChange(LP_NODE_BUDGET); //back to the fixed budget
+    break;
+  case LP_TARGET_FRAME_TIME:
+    if (m_pBudgetController) m_pBudgetController->SetTarget(m_pSettingsStore->GetLongParameter(LP_TARGET_FRAME_TIME));
     break;
   case BP_SPEAK_WORDS:
     delete m_pWordSpeaker;
@@ -411,9 +458,11 @@ void CDasherInterfaceBase::editProtect(CDasherNode *pCause) {
 
 void CDasherInterfaceBase::WriteTrainFileFull() {
   m_pNCManager->GetAlphabetManager()->WriteTrainFileFull(this);
+  //so the text is on disk, e.g. before we retrain from the files
+  if (m_pTrainingJournal) m_pTrainingJournal->Flush();
 }
 
-void CDasherInterfaceBase::CreateNCManager() {
+void CDasherInterfaceBase::CreateNCManager(bool bAllowReadOnlyModel) {
 
   if(!m_AlphIO || m_pSettingsStore->GetLongParameter(LP_LANGUAGE_MODEL_ID)==-1)
     return;
@@ -422,7 +471,7 @@ void CDasherInterfaceBase::CreateNCManager() {
   CNodeCreationManager *pOldMgr = m_pNCManager;
 
   //now create the new manager...
-  m_pNCManager = new CNodeCreationManager(m_pSettingsStore, this, m_AlphIO);
+  m_pNCManager = new CNodeCreationManager(m_pSettingsStore, this, m_AlphIO, bAllowReadOnlyModel);
   if (m_pSettingsStore->GetBoolParameter(BP_PALETTE_CHANGE))
     m_pSettingsStore->SetStringParameter(SP_COLOUR_ID, m_pNCManager->GetAlphabet()->GetPalette());
 
@@ -486,9 +535,15 @@ void CDasherInterfaceBase::NewFrame(unsigned long iTime, bool bForceRedraw) {
 
   if(m_DasherScreen) {
     //ok, can draw _something_. Try and see what we can :).
+    DASHER_PROFILE_FRAME(m_pFrameProfiler, iTime);
 
     bool bBlit = false; //set to true if we actually render anything different i.e. that needs blitting to display
 
+    if (m_pBudgetController) {
+      m_frameCost = CNodeBudgetController::SFrameCost();
+      m_tPhaseEnd = std::chrono::steady_clock::now();
+    }
+
     if (isLocked() || !m_pDasherView) {
       //Hmmm. If we're locked, NewFrame is never actually called - the thread
       // that would be rendering frames, is the same one doing the training.
@@ -503,9 +558,14 @@ void CDasherInterfaceBase::NewFrame(unsigned long iTime, bool bForceRedraw) {
       bBlit = true;
     } else {
       CExpansionPolicy *pol=m_defaultPolicy;
+
+      //0. Add the children of nodes expanded in the background during the last frame
+      if (m_pExpansionWorker && m_pExpansionWorker->LinkFinished(m_pDasherModel))
+        bForceRedraw=true;
   
       //1. Schedule any per-frame movement in the model...
       if(m_pInputFilter) {
+        DASHER_PROFILE_PHASE(m_pFrameProfiler, PHASE_INPUT_TIMER);
         m_pInputFilter->Timer(iTime, m_pDasherView, m_pInput, m_pDasherModel, &pol);
       }
       //2. Render...
@@ -516,7 +576,12 @@ void CDasherInterfaceBase::NewFrame(unsigned long iTime, bool bForceRedraw) {
       m_bRedrawScheduled=false;
 
       //Apply any movement that has been scheduled
-      if (m_pDasherModel->NextScheduledStep()) {
+      bool bMoved;
+      {
+        DASHER_PROFILE_PHASE(m_pFrameProfiler, PHASE_SCHEDULED_STEP);
+        bMoved = m_pDasherModel->NextScheduledStep();
+      }
+      if (bMoved) {
         //yes, we moved...
         if (!m_bLastMoved) onUnpause(iTime);
         // ...so definitely need to render the nodes. We also make sure
@@ -528,9 +593,17 @@ void CDasherInterfaceBase::NewFrame(unsigned long iTime, bool bForceRedraw) {
         if (m_bLastMoved) bForceRedraw=true;//move into onPause() method if reqd
         m_bLastMoved=false;
       }
+      EndPhase(CNodeBudgetController::PHASE_INPUT);
       //2. Render nodes decorations, messages
       bBlit = Redraw(iTime, bForceRedraw, *pol);
 
+      //The worker computes, for any nodes the policy queued, from here until the Pause()
+      // at the end of the frame, concurrently with the user log's FrameEnded(),
+      // FinishRender() and Display(). So those must not touch the nodes or language model
+      // (they don't: they use only the symbols logged, messages and the screen); they are
+      // where the worker gets its time, so Resume() cannot move after them.
+      if (m_pExpansionWorker) m_pExpansionWorker->Resume();
+
       if (m_pUserLog != nullptr) {
         //(any) UserLogBase will have been watching output events to gather information
         // about symbols added/deleted; this tells it to apply that information at end-of-frame
@@ -538,8 +611,28 @@ void CDasherInterfaceBase::NewFrame(unsigned long iTime, bool bForceRedraw) {
         m_pUserLog->FrameEnded();
       }
     }
-    if (FinishRender(iTime)) bBlit = true;
-    if (bBlit) m_DasherScreen->Display();
+    {
+      DASHER_PROFILE_PHASE(m_pFrameProfiler, PHASE_FINISH_RENDER);
+      if (FinishRender(iTime)) bBlit = true;
+    }
+    if (bBlit) {
+      DASHER_PROFILE_PHASE(m_pFrameProfiler, PHASE_DISPLAY);
+      m_DasherScreen->Display();
+    }
+    EndPhase(CNodeBudgetController::PHASE_DISPLAY);
+
+    //Adapt the budget, if this frame rendered nodes using it
+    if (m_pBudgetController && m_frameCost.iNumNodes > 0) {
+      m_pBudgetController->Update(m_frameCost);
+      m_defaultPolicy->SetNodeBudget(m_pBudgetController->GetBudget());
+      m_defaultPolicy->SetMaxExpands(m_pBudgetController->GetMaxExpands());
+    }
+  }
+
+  if (m_pExpansionWorker) {
+    m_pExpansionWorker->Pause();
+    //make sure we get another frame in which to finish (and then link in) any queued work
+    if (m_pExpansionWorker->HasPending()) ScheduleRedraw();
   }
 
   bReentered=false;
@@ -547,6 +640,13 @@ void CDasherInterfaceBase::NewFrame(unsigned long iTime, bool bForceRedraw) {
   GetActionManager()->ExecuteDelayedActions();
 }
 
+void CDasherInterfaceBase::EndPhase(CNodeBudgetController::Phase phase) {
+  if (!m_pBudgetController) return;
+  const std::chrono::steady_clock::time_point tNow = std::chrono::steady_clock::now();
+  m_frameCost.dPhaseMs[phase] += std::chrono::duration<double, std::milli>(tNow - m_tPhaseEnd).count();
+  m_tPhaseEnd = tNow;
+}
+
 void CDasherInterfaceBase::onUnpause(unsigned long lTime) {
   //TODO When Game+UserLog modules are combined => reduce to just one call here
   if (m_pGameModule)
@@ -561,13 +661,25 @@ bool CDasherInterfaceBase::Redraw(unsigned long ulTime, bool bRedrawNodes, CExpa
   // Draw the nodes
   if(bRedrawNodes) {
     if (m_pDasherModel) {
-      m_pDasherModel->RenderToView(m_pDasherView,policy);
+      if (&policy == m_defaultPolicy) m_frameCost.iNumNodes = currentNumNodeObjects();
+      {
+        DASHER_PROFILE_PHASE(m_pFrameProfiler, PHASE_RENDER);
+        m_pDasherModel->RenderToView(m_pDasherView,policy);
+      }
+      EndPhase(CNodeBudgetController::PHASE_RENDER);
       // if anything was expanded or collapsed render at least one more
       // frame after this
-      if (policy.apply())
+      bool bChanged;
+      {
+        DASHER_PROFILE_PHASE(m_pFrameProfiler, PHASE_EXPAND);
+        bChanged = policy.apply();
+      }
+      if (bChanged)
         ScheduleRedraw();
+      EndPhase(CNodeBudgetController::PHASE_EXPAND);
     }
     if(m_pGameModule) {
+      DASHER_PROFILE_PHASE(m_pFrameProfiler, PHASE_GAME_DECORATE);
       m_pGameModule->DecorateView(ulTime, m_pDasherView, m_pDasherModel);
     }          
   }
@@ -575,8 +687,10 @@ bool CDasherInterfaceBase::Redraw(unsigned long ulTime, bool bRedrawNodes, CExpa
   //From here on, we'll use bRedrawNodes just to denote whether we need to blit the display...
 
   if(m_pInputFilter) {
+    DASHER_PROFILE_PHASE(m_pFrameProfiler, PHASE_FILTER_DECORATE);
     if (m_pInputFilter->DecorateView(m_pDasherView, m_pInput)) bRedrawNodes=true;
   }
+  EndPhase(CNodeBudgetController::PHASE_DECORATE);
   
   return bRedrawNodes;
 
@@ -712,6 +826,19 @@ CUserLogBase* CDasherInterfaceBase::GetUserLogPtr() {
   return m_pUserLog;
 }
 
+const CAlphabetManager *CDasherInterfaceBase::GetAlphabetManager() const {
+  return m_pNCManager ? m_pNCManager->GetAlphabetManager() : NULL;
+}
+
+CMemoryReport CDasherInterfaceBase::GetMemoryReport() const {
+  CMemoryReport report;
+  m_pDasherModel->ReportMemory(report);
+  if (m_pNCManager) m_pNCManager->GetAlphabetManager()->ReportMemory(report);
+  if (m_pUserLog) m_pUserLog->ReportMemory(report);
+  m_pSettingsStore->ReportMemory(report);
+  return report;
+}
+
 void CDasherInterfaceBase::KeyDown(unsigned long iTime, Keys::VirtualKey Key) {
   if(isLocked())
     return;
@@ -811,12 +938,18 @@ const char* CDasherInterfaceBase::ClSet(const std::string &strKey, const std::st
 
 
 void CDasherInterfaceBase::ImportTrainingText(const std::string &strPath) {
-  if(m_pNCManager)
-    m_pNCManager->ImportTrainingText(strPath);
+  if(!m_pNCManager) return;
+  //the text must be learnt, even if nothing else is
+  if (m_pNCManager->IsModelReadOnly()) CreateNCManager(false);
+  m_pNCManager->ImportTrainingText(strPath);
 }
 
 void CDasherInterfaceBase::WriteTrainFile(const std::string& filename, const std::string& strNewText) {
-    Dasher::FileUtils::WriteUserDataFile(filename, strNewText, true);
+    //the journal writes the file itself, and must find it again when replaying
+    if (m_pTrainingJournal)
+        m_pTrainingJournal->Append(Dasher::FileUtils::GetFullFilenamePath(filename), strNewText);
+    else
+        Dasher::FileUtils::WriteUserDataFile(filename, strNewText, true);
 };
 
 
@@ -828,3 +961,16 @@ int CDasherInterfaceBase::GetFileSize(const std::string& strFileName) {
 void CDasherInterfaceBase::ScanFiles(AbstractParser* parser, const std::string& strPattern) {
     Dasher::FileUtils::ScanFiles(parser, strPattern);
 }
+
+std::string CDasherInterfaceBase::GetCacheDirectory() {
+    return Dasher::FileUtils::GetFullFilenamePath("cache");
+}
+
+std::string CDasherInterfaceBase::GetTrainingJournalFile() {
+#ifdef HAVE_OWN_FILEUTILS
+    //the host's FileUtils decides where (and how) user data is stored
+    return "";
+#else
+    return Dasher::FileUtils::GetFullFilenamePath("training.journal");
+#endif
+}
@@ -37,6 +37,11 @@
 #include "InputFilter.h"
 #include "ModuleManager.h"
 #include "FrameRate.h"
+#include "NodeBudgetController.h"
+#include "FrameProfiler.h"
+#include "MemoryReport.h"
+
+#include <chrono>
 
 namespace Dasher {
   class CDasherScreen;
@@ -44,8 +49,11 @@ namespace Dasher {
   class CDasherInput;
   class CInputFilter;
   class CDasherModel;
+  class CExpansionWorker;
+  class CTrainingJournal;
   class CSettingsStore;
   class CGameModule;
+  class CAlphabetManager;
   class CDasherInterfaceBase;
   class FileUtils;
 }
@@ -83,6 +91,13 @@ public:
 
   CUserLogBase* GetUserLogPtr();
 
+  ///The alphabet manager for the current alphabet, or NULL before Realize
+  const CAlphabetManager *GetAlphabetManager() const;
+
+  ///Timings of the phases of recent frames, if built with DASHER_FRAME_PROFILER
+  /// (else NULL). Query, dump or clear it between calls to NewFrame.
+  CFrameProfiler *GetFrameProfiler() {return m_pFrameProfiler;}
+
   // @}
 
   ///
@@ -201,11 +216,13 @@ public:
   /// @}
 
   ///
-  /// Append text to the user training file - used to store state between sessions
+  /// Append text to the user training file - used to store state between sessions.
+  /// The default queues the text in the training journal (see GetTrainingJournalFile),
+  /// so it is written in the background.
   /// \param filename name of training file, without path (e.g. "training_english_GB.txt")
   /// \param strNewText text to append
   ///
-  void WriteTrainFile(const std::string& filename, const std::string& strNewText);
+  virtual void WriteTrainFile(const std::string& filename, const std::string& strNewText);
   // App Interface
   // -----------------------------------------------------
 
@@ -349,7 +366,8 @@ public:
   void ImportTrainingText(const std::string &strPath);
 
   /// Flush the/all currently-written text to the user's training file(s).
-  /// Just calls through to WriteTrainFileFull(this) on the AlphabetManager;
+  /// Calls through to WriteTrainFileFull(this) on the AlphabetManager, then waits
+  /// for the training journal to write it out;
   /// public so e.g. iPhone can flush the buffer when app is backgrounded.
   ///
   /// TODO JAN : IS THIS POINTLESS?
@@ -358,13 +376,13 @@ public:
   /// @name Platform dependent utility functions
   /// These functions provide various platform dependent functions
   /// required by the core. A derived class is created for each
-  /// supported platform which implements these.
+  /// supported platform which implements these. The defaults use FileUtils.
   // @{
 
   ///
   /// Obtain the size in bytes of a file
   ///
-  int GetFileSize(const std::string& strFileName);
+  virtual int GetFileSize(const std::string& strFileName);
 
 	
   ///Look for files, matching a filename pattern, in whatever system and/or user
@@ -373,7 +391,21 @@ public:
   /// \param pattern string matching just filename (not path), potentially
   /// including '*'s (as per glob)
   ///
-  void ScanFiles(AbstractParser* parser, const std::string& strPattern);
+  virtual void ScanFiles(AbstractParser* parser, const std::string& strPattern);
+
+  ///Directory in which to keep data derived from other files, to save recomputing
+  /// it (e.g. compiled alphabets); it and its subdirectories are created as needed.
+  /// The default is "cache" under the working directory, alongside the user's
+  /// training files; return an empty string to disable caching.
+  virtual std::string GetCacheDirectory();
+
+  ///File in which to journal text written to the user's training files, so that
+  /// WriteTrainFile can return without waiting for the disk, and the text survives a
+  /// crash (see CTrainingJournal). The default is "training.journal" under the working
+  /// directory, alongside the training files, or empty when built with
+  /// HAVE_OWN_FILEUTILS; an empty string means the text is written synchronously,
+  /// by FileUtils::WriteUserDataFile, instead.
+  virtual std::string GetTrainingJournalFile();
   
   // @}
   
@@ -452,6 +484,7 @@ protected:
   /// Default does nothing, but subclasses can override if they need to do anything else.
   /// \return true if anything has been rendered to the Screen such that it needs to be blitted
   /// (i.e. Display() called) - the default just returns false.
+  /// Runs while any CExpansionWorker is computing, so must not touch nodes or the language model.
   virtual bool FinishRender(unsigned long ulTime) {return false;}
 
   /// @}
@@ -463,6 +496,15 @@ protected:
   virtual void onUnpause(unsigned long lTime);
   
   CDasherView *GetView() {return m_pDasherView;}
+
+  ///The controller adapting the node budget to the time frames take, if BP_ADAPTIVE_NODE_BUDGET
+  /// is on (else NULL). Subscribe to its OnDecision to log what it does.
+  CNodeBudgetController *GetBudgetController() {return m_pBudgetController;}
+
+  ///Bytes held by the node tree, language model and its contexts, alphabet,
+  /// labels, user log and settings, by class. Walks the whole node tree (and
+  /// for some LMs, the trie), so is best called periodically, between frames.
+  CMemoryReport GetMemoryReport() const;
   
   CDasherModel * const m_pDasherModel;
   ///Framerate monitor; created in constructor, req'd for DynamicFilter subclasses
@@ -473,8 +515,29 @@ protected:
   CSettingsStore * const m_pSettingsStore;
 
 private:
-  //The default expansion policy to use - an amortized policy depending on the LP_NODE_BUDGET parameter.
-  CExpansionPolicy *m_defaultPolicy;
+  //The default expansion policy to use - an amortized (or, if BP_HEAP_EXPANSION_POLICY, heap)
+  // policy depending on the LP_NODE_BUDGET parameter.
+  BudgettingPolicy *m_defaultPolicy;
+
+  ///Adjusts m_defaultPolicy's budget each frame; NULL unless BP_ADAPTIVE_NODE_BUDGET.
+  CNodeBudgetController *m_pBudgetController;
+  ///Cost of the phases of the current frame, for m_pBudgetController
+  CNodeBudgetController::SFrameCost m_frameCost;
+  ///When the last phase of the current frame ended
+  std::chrono::steady_clock::time_point m_tPhaseEnd;
+  ///If measuring (i.e. m_pBudgetController), record the time since the last call as being spent in the given phase
+  void EndPhase(CNodeBudgetController::Phase phase);
+
+  ///Per-phase frame timings; NULL unless compiled with DASHER_FRAME_PROFILER.
+  CFrameProfiler *m_pFrameProfiler;
+
+  ///Computes predictions for nodes queued by the default policy, in the
+  /// background (during rendering); NULL unless BP_BACKGROUND_EXPANSION.
+  CExpansionWorker *m_pExpansionWorker;
+
+  ///Writes text for the user's training files in the background; NULL until Realize,
+  /// or if GetTrainingJournalFile() is empty.
+  CTrainingJournal *m_pTrainingJournal;
 
   /// Provide a new CDasherInput input device object.
 
@@ -483,7 +546,8 @@ private:
   void CreateInputFilter();
 
   void CreateModel(int iOffset);
-  void CreateNCManager();
+  ///\param bAllowReadOnlyModel see CNodeCreationManager's constructor
+  void CreateNCManager(bool bAllowReadOnlyModel = true);
 
   void ChangeAlphabet();
   void ChangeColors();
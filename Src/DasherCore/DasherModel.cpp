@@ -22,6 +22,8 @@
 #include "DasherView.h"
 
 #include "NodeCreationManager.h"
+#include "MemoryReport.h"
+#include "TraceRecorder.h"
 #include <cmath>
 #include <cstdint>
 #include <algorithm>
@@ -67,6 +69,30 @@ CDasherModel::~CDasherModel() {
   }
 }
 
+void CDasherModel::ReportMemory(CMemoryReport &report) const {
+  CDasherNode *pTop = oldroots.empty() ? m_Root : oldroots[0];
+  std::size_t iObjectBytes = 0, iArrays = 0, iArrayBytes = 0;
+  if (pTop) {
+    std::vector<const CDasherNode *> vStack(1, pTop);
+    while (!vStack.empty()) {
+      const CDasherNode *pNode = vStack.back();
+      vStack.pop_back();
+      report.Add(CMemoryReport::MEM_NODES, pNode->ClassName(), 1, pNode->ObjectSize());
+      iObjectBytes += pNode->ObjectSize();
+      if (const std::size_t iBytes = CMemoryReport::VectorBytes(pNode->GetChildren())) {
+        ++iArrays;
+        iArrayBytes += iBytes;
+      }
+      vStack.insert(vStack.end(), pNode->GetChildren().begin(), pNode->GetChildren().end());
+    }
+  }
+  report.Add(CMemoryReport::MEM_NODES, "CDasherNode child arrays", iArrays, iArrayBytes);
+  //Free slots and rounding up to size classes; the allocator is shared between
+  // models, so this is only accurate if there is just one.
+  const NodeAllocStats stats(GetNodeAllocStats());
+  report.Add(CMemoryReport::MEM_NODES, "CSlabAlloc overhead", 0, stats.iBytesReserved > iObjectBytes ? stats.iBytesReserved - iObjectBytes : 0);
+}
+
 //Function reimplemented from description:
 //CDasherModel::ClearScheduledSteps(void)
 //- Clears the GotoQueue
@@ -463,6 +489,7 @@ void CDasherModel::OutputTo(CDasherNode *pNewNode) {
 
 void CDasherModel::ExpandNode(CDasherNode *pNode) {
   DASHER_ASSERT(pNode != NULL);
+  DASHER_TRACE_SPAN("ExpandNode", "model");
 
   // TODO: Is NF_ALLCHILDREN any more useful/efficient than reading the map size?
 
@@ -474,10 +501,12 @@ void CDasherModel::ExpandNode(CDasherNode *pNode) {
   // TODO: Do we really need to delete all of the children at this point?
   pNode->DeleteChildren(); // trial commented out - pconlon
 
-#ifdef DEBUG
   unsigned int iExpect = pNode->ExpectedNumChildren();
-#endif
-  pNode->PopulateChildren();
+  pNode->ReserveChildren(iExpect);
+  {
+    DASHER_TRACE_SPAN("PopulateChildren", "model");
+    pNode->PopulateChildren();
+  }
 #ifdef DEBUG
   if (iExpect != pNode->GetChildren().size()) {
     std::cout << "(Note: expected " << iExpect << " children, actually created " << pNode->GetChildren().size() << ")" << std::endl;
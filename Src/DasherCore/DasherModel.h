@@ -31,6 +31,7 @@
 namespace Dasher {
   class CDasherModel;
   class CDasherView;
+  class CMemoryReport;
 }
 
 /// \defgroup Model The Dasher model
@@ -179,6 +180,22 @@ class Dasher::CDasherModel: private NoClones
   /// Create the children of a Dasher node
   void ExpandNode(CDasherNode * pNode);
 
+  ///
+  /// Node allocation statistics (live count, peak, bytes). Nodes of all models
+  /// share one allocator, so these cover every model in the process.
+  ///
+
+  NodeAllocStats GetNodeAllocStats() const {
+    return currentNodeAllocStats();
+  }
+
+  ///
+  /// Add this model's node tree to a memory report (CMemoryReport::MEM_NODES),
+  /// by class of node, plus child arrays and the node allocator's overhead.
+  ///
+
+  void ReportMemory(CMemoryReport &report) const;
+
   /// broadcasts a pointer to a CDasherNode when the node's children are created.
   Event<CDasherNode*> OnNodeChildrenCreated;
 
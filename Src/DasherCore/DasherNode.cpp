@@ -21,6 +21,7 @@
 // #include "AlphabetManager.h" - doesnt seem to be required - pconlon
 
 #include "DasherInterfaceBase.h"
+#include "../Common/Allocators/SlabAlloc.h"
 
 using namespace Dasher;
 
@@ -28,6 +29,25 @@ static int iNumNodes = 0;
 
 int Dasher::currentNumNodeObjects() {return iNumNodes;}
 
+//Never deleted, so nodes may safely be destroyed during static destruction
+static CSlabAlloc &NodeAlloc() {
+  static CSlabAlloc *pAlloc = new CSlabAlloc(256);
+  return *pAlloc;
+}
+
+void *CDasherNode::operator new(std::size_t iSize) {
+  return NodeAlloc().Alloc(iSize);
+}
+
+void CDasherNode::operator delete(void *p, std::size_t iSize) {
+  NodeAlloc().Free(p, iSize);
+}
+
+NodeAllocStats Dasher::currentNodeAllocStats() {
+  const CSlabAlloc &alloc(NodeAlloc());
+  return NodeAllocStats{alloc.GetLive(), alloc.GetPeak(), alloc.GetAllocated(), alloc.GetBytesLive(), alloc.GetBytesReserved()};
+}
+
 //TODO this used to be inline - should we make it so again?
 CDasherNode::CDasherNode(int iOffset, CDasherScreen::Label *pLabel)
 : onlyChildRendered(NULL),  m_iLbnd(0), m_iHbnd(CDasherModel::NORMALIZATION), m_pParent(NULL), m_iFlags(DEFAULT_FLAGS), m_iOffset(iOffset), m_pLabel(pLabel) {
@@ -89,7 +109,7 @@ void CDasherNode::SetFlag(int iFlag, bool bValue) {
 //- Reset the NF_ALLCHILDREN flag on the called node
 
 void CDasherNode::OrphanChild(CDasherNode* pChild) {
-    for (CDasherNode* child : Children()) {  //Children is an std::deque
+    for (CDasherNode* child : Children()) {
         if (child != pChild) {
             child->DeleteChildren();
             delete(child);
@@ -133,14 +153,14 @@ void CDasherNode::DeleteNephews(CDasherNode *pChild) {
 }
 //CDasherNode::DeleteChildren()
 //- Call delete on all children
-//- Clear Child List
+//- Clear Child List, freeing its storage (most collapsed nodes are never re-expanded)
 //- Reset the NF_ALLCHILDREN flag
 //- Set the OnlyChildRendered to nullptr
 void CDasherNode::DeleteChildren(){
     for (CDasherNode* child : Children()) {
         delete(child);
     }
-    Children().clear();
+    ChildMap().swap(Children());
     SetFlag(NF_ALLCHILDREN, false);
     onlyChildRendered = nullptr;
 }
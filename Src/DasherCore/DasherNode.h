@@ -31,6 +31,7 @@
 namespace Dasher {
   class CDasherNode;
   class CDasherInterfaceBase;
+  class CExpansionWorker;
 }
 #include <deque>
 #include <vector>
@@ -101,8 +102,9 @@ class Dasher::CDasherNode:private NoClones {
   CDasherNode *onlyChildRendered; //cache that only one child was rendered (as it filled the screen)
 
   /// Container type for storing children. Note that it's worth
-  /// optimising this as lookup happens a lot
-  typedef std::deque<CDasherNode*> ChildMap;
+  /// optimising this as lookup happens a lot: a vector keeps the children
+  /// contiguous for rendering, and (unlike a deque) costs nothing until used.
+  typedef std::vector<CDasherNode*> ChildMap;
 
   /// @brief Constructor
   ///
@@ -119,6 +121,12 @@ class Dasher::CDasherNode:private NoClones {
   ///
   virtual ~CDasherNode();
 
+  /// Nodes of all types are allocated from (and freed to) a slab allocator
+  /// with a free list per size class, as they are created and deleted in
+  /// great numbers; see currentNodeAllocStats().
+  static void *operator new(std::size_t iSize);
+  static void operator delete(void *p, std::size_t iSize);
+
   void Trace() const;           // diagnostic
 
   /// @name Routines for manipulating node status
@@ -180,6 +188,9 @@ class Dasher::CDasherNode:private NoClones {
 
   inline const ChildMap & GetChildren() const;
   inline unsigned int ChildCount() const;
+  /// Make room for the given number of children, so adding them (e.g. in
+  /// PopulateChildren) needs a single allocation.
+  inline void ReserveChildren(unsigned int iNumChildren);
   inline CDasherNode *Parent() const;
   
   /// Makes the node be the child of a new parent, and set its range amongst
@@ -232,6 +243,18 @@ class Dasher::CDasherNode:private NoClones {
   /// the node budgetting algorithm to behave sub-optimally)
   virtual int ExpectedNumChildren() = 0;
 
+  /// Start computing, on the given worker, whatever a later PopulateChildren will need
+  /// (see CExpansionWorker); once the job has been linked, the node is expanded as normal.
+  /// \return false if there is nothing worth doing in the background, in which case the
+  /// caller should expand the node immediately. The default returns false.
+  virtual bool PrefetchChildren(CExpansionWorker *pWorker) {return false;}
+
+  /// Name of the node's (most-derived) class, and the size of an object of that
+  /// class, for memory reports (CDasherModel::ReportMemory). Every concrete
+  /// subclass must override both.
+  virtual const char *ClassName() const = 0;
+  virtual std::size_t ObjectSize() const = 0;
+
   ///
   /// Called whenever a node belonging to this manager first
   /// moves under the crosshair
@@ -300,6 +323,21 @@ class Dasher::CDasherNode:private NoClones {
 namespace Dasher {
   /// Return the number of CDasherNode objects currently in existence.
   int currentNumNodeObjects();
+
+  /// Statistics from the allocator used for all CDasherNode objects
+  struct NodeAllocStats {
+    /// Number of nodes currently allocated
+    std::size_t iLive;
+    /// Highest number of nodes allocated at once
+    std::size_t iPeak;
+    /// Number of nodes ever allocated (iTotalAllocated - iLive have been deleted)
+    std::size_t iTotalAllocated;
+    /// Bytes occupied by current nodes
+    std::size_t iBytesLive;
+    /// Bytes held by the allocator, including free space for reuse
+    std::size_t iBytesReserved;
+  };
+  NodeAllocStats currentNodeAllocStats();
 }
 
 
@@ -337,6 +375,10 @@ inline unsigned int CDasherNode::ChildCount() const {
   return static_cast<unsigned int>(m_mChildren.size());
 }
 
+inline void CDasherNode::ReserveChildren(unsigned int iNumChildren) {
+  m_mChildren.reserve(iNumChildren);
+}
+
 inline bool CDasherNode::GetFlag(int iFlag) const {
   return ((m_iFlags & iFlag) != 0);
 }
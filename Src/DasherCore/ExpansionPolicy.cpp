@@ -9,6 +9,7 @@
 
 #include "ExpansionPolicy.h"
 #include "DasherModel.h"
+#include "ExpansionWorker.h"
 #include <algorithm>
 #include <limits>
 
@@ -18,10 +19,34 @@ void CExpansionPolicy::ExpandNode(CDasherNode *pNode) {
   m_pModel->ExpandNode(pNode);
 }
 
+bool CExpansionPolicy::RequestExpansion(CDasherNode *pNode) {
+  if (m_pWorker && pNode->PrefetchChildren(m_pWorker)) return true;
+  m_vBatch.push_back(pNode);
+  return false;
+}
+
+void CExpansionPolicy::ExpandBatch() {
+  //nodes are usually all from one manager, so this is a single pass
+  m_vUnprefetched = m_vBatch;
+  while (!m_vUnprefetched.empty()) {
+    CNodeManager *pMgr = m_vUnprefetched.front()->mgr();
+    m_vMgrNodes.clear();
+    std::vector<CDasherNode *>::iterator itRest = m_vUnprefetched.begin();
+    for (CDasherNode *pNode : m_vUnprefetched) {
+      if (pNode->mgr() == pMgr) m_vMgrNodes.push_back(pNode);
+      else *itRest++ = pNode;
+    }
+    m_vUnprefetched.erase(itRest, m_vUnprefetched.end());
+    if (pMgr) pMgr->PrefetchChildren(m_vMgrNodes);
+  }
+  for (CDasherNode *pNode : m_vBatch) ExpandNode(pNode);
+  m_vBatch.clear();
+}
+
 bool Less(std::pair<double,CDasherNode *> x, std::pair<double, CDasherNode *> y) {return x.first < y.first;}
 bool More(std::pair<double,CDasherNode *> x, std::pair<double, CDasherNode *> y) {return x.first > y.first;}
   
-BudgettingPolicy::BudgettingPolicy(CDasherModel *pModel, unsigned int iNodeBudget) : CExpansionPolicy(pModel), m_iNodeBudget(iNodeBudget) {}
+BudgettingPolicy::BudgettingPolicy(CDasherModel *pModel, unsigned int iNodeBudget, CExpansionWorker *pWorker) : CExpansionPolicy(pModel, pWorker), m_iNodeBudget(iNodeBudget) {}
 
 double BudgettingPolicy::pushNode(CDasherNode *pNode, int iMin, int iMax, bool bExpand, double dParentCost) {
   double dRes = getCost(pNode, iMin, iMax);
@@ -64,6 +89,10 @@ bool BudgettingPolicy::apply() {
   // collapsed node! Sadly we can't rely on trading one-for-one as different nodes
   // may have different numbers of children...)
   double collapseCost = -std::numeric_limits<double>::infinity();
+
+  //children of nodes queued for expansion, either in the background (to be created next
+  // frame) or at the end of this method (all together, see ExpandBatch)
+  unsigned int iQueuedChildren = 0;
   
   //first, make sure we are within our budget (probably only in case the budget's changed)
   while (!sCollapse.empty()
@@ -81,9 +110,11 @@ bool BudgettingPolicy::apply() {
   // to make room to expand other more important (high-benefit) nodes.  
   while (!sExpand.empty() && sExpand.back().first > collapseCost)
   {
-    if (static_cast<unsigned int>(currentNumNodeObjects()+sExpand.back().second->ExpectedNumChildren()) < m_iNodeBudget)
+    const unsigned int iExpect = sExpand.back().second->ExpectedNumChildren();
+    if (static_cast<unsigned int>(currentNumNodeObjects()) + iQueuedChildren + iExpect < m_iNodeBudget)
     {
-      ExpandNode(sExpand.back().second);
+      RequestExpansion(sExpand.back().second);
+      iQueuedChildren += iExpect;
       sExpand.pop_back();
       bReturnValue = true;
       //...and loop.
@@ -92,6 +123,8 @@ bool BudgettingPolicy::apply() {
              && sCollapse.back().first < sExpand.back().first)
     {
       //could be a beneficial trade - make room by performing collapse...
+      // (this cannot delete a node queued for expansion: those cost at least as much as
+      // the current sExpand.back(), so more than this node, so are not its descendants)
       std::pair<double,CDasherNode *> node = sCollapse.back();
       DASHER_ASSERT(node.first >= collapseCost);
       collapseCost = node.first;
@@ -101,6 +134,7 @@ bool BudgettingPolicy::apply() {
     }
     else break; //not enough room, nothing to collapse.
   }
+  ExpandBatch();
   sExpand.clear();
   sCollapse.clear();
   return bReturnValue;
@@ -119,6 +153,8 @@ AmortizedPolicy::AmortizedPolicy(CDasherModel *pModel, unsigned int iNodeBudget)
 
 AmortizedPolicy::AmortizedPolicy(CDasherModel *pModel, unsigned int iNodeBudget, unsigned int iMaxExpands) : BudgettingPolicy(pModel, iNodeBudget), m_iMaxExpands(iMaxExpands) {}
 
+AmortizedPolicy::AmortizedPolicy(CDasherModel *pModel, unsigned int iNodeBudget, CExpansionWorker *pWorker) : BudgettingPolicy(pModel,iNodeBudget,pWorker), m_iMaxExpands(std::max(1u,(500+iNodeBudget)/1000)) {}
+
 double AmortizedPolicy::pushNode(CDasherNode *node, int iMin, int iMax, bool bExpand, double dParentCost) {
   double dRes = BudgettingPolicy::pushNode(node,iMin,iMax,bExpand,dParentCost);
   if (bExpand && sExpand.size() > 2*m_iMaxExpands) trim();
@@ -192,3 +228,176 @@ void AmortizedPolicy::trim() {
     else cout << "trim not equal!\n";
 #endif
 }
+
+HeapPolicy::HeapPolicy(CDasherModel *pModel, unsigned int iNodeBudget, CExpansionWorker *pWorker) : BudgettingPolicy(pModel, iNodeBudget, pWorker), m_iFrame(1), m_iPushed(0), m_iMaxExpands(std::max(1u,(500+iNodeBudget)/1000)) {}
+
+bool HeapPolicy::Before(int iHeap, size_t a, size_t b) const {
+  return (iHeap == EXPAND) ? m_vCandidates[a].dCost > m_vCandidates[b].dCost
+                           : m_vCandidates[a].dCost < m_vCandidates[b].dCost;
+}
+
+void HeapPolicy::Place(int iHeap, size_t iPos, size_t iId) {
+  m_vHeap[iHeap][iPos] = iId;
+  m_vCandidates[iId].iHeap = iHeap;
+  m_vCandidates[iId].iPos = iPos;
+}
+
+void HeapPolicy::SiftUp(int iHeap, size_t iPos) {
+  std::vector<size_t> &heap(m_vHeap[iHeap]);
+  const size_t iId = heap[iPos];
+  while (iPos > 0) {
+    const size_t iParent = (iPos - 1) / 2;
+    if (!Before(iHeap, iId, heap[iParent])) break;
+    Place(iHeap, iPos, heap[iParent]);
+    iPos = iParent;
+  }
+  Place(iHeap, iPos, iId);
+}
+
+void HeapPolicy::SiftDown(int iHeap, size_t iPos) {
+  std::vector<size_t> &heap(m_vHeap[iHeap]);
+  const size_t iId = heap[iPos];
+  while (true) {
+    size_t iChild = 2 * iPos + 1;
+    if (iChild >= heap.size()) break;
+    if (iChild + 1 < heap.size() && Before(iHeap, heap[iChild + 1], heap[iChild])) iChild++;
+    if (!Before(iHeap, heap[iChild], iId)) break;
+    Place(iHeap, iPos, heap[iChild]);
+    iPos = iChild;
+  }
+  Place(iHeap, iPos, iId);
+}
+
+void HeapPolicy::Insert(int iHeap, size_t iId) {
+  m_vHeap[iHeap].push_back(iId);
+  SiftUp(iHeap, m_vHeap[iHeap].size() - 1);
+}
+
+void HeapPolicy::RemoveFromHeap(size_t iId) {
+  SCandidate &c(m_vCandidates[iId]);
+  std::vector<size_t> &heap(m_vHeap[c.iHeap]);
+  const int iHeap = c.iHeap;
+  const size_t iPos = c.iPos, iLast = heap.back();
+  heap.pop_back();
+  c.iHeap = NEITHER;
+  if (iLast == iId) return;
+  //fill the hole with the last element, which may need to move either way
+  Place(iHeap, iPos, iLast);
+  SiftUp(iHeap, iPos);
+  SiftDown(iHeap, m_vCandidates[iLast].iPos);
+}
+
+void HeapPolicy::Forget(size_t iId) {
+  SCandidate &c(m_vCandidates[iId]);
+  if (c.iHeap != NEITHER) RemoveFromHeap(iId);
+  if (c.iFrame == m_iFrame) m_iPushed--;
+  m_mapIds.erase(c.pNode);
+  c.pNode = NULL;
+  m_vFreeIds.push_back(iId);
+}
+
+double HeapPolicy::pushNode(CDasherNode *pNode, int iMin, int iMax, bool bExpand, double dParentCost) {
+  //as BudgettingPolicy
+  double dRes = getCost(pNode, iMin, iMax);
+  int iHeap = bExpand ? EXPAND : COLLAPSE;
+  if (dRes >= dParentCost) {
+    dRes = dParentCost;
+    if (!bExpand) iHeap = NEITHER;
+  }
+  std::unordered_map<CDasherNode *, size_t>::iterator it = m_mapIds.find(pNode);
+  if (iHeap == NEITHER) {
+    if (it != m_mapIds.end()) Forget(it->second);
+    return dRes;
+  }
+  size_t iId;
+  if (it != m_mapIds.end()) iId = it->second;
+  else {
+    if (m_vFreeIds.empty()) {
+      iId = m_vCandidates.size();
+      m_vCandidates.push_back(SCandidate());
+    } else {
+      iId = m_vFreeIds.back();
+      m_vFreeIds.pop_back();
+    }
+    SCandidate &c(m_vCandidates[iId]);
+    c.pNode = pNode;
+    c.iFrame = 0;
+    c.iHeap = NEITHER;
+    m_mapIds.emplace(pNode, iId);
+  }
+  SCandidate &c(m_vCandidates[iId]);
+  if (c.iFrame != m_iFrame) {
+    c.iFrame = m_iFrame;
+    m_iPushed++;
+  }
+  if (c.iHeap != iHeap) {
+    if (c.iHeap != NEITHER) RemoveFromHeap(iId);
+    c.dCost = dRes;
+    Insert(iHeap, iId);
+  } else if (c.dCost != dRes) {
+    const bool bUp = (iHeap == EXPAND) ? dRes > c.dCost : dRes < c.dCost;
+    c.dCost = dRes;
+    if (bUp) SiftUp(iHeap, c.iPos);
+    else SiftDown(iHeap, c.iPos);
+  }
+  return dRes;
+}
+
+bool HeapPolicy::apply() {
+  //drop the candidates not pushed this frame, without dereferencing them:
+  // they may have been deleted since
+  if (m_iPushed < m_mapIds.size()) {
+    for (size_t iId = 0; iId < m_vCandidates.size(); iId++)
+      if (m_vCandidates[iId].pNode && m_vCandidates[iId].iFrame != m_iFrame) Forget(iId);
+  }
+  std::vector<size_t> &vExpand(m_vHeap[EXPAND]), &vCollapse(m_vHeap[COLLAPSE]);
+
+  //then as BudgettingPolicy::apply, taking nodes from the tops of the heaps. Collapsing
+  // a node deletes any descendants still in the expand heap; but those cost no more than
+  // it, so will not be expanded (or looked at) before the next frame's pushNode calls.
+  bool bReturnValue = false;
+  double collapseCost = -std::numeric_limits<double>::infinity();
+  unsigned int iQueuedChildren = 0, iExpanded = 0;
+
+  while (!vCollapse.empty()
+         && static_cast<unsigned int>(currentNumNodeObjects()) > m_iNodeBudget)
+  {
+    const size_t iId = vCollapse.front();
+    DASHER_ASSERT(m_vCandidates[iId].dCost >= collapseCost);
+    collapseCost = m_vCandidates[iId].dCost;
+    CDasherNode *pNode = m_vCandidates[iId].pNode;
+    Forget(iId);
+    pNode->DeleteChildren();
+  }
+
+  //as AmortizedPolicy, consider only the m_iMaxExpands best nodes for expansion
+  while (iExpanded < m_iMaxExpands && !vExpand.empty() && m_vCandidates[vExpand.front()].dCost > collapseCost)
+  {
+    const size_t iId = vExpand.front();
+    CDasherNode *pNode = m_vCandidates[iId].pNode;
+    const unsigned int iExpect = pNode->ExpectedNumChildren();
+    if (static_cast<unsigned int>(currentNumNodeObjects()) + iQueuedChildren + iExpect < m_iNodeBudget)
+    {
+      RequestExpansion(pNode);
+      iQueuedChildren += iExpect;
+      Forget(iId);
+      iExpanded++;
+      bReturnValue = true;
+    }
+    else if (!vCollapse.empty()
+             && m_vCandidates[vCollapse.front()].dCost < m_vCandidates[iId].dCost)
+    {
+      const size_t iCollapse = vCollapse.front();
+      DASHER_ASSERT(m_vCandidates[iCollapse].dCost >= collapseCost);
+      collapseCost = m_vCandidates[iCollapse].dCost;
+      CDasherNode *pCollapse = m_vCandidates[iCollapse].pNode;
+      Forget(iCollapse);
+      pCollapse->DeleteChildren();
+    }
+    else break;
+  }
+  ExpandBatch();
+  m_iFrame++;
+  m_iPushed = 0;
+  return bReturnValue;
+}
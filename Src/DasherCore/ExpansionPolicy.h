@@ -9,6 +9,8 @@
 
 #pragma once
 
+#include <algorithm>
+#include <unordered_map>
 #include <vector>
 #include "DasherNode.h"
 
@@ -16,6 +18,7 @@ class CNodeCreationManager;
 
 namespace Dasher {
   class CDasherModel;
+  class CExpansionWorker;
 class CExpansionPolicy
 {
 public:
@@ -31,9 +34,25 @@ public:
   /// which must be expanded during rendering. (Delegates to CDasherModel.)
   void ExpandNode(CDasherNode *pNode);
 protected:
-  CExpansionPolicy(CDasherModel *pModel) : m_pModel(pModel) {}
+  CExpansionPolicy(CDasherModel *pModel, CExpansionWorker *pWorker=NULL) : m_pModel(pModel), m_pWorker(pWorker) {}
+  ///For use by apply(): if we have a worker, and the node can do (costly) work towards
+  /// its children there (CDasherNode::PrefetchChildren), queue it - the children will
+  /// be added at the start of the next frame; otherwise, add it to the nodes to expand
+  /// at the next ExpandBatch. Either way, the children do not exist yet.
+  /// \return true if queued on the worker
+  bool RequestExpansion(CDasherNode *pNode);
+  ///Expands the nodes added by RequestExpansion since the last call, first letting each
+  /// node manager compute what all its nodes need together (CNodeManager::PrefetchChildren,
+  /// e.g. probabilities from one CLanguageModel::GetProbsBatch call). apply() must call
+  /// this before any of those nodes could be deleted.
+  void ExpandBatch();
 private:
   CDasherModel *m_pModel;
+  CExpansionWorker *m_pWorker;
+  ///Nodes to expand at the next ExpandBatch
+  std::vector<CDasherNode *> m_vBatch;
+  ///Kept to avoid reallocating: nodes of the batch not yet passed to their manager, and those for one manager
+  std::vector<CDasherNode *> m_vUnprefetched, m_vMgrNodes;
 };
 
 class NoExpansions : public CExpansionPolicy
@@ -50,13 +69,20 @@ public:
 class BudgettingPolicy : public CExpansionPolicy
 {
 public:
-  BudgettingPolicy(CDasherModel *pModel, unsigned int iNodeBudget);
+  ///\param pWorker if non-null, nodes are expanded in the background where possible (see RequestExpansion)
+  BudgettingPolicy(CDasherModel *pModel, unsigned int iNodeBudget, CExpansionWorker *pWorker=NULL);
   virtual ~BudgettingPolicy() = default;
   ///sets cost according to getCost(pNode,iMin,iMax);
   ///then assures node is cheaper (less important) than its parent;
   ///then adds to relevant queue
   double pushNode(CDasherNode *pNode, int iMin, int iMax, bool bExpand, double dParentCost) override;
   bool apply() override;
+  ///Change the budget, e.g. to adapt to the time frames are taking; takes effect at the next apply()
+  void SetNodeBudget(unsigned int iNodeBudget) {m_iNodeBudget = iNodeBudget;}
+  unsigned int GetNodeBudget() const {return m_iNodeBudget;}
+  ///Limit the number of nodes expanded per apply(), for subclasses which do;
+  /// by default there is no limit, and this does nothing.
+  virtual void SetMaxExpands(unsigned int iMaxExpands) {}
 protected:
   virtual double getCost(CDasherNode *pNode, int iDasherMinY, int iDasherMaxY);
   ///return the intersection of the ranges (y1-y2) and (iMin-iMax)
@@ -73,11 +99,63 @@ public:
   AmortizedPolicy() = delete;
   AmortizedPolicy(CDasherModel *pModel, unsigned int iNodeBudget);
 	AmortizedPolicy(CDasherModel *pModel, unsigned int iNodeBudget, unsigned int iMaxExpands);
+  AmortizedPolicy(CDasherModel *pModel, unsigned int iNodeBudget, CExpansionWorker *pWorker);
   ~AmortizedPolicy() = default;
   bool apply() override;
   double pushNode(CDasherNode *pNode, int iMin, int iMax, bool bExpand, double dParentCost) override;
+  void SetMaxExpands(unsigned int iMaxExpands) override {m_iMaxExpands = std::max(1u, iMaxExpands);}
 private:
 	unsigned int m_iMaxExpands;
   void trim();
 };
+
+///Makes the same choices as AmortizedPolicy (up to the order of nodes of equal cost),
+/// but keeps the candidates for expansion and collapse in two heaps which persist from
+/// frame to frame: pushNode moves a node only if its cost or queue has changed since
+/// the last frame, and apply() pops only the nodes it expands or collapses. Thus a frame costs O(n + (c+k) log n) for n
+/// nodes onscreen, of which c change cost or appear and k are expanded or collapsed,
+/// rather than the O(n log n) of sorting them all; while the user holds still, c is 0.
+///Nodes are identified by address only, and never dereferenced unless pushed in the
+/// current frame; any not pushed (offscreen, deleted, or expanded by the view) are
+/// dropped at the next apply().
+class HeapPolicy : public BudgettingPolicy
+{
+public:
+  HeapPolicy(CDasherModel *pModel, unsigned int iNodeBudget, CExpansionWorker *pWorker=NULL);
+  ~HeapPolicy() = default;
+  double pushNode(CDasherNode *pNode, int iMin, int iMax, bool bExpand, double dParentCost) override;
+  bool apply() override;
+  void SetMaxExpands(unsigned int iMaxExpands) override {m_iMaxExpands = std::max(1u, iMaxExpands);}
+private:
+  enum {EXPAND = 0, COLLAPSE = 1, NEITHER = 2};
+  struct SCandidate {
+    CDasherNode *pNode;
+    double dCost;
+    ///Number of the last frame in which the node was pushed
+    unsigned long iFrame;
+    ///EXPAND or COLLAPSE, i.e. which of m_vHeap the candidate is in, and where
+    int iHeap;
+    size_t iPos;
+  };
+  ///True if a should come out of m_vHeap[iHeap] before b
+  bool Before(int iHeap, size_t a, size_t b) const;
+  void SiftUp(int iHeap, size_t iPos);
+  void SiftDown(int iHeap, size_t iPos);
+  void Place(int iHeap, size_t iPos, size_t iId);
+  void Insert(int iHeap, size_t iId);
+  void RemoveFromHeap(size_t iId);
+  ///Remove the candidate completely, making its id free for reuse
+  void Forget(size_t iId);
+  ///Candidates, indexed by id; ids in m_vFreeIds are unused
+  std::vector<SCandidate> m_vCandidates;
+  std::vector<size_t> m_vFreeIds;
+  ///Id of the candidate for each node
+  std::unordered_map<CDasherNode *, size_t> m_mapIds;
+  ///Ids of the candidates to expand, most beneficial first, and to collapse, cheapest first
+  std::vector<size_t> m_vHeap[2];
+  unsigned long m_iFrame;
+  ///Number of candidates pushed in the current frame
+  size_t m_iPushed;
+  unsigned int m_iMaxExpands;
+};
 }
@@ -0,0 +1,102 @@
+// ExpansionWorker.cpp
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// This file is part of Dasher.
+//
+// Dasher is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Dasher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Dasher; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include "ExpansionWorker.h"
+#include "DasherModel.h"
+#include "DasherNode.h"
+
+using namespace Dasher;
+
+CExpansionWorker::CExpansionWorker() : m_bRunning(false), m_bBusy(false), m_bStop(false) {
+  m_thread = std::thread(&CExpansionWorker::Run, this);
+}
+
+CExpansionWorker::~CExpansionWorker() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_bStop = true;
+  }
+  m_condWork.notify_one();
+  m_thread.join();
+  //nodes may still hold references to these; make sure they don't wait for them
+  for (auto &pJob : m_qPending) pJob->Cancel();
+  for (auto &pJob : m_vFinished) pJob->Cancel();
+}
+
+void CExpansionWorker::Queue(std::shared_ptr<Job> pJob) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_qPending.push_back(std::move(pJob));
+}
+
+void CExpansionWorker::Resume() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_qPending.empty()) return;
+    m_bRunning = true;
+  }
+  m_condWork.notify_one();
+}
+
+void CExpansionWorker::Pause() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_bRunning = false;
+  m_condIdle.wait(lock, [this] {return !m_bBusy;});
+}
+
+bool CExpansionWorker::LinkFinished(CDasherModel *pModel) {
+  std::vector<std::shared_ptr<Job> > vFinished;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    DASHER_ASSERT(!m_bRunning);
+    vFinished.swap(m_vFinished);
+  }
+  bool bExpanded = false;
+  for (auto &pJob : vFinished) {
+    //cancelled => node deleted, or expanded (synchronously) already
+    if (pJob->IsCancelled()) continue;
+    pJob->Link();
+    pModel->ExpandNode(pJob->GetNode());
+    bExpanded = true;
+  }
+  return bExpanded;
+}
+
+bool CExpansionWorker::HasPending() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return !m_qPending.empty();
+}
+
+void CExpansionWorker::Run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_condWork.wait(lock, [this] {return m_bStop || (m_bRunning && !m_qPending.empty());});
+    if (m_bStop) return;
+    std::shared_ptr<Job> pJob = std::move(m_qPending.front());
+    m_qPending.pop_front();
+    if (pJob->IsCancelled()) continue;
+    m_bBusy = true;
+    lock.unlock();
+    pJob->Compute();
+    lock.lock();
+    m_bBusy = false;
+    m_vFinished.push_back(std::move(pJob));
+    m_condIdle.notify_all();
+  }
+}
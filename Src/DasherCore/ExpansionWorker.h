@@ -0,0 +1,100 @@
+// ExpansionWorker.h
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// This file is part of Dasher.
+//
+// Dasher is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Dasher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Dasher; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+#pragma once
+
+#include "../Common/NoClones.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Dasher {
+  class CDasherNode;
+  class CDasherModel;
+
+  ///Background thread doing the expensive part of expanding nodes (usually, asking the
+  /// language model for predictions) so the main thread need only link in the children.
+  ///
+  /// Nothing else in Dasher is thread-safe, so jobs only run between Resume() and Pause(),
+  /// which the main thread must bracket around a period in which it does not touch the
+  /// node tree or language model (in CDasherInterfaceBase::NewFrame, from the end of
+  /// CExpansionPolicy::apply() until after the frame has been displayed). Pause() waits
+  /// for any job in progress, so afterwards the main thread may do as it likes.
+  class CExpansionWorker : private NoClones {
+  public:
+    ///Some work for a node, created by CDasherNode::PrefetchChildren
+    class Job {
+    public:
+      Job(CDasherNode *pNode) : m_pNode(pNode), m_bCancelled(false) {}
+      virtual ~Job() = default;
+      ///Called on the worker thread (while the main thread is outside the node tree)
+      virtual void Compute() = 0;
+      ///Called on the main thread, once Compute() has finished, before the node is expanded
+      virtual void Link() = 0;
+      ///Called on the main thread if the node no longer wants the result (e.g. is being deleted),
+      /// only while the worker is paused.
+      void Cancel() {m_bCancelled = true;}
+      bool IsCancelled() const {return m_bCancelled;}
+      CDasherNode *GetNode() const {return m_pNode;}
+    private:
+      CDasherNode * const m_pNode;
+      std::atomic<bool> m_bCancelled;
+    };
+
+    ///Starts the thread, initially paused
+    CExpansionWorker();
+    ///Stops the thread, cancelling any outstanding jobs
+    ~CExpansionWorker();
+
+    ///Add a job to the back of the queue; it will run after the next Resume().
+    void Queue(std::shared_ptr<Job> pJob);
+
+    ///Allow jobs to run, until the next Pause()
+    void Resume();
+    ///Stop running jobs; blocks until any job in progress has completed.
+    void Pause();
+
+    ///Link in, and expand (via CDasherModel::ExpandNode), all nodes whose jobs have finished.
+    /// Call on the main thread while paused.
+    /// \return true if any nodes were expanded
+    bool LinkFinished(CDasherModel *pModel);
+
+    ///Whether any jobs are still waiting to run (so another frame should be scheduled)
+    bool HasPending();
+
+  private:
+    void Run();
+
+    std::mutex m_mutex;
+    ///Signalled when there is (possibly) work to do, or we should stop
+    std::condition_variable m_condWork;
+    ///Signalled when a job finishes (for Pause)
+    std::condition_variable m_condIdle;
+    std::deque<std::shared_ptr<Job> > m_qPending;
+    std::vector<std::shared_ptr<Job> > m_vFinished;
+    bool m_bRunning, m_bBusy, m_bStop;
+    std::thread m_thread;
+  };
+}
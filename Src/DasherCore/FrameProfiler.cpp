@@ -0,0 +1,109 @@
+// FrameProfiler.cpp
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// This file is part of Dasher.
+//
+// Dasher is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Dasher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Dasher; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include "FrameProfiler.h"
+
+#include <myassert.h>
+
+#include <algorithm>
+
+using namespace Dasher;
+
+CFrameProfiler::CFrameProfiler(unsigned int iCapacity)
+: m_tEpoch(std::chrono::steady_clock::now()), m_vFrames(std::max(1u, iCapacity)) {
+  Clear();
+}
+
+const char *CFrameProfiler::PhaseName(Phase phase) {
+  switch (phase) {
+    case PHASE_INPUT_TIMER: return "input_timer";
+    case PHASE_SCHEDULED_STEP: return "scheduled_step";
+    case PHASE_RENDER: return "render";
+    case PHASE_EXPAND: return "expand";
+    case PHASE_GAME_DECORATE: return "game_decorate";
+    case PHASE_FILTER_DECORATE: return "filter_decorate";
+    case PHASE_FINISH_RENDER: return "finish_render";
+    case PHASE_DISPLAY: return "display";
+    default: return "?";
+  }
+}
+
+void CFrameProfiler::BeginFrame(unsigned long iTime) {
+  DASHER_ASSERT(!m_bInFrame);
+  SFrame &frame(m_vFrames[m_iNext]);
+  frame.iFrame = m_iNumFrames;
+  frame.iTime = iTime;
+  frame.dTotalMs = 0;
+  for (int i = 0; i < NUM_PHASES; i++) {
+    frame.dPhaseMs[i] = 0;
+    frame.dPhaseStartMs[i] = -1;
+  }
+  m_bInFrame = true;
+  //last, so as to exclude the above
+  frame.dStartMs = MsSinceEpoch(std::chrono::steady_clock::now());
+}
+
+void CFrameProfiler::EndFrame() {
+  DASHER_ASSERT(m_bInFrame);
+  SFrame &frame(m_vFrames[m_iNext]);
+  frame.dTotalMs = MsSinceEpoch(std::chrono::steady_clock::now()) - frame.dStartMs;
+  m_bInFrame = false;
+  m_iNumFrames++;
+  m_iNext = (m_iNext + 1) % m_vFrames.size();
+  m_iCount = std::min(m_iCount + 1, GetCapacity());
+}
+
+void CFrameProfiler::AddPhase(Phase phase, std::chrono::steady_clock::time_point tStart, std::chrono::steady_clock::time_point tEnd) {
+  //phases outside a frame (e.g. a host calling Redraw directly) aren't recorded
+  if (!m_bInFrame) return;
+  SFrame &frame(m_vFrames[m_iNext]);
+  if (frame.dPhaseStartMs[phase] < 0)
+    frame.dPhaseStartMs[phase] = MsSinceEpoch(tStart) - frame.dStartMs;
+  frame.dPhaseMs[phase] += std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+}
+
+const CFrameProfiler::SFrame &CFrameProfiler::GetFrame(unsigned int i) const {
+  DASHER_ASSERT(i < m_iCount);
+  return m_vFrames[(m_iNext + m_vFrames.size() - m_iCount + i) % m_vFrames.size()];
+}
+
+void CFrameProfiler::GetFrames(std::vector<SFrame> &vFrames) const {
+  vFrames.clear();
+  vFrames.reserve(m_iCount);
+  for (unsigned int i = 0; i < m_iCount; i++) vFrames.push_back(GetFrame(i));
+}
+
+void CFrameProfiler::Clear() {
+  m_iNext = m_iCount = 0;
+  m_iNumFrames = 0;
+  m_bInFrame = false;
+}
+
+void CFrameProfiler::Dump(std::ostream &out) const {
+  out << "frame,time,start_ms,total_ms";
+  for (int i = 0; i < NUM_PHASES; i++) out << "," << PhaseName(static_cast<Phase>(i)) << "_ms";
+  out << "\n";
+  for (unsigned int i = 0; i < m_iCount; i++) {
+    const SFrame &frame(GetFrame(i));
+    out << frame.iFrame << "," << frame.iTime << "," << frame.dStartMs << "," << frame.dTotalMs;
+    for (int j = 0; j < NUM_PHASES; j++) out << "," << frame.dPhaseMs[j];
+    out << "\n";
+  }
+}
@@ -0,0 +1,145 @@
+// FrameProfiler.h
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// This file is part of Dasher.
+//
+// Dasher is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Dasher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Dasher; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+#pragma once
+
+#include <chrono>
+#include <ostream>
+#include <vector>
+
+namespace Dasher {
+/// \ingroup Model
+/// \{
+
+/// Records how long each phase of CDasherInterfaceBase::NewFrame took, for the most
+/// recent frames, in a ring buffer of fixed size (allocated up front, so recording
+/// never allocates). Only compiled into NewFrame if DASHER_FRAME_PROFILER is defined
+/// (the CMake option of the same name); otherwise the DASHER_PROFILE_ macros expand to
+/// nothing, and CDasherInterfaceBase::GetFrameProfiler returns NULL.
+///
+/// Not thread-safe: query it from the thread calling NewFrame, between frames.
+class CFrameProfiler {
+public:
+  enum Phase {
+    PHASE_INPUT_TIMER,     ///< CInputFilter::Timer
+    PHASE_SCHEDULED_STEP,  ///< CDasherModel::NextScheduledStep
+    PHASE_RENDER,          ///< CDasherModel::RenderToView
+    PHASE_EXPAND,          ///< CExpansionPolicy::apply
+    PHASE_GAME_DECORATE,   ///< CGameModule::DecorateView
+    PHASE_FILTER_DECORATE, ///< CInputFilter::DecorateView
+    PHASE_FINISH_RENDER,   ///< messages etc., drawn by FinishRender
+    PHASE_DISPLAY,         ///< CDasherScreen::Display (i.e. the host's blit)
+    NUM_PHASES
+  };
+
+  ///Timings of one frame. Times not in any phase (e.g. the user log) count only
+  /// towards the total.
+  struct SFrame {
+    ///Number of the frame since the profiler was created (or cleared)
+    unsigned long iFrame;
+    ///Time passed to NewFrame
+    unsigned long iTime;
+    ///Wall-clock start of the frame, relative to the creation of the profiler
+    double dStartMs;
+    double dTotalMs;
+    ///Time spent in each phase (0 if not entered)
+    double dPhaseMs[NUM_PHASES];
+    ///When each phase was (first) entered, relative to dStartMs; negative if not entered
+    double dPhaseStartMs[NUM_PHASES];
+  };
+
+  ///\param iCapacity number of frames to keep
+  CFrameProfiler(unsigned int iCapacity = DEFAULT_CAPACITY);
+
+  static constexpr unsigned int DEFAULT_CAPACITY = 1024;
+
+  ///Name of a phase, e.g. for column headings
+  static const char *PhaseName(Phase phase);
+
+  ///Start recording a frame, overwriting the oldest if the buffer is full
+  void BeginFrame(unsigned long iTime);
+  ///Finish the frame begun by the last BeginFrame
+  void EndFrame();
+  ///Add time to a phase of the current frame
+  void AddPhase(Phase phase, std::chrono::steady_clock::time_point tStart, std::chrono::steady_clock::time_point tEnd);
+
+  ///Number of complete frames held (at most the capacity)
+  unsigned int GetNumFrames() const {return m_iCount;}
+  unsigned int GetCapacity() const {return static_cast<unsigned int>(m_vFrames.size());}
+  ///The i'th complete frame held, oldest (0) first
+  const SFrame &GetFrame(unsigned int i) const;
+  ///Copies all complete frames held, oldest first
+  void GetFrames(std::vector<SFrame> &vFrames) const;
+  ///Forget all frames
+  void Clear();
+
+  ///Writes the frames held, oldest first, as CSV with a header line:
+  /// frame, time, start and total ms, then ms for each phase.
+  void Dump(std::ostream &out) const;
+
+  ///Times a phase from construction to destruction
+  class ScopedPhase {
+  public:
+    ScopedPhase(CFrameProfiler *pProfiler, Phase phase)
+    : m_pProfiler(pProfiler), m_phase(phase), m_tStart(std::chrono::steady_clock::now()) {}
+    ~ScopedPhase() {m_pProfiler->AddPhase(m_phase, m_tStart, std::chrono::steady_clock::now());}
+  private:
+    CFrameProfiler * const m_pProfiler;
+    const Phase m_phase;
+    const std::chrono::steady_clock::time_point m_tStart;
+  };
+
+  ///Times a frame from construction to destruction
+  class ScopedFrame {
+  public:
+    ScopedFrame(CFrameProfiler *pProfiler, unsigned long iTime) : m_pProfiler(pProfiler) {m_pProfiler->BeginFrame(iTime);}
+    ~ScopedFrame() {m_pProfiler->EndFrame();}
+  private:
+    CFrameProfiler * const m_pProfiler;
+  };
+
+private:
+  double MsSinceEpoch(std::chrono::steady_clock::time_point t) const {
+    return std::chrono::duration<double, std::milli>(t - m_tEpoch).count();
+  }
+
+  const std::chrono::steady_clock::time_point m_tEpoch;
+  std::vector<SFrame> m_vFrames;
+  ///Index of the slot for the next frame, and number of complete frames before it
+  unsigned int m_iNext, m_iCount;
+  unsigned long m_iNumFrames;
+  bool m_bInFrame;
+};
+/// \}
+}
+
+/// DASHER_PROFILE_FRAME(pProfiler, iTime) and DASHER_PROFILE_PHASE(pProfiler, phase)
+/// time the rest of the enclosing scope as the current frame, or a phase of it.
+#ifdef DASHER_FRAME_PROFILER
+#define DASHER_PROFILE_CONCAT2(a, b) a##b
+#define DASHER_PROFILE_CONCAT(a, b) DASHER_PROFILE_CONCAT2(a, b)
+#define DASHER_PROFILE_FRAME(pProfiler, iTime) \
+  Dasher::CFrameProfiler::ScopedFrame DASHER_PROFILE_CONCAT(profileFrame_, __LINE__)(pProfiler, iTime)
+#define DASHER_PROFILE_PHASE(pProfiler, phase) \
+  Dasher::CFrameProfiler::ScopedPhase DASHER_PROFILE_CONCAT(profilePhase_, __LINE__)(pProfiler, Dasher::CFrameProfiler::phase)
+#else
+#define DASHER_PROFILE_FRAME(pProfiler, iTime)
+#define DASHER_PROFILE_PHASE(pProfiler, phase)
+#endif
@@ -24,11 +24,13 @@
 
 //#include "stdafx.h"
 #include "CTWLanguageModel.h"
+#include <algorithm>
 #include <cstddef>
 #include <cstring>
 #include <cstdint>
 #include <cmath>
 #include "HashTable.h"
+#include "../MemoryReport.h"
 
 using namespace Dasher;
 
@@ -332,6 +334,25 @@ void CCTWLanguageModel::LearnSymbol(Context CurContext, int Symbol)
 }
 
 void CCTWLanguageModel::GetProbs(Context context, std::vector<unsigned int> &Probs, int Norm, int iUniform) const
+{
+	Probs.resize(GetSize());
+	vector<int> Index;
+	vector<unsigned short int> Interval;
+	GetProbsRow(context, &Probs[0], Norm, iUniform, Index, Interval);
+}
+
+size_t CCTWLanguageModel::GetProbsBatch(const Context *pContexts, size_t iNumContexts, std::vector<unsigned int> &Probs, int Norm, int iUniform) const
+{	// as GetProbs, but with the working arrays allocated once for all contexts
+	const int iNumSymbols = GetSize();
+	Probs.resize(iNumContexts * iNumSymbols);
+	vector<int> Index;
+	vector<unsigned short int> Interval;
+	for (size_t i = 0; i < iNumContexts; i++)
+		GetProbsRow(pContexts[i], &Probs[i * iNumSymbols], Norm, iUniform, Index, Interval);
+	return iNumSymbols;
+}
+
+void CCTWLanguageModel::GetProbsRow(Context context, unsigned int *Probs, int Norm, int iUniform, vector<int> &Index, vector<unsigned short int> &Interval) const
 {   	// because we reuse findpath and updatepath function, we need to de-const the object :(
 	// findpath should be declared const anyway (?)
 
@@ -343,13 +364,13 @@ void CCTWLanguageModel::GetProbs(Context context, std::vector<unsigned int> &Pro
 	int iNumSymbols = GetSize();
 	int MinProb = iUniform / iNumSymbols; //smallest probability to assign
 
-	Probs.resize(iNumSymbols);
 	int pLeft = 0;
 
 	// calculate probabilities of all possible symbols. Again assume all 2^NrPhases
-	int *Index = new int[LocalContext.Context.size()+1]; // +1 for the rootnode
+	Index.resize(LocalContext.Context.size()+1); // +1 for the rootnode
+	int *pIndex = &Index[0];
 
-	vector <unsigned short int>Interval((1<<(NrPhases+1))-1); // number of rootnodes*2 (1 prob for bit 0 and 1 each)
+	Interval.assign((1<<(NrPhases+1))-1, 0); // number of rootnodes*2 (1 prob for bit 0 and 1 each)
 	if (Norm>65535)
 	{
 		Interval[0]=65535; // to prevent overflow
@@ -372,10 +393,10 @@ void CCTWLanguageModel::GetProbs(Context context, std::vector<unsigned int> &Pro
 		for (int steps = 0;steps < 1<<phase;steps++)
 		{ // find the path for all needed symbols
 			// FIXME now I round up to next power of 2
-			ValidDepth = self->FindPath(LocalContext, steps*stepsize, phase, 0, Index); // Find indices of the nodes for this phase and context
+			ValidDepth = self->FindPath(LocalContext, steps*stepsize, phase, 0, pIndex); // Find indices of the nodes for this phase and context
 
 			IntervalB = Interval[(1<<phase)+ steps - 1];
-			self->UpdatePath(0,0, ValidDepth, Index, Pw0, Pw1);
+			self->UpdatePath(0,0, ValidDepth, pIndex, Pw0, Pw1);
 
 			IntervalZ = (IntervalB * Pw0)/(uint64_t)(Pw0+Pw1); // flooring, influence of flooring P0 instead of P1 is negligible
 			IntervalO = IntervalB - IntervalZ;
@@ -398,10 +419,9 @@ void CCTWLanguageModel::GetProbs(Context context, std::vector<unsigned int> &Pro
 			Interval[(1<<(phase+1))+ 2*steps] = static_cast<unsigned short int>(IntervalO);
 		} // for steps
 	} // for phase
-	delete [] Index;
 
 	// Copy the intervals associated with the actual symbols to the vector Probs.
-	Probs.assign((Interval.end()-(1ULL<NrPhases)), (Interval.end()-(1ULL<<NrPhases)+iNumSymbols));
+	std::copy(Interval.end()-(1<<NrPhases), Interval.end()-(1<<NrPhases)+iNumSymbols, Probs);
 	pLeft +=Probs[0]; //symbol 0 is a special dummy symbol, should get prob. 0
 	Probs[0] = 0;
 
@@ -420,8 +440,13 @@ void CCTWLanguageModel::GetProbs(Context context, std::vector<unsigned int> &Pro
 		pLeft -= p;
 	}
 
-} // end function GetProbs
+} // end function GetProbsRow
+
 
+void CCTWLanguageModel::ReportMemory(CMemoryReport &report) const
+{
+	report.Add(CMemoryReport::MEM_LANGUAGE_MODEL, "CCTWLanguageModel::CCTWNode", TotalNodes, MaxNrNodes * sizeof(CCTWNode));
+}
 
 bool CCTWLanguageModel::WriteToFile(std::string strFilename, std::string AlphabetName){
 	SLMFileHeader GenericHeader;
@@ -47,6 +47,10 @@ namespace Dasher {
     virtual void EnterSymbol(Context context, int Symbol); 
 	virtual void LearnSymbol(Context context, int Symbol); 	
 	virtual void GetProbs(Context context, std::vector < unsigned int >&Probs, int Norm, int iUniform) const; 
+	// Reuses the working arrays across all the contexts
+	virtual size_t GetProbsBatch(const Context *pContexts, size_t iNumContexts, std::vector < unsigned int >&Probs, int Norm, int iUniform) const;
+	// Reports the node table (allocated in full up-front); contexts are not tracked
+	void ReportMemory(CMemoryReport &report) const override;
 
     unsigned int MaxDepth;	// Maximum depth of the tree
 	int MaxTries;	// Determines how many times to try to find an empty index for a new node (max number of collisions)
@@ -118,6 +122,9 @@ namespace Dasher {
 	// Returns depth of found path. ``Create'' specifies whether non-existing nodes need to be
 	// created (LearnSymbol) or not (GetProbs).
 
+	void GetProbsRow(Context context, unsigned int *Probs, int Norm, int iUniform, vector<int> &Index, vector<unsigned short int> &Interval) const;
+	// GetProbs for one context into Probs[0..GetSize()-1], using Index and Interval as working space
+
 	void Scale(uint64_t & a, uint64_t & b);
 	// Scales both inputs to fit in NrBits
 
@@ -0,0 +1,448 @@
+// CompactPPMLanguageModel.cpp
+//
+/////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2024 The Dasher Team
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include "CompactPPMLanguageModel.h"
+#include "PPMSnapshotLanguageModel.h"
+#include "../MemoryReport.h"
+
+#include <algorithm>
+#include <climits>
+#include <fstream>
+#include <myassert.h>
+
+using namespace Dasher;
+
+#define MAX_RUN 4
+
+static_assert(sizeof(int32_t) == sizeof(Dasher::symbol), "CCompactPPMLanguageModel::SNode assumes 32-bit symbols");
+
+CCompactPPMLanguageModel::CCompactPPMLanguageModel(CSettingsStore *pSettingsStore, int iNumSyms)
+: CLanguageModel(iNumSyms), m_pSettingsStore(pSettingsStore),
+  m_iAlpha(pSettingsStore->GetLongParameter(LP_LM_ALPHA)), m_iBeta(pSettingsStore->GetLongParameter(LP_LM_BETA)),
+  m_iMaxOrder(pSettingsStore->GetLongParameter(LP_LM_MAX_ORDER)),
+  bUpdateExclusion(pSettingsStore->GetLongParameter(LP_LM_UPDATE_EXCLUSION) != 0), m_ContextAlloc(1024) {
+  static_assert(sizeof(SNode) <= 32, "compact PPM nodes should take at most half a cache line");
+  m_vNodes.reserve(8192);
+  MakeNode(0); //sentinel: index 0 means "no node"
+  MakeNode(-1); //root
+  m_pSettingsStore->OnParameterChanged.Subscribe(this, [this](Parameter parameter) {
+    if (parameter == LP_LM_ALPHA)
+      m_iAlpha = m_pSettingsStore->GetLongParameter(LP_LM_ALPHA);
+    else if (parameter == LP_LM_BETA)
+      m_iBeta = m_pSettingsStore->GetLongParameter(LP_LM_BETA);
+  });
+}
+
+CCompactPPMLanguageModel::~CCompactPPMLanguageModel() {
+  m_pSettingsStore->OnParameterChanged.Unsubscribe(this);
+}
+
+CCompactPPMLanguageModel::NodeIdx CCompactPPMLanguageModel::MakeNode(symbol sym) {
+  SNode node;
+  node.vine = 0;
+  node.iChildren = 0;
+  node.iNumChildSlots = 0;
+  node.sym = sym;
+  node.count = 1;
+  m_vNodes.push_back(node);
+  return static_cast<NodeIdx>(m_vNodes.size() - 1);
+}
+
+CLanguageModel::Context CCompactPPMLanguageModel::CreateEmptyContext() {
+  SContext *pCont = m_ContextAlloc.Alloc();
+  pCont->head = iRoot;
+  pCont->order = 0;
+  return reinterpret_cast<Context>(pCont);
+}
+
+CLanguageModel::Context CCompactPPMLanguageModel::CloneContext(Context context) {
+  SContext *pCont = m_ContextAlloc.Alloc();
+  *pCont = *reinterpret_cast<SContext *>(context);
+  return reinterpret_cast<Context>(pCont);
+}
+
+void CCompactPPMLanguageModel::ReleaseContext(Context context) {
+  m_ContextAlloc.Free(reinterpret_cast<SContext *>(context));
+}
+
+/////////////////////////////////////////////////////////////////////
+// Child tables: as CAbstractPPM::CPPMnode::find_symbol / AddChild
+
+CCompactPPMLanguageModel::NodeIdx CCompactPPMLanguageModel::FindSymbol(NodeIdx iNode, symbol sym) const {
+  const SNode &node = m_vNodes[iNode];
+  if (node.iNumChildSlots < 0) //direct indexing
+    return m_vSlots[node.iChildren + sym];
+  if (node.iNumChildSlots == 0)
+    return 0;
+  if (node.iNumChildSlots == 1)
+    return (m_vNodes[node.iChildren].sym == sym) ? node.iChildren : 0;
+  const NodeIdx *pSlots = m_vSlots.data() + node.iChildren;
+  if (node.iNumChildSlots <= MAX_RUN) {
+    for (int i = 0; i < node.iNumChildSlots && pSlots[i]; i++)
+      if (m_vNodes[pSlots[i]].sym == sym) return pSlots[i];
+    return 0;
+  }
+  for (int i = sym; ; i++) { //search through elements which have overflowed into subsequent slots
+    const NodeIdx iFound = pSlots[i % node.iNumChildSlots];
+    if (!iFound) return 0;
+    if (m_vNodes[iFound].sym == sym) return iFound;
+  }
+}
+
+uint32_t CCompactPPMLanguageModel::AllocSlots(int iNum) {
+  std::map<int, std::vector<uint32_t> >::iterator it = m_mapFreeSlots.find(iNum);
+  if (it != m_mapFreeSlots.end() && !it->second.empty()) {
+    const uint32_t iStart = it->second.back();
+    it->second.pop_back();
+    std::fill(m_vSlots.begin() + iStart, m_vSlots.begin() + iStart + iNum, 0);
+    return iStart;
+  }
+  const uint32_t iStart = static_cast<uint32_t>(m_vSlots.size());
+  m_vSlots.resize(m_vSlots.size() + iNum, 0);
+  return iStart;
+}
+
+void CCompactPPMLanguageModel::FreeSlots(uint32_t iStart, int iNum) {
+  m_mapFreeSlots[iNum].push_back(iStart);
+}
+
+void CCompactPPMLanguageModel::AddChild(NodeIdx iNode, NodeIdx iChild) {
+  //No nodes are created here, so this reference stays valid (m_vSlots may grow, though)
+  SNode &node = m_vNodes[iNode];
+  const symbol sym = m_vNodes[iChild].sym;
+  if (node.iNumChildSlots < 0) {
+    m_vSlots[node.iChildren + sym] = iChild;
+    return;
+  }
+  if (node.iNumChildSlots == 0) {
+    node.iNumChildSlots = 1;
+    node.iChildren = iChild;
+    return;
+  } else if (node.iNumChildSlots == 1) {
+    //no room, have to resize...
+  } else if (node.iNumChildSlots <= MAX_RUN) {
+    for (int i = 0; i < node.iNumChildSlots; i++)
+      if (!m_vSlots[node.iChildren + i]) {
+        m_vSlots[node.iChildren + i] = iChild;
+        return;
+      }
+  } else {
+    NodeIdx *pSlots = m_vSlots.data() + node.iChildren;
+    const int iSlots = node.iNumChildSlots;
+    int start = sym;
+    //find length of run (including to-be-inserted element)....
+    while (pSlots[start = (start + iSlots - 1) % iSlots]);
+
+    int idx = sym;
+    while (pSlots[idx %= iSlots]) ++idx;
+    //found empty slot
+    int stop = idx;
+    while (pSlots[stop = (stop + 1) % iSlots]);
+
+    const int runLen = (iSlots + stop - (start + 1)) % iSlots;
+    if (runLen <= MAX_RUN) {
+      //ok, maintain size
+      pSlots[idx] = iChild;
+      return;
+    }
+  }
+  //resize!
+  const uint32_t iOldChildren = node.iChildren;
+  int oldSlots = node.iNumChildSlots;
+  int newNumElems;
+  if (node.iNumChildSlots >= GetSize() / 4) {
+    node.iNumChildSlots = -GetSize(); // negative = "use direct indexing"
+    newNumElems = GetSize();
+  } else {
+    node.iNumChildSlots += node.iNumChildSlots + 1;
+    newNumElems = node.iNumChildSlots;
+  }
+  node.iChildren = AllocSlots(newNumElems);
+  if (oldSlots == 1)
+    AddChild(iNode, iOldChildren);
+  else {
+    const int iFreed = oldSlots;
+    while (oldSlots-- > 0)
+      if (const NodeIdx iOld = m_vSlots[iOldChildren + oldSlots]) AddChild(iNode, iOld);
+    FreeSlots(iOldChildren, iFreed);
+  }
+  AddChild(iNode, iChild);
+}
+
+CCompactPPMLanguageModel::NodeIdx CCompactPPMLanguageModel::AddSymbolToNode(NodeIdx iNode, symbol sym) {
+  NodeIdx iReturn = FindSymbol(iNode, sym);
+
+  if (iReturn) {
+    if (m_vNodes[iReturn].count < USHRT_MAX) m_vNodes[iReturn].count++; // Truncate counts at storage limit
+    if (!bUpdateExclusion) {
+      //update vine contexts too. Guaranteed to exist if child does!
+      for (NodeIdx v = m_vNodes[iReturn].vine; v; v = m_vNodes[v].vine) {
+        DASHER_ASSERT(v == iRoot || m_vNodes[v].sym == sym);
+        if (m_vNodes[v].count < USHRT_MAX) m_vNodes[v].count++;
+      }
+    }
+  } else {
+    //symbol does not exist at this level
+    iReturn = MakeNode(sym); //count initialized to 1 but no vine
+    AddChild(iNode, iReturn);
+    //(recursion may reallocate m_vNodes, so don't hold a reference across it)
+    const NodeIdx iVine = (iNode == iRoot) ? iRoot : AddSymbolToNode(m_vNodes[iNode].vine, sym);
+    m_vNodes[iReturn].vine = iVine;
+  }
+
+  return iReturn;
+}
+
+/////////////////////////////////////////////////////////////////////
+// As CAbstractPPM::EnterSymbol & LearnSymbol
+
+void CCompactPPMLanguageModel::EnterSymbol(Context c, int Symbol) {
+  if (Symbol == 0)
+    return;
+
+  DASHER_ASSERT(Symbol >= 0 && Symbol < GetSize());
+
+  SContext &context = *reinterpret_cast<SContext *>(c);
+
+  while (context.head) {
+    if (context.order < m_iMaxOrder) { // Only try to extend the context if it's not going to make it too long
+      if (const NodeIdx iFound = FindSymbol(context.head, Symbol)) {
+        context.order++;
+        context.head = iFound;
+        return;
+      }
+    }
+    // If we can't extend the current context, follow vine to shorten it and try again
+    context.order--;
+    context.head = m_vNodes[context.head].vine;
+  }
+
+  context.head = iRoot;
+  context.order = 0;
+}
+
+void CCompactPPMLanguageModel::LearnSymbol(Context c, int Symbol) {
+  if (Symbol == 0)
+    return;
+
+  DASHER_ASSERT(Symbol >= 0 && Symbol < GetSize());
+  SContext &context = *reinterpret_cast<SContext *>(c);
+
+  context.head = AddSymbolToNode(context.head, Symbol);
+  context.order++;
+
+  while (context.order > m_iMaxOrder) {
+    context.head = m_vNodes[context.head].vine;
+    context.order--;
+  }
+  IncrementVersion();
+}
+
+bool CCompactPPMLanguageModel::GetContextKey(Context c, ContextKey &key) const {
+  if (!c) return false;
+  const SContext &context = *reinterpret_cast<const SContext *>(c);
+  key.iState = context.head;
+  key.iOrder = context.order;
+  return true;
+}
+
+/////////////////////////////////////////////////////////////////////
+
+void CCompactPPMLanguageModel::GetProbs(Context context, std::vector<unsigned int> &probs, int norm, int iUniform) const {
+  const SContext *pContext = reinterpret_cast<const SContext *>(context);
+
+  const int iNumSymbols = GetSize();
+  probs.resize(iNumSymbols);
+
+  unsigned int iToSpend = norm;
+  unsigned int iUniformLeft = iUniform;
+
+  probs[0] = 0;
+  for (int i = 1; i < iNumSymbols; i++) {
+    probs[i] = iUniformLeft / (iNumSymbols - i);
+    iUniformLeft -= probs[i];
+    iToSpend -= probs[i];
+  }
+
+  DASHER_ASSERT(iUniformLeft == 0);
+
+  //Same arithmetic as CPPMLanguageModel::GetProbs (which never applies exclusions)
+  for (NodeIdx iNode = pContext->head; iNode; iNode = m_vNodes[iNode].vine) {
+    int iLen;
+    const NodeIdx *pChildren = Children(m_vNodes[iNode], iLen);
+
+    int iTotal = 0;
+    for (int i = 0; i < iLen; i++)
+      if (pChildren[i]) iTotal += m_vNodes[pChildren[i]].count;
+
+    if (iTotal) {
+      const unsigned int size_of_slice = iToSpend;
+      for (int i = 0; i < iLen; i++) {
+        if (!pChildren[i]) continue;
+        const SNode &child = m_vNodes[pChildren[i]];
+        const unsigned int p = static_cast<myint>(size_of_slice) * (100 * child.count - m_iBeta) / (100 * iTotal + m_iAlpha);
+        probs[child.sym] += p;
+        iToSpend -= p;
+      }
+    }
+  }
+
+  const unsigned int size_of_slice = iToSpend;
+  const int symbolsleft = iNumSymbols - 1;
+
+  for (int i = 1; i < iNumSymbols; i++) {
+    const unsigned int p = size_of_slice / symbolsleft;
+    probs[i] += p;
+    iToSpend -= p;
+  }
+
+  int iLeft = iNumSymbols - 1;
+
+  for (int i = 1; i < iNumSymbols; i++) {
+    const unsigned int p = iToSpend / iLeft;
+    probs[i] += p;
+    --iLeft;
+    iToSpend -= p;
+  }
+
+  DASHER_ASSERT(iToSpend == 0);
+}
+
+/////////////////////////////////////////////////////////////////////
+// Snapshots: same format, and node numbering, as CPPMLanguageModel
+
+void CCompactPPMLanguageModel::ReportMemory(CMemoryReport &report) const {
+  report.Add(CMemoryReport::MEM_LANGUAGE_MODEL, "CCompactPPMLanguageModel::SNode", GetNumNodes(), CMemoryReport::VectorBytes(m_vNodes));
+  size_t iFreeListBytes = 0;
+  for (const auto &it : m_mapFreeSlots)
+    iFreeListBytes += CMemoryReport::TreeNodeBytes<std::pair<const int, std::vector<uint32_t> > >() + CMemoryReport::VectorBytes(it.second);
+  report.Add(CMemoryReport::MEM_LANGUAGE_MODEL, "CCompactPPMLanguageModel child slots", 0, CMemoryReport::VectorBytes(m_vSlots) + iFreeListBytes);
+  report.Add(CMemoryReport::MEM_CONTEXTS, "CCompactPPMLanguageModel::SContext", m_ContextAlloc.GetNumLive(), m_ContextAlloc.GetBytesReserved());
+}
+
+bool CCompactPPMLanguageModel::WriteToFile(std::string strFilename) {
+  using namespace PPMSnapshot;
+
+  //Breadth-first numbering; snapshot index of each of our nodes (the sentinel is unused)
+  std::vector<uint32_t> vIdx(m_vNodes.size(), iNoNode);
+  std::vector<NodeIdx> vOrder(1, iRoot);
+  std::vector<uint32_t> vFirstChild, vNumChildren;
+  vIdx[iRoot] = 0;
+  std::vector<NodeIdx> vChildren;
+  for (size_t i = 0; i < vOrder.size(); i++) {
+    int iLen;
+    const NodeIdx *pChildren = Children(m_vNodes[vOrder[i]], iLen);
+    vChildren.clear();
+    for (int c = 0; c < iLen; c++)
+      if (pChildren[c]) vChildren.push_back(pChildren[c]);
+    std::sort(vChildren.begin(), vChildren.end(), [this](NodeIdx a, NodeIdx b) {return m_vNodes[a].sym < m_vNodes[b].sym;});
+    vFirstChild.push_back(vChildren.empty() ? 0 : static_cast<uint32_t>(vOrder.size()));
+    vNumChildren.push_back(static_cast<uint32_t>(vChildren.size()));
+    for (NodeIdx iChild : vChildren) {
+      vIdx[iChild] = static_cast<uint32_t>(vOrder.size());
+      vOrder.push_back(iChild);
+    }
+  }
+
+  std::ofstream oOutputFile(strFilename.c_str(), std::ios::binary | std::ios::trunc);
+  if (!oOutputFile.is_open()) return false;
+
+  SHeader header;
+  header.iNumSyms = m_iNumSyms;
+  header.iMaxOrder = m_iMaxOrder;
+  header.iFlags = bUpdateExclusion ? iFlagUpdateExclusion : 0;
+  header.iNodeCount = static_cast<uint32_t>(vOrder.size());
+  WriteHeader(oOutputFile, header);
+
+  for (size_t i = 0; i < vOrder.size(); i++) {
+    const SNode &node = m_vNodes[vOrder[i]];
+    WriteNode(oOutputFile, node.vine ? vIdx[node.vine] : iNoNode, vFirstChild[i], vNumChildren[i], i ? node.sym : 0, node.count);
+  }
+
+  oOutputFile.close();
+  return !oOutputFile.fail();
+}
+
+bool CCompactPPMLanguageModel::ReadFromFile(std::string strFilename) {
+  using namespace PPMSnapshot;
+
+  //Only a freshly-constructed model can be loaded
+  if (m_vNodes.size() != iRoot + 1) return false;
+
+  CMappedFile file;
+  if (!file.Open(strFilename)) return false;
+  SHeader header;
+  const unsigned char *pNodes = Validate(file.Data(), file.Size(), header);
+  if (!pNodes || header.iNumSyms != static_cast<uint32_t>(m_iNumSyms)
+      || header.iMaxOrder != static_cast<uint32_t>(m_iMaxOrder)
+      || ((header.iFlags & iFlagUpdateExclusion) != 0) != bUpdateExclusion)
+    return false;
+
+  //Snapshot node i becomes our node iRoot+i
+  m_vNodes.reserve(iRoot + header.iNodeCount);
+  for (uint32_t i = 1; i < header.iNodeCount; i++)
+    MakeNode(Symbol(pNodes + i * iNodeSize));
+
+  for (uint32_t i = 0; i < header.iNodeCount; i++) {
+    const unsigned char *pRecord = pNodes + i * iNodeSize;
+    const NodeIdx iNode = iRoot + i;
+    m_vNodes[iNode].count = Count(pRecord);
+    m_vNodes[iNode].vine = i ? iRoot + Vine(pRecord) : 0;
+    const uint32_t iFirst = FirstChild(pRecord), iNum = NumChildren(pRecord);
+    for (uint32_t c = iFirst; c < iFirst + iNum; c++)
+      AddChild(iNode, iRoot + c);
+  }
+
+  IncrementVersion();
+  return true;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Equivalence with CPPMLanguageModel, as CAbstractPPM::eq
+
+bool CCompactPPMLanguageModel::eq(const CPPMLanguageModel *other) const {
+  typedef CAbstractPPM::CPPMnode CPPMnode;
+  std::map<NodeIdx, const CPPMnode *> equivs;
+  if (!eq(iRoot, other->m_pRoot, equivs)) return false;
+  //nodes paired off by position in the trie; now check their vines correspond too
+  for (std::map<NodeIdx, const CPPMnode *>::iterator it = equivs.begin(); it != equivs.end(); it++) {
+    const NodeIdx myVine = m_vNodes[it->first].vine;
+    const CPPMnode *oVine = it->second->vine;
+    if (!myVine || !oVine) {
+      if (!myVine && !oVine) continue;
+      return false;
+    }
+    std::map<NodeIdx, const CPPMnode *>::iterator found = equivs.find(myVine);
+    if (found == equivs.end() || found->second != oVine) return false;
+  }
+  return true;
+}
+
+bool CCompactPPMLanguageModel::eq(NodeIdx iNode, const CAbstractPPM::CPPMnode *pOther, std::map<NodeIdx, const CAbstractPPM::CPPMnode *> &equivs) const {
+  typedef CAbstractPPM::CPPMnode CPPMnode;
+  const SNode &node = m_vNodes[iNode];
+  if (node.sym != pOther->sym || node.count != pOther->count)
+    return false;
+  //compare children in symbol order
+  std::map<symbol, NodeIdx> thisCh;
+  std::map<symbol, const CPPMnode *> otherCh;
+  int iLen;
+  const NodeIdx *pChildren = Children(node, iLen);
+  for (int i = 0; i < iLen; i++)
+    if (pChildren[i]) thisCh[m_vNodes[pChildren[i]].sym] = pChildren[i];
+  for (CAbstractPPM::ChildIterator it = pOther->children(); it != pOther->end(); it++)
+    otherCh[(*it)->sym] = *it;
+  if (thisCh.size() != otherCh.size())
+    return false;
+  std::map<symbol, const CPPMnode *>::iterator it2 = otherCh.begin();
+  for (std::map<symbol, NodeIdx>::iterator it1 = thisCh.begin(); it1 != thisCh.end(); it1++, it2++)
+    if (!eq(it1->second, it2->second, equivs))
+      return false;
+  equivs.insert(std::make_pair(iNode, pOther));
+  return true;
+}
@@ -0,0 +1,132 @@
+// CompactPPMLanguageModel.h
+//
+/////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2024 The Dasher Team
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "../../Common/NoClones.h"
+#include "../../Common/Allocators/PooledAlloc.h"
+
+#include "DasherTypes.h"
+#include "LanguageModel.h"
+#include "PPMLanguageModel.h"
+#include "../SettingsStore.h"
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace Dasher {
+
+  ///
+  /// \ingroup LM
+  /// @{
+
+  /// PPM model with exactly the same trie, and hence exactly the same predictions, as
+  /// CPPMLanguageModel, but a more compact node layout: nodes live in one contiguous
+  /// arena and refer to each other (vine and children) by 32-bit index rather than
+  /// by pointer, and there is no vtable. Each node takes 20 bytes (vs. 40 for a
+  /// CPPMnode), so four nodes fit in a 64-byte cache line, and walking the vine chain
+  /// in GetProbs touches fewer lines.
+  ///
+  /// Child tables use the same scheme as CPPMnode (single child / short unordered run /
+  /// inline hash / direct index), but are ranges of a second arena of 32-bit slots;
+  /// ranges given up when a table grows are recycled by size.
+  ///
+  /// Selected by LP_LANGUAGE_MODEL_ID 5.
+  class CCompactPPMLanguageModel : public CLanguageModel, private NoClones {
+  public:
+    CCompactPPMLanguageModel(CSettingsStore *pSettingsStore, int iNumSyms);
+    ~CCompactPPMLanguageModel();
+
+    Context CreateEmptyContext();
+    Context CloneContext(Context context);
+    void ReleaseContext(Context context);
+
+    virtual void EnterSymbol(Context context, int Symbol);
+    virtual void LearnSymbol(Context context, int Symbol);
+
+    virtual void GetProbs(Context context, std::vector<unsigned int> &Probs, int iNorm, int iUniform) const;
+
+    ///Key is the context's head node index and order
+    bool GetContextKey(Context context, ContextKey &key) const;
+
+    ///Writes the trie as a PPMSnapshot; the file is byte-identical to that which
+    /// CPPMLanguageModel::WriteToFile would produce from the same training.
+    virtual bool WriteToFile(std::string strFilename);
+    virtual bool CanWriteToFile() const {return true;}
+    ///Rebuilds the trie from a PPMSnapshot; as CPPMLanguageModel::ReadFromFile, only
+    /// possible while the model is empty and if the snapshot's parameters match.
+    virtual bool ReadFromFile(std::string strFilename);
+
+    ///Checks that this model holds the same trie (symbols, counts, children and
+    /// vines) as a CPPMLanguageModel, i.e. that both will predict identically.
+    bool eq(const CPPMLanguageModel *other) const;
+
+    ///Number of trie nodes, including the root
+    size_t GetNumNodes() const {return m_vNodes.size() - 1;}
+    ///Bytes reserved by the node and child-slot arenas
+    size_t GetMemoryUsage() const {
+      return m_vNodes.capacity() * sizeof(SNode) + m_vSlots.capacity() * sizeof(uint32_t);
+    }
+
+    void ReportMemory(CMemoryReport &report) const override;
+
+  private:
+    ///Index of a node in m_vNodes; 0 is reserved to mean "no node".
+    typedef uint32_t NodeIdx;
+    static constexpr NodeIdx iRoot = 1;
+
+    struct SNode {
+      NodeIdx vine;
+      ///Depending on iNumChildSlots: (1) the single child, else start of the
+      /// child table in m_vSlots
+      uint32_t iChildren;
+      ///As CPPMnode::m_iNumChildSlots: negative => direct indexing by symbol;
+      /// 0/1 => no/single child; 2-MAX_RUN => unordered run; larger => inline hash.
+      int32_t iNumChildSlots;
+      symbol sym;
+      unsigned short count;
+    };
+
+    struct SContext {
+      NodeIdx head;
+      int order;
+    };
+
+    ///The used children of a node, as an array which may contain 0s
+    /// (valid only until the next change to the trie)
+    const NodeIdx *Children(const SNode &node, int &iLen) const {
+      iLen = abs(node.iNumChildSlots);
+      return (iLen <= 1) ? &node.iChildren : m_vSlots.data() + node.iChildren;
+    }
+
+    NodeIdx MakeNode(symbol sym);
+    NodeIdx FindSymbol(NodeIdx iNode, symbol sym) const;
+    void AddChild(NodeIdx iNode, NodeIdx iChild);
+    NodeIdx AddSymbolToNode(NodeIdx iNode, symbol sym);
+    uint32_t AllocSlots(int iNum);
+    void FreeSlots(uint32_t iStart, int iNum);
+
+    bool eq(NodeIdx iNode, const CAbstractPPM::CPPMnode *pOther, std::map<NodeIdx, const CAbstractPPM::CPPMnode *> &equivs) const;
+
+    CSettingsStore *m_pSettingsStore;
+    ///LP_LM_ALPHA and LP_LM_BETA, kept up-to-date by a parameter-change listener
+    int m_iAlpha, m_iBeta;
+    const int m_iMaxOrder;
+    const bool bUpdateExclusion;
+
+    std::vector<SNode> m_vNodes;
+    std::vector<uint32_t> m_vSlots;
+    ///Released ranges of m_vSlots, by length
+    std::map<int, std::vector<uint32_t> > m_mapFreeSlots;
+
+    CPooledAlloc<SContext> m_ContextAlloc;
+  };
+
+  /// @}
+}
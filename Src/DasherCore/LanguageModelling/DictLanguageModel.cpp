@@ -8,6 +8,7 @@
 
 #include "DictLanguageModel.h"
 #include "../Alphabet/AlphabetMap.h"
+#include "../MemoryReport.h"
 
 #include <climits>
 #include <fstream>
@@ -75,7 +76,12 @@ CDictLanguageModel::CDictnode * CDictLanguageModel::AddSymbolToNode(CDictnode *p
 /////////////////////////////////////////////////////////////////////
 
 CDictLanguageModel::CDictLanguageModel(CSettingsStore* pSettingsStore, const CAlphInfo *pAlph, const CAlphabetMap *pAlphMap)
-:CLanguageModel(pAlph->iEnd-1), m_pSettingsStore(pSettingsStore), m_pAlphMap(pAlphMap), NodesAllocated(0), max_order(0), m_NodeAlloc(8192), m_ContextAlloc(1024), m_pAlph(pAlph) {
+:CLanguageModel(pAlph->iEnd-1), m_pSettingsStore(pSettingsStore), m_pAlphMap(pAlphMap), NodesAllocated(0), max_order(0), m_bExclusion(pSettingsStore->GetLongParameter(LP_LM_EXCLUSION) == 1), m_vExclusions(GetSize()), m_NodeAlloc(8192), m_ContextAlloc(1024), m_pAlph(pAlph) {
+  m_pSettingsStore->OnParameterChanged.Subscribe(this, [this](Parameter parameter) {
+    if (parameter == LP_LM_EXCLUSION)
+      m_bExclusion = (m_pSettingsStore->GetLongParameter(LP_LM_EXCLUSION) == 1);
+  });
+
   m_pRoot = m_NodeAlloc.Alloc();
   m_pRoot->sbl = -1;
   m_rootcontext = new CDictContext(m_pRoot, 0);
@@ -86,8 +92,8 @@ CDictLanguageModel::CDictLanguageModel(CSettingsStore* pSettingsStore, const CAl
 
   std::string CurrentWord;
 
-  while(!DictFile.eof()) {
-    DictFile >> CurrentWord;
+  //(if the file is missing, there are no words, rather than never reaching eof)
+  while(DictFile >> CurrentWord) {
 
     CurrentWord = CurrentWord + " ";
 
@@ -109,6 +115,7 @@ CDictLanguageModel::CDictLanguageModel(CSettingsStore* pSettingsStore, const CAl
 }
 
 CDictLanguageModel::~CDictLanguageModel() {
+  m_pSettingsStore->OnParameterChanged.Unsubscribe(this);
 
   delete m_rootcontext;
 
@@ -158,6 +165,16 @@ int CDictLanguageModel::lookup_word_const(const std::string &w) const {
 /////////////////////////////////////////////////////////////////////
 // get the probability distribution at the context
 
+void CDictLanguageModel::ReportMemory(CMemoryReport &report) const {
+  report.Add(CMemoryReport::MEM_LANGUAGE_MODEL, "CDictLanguageModel::CDictnode", NodesAllocated, m_NodeAlloc.GetBytesReserved());
+  size_t iDictBytes = 0;
+  for (const auto &it : dict)
+    iDictBytes += CMemoryReport::TreeNodeBytes<std::pair<const std::string, int> >() + CMemoryReport::StringBytes(it.first);
+  report.Add(CMemoryReport::MEM_LANGUAGE_MODEL, "CDictLanguageModel dictionary", dict.size(), iDictBytes);
+  //excludes any heap storage of the contexts' current_word
+  report.Add(CMemoryReport::MEM_CONTEXTS, "CDictLanguageModel::CDictContext", m_ContextAlloc.GetNumLive(), m_ContextAlloc.GetBytesReserved());
+}
+
 void CDictLanguageModel::GetProbs(Context context, std::vector<unsigned int > &probs, int norm, int iUniform) const {
 
   const CDictLanguageModel::CDictContext * wordcontext = (const CDictContext *)(context);
@@ -166,15 +183,14 @@ void CDictLanguageModel::GetProbs(Context context, std::vector<unsigned int > &p
 
   probs.resize(iNumSymbols);
 
-  std::vector < bool > exclusions(iNumSymbols);
+  std::vector < bool > &exclusions(m_vExclusions);
+  exclusions.assign(iNumSymbols, false);
 
   int i;
-  for(i = 1; i < iNumSymbols; i++) {
+  for(i = 1; i < iNumSymbols; i++)
     probs[i] = 0;
-    exclusions[i] = false;
-  }
 
-  bool doExclusion = (m_pSettingsStore->GetLongParameter(LP_LM_EXCLUSION) == 1);
+  const bool doExclusion = m_bExclusion;
 
   unsigned int iToSpend = norm;
 
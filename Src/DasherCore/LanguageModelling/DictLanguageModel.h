@@ -32,12 +32,15 @@ namespace Dasher {
     void ReleaseContext(Context context);
     Context CloneContext(Context context);
 
+    ///Does no heap allocation (beyond sizing Probs) and no settings lookups
     virtual void GetProbs(Context Context, std::vector < unsigned int >&Probs, int iNorm, int iUniform) const;
 
     virtual void EnterSymbol(Context context, int Symbol);
     virtual void LearnSymbol(Context context, int Symbol) {
       EnterSymbol(context, Symbol);
     };                          // Never learn in this model
+
+    void ReportMemory(CMemoryReport &report) const override;
   protected:
     CSettingsStore* m_pSettingsStore;
 
@@ -102,6 +105,11 @@ namespace Dasher {
 
     int max_order;
 
+    ///LP_LM_EXCLUSION, kept up-to-date by a parameter-change listener
+    bool m_bExclusion;
+    ///Scratch space for GetProbs (one flag per symbol), to avoid allocating each call
+    mutable std::vector < bool > m_vExclusions;
+
     mutable CSimplePooledAlloc < CDictnode > m_NodeAlloc;
     CPooledAlloc < CDictContext > m_ContextAlloc;
   };
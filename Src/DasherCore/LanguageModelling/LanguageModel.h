@@ -16,6 +16,7 @@
 
 namespace Dasher {
   class CLanguageModel;
+  class CMemoryReport;
 }
 
 ///
@@ -33,7 +34,7 @@ public:
 
   /////////////////////////////////////////////////////////////////////////////
 
-  CLanguageModel(int iNumSyms) : m_iNumSyms(iNumSyms) {};
+  CLanguageModel(int iNumSyms) : m_iNumSyms(iNumSyms), m_iVersion(0) {};
 
   virtual ~CLanguageModel() {};
   
@@ -97,6 +98,61 @@ public:
 
   virtual void GetProbs(Context Context, std::vector < unsigned int >&Probs, int iNorm, int iUniform) const = 0;
 
+  ///
+  /// Get symbol probability distributions for several contexts at once, as consecutive
+  /// rows of one block: Probs is resized to iNumContexts rows, row i being what
+  /// GetProbs(pContexts[i], ...) would give. Subclasses may override to share work
+  /// (parameter lookups, buffers, etc.) across the batch; the default calls GetProbs for each.
+  /// \return the length of each row (i.e. of the vector GetProbs gives; usually GetSize())
+  ///
+
+  virtual size_t GetProbsBatch(const Context *pContexts, size_t iNumContexts, std::vector < unsigned int >&Probs, int iNorm, int iUniform) const {
+    std::vector<unsigned int> row;
+    size_t iRowLen = GetSize();
+    Probs.clear();
+    for (size_t i = 0; i < iNumContexts; i++) {
+      GetProbs(pContexts[i], row, iNorm, iUniform);
+      iRowLen = row.size();
+      Probs.insert(Probs.end(), row.begin(), row.end());
+    }
+    return iRowLen;
+  };
+
+  /// @}
+
+  /// @name Prediction caching
+  /// Recognising when different contexts must give the same predictions
+  /// @{
+
+  ///
+  /// The state of a context, as far as GetProbs is concerned (e.g. PPM trie node and order)
+  ///
+
+  struct ContextKey {
+    size_t iState;
+    int iOrder;
+    bool operator==(const ContextKey &other) const {return iState == other.iState && iOrder == other.iOrder;}
+  };
+
+  ///
+  /// Identify the state of a context: two contexts with equal keys, at the same
+  /// GetVersion(), give identical results from GetProbs (given the same parameters)
+  /// \return false if this model cannot do so (so predictions should not be shared)
+  ///
+
+  virtual bool GetContextKey(Context context, ContextKey &key) const {
+    return false;
+  };
+
+  ///
+  /// Incremented whenever the model changes in a way that might alter any predictions
+  /// (e.g. learning, pruning, loading). Only meaningful if GetContextKey is supported.
+  ///
+
+  unsigned long GetVersion() const {
+    return m_iVersion;
+  };
+
   /// @}
 
   /// @name Persistant storage
@@ -107,12 +163,51 @@ public:
     return false;
   };
 
+  ///True if WriteToFile can save this model, i.e. if it overrides it
+  virtual bool CanWriteToFile() const {
+    return false;
+  };
+
   virtual bool ReadFromFile(std::string strFilename) {
     return false;
   };
 
   /// @}
 
+  /// @name Parallel training
+  /// Learning separate parts of a corpus concurrently, then combining them
+  /// @{
+
+  ///
+  /// Create an empty model of the same kind and parameters, to learn part of a
+  /// corpus independently (e.g. on another thread) before MergeShard
+  /// \return NULL if this model does not support merging
+  ///
+
+  virtual CLanguageModel *CreateShard() const {
+    return NULL;
+  };
+
+  ///
+  /// Add everything learnt by a model from CreateShard into this one
+  /// \return false if the shard could not be merged (this model is unchanged)
+  ///
+
+  virtual bool MergeShard(const CLanguageModel *pShard) {
+    return false;
+  };
+
+  /// @}
+
+  ///
+  /// Add the memory used by the model (its tables, and contexts) to a report,
+  /// under CMemoryReport::MEM_LANGUAGE_MODEL and MEM_CONTEXTS respectively.
+  /// The default adds nothing.
+  ///
+
+  virtual void ReportMemory(CMemoryReport &report) const {
+  }
+
   ///
   /// Get the maximum useful context length for this language model
 
@@ -148,6 +243,14 @@ public:
 
   const int m_iNumSyms;
 
+  ///Subclasses supporting GetContextKey must call this whenever their predictions may change
+  void IncrementVersion() {
+    ++m_iVersion;
+  }
+
+ private:
+  unsigned long m_iVersion;
+
 };
 
 /// @}
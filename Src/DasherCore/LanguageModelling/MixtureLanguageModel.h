@@ -11,6 +11,9 @@
 #include "LanguageModel.h"
 #include "PPMLanguageModel.h"
 #include "DictLanguageModel.h"
+#include "myassert.h"
+#include "../MemoryReport.h"
+#include "../../Common/Allocators/PooledAlloc.h"
 
 //#include <iostream>
 #include <vector>
@@ -28,12 +31,10 @@ namespace Dasher {
     /////////////////////////////////////////////////////////////////////////////
 
     CMixtureLanguageModel(CSettingsStore* pSettingsStore, const CAlphInfo *pAlph, const CAlphabetMap *pAlphMap)
-    : CLanguageModel(pAlph->iEnd-1), m_pSettingsStore(pSettingsStore) {
+    : CLanguageModel(pAlph->iEnd-1), m_ContextAlloc(1024), m_pSettingsStore(pSettingsStore) {
 
       //      std::cout << m_pAlphabet << std::endl;
 
-      NextContext = 0;
-
       lma = new CPPMLanguageModel(m_pSettingsStore, m_iNumSyms);
       lmb = new CDictLanguageModel(m_pSettingsStore, pAlph, pAlphMap);
 
@@ -61,15 +62,15 @@ namespace Dasher {
 
     // Update context with a character - only modifies context
     virtual void EnterSymbol(CLanguageModel::Context context, int Symbol) {
-      lma->EnterSymbol(ContextMap.find(static_cast<const int>(context))->second->GetContextA(), Symbol);
-      lmb->EnterSymbol(ContextMap.find(static_cast<const int>(context))->second->GetContextB(), Symbol);
+      lma->EnterSymbol(GetContext(context).ca, Symbol);
+      lmb->EnterSymbol(GetContext(context).cb, Symbol);
     };
 
     // Add character to the language model at the current context and update the context 
     // - modifies both the context and the LanguageModel
     virtual void LearnSymbol(CLanguageModel::Context context, int Symbol) {
-      lma->LearnSymbol(ContextMap[static_cast<const int>(context)]->GetContextA(), Symbol);
-      lmb->LearnSymbol(ContextMap[static_cast<const int>(context)]->GetContextB(), Symbol);
+      lma->LearnSymbol(GetContext(context).ca, Symbol);
+      lmb->LearnSymbol(GetContext(context).cb, Symbol);
     };
 
     /////////////////////////////////////////////////////////////////////////////
@@ -83,58 +84,90 @@ namespace Dasher {
 
         Probs.resize(iNumSymbols);
 
-        std::vector < unsigned int >ProbsA(iNumSymbols);
-        std::vector < unsigned int >ProbsB(iNumSymbols);
+        // component distributions go into buffers kept between calls
+        std::vector < unsigned int >&ProbsA(m_vProbsA);
+        std::vector < unsigned int >&ProbsB(m_vProbsB);
+
+      // the components share what is left after the uniform part, which we add ourselves
+      // (not every component model implements iUniform)
+      int iNormA((iNorm - iUniform) * m_pSettingsStore->GetLongParameter(LP_LM_MIXTURE) / 100);
+      int iNormB(iNorm - iUniform - iNormA);
 
-      int iNormA(iNorm * m_pSettingsStore->GetLongParameter(LP_LM_MIXTURE) / 100);
-      int iNormB(iNorm - iNormA);
-      
-      // TODO: Fix uniform here
-        lma->GetProbs(ContextMap.find(static_cast<const int>(context))->second->GetContextA(), ProbsA, iNormA, 0);
-        lmb->GetProbs(ContextMap.find(static_cast<const int>(context))->second->GetContextB(), ProbsB, iNormB, 0);
+        lma->GetProbs(GetContext(context).ca, ProbsA, iNormA, 0);
+        lmb->GetProbs(GetContext(context).cb, ProbsB, iNormB, 0);
 
       for(int i(1); i < iNumSymbols; i++) {
         Probs[i] = ProbsA[i] + ProbsB[i];
-    }};
-
-  private:
-    CLanguageModel * lma;
-    CLanguageModel *lmb;
+    }
+      if (iUniform) AddUniform(&Probs[0], iUniform);
+    };
 
-    class CMixtureContext {
-    public:
-      CMixtureContext(CLanguageModel * _lma, CLanguageModel * _lmb):lma(_lma), lmb(_lmb) {
-        ca = lma->CreateEmptyContext();
-        cb = lmb->CreateEmptyContext();
-      };
+    // Get distributions for many contexts, by a batch call on each component model
+    virtual size_t GetProbsBatch(const CLanguageModel::Context *pContexts, size_t iNumContexts, std::vector < unsigned int >&Probs, int iNorm, int iUniform) const {
 
-    CMixtureContext(CLanguageModel * _lma, CLanguageModel * _lmb, CLanguageModel::Context _ca, CLanguageModel::Context _cb):lma(_lma), lmb(_lmb), ca(_ca), cb(_cb) {
-      };
+      std::vector < CLanguageModel::Context > &ContextsA(m_vContextsA), &ContextsB(m_vContextsB);
+      ContextsA.resize(iNumContexts);
+      ContextsB.resize(iNumContexts);
+      for(size_t i(0); i < iNumContexts; i++) {
+        ContextsA[i] = GetContext(pContexts[i]).ca;
+        ContextsB[i] = GetContext(pContexts[i]).cb;
+      }
 
-      ~CMixtureContext() {
-        lma->ReleaseContext(ca);
-        lmb->ReleaseContext(cb);
-      };
+      // split as GetProbs, so each row is identical to what it would give
+      int iNormA((iNorm - iUniform) * m_pSettingsStore->GetLongParameter(LP_LM_MIXTURE) / 100);
+      int iNormB(iNorm - iUniform - iNormA);
+
+      std::vector < unsigned int >&ProbsB(m_vProbsB);
+      const size_t iRowLen = lma->GetProbsBatch(ContextsA.data(), iNumContexts, Probs, iNormA, 0);
+      lmb->GetProbsBatch(ContextsB.data(), iNumContexts, ProbsB, iNormB, 0);
+      DASHER_ASSERT(ProbsB.size() == Probs.size());
+
+      for(size_t i(0); i < Probs.size(); i++)
+        Probs[i] += ProbsB[i];
+      if (iUniform)
+        for(size_t i(0); i < iNumContexts; i++)
+          AddUniform(&Probs[i * iRowLen], iUniform);
+      return iRowLen;
+    };
 
-      CLanguageModel::Context GetContextA() {
-        return ca;
-      }
+    ///Reports both component models, plus our own contexts
+    void ReportMemory(CMemoryReport &report) const override {
+      lma->ReportMemory(report);
+      lmb->ReportMemory(report);
+      report.Add(CMemoryReport::MEM_CONTEXTS, "CMixtureLanguageModel::SMixtureContext", m_ContextAlloc.GetNumLive(), m_ContextAlloc.GetBytesReserved());
+    }
 
-      CLanguageModel::Context GetContextB() {
-        return cb;
+  private:
+    ///Spreads iUniform over symbols 1 to GetSize()-1 of a row, as CPPMLanguageModel does
+    void AddUniform(unsigned int *pRow, int iUniform) const {
+      const int iNumSymbols = GetSize();
+      unsigned int iUniformLeft = iUniform;
+      for(int i(1); i < iNumSymbols; i++) {
+        const unsigned int p = iUniformLeft / (iNumSymbols - i);
+        pRow[i] += p;
+        iUniformLeft -= p;
       }
+    }
 
-    private:
-      CLanguageModel * lma;
-      CLanguageModel *lmb;
+    CLanguageModel * lma;
+    CLanguageModel *lmb;
 
+    ///A context in each component model. Handles given out are pointers to these,
+    /// from a pooled allocator, so need no lookup and are reused once released.
+    struct SMixtureContext {
       CLanguageModel::Context ca;
       CLanguageModel::Context cb;
     };
 
-    int NextContext;
+    SMixtureContext &GetContext(CLanguageModel::Context context) const {
+      return *reinterpret_cast<SMixtureContext *>(context);
+    }
 
-    std::map < int, CMixtureContext * >ContextMap;
+    CPooledAlloc < SMixtureContext > m_ContextAlloc;
+
+    ///Scratch space for GetProbs/GetProbsBatch, kept to avoid allocating on every call
+    mutable std::vector < unsigned int > m_vProbsA, m_vProbsB;
+    mutable std::vector < CLanguageModel::Context > m_vContextsA, m_vContextsB;
 
     CSettingsStore* m_pSettingsStore;
   };
@@ -143,29 +176,29 @@ namespace Dasher {
 ///////////////////////////////////////////////////////////////////
 
   inline CLanguageModel::Context CMixtureLanguageModel::CreateEmptyContext() {
-    CMixtureContext *pCont = new CMixtureContext(lma, lmb);
-    ContextMap[NextContext] = pCont;
-    ++NextContext;
-    return NextContext - 1;
+    SMixtureContext *pCont = m_ContextAlloc.Alloc();
+    pCont->ca = lma->CreateEmptyContext();
+    pCont->cb = lmb->CreateEmptyContext();
+    return reinterpret_cast<CLanguageModel::Context>(pCont);
   }
 
 ///////////////////////////////////////////////////////////////////
 
   inline CLanguageModel::Context CMixtureLanguageModel::CloneContext(CLanguageModel::Context Copy) {
-    CMixtureContext *pCopy = ContextMap[static_cast<const int>(Copy)];
-    CMixtureContext *pCont = new CMixtureContext(lma, lmb, lma->CloneContext(pCopy->GetContextA()), lmb->CloneContext(pCopy->GetContextB()));
-
-    ContextMap[NextContext] = pCont;
-    ++NextContext;
-    return NextContext - 1;
+    const SMixtureContext &copy(GetContext(Copy));
+    SMixtureContext *pCont = m_ContextAlloc.Alloc();
+    pCont->ca = lma->CloneContext(copy.ca);
+    pCont->cb = lmb->CloneContext(copy.cb);
+    return reinterpret_cast<CLanguageModel::Context>(pCont);
   }
 
 ///////////////////////////////////////////////////////////////////
 
   inline void CMixtureLanguageModel::ReleaseContext(CLanguageModel::Context release) {
-    // m_ContextAlloc.Free( (CMixtureContext*) release );
-    delete ContextMap[static_cast<const int>(release)];
-    ContextMap[static_cast<const int>(release)] = NULL;
+    SMixtureContext &context(GetContext(release));
+    lma->ReleaseContext(context.ca);
+    lmb->ReleaseContext(context.cb);
+    m_ContextAlloc.Free(&context);
   }
 }
 
@@ -7,8 +7,14 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include "PPMLanguageModel.h"
+#include "PPMSnapshotLanguageModel.h"
+#include "../MemoryReport.h"
 
+#include <algorithm>
+#include <climits>
 #include <cstring>
+#include <unordered_map>
+#include <unordered_set>
 #include <myassert.h>
 
 using namespace Dasher;
@@ -16,103 +22,84 @@ using namespace Dasher;
 /////////////////////////////////////////////////////////////////////
 
 CAbstractPPM::CAbstractPPM(CSettingsStore* pSettingsStore, int iNumSyms, CPPMnode *pRoot, int iMaxOrder)
-: CLanguageModel(iNumSyms), m_pRoot(pRoot), m_pSettingsStore(pSettingsStore), m_iMaxOrder(iMaxOrder<0 ? m_pSettingsStore->GetLongParameter(LP_LM_MAX_ORDER) : iMaxOrder), bUpdateExclusion(m_pSettingsStore->GetLongParameter(LP_LM_UPDATE_EXCLUSION)!=0 ), m_ContextAlloc(1024) {
-  m_pRootContext = m_ContextAlloc.Alloc();
-  m_pRootContext->head = m_pRoot;
-  m_pRootContext->order = 0;
-}
-
-bool CAbstractPPM::isValidContext(const Context context) const {
-  return m_setContexts.count((const CPPMContext *)context) > 0;
+: CLanguageModel(iNumSyms), m_RootContext(pRoot, 0), m_pRoot(pRoot), m_pSettingsStore(pSettingsStore), m_iMaxOrder(iMaxOrder<0 ? m_pSettingsStore->GetLongParameter(LP_LM_MAX_ORDER) : iMaxOrder), bUpdateExclusion(m_pSettingsStore->GetLongParameter(LP_LM_UPDATE_EXCLUSION)!=0 ), m_iChildTableBytes(0) {
 }
 
 /////////////////////////////////////////////////////////////////////
 // Get the probability distribution at the context
 
 void CPPMLanguageModel::GetProbs(Context context, std::vector<unsigned int> &probs, int norm, int iUniform) const {
-  const CPPMContext *ppmcontext = (const CPPMContext *)(context);
+  const CPPMContext &ppmcontext(GetContext(context));
 
-  DASHER_ASSERT(isValidContext(context));
+  probs.resize(GetSize());
 
+  GetProbsRow(ppmcontext.head, &probs[0], norm, iUniform, m_iAlpha, m_iBeta);
+}
+
+size_t CPPMLanguageModel::GetProbsBatch(const Context *pContexts, size_t iNumContexts, std::vector<unsigned int> &probs, int norm, int iUniform) const {
+  const int iNumSymbols = GetSize();
+  probs.resize(iNumContexts * iNumSymbols);
+
+  for (size_t i = 0; i < iNumContexts; i++) {
+    const CPPMnode *pHead = GetContext(pContexts[i]).head;
+    unsigned int *pRow = &probs[i * iNumSymbols];
+    //predictions depend only on the head node, which is often shared (e.g. by a group
+    // node and its parent); if so, copy the row already computed
+    size_t j = 0;
+    while (j < i && GetContext(pContexts[j]).head != pHead) j++;
+    if (j < i)
+      std::copy(&probs[j * iNumSymbols], &probs[j * iNumSymbols] + iNumSymbols, pRow);
+    else
+      GetProbsRow(pHead, pRow, norm, iUniform, m_iAlpha, m_iBeta);
+  }
+  return iNumSymbols;
+}
+
+void CPPMLanguageModel::GetProbsRow(const CPPMnode *pHead, unsigned int *probs, int norm, int iUniform, int alpha, int beta) const {
   int iNumSymbols = GetSize();
-  
-  probs.resize(iNumSymbols);
 
-  std::vector < bool > exclusions(iNumSymbols);
-  
   unsigned int iToSpend = norm;
   unsigned int iUniformLeft = iUniform;
 
   // TODO: Sort out zero symbol case
   probs[0] = 0;
-  exclusions[0] = false;
 
   for (int i = 1; i < iNumSymbols; i++) {
     probs[i] = iUniformLeft / (iNumSymbols - i);
     iUniformLeft -= probs[i];
     iToSpend -= probs[i];
-    exclusions[i] = false;
   }
 
   DASHER_ASSERT(iUniformLeft == 0);
 
-  //  bool doExclusion = GetLongParameter( LP_LM_ALPHA );
-  bool doExclusion = 0; //FIXME
-
-  int alpha = m_pSettingsStore->GetLongParameter( LP_LM_ALPHA );
-  int beta = m_pSettingsStore->GetLongParameter( LP_LM_BETA );
+  //Exclusion (ignoring, in lower-order contexts, symbols already seen in higher ones)
+  // used to be here, but was never enabled (doExclusion was always 0), so every symbol
+  // takes part at every order.
 
-  for (CPPMnode *pTemp = ppmcontext->head; pTemp; pTemp=pTemp->vine) {
+  for (const CPPMnode *pTemp = pHead; pTemp; pTemp=pTemp->vine) {
     int iTotal = 0;
 
-    for (ChildIterator pSymbol = pTemp->children(); pSymbol != pTemp->end(); pSymbol++) {
-      symbol sym = (*pSymbol)->sym;
-      if(!(exclusions[sym] && doExclusion))
-        iTotal += (*pSymbol)->count;
-    }
+    for (ChildIterator pSymbol = pTemp->children(); pSymbol != pTemp->end(); pSymbol++)
+      iTotal += (*pSymbol)->count;
 
     if(iTotal) {
       unsigned int size_of_slice = iToSpend;
       for (ChildIterator pSymbol = pTemp->children(); pSymbol != pTemp->end(); pSymbol++) {
-        if(!(exclusions[(*pSymbol)->sym] && doExclusion)) {
-          exclusions[(*pSymbol)->sym] = 1;
+        unsigned int p = static_cast < myint > (size_of_slice) * (100 * (*pSymbol)->count - beta) / (100 * iTotal + alpha);
 
-          unsigned int p = static_cast < myint > (size_of_slice) * (100 * (*pSymbol)->count - beta) / (100 * iTotal + alpha);
-
-          probs[(*pSymbol)->sym] += p;
-          iToSpend -= p;
-        }
-        //                              Usprintf(debug,TEXT("sym %u counts %d p %u tospend %u \n"),sym,s->count,p,tospend);      
-        //                              DebugOutput(debug);
+        probs[(*pSymbol)->sym] += p;
+        iToSpend -= p;
       }
     }
   }
 
   unsigned int size_of_slice = iToSpend;
-  int symbolsleft = 0;
-
-  for(int i = 1; i < iNumSymbols; i++)
-    if(!(exclusions[i] && doExclusion))
-      symbolsleft++;
-
-//      std::ostringstream str;
-//      for (sym=0;sym<modelchars;sym++)
-//              str << probs[sym] << " ";
-//      str << std::endl;
-//      DASHER_TRACEOUTPUT("probs %s",str.str().c_str());
-
-//      std::ostringstream str2;
-//      for (sym=0;sym<modelchars;sym++)
-//              str2 << valid[sym] << " ";
-//      str2 << std::endl;
-//      DASHER_TRACEOUTPUT("valid %s",str2.str().c_str());
+  int symbolsleft = iNumSymbols - 1;
 
   for(int i = 1; i < iNumSymbols; i++) {
-    if(!(exclusions[i] && doExclusion)) {
-      unsigned int p = size_of_slice / symbolsleft;
-      probs[i] += p;
-      iToSpend -= p;
-    }
+    unsigned int p = size_of_slice / symbolsleft;
+    probs[i] += p;
+    iToSpend -= p;
   }
 
   int iLeft = iNumSymbols-1;
@@ -136,7 +123,7 @@ void CAbstractPPM::EnterSymbol(Context c, int Symbol) {
 
   DASHER_ASSERT(Symbol >= 0 && Symbol < GetSize());
 
-  CPPMContext & context = *(CPPMContext *) (c);
+  CPPMContext & context = GetContext(c);
 
   while(context.head) {
 
@@ -178,7 +165,7 @@ void CAbstractPPM::LearnSymbol(Context c, int Symbol) {
   
 
   DASHER_ASSERT(Symbol >= 0 && Symbol < GetSize());
-  CPPMContext & context = *(CPPMContext *) (c);
+  CPPMContext & context = GetContext(c);
   
   CPPMnode* n = AddSymbolToNode(context.head, Symbol);
   DASHER_ASSERT ( n == context.head->find_symbol(Symbol));
@@ -404,6 +391,13 @@ void CAbstractPPM::CPPMnode::AddChild(CPPMnode *pNewChild, int numSymbols) {
   }
 }
 
+void CAbstractPPM::CPPMnode::ClearChildren() {
+  if (m_iNumChildSlots != 1)
+    delete[] m_ppChildren;
+  m_ppChildren = NULL;
+  m_iNumChildSlots = 0;
+}
+
 CAbstractPPM::CPPMnode * CAbstractPPM::AddSymbolToNode(CPPMnode *pNode, symbol sym) {
 
   CPPMnode *pReturn = pNode->find_symbol(sym);
@@ -411,165 +405,265 @@ CAbstractPPM::CPPMnode * CAbstractPPM::AddSymbolToNode(CPPMnode *pNode, symbol s
   //      std::cout << sym << ",";
 
   if(pReturn != NULL) {
-    pReturn->count++;
+    if (pReturn->count < USHRT_MAX) pReturn->count++; // Truncate counts at storage limit
     if (!bUpdateExclusion) {
       //update vine contexts too. Guaranteed to exist if child does!
       for (CPPMnode *v = pReturn->vine; v; v=v->vine) {
         DASHER_ASSERT(v == m_pRoot || v->sym == sym);
-        v->count++;
+        if (v->count < USHRT_MAX) v->count++;
       }
     }
   } else {
     //symbol does not exist at this level
     pReturn = makeNode(sym); //count initialized to 1 but no vine pointer
-    pNode->AddChild(pReturn, GetSize());
+    AddChild(pNode, pReturn);
     pReturn->vine = (pNode==m_pRoot) ? m_pRoot : AddSymbolToNode(pNode->vine,sym);
   }
   
   return pReturn;
 }
 
+void CAbstractPPM::ReportMemory(CMemoryReport &report) const {
+  size_t iInUse = 0;
+  ForEachContext([&iInUse](const CPPMContext &) {++iInUse;});
+  report.Add(CMemoryReport::MEM_CONTEXTS, "CAbstractPPM::CPPMContext", iInUse,
+             CMemoryReport::VectorBytes(m_vContextSlots) + CMemoryReport::VectorBytes(m_vFreeContextSlots));
+  report.Add(CMemoryReport::MEM_LANGUAGE_MODEL, "CAbstractPPM child tables", 0, m_iChildTableBytes);
+}
+
 CPPMLanguageModel::CPPMLanguageModel(CSettingsStore* pSettingsStore, int iNumSyms)
-: CAbstractPPM(pSettingsStore, iNumSyms, new CPPMnode(-1)), NodesAllocated(0), m_NodeAlloc(8192) {
+: CAbstractPPM(pSettingsStore, iNumSyms, new CPPMnode(-1)),
+  m_iAlpha(pSettingsStore->GetLongParameter(LP_LM_ALPHA)), m_iBeta(pSettingsStore->GetLongParameter(LP_LM_BETA)), NodesAllocated(0),
+  m_iMemoryLimit(static_cast<size_t>(std::max(0l, pSettingsStore->GetLongParameter(LP_LM_MEMORY_LIMIT))) * 1024), m_NodeAlloc(8192) {
+  m_pSettingsStore->OnParameterChanged.Subscribe(this, [this](Parameter parameter) {
+    if (parameter == LP_LM_ALPHA)
+      m_iAlpha = m_pSettingsStore->GetLongParameter(LP_LM_ALPHA);
+    else if (parameter == LP_LM_BETA)
+      m_iBeta = m_pSettingsStore->GetLongParameter(LP_LM_BETA);
+  });
+}
+
+CPPMLanguageModel::~CPPMLanguageModel() {
+  m_pSettingsStore->OnParameterChanged.Unsubscribe(this);
 }
 
 CAbstractPPM::CPPMnode *CPPMLanguageModel::makeNode(int sym) {
   CPPMnode *res = m_NodeAlloc.Alloc();
+  //may be recycled from pruning, so reinitialize
   res->sym = sym;
+  res->count = 1;
+  res->vine = NULL;
+  res->m_ppChildren = NULL;
+  res->m_iNumChildSlots = 0;
   ++NodesAllocated;
   return res;
 }
 
-struct BinaryRecord {
-  int m_iIndex;
-  int m_iChild;
-  int m_iNext;
-  int m_iVine;
-  unsigned short int m_iCount;
-  short int m_iSymbol;
-};
-
-bool CPPMLanguageModel::WriteToFile(std::string strFilename) {
-
-  std::map<CPPMnode *, int> mapIdx;
-  int iNextIdx(1); // Index of 0 means NULL;
-
-  std::ofstream oOutputFile(strFilename.c_str());
-
-  RecursiveWrite(m_pRoot, NULL, &mapIdx, &iNextIdx, &oOutputFile);
-
-  oOutputFile.close();
-
-  return false;
+void CPPMLanguageModel::ReportMemory(CMemoryReport &report) const {
+  CAbstractPPM::ReportMemory(report);
+  //the root is allocated separately, all other nodes from the pool
+  report.Add(CMemoryReport::MEM_LANGUAGE_MODEL, "CAbstractPPM::CPPMnode", NodesAllocated + 1, (NodesAllocated + 1) * sizeof(CPPMnode));
+  report.Add(CMemoryReport::MEM_LANGUAGE_MODEL, "CPooledAlloc<CPPMnode> (free)", 0,
+             m_NodeAlloc.GetBytesReserved() - NodesAllocated * sizeof(CPPMnode));
 }
 
-bool CPPMLanguageModel::RecursiveWrite(CPPMnode *pNode, CPPMnode *pNextSibling, std::map<CPPMnode *, int> *pmapIdx, int *pNextIdx, std::ofstream *pOutputFile) {
-
-  // Dump node here
+void CPPMLanguageModel::LearnSymbol(Context context, int Symbol) {
+  CAbstractPPM::LearnSymbol(context, Symbol);
+  if (m_iMemoryLimit && GetMemoryUsage() > m_iMemoryLimit)
+    EnforceMemoryLimit();
+  IncrementVersion();
+}
 
-  BinaryRecord sBR;
+bool CPPMLanguageModel::GetContextKey(Context context, ContextKey &key) const {
+  if (!context) return false;
+  const CPPMContext &ppmcontext(GetContext(context));
+  key.iState = reinterpret_cast<size_t>(ppmcontext.head);
+  key.iOrder = ppmcontext.order;
+  return true;
+}
 
-  sBR.m_iIndex = GetIndex(pNode, pmapIdx, pNextIdx); 
-  sBR.m_iNext = GetIndex(pNextSibling, pmapIdx, pNextIdx); 
-  sBR.m_iVine = GetIndex(pNode->vine, pmapIdx, pNextIdx);
-  sBR.m_iCount = pNode->count;
-  sBR.m_iSymbol = pNode->sym;
+void CPPMLanguageModel::EnforceMemoryLimit() {
+  if (!m_iMemoryLimit) return;
+  while (GetMemoryUsage() > m_iMemoryLimit / 4 * 3)
+    if (HalveAndPrune() == 0) break;
+}
 
-  ChildIterator it =pNode->children();
-  CPPMnode *pCurrentChild = (it == pNode->end()) ? NULL : *it++;
-  sBR.m_iChild = GetIndex(pCurrentChild, pmapIdx, pNextIdx); 
-  
-  pOutputFile->write(reinterpret_cast<char*>(&sBR), sizeof(BinaryRecord));
+size_t CPPMLanguageModel::HalveAndPrune() {
+  //Nodes by depth (root at 0). The trie is pruned deepest-first, so that a node can
+  // be removed once its children have been; and a node is kept if any deeper node
+  // which survives uses it as a vine.
+  std::vector<std::vector<CPPMnode *> > vLevels(1, std::vector<CPPMnode *>(1, m_pRoot));
+  for (;;) {
+    std::vector<CPPMnode *> vNext;
+    for (CPPMnode *pNode : vLevels.back())
+      for (ChildIterator it = pNode->children(); it != pNode->end(); it++)
+        vNext.push_back(*it);
+    if (vNext.empty()) break;
+    vLevels.push_back(vNext);
+  }
 
-  if (pCurrentChild) {
-    for (CPPMnode *pNextChild; it != pNode->end(); pCurrentChild = pNextChild) {
-      pNextChild = *it++;
-      RecursiveWrite(pCurrentChild, pNextChild, pmapIdx, pNextIdx, pOutputFile);
+  std::unordered_set<const CPPMnode *> setKeep;
+  ForEachContext([&setKeep](const CPPMContext &context) {setKeep.insert(context.head);});
+
+  size_t iPruned = 0;
+  std::unordered_set<const CPPMnode *> setVines, setNextVines;
+  std::vector<CPPMnode *> vSurvivors;
+  for (size_t d = vLevels.size() - 1; d > 0; d--) {
+    //Halve counts at this depth, marking prunable nodes by clearing their vine...
+    setNextVines.clear();
+    for (CPPMnode *pNode : vLevels[d]) {
+      pNode->count >>= 1;
+      if (pNode->count == 0 && pNode->children() == pNode->end()
+          && !setVines.count(pNode) && !setKeep.count(pNode)) {
+        pNode->vine = NULL;
+      } else {
+        if (pNode->count == 0) pNode->count = 1;
+        setNextVines.insert(pNode->vine);
+      }
+    }
+    setVines.swap(setNextVines);
+    //...then rebuild the child tables of their parents without them.
+    for (CPPMnode *pParent : vLevels[d - 1]) {
+      vSurvivors.clear();
+      bool bPruned = false;
+      for (ChildIterator it = pParent->children(); it != pParent->end(); it++) {
+        if ((*it)->vine) vSurvivors.push_back(*it);
+        else bPruned = true;
+      }
+      if (!bPruned) continue;
+      m_iChildTableBytes -= pParent->ChildTableBytes();
+      pParent->ClearChildren();
+      for (CPPMnode *pChild : vSurvivors)
+        AddChild(pParent, pChild);
     }
-    RecursiveWrite(pCurrentChild, NULL, pmapIdx, pNextIdx, pOutputFile);
+    for (CPPMnode *pNode : vLevels[d])
+      if (!pNode->vine) {
+        m_NodeAlloc.Free(pNode);
+        --NodesAllocated;
+        ++iPruned;
+      }
   }
-
-  return true;
+  return iPruned;
 }
 
-int CPPMLanguageModel::GetIndex(CPPMnode *pAddr, std::map<CPPMnode *, int> *pmapIdx, int *pNextIdx) {
-
-  int iIndex;
-  if(pAddr == NULL)
-    iIndex = 0;
-  else {
-    std::map<CPPMnode *, int>::iterator it(pmapIdx->find(pAddr));
-    
-    if(it == pmapIdx->end()) {
-      iIndex = *pNextIdx;
-      pmapIdx->insert(std::pair<CPPMnode *, int>(pAddr, iIndex));
-      ++(*pNextIdx);
-    }
-    else {
-      iIndex = it->second;
+bool CPPMLanguageModel::WriteToFile(std::string strFilename) {
+  using namespace PPMSnapshot;
+
+  //Number nodes breadth-first, so that each node's children are contiguous
+  // (and sorted by symbol); see PPMSnapshot for the layout.
+  std::vector<CPPMnode *> vNodes(1, m_pRoot);
+  std::vector<uint32_t> vFirstChild, vNumChildren;
+  std::unordered_map<const CPPMnode *, uint32_t> mapIdx;
+  mapIdx[m_pRoot] = 0;
+  std::vector<CPPMnode *> vChildren;
+  for (size_t i = 0; i < vNodes.size(); i++) {
+    vChildren.clear();
+    for (ChildIterator it = vNodes[i]->children(); it != vNodes[i]->end(); it++)
+      vChildren.push_back(*it);
+    std::sort(vChildren.begin(), vChildren.end(), [](const CPPMnode *a, const CPPMnode *b) {return a->sym < b->sym;});
+    vFirstChild.push_back(vChildren.empty() ? 0 : static_cast<uint32_t>(vNodes.size()));
+    vNumChildren.push_back(static_cast<uint32_t>(vChildren.size()));
+    for (CPPMnode *pChild : vChildren) {
+      mapIdx[pChild] = static_cast<uint32_t>(vNodes.size());
+      vNodes.push_back(pChild);
     }
   }
-  return iIndex;
+
+  std::ofstream oOutputFile(strFilename.c_str(), std::ios::binary | std::ios::trunc);
+  if (!oOutputFile.is_open()) return false;
+
+  SHeader header;
+  header.iNumSyms = m_iNumSyms;
+  header.iMaxOrder = m_iMaxOrder;
+  header.iFlags = bUpdateExclusion ? iFlagUpdateExclusion : 0;
+  header.iNodeCount = static_cast<uint32_t>(vNodes.size());
+  WriteHeader(oOutputFile, header);
+
+  for (size_t i = 0; i < vNodes.size(); i++) {
+    const CPPMnode *pNode = vNodes[i];
+    const uint32_t iVine = pNode->vine ? mapIdx[pNode->vine] : iNoNode;
+    WriteNode(oOutputFile, iVine, vFirstChild[i], vNumChildren[i], i ? pNode->sym : 0, pNode->count);
+  }
+
+  oOutputFile.close();
+  return !oOutputFile.fail();
 }
 
 bool CPPMLanguageModel::ReadFromFile(std::string strFilename) {
-  
-  std::ifstream oInputFile(strFilename.c_str());
-  //map from file index, to address of node object with that index
-  std::map<int, CPPMnode*> oMap;
-  //map from file index, to address of *parent* for that node
-  // - only stored for the child that will *next* be read.
-  std::map<int, CPPMnode *> parentMap;
-  BinaryRecord sBR;
-  bool bStarted(false);
-
-  while(!oInputFile.eof()) {
-    oInputFile.read(reinterpret_cast<char *>(&sBR), sizeof(BinaryRecord));
-
-    CPPMnode *pCurrent(GetAddress(sBR.m_iIndex, &oMap));
-
-    pCurrent->vine = GetAddress(sBR.m_iVine, &oMap);
-    pCurrent->count = sBR.m_iCount;
-    pCurrent->sym = sBR.m_iSymbol;
-
-    //if this node has a parent...
-    std::map<int,CPPMnode *>::iterator it(parentMap.find(sBR.m_iIndex));
-    if (it != parentMap.end()) {
-      CPPMnode *parent = it->second;
-      parent->AddChild(pCurrent,GetSize());
-      //erase the record of parent hood, now we've realized it
-      parentMap.erase(it);
-      //add mapping for the _next_ sibling; since siblings will be read in the order
-      // they were written out, when the next sibling is read it will find the mapping.
-      if (sBR.m_iNext) parentMap.insert(std::pair<int,CPPMnode *>(sBR.m_iNext,parent));
-    }
-    
-    //if the node has children, record for the benefit of the first child
-    // this node's address...(said child will be the first one read)
-    if (sBR.m_iChild) parentMap.insert(std::pair<int,CPPMnode *>(sBR.m_iChild, pCurrent));
-    
-    if(!bStarted) {
-      m_pRoot = pCurrent;
-      bStarted = true;
-    }
+  using namespace PPMSnapshot;
+
+  //Only a freshly-constructed model can be loaded
+  if (m_pRoot->children() != m_pRoot->end()) return false;
+
+  CMappedFile file;
+  if (!file.Open(strFilename)) return false;
+  SHeader header;
+  const unsigned char *pNodes = Validate(file.Data(), file.Size(), header);
+  //The trie shape depends on max order and update exclusion, so these must match
+  if (!pNodes || header.iNumSyms != static_cast<uint32_t>(m_iNumSyms)
+      || header.iMaxOrder != static_cast<uint32_t>(m_iMaxOrder)
+      || ((header.iFlags & iFlagUpdateExclusion) != 0) != bUpdateExclusion)
+    return false;
+
+  std::vector<CPPMnode *> vNodes(header.iNodeCount);
+  vNodes[0] = m_pRoot;
+  for (uint32_t i = 1; i < header.iNodeCount; i++)
+    vNodes[i] = makeNode(Symbol(pNodes + i * iNodeSize));
+
+  for (uint32_t i = 0; i < header.iNodeCount; i++) {
+    const unsigned char *pRecord = pNodes + i * iNodeSize;
+    CPPMnode *pNode = vNodes[i];
+    pNode->count = Count(pRecord);
+    //Validate() guarantees the root has no vine, and every other vine is in range
+    pNode->vine = i ? vNodes[Vine(pRecord)] : NULL;
+    const uint32_t iFirst = FirstChild(pRecord), iNum = NumChildren(pRecord);
+    for (uint32_t c = iFirst; c < iFirst + iNum; c++)
+      AddChild(pNode, vNodes[c]);
   }
 
-  oInputFile.close();
+  EnforceMemoryLimit();
+  IncrementVersion();
+  return true;
+}
 
-  return false;
+CLanguageModel *CPPMLanguageModel::CreateShard() const {
+  CPPMLanguageModel *pShard = new CPPMLanguageModel(m_pSettingsStore, m_iNumSyms);
+  //A shard built with different settings couldn't be merged back in
+  if (pShard->m_iMaxOrder != m_iMaxOrder || pShard->bUpdateExclusion != bUpdateExclusion) {
+    delete pShard;
+    return NULL;
+  }
+  return pShard;
 }
 
-CPPMLanguageModel::CPPMnode *CPPMLanguageModel::GetAddress(int iIndex, std::map<int, CPPMnode*> *pMap) {
-  if (iIndex==0) return NULL;
-  std::map<int, CPPMnode*>::iterator it(pMap->find(iIndex));
+bool CPPMLanguageModel::MergeShard(const CLanguageModel *pShard) {
+  const CPPMLanguageModel *pOther = static_cast<const CPPMLanguageModel *>(pShard);
+  if (pOther->m_iNumSyms != m_iNumSyms || pOther->m_iMaxOrder != m_iMaxOrder || pOther->bUpdateExclusion != bUpdateExclusion)
+    return false;
 
-  if(it == pMap->end()) {
-    CPPMnode *pNewNode;
-    pNewNode = m_NodeAlloc.Alloc();
-    pMap->insert(std::pair<int, CPPMnode*>(iIndex, pNewNode));
-    return pNewNode;
-  }
-  else {
-    return it->second;
+  //Walk the shard breadth-first, pairing each of its nodes with one of ours. A new
+  // node's vine is the same symbol's child of its parent's vine, which being one
+  // level shallower will already have been merged.
+  std::vector<std::pair<const CPPMnode *, CPPMnode *> > vQueue(1, std::make_pair(pOther->m_pRoot, m_pRoot));
+  for (size_t i = 0; i < vQueue.size(); i++) {
+    const CPPMnode *pFrom = vQueue[i].first;
+    CPPMnode *pTo = vQueue[i].second;
+    for (ChildIterator it = pFrom->children(); it != pFrom->end(); it++) {
+      const CPPMnode *pChild = *it;
+      CPPMnode *pMerged = pTo->find_symbol(pChild->sym);
+      if (pMerged) {
+        pMerged->count = static_cast<unsigned short>(std::min<int>(USHRT_MAX, pMerged->count + pChild->count));
+      } else {
+        pMerged = makeNode(pChild->sym);
+        pMerged->count = pChild->count;
+        pMerged->vine = (pTo == m_pRoot) ? m_pRoot : pTo->vine->find_symbol(pChild->sym);
+        DASHER_ASSERT(pMerged->vine);
+        AddChild(pTo, pMerged);
+      }
+      vQueue.push_back(std::make_pair(pChild, pMerged));
+    }
   }
+  EnforceMemoryLimit();
+  IncrementVersion();
+  return true;
 }
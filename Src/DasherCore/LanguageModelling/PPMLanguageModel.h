@@ -15,12 +15,14 @@
 #include "LanguageModel.h"
 #include "../SettingsStore.h"
 #include "stdlib.h"
+#include "myassert.h"
 #include <vector>
 #include <fstream>
 #include <set>
 #include <map>
 
 namespace Dasher {
+  class CCompactPPMLanguageModel;
 
   ///
   /// \ingroup LM
@@ -35,6 +37,8 @@ namespace Dasher {
   /// using a pooled allocator).
   ///
   class CAbstractPPM : public CLanguageModel, private NoClones {
+    ///Compares its own tries against ours (eq)
+    friend class CCompactPPMLanguageModel;
   protected:
     class ChildIterator;
     class CPPMnode {
@@ -54,6 +58,12 @@ namespace Dasher {
       ChildIterator children() const;
       const ChildIterator end() const;
       void AddChild(CPPMnode *pNewChild, int numSymbols);
+      ///Forgets all children (without deleting them), freeing any child table
+      void ClearChildren();
+      ///Heap memory used by the child table (0 for zero or one children)
+      size_t ChildTableBytes() const {
+        return (m_iNumChildSlots == 0 || m_iNumChildSlots == 1) ? 0 : abs(m_iNumChildSlots) * sizeof(CPPMnode *);
+      }
       CPPMnode * find_symbol(symbol sym)const;
       CPPMnode *vine;
       unsigned short int count;
@@ -103,17 +113,56 @@ namespace Dasher {
     /// \param iMaxOrder max order of model; anything <0 means to use LP_LM_MAX_ORDER.
     CAbstractPPM(CSettingsStore* pSettingsStore, int iNumSyms, CPPMnode *pRoot, int iMaxOrder=-1);
           
+    ///Adds a child to a node, keeping m_iChildTableBytes up-to-date
+    void AddChild(CPPMnode *pParent, CPPMnode *pChild) {
+      const size_t iBefore = pParent->ChildTableBytes();
+      pParent->AddChild(pChild, GetSize());
+      m_iChildTableBytes += pParent->ChildTableBytes() - iBefore;
+    }
+
     void dumpSymbol(symbol sym);
     void dumpString(char *str, int pos, int len);
     void dumpTrie(CPPMnode * t, int d);
     
-    CPPMContext *m_pRootContext;
+    CPPMContext m_RootContext;
     CPPMnode *m_pRoot;
     CSettingsStore* m_pSettingsStore;
     
     /// Cache parameters that don't make sense to adjust during the life of a language model...
     const int m_iMaxOrder; 
     const bool bUpdateExclusion;
+
+    ///Total heap memory used by child tables of all nodes
+    size_t m_iChildTableBytes;
+
+    ///The context a handle (from CreateEmptyContext/CloneContext) refers to. Valid only
+    /// until the next CreateEmptyContext or CloneContext, which may move the table.
+    CPPMContext &GetContext(Context c) {
+      DASHER_ASSERT(isValidContext(c));
+      return m_vContextSlots[(c & CONTEXT_INDEX_MASK) - 1].context;
+    }
+    const CPPMContext &GetContext(Context c) const {
+      DASHER_ASSERT(isValidContext(c));
+      return m_vContextSlots[(c & CONTEXT_INDEX_MASK) - 1].context;
+    }
+
+    ///Calls fn(const CPPMContext &) for every context currently in use (i.e. created and not released)
+    template<typename Fn> void ForEachContext(Fn fn) const {
+      for (const SContextSlot &slot : m_vContextSlots)
+        if (slot.iGeneration & 1) fn(slot.context);
+    }
+
+    ///Calls fn(const CPPMnode *) for every node in the trie, including the root
+    template<typename Fn> void ForEachNode(Fn fn) const {
+      std::vector<const CPPMnode *> vStack(1, m_pRoot);
+      while (!vStack.empty()) {
+        const CPPMnode *pNode = vStack.back();
+        vStack.pop_back();
+        fn(pNode);
+        for (ChildIterator it = pNode->children(); it != pNode->end(); ++it)
+          vStack.push_back(*it);
+      }
+    }
     
   public:
     virtual bool eq(CAbstractPPM *other);
@@ -126,14 +175,31 @@ namespace Dasher {
     virtual void EnterSymbol(Context context, int Symbol);
     virtual void LearnSymbol(Context context, int Symbol);
 
+    ///Reports the context table and the nodes' child tables; subclasses add the nodes themselves
+    void ReportMemory(CMemoryReport &report) const override;
+
     void dump();
+    ///Whether c is a handle to a context in use; O(1), but only DASHER_ASSERTed (i.e. in debug builds)
     bool isValidContext(const Context c) const ;
   private:
     CPPMnode *AddSymbolToNode(CPPMnode * pNode, symbol sym);
 
-    CPooledAlloc < CPPMContext > m_ContextAlloc;
-    
-    std::set<const CPPMContext *> m_setContexts;
+    ///Contexts are handed out as handles into a slot table: the low CONTEXT_INDEX_BITS
+    /// hold the slot index plus one (so no handle is nullContext), and the remaining
+    /// bits the slot's generation when allocated, so a stale handle can be detected.
+    static constexpr int CONTEXT_INDEX_BITS = (sizeof(Context) > 4) ? 32 : 20;
+    static constexpr Context CONTEXT_INDEX_MASK = (Context(1) << CONTEXT_INDEX_BITS) - 1;
+    struct SContextSlot {
+      CPPMContext context;
+      ///Incremented on every allocation and release, so odd iff in use
+      unsigned int iGeneration;
+    };
+    ///Takes a free slot (or a new one) and returns a handle to it; the context is uninitialized
+    Context AllocContext();
+
+    std::vector<SContextSlot> m_vContextSlots;
+    ///Indices of slots not in use
+    std::vector<unsigned int> m_vFreeContextSlots;
   };
 
   ///"Standard" PPM language model: GetProbs uses counts in PPM child nodes,
@@ -142,21 +208,67 @@ namespace Dasher {
   class CPPMLanguageModel : public CAbstractPPM {
   public:
     CPPMLanguageModel(CSettingsStore* pSettingsStore, int iNumSyms);
+    virtual ~CPPMLanguageModel();
+    ///Does no heap allocation (beyond sizing Probs) and no settings lookups
     virtual void GetProbs(Context context, std::vector < unsigned int >&Probs, int norm, int iUniform) const;
+    ///Computes each distinct head node only once
+    virtual size_t GetProbsBatch(const Context *pContexts, size_t iNumContexts, std::vector < unsigned int >&Probs, int norm, int iUniform) const;
+
+    ///Writes the trie as a snapshot (see PPMSnapshot), which can be memory-mapped
+    /// by CPPMSnapshotLanguageModel, or loaded back by ReadFromFile.
+    virtual bool WriteToFile(std::string strFilename);
+    virtual bool CanWriteToFile() const {return true;}
+    ///Rebuilds the trie from a snapshot. Fails (leaving the model untouched) unless this
+    /// model is still empty, and the snapshot matches its alphabet size, LP_LM_MAX_ORDER
+    /// and LP_LM_UPDATE_EXCLUSION.
+    virtual bool ReadFromFile(std::string strFilename);
+
+    ///Learns as CAbstractPPM, then enforces the memory limit (if any)
+    virtual void LearnSymbol(Context context, int Symbol);
+
+    ///Key is the context's head node and order. (Nodes may be reused after pruning,
+    /// but that only happens when learning, which increments the version.)
+    bool GetContextKey(Context context, ContextKey &key) const;
+
+    CLanguageModel *CreateShard() const;
+    ///Adds the shard's counts into ours, node by node, creating any nodes we lack.
+    /// Counts saturate rather than wrapping. Update exclusion will have been applied
+    /// within the shard only, so the result can have slightly higher counts in
+    /// lower-order contexts than learning the same text sequentially.
+    bool MergeShard(const CLanguageModel *pShard);
+
+    void ReportMemory(CMemoryReport &report) const override;
+
+    ///Bytes used by the trie: nodes (excluding the root) plus their child tables
+    size_t GetMemoryUsage() const {
+      return NodesAllocated * sizeof(CPPMnode) + m_iChildTableBytes;
+    }
   protected:
     /// Makes a standard CPPMnode, but using a pooled allocator (m_NodeAlloc) - faster!
+    /// (Nodes freed by pruning are reused.)
     virtual CPPMnode *makeNode(int sym);
-    
-    virtual bool WriteToFile(std::string strFilename);
-    virtual bool ReadFromFile(std::string strFilename);
   private:
-    int NodesAllocated;
+    ///GetProbs for the context with the given head, into probs[0..GetSize()-1]
+    void GetProbsRow(const CPPMnode *pHead, unsigned int *probs, int norm, int iUniform, int alpha, int beta) const;
+
+    ///If over the memory limit, repeatedly halves all counts and prunes leaves whose
+    /// count drops to zero, until usage is at most 3/4 of the limit (or nothing more
+    /// can be pruned). Nodes which are the head of a live context, or the vine of a
+    /// remaining node, are kept (with a count of at least 1).
+    void EnforceMemoryLimit();
+    ///One round of the above
+    /// \return number of nodes pruned
+    size_t HalveAndPrune();
+
+    ///LP_LM_ALPHA and LP_LM_BETA, kept up-to-date by a parameter-change listener
+    int m_iAlpha, m_iBeta;
 
-    bool RecursiveWrite(CPPMnode *pNode, CPPMnode *pNextSibling, std::map<CPPMnode *, int> *pmapIdx, int *pNextIdx, std::ofstream *pOutputFile);
-    int GetIndex(CPPMnode *pAddr, std::map<CPPMnode *, int> *pmapIdx, int *pNextIdx);
-    CPPMnode *GetAddress(int iIndex, std::map<int, CPPMnode*> *pMap);
+    ///Nodes currently allocated (and not pruned), excluding the root
+    size_t NodesAllocated;
+    ///Max bytes for GetMemoryUsage(), from LP_LM_MEMORY_LIMIT; 0 = unlimited
+    const size_t m_iMemoryLimit;
 
-    mutable CSimplePooledAlloc < CPPMnode > m_NodeAlloc;
+    CPooledAlloc < CPPMnode > m_NodeAlloc;
   };
 
   /// @}
@@ -192,30 +304,48 @@ namespace Dasher {
       delete[] m_ppChildren;
   }
 
-  inline CLanguageModel::Context CAbstractPPM::CreateEmptyContext() {
-    CPPMContext *pCont = m_ContextAlloc.Alloc();
-    *pCont = *m_pRootContext;
-
-    m_setContexts.insert(pCont);
+  inline CLanguageModel::Context CAbstractPPM::AllocContext() {
+    unsigned int iSlot;
+    if (m_vFreeContextSlots.empty()) {
+      iSlot = static_cast<unsigned int>(m_vContextSlots.size());
+      DASHER_ASSERT(iSlot < CONTEXT_INDEX_MASK);
+      m_vContextSlots.push_back(SContextSlot());
+      m_vContextSlots.back().iGeneration = 0;
+    } else {
+      iSlot = m_vFreeContextSlots.back();
+      m_vFreeContextSlots.pop_back();
+    }
+    const unsigned int iGeneration = ++m_vContextSlots[iSlot].iGeneration;
+    return (Context(iGeneration) << CONTEXT_INDEX_BITS) | (iSlot + 1);
+  }
 
-    return (Context) pCont;
+  inline CLanguageModel::Context CAbstractPPM::CreateEmptyContext() {
+    Context cont = AllocContext();
+    GetContext(cont) = m_RootContext;
+    return cont;
   }
 
   inline CLanguageModel::Context CAbstractPPM::CloneContext(Context Copy) {
-    CPPMContext *pCont = m_ContextAlloc.Alloc();
-    CPPMContext *pCopy = (CPPMContext *) Copy;
-    *pCont = *pCopy;
-
-    m_setContexts.insert(pCont);
-
-    return (Context) pCont;
+    //copy first, as allocating may move the slot table
+    const CPPMContext copy(GetContext(Copy));
+    Context cont = AllocContext();
+    GetContext(cont) = copy;
+    return cont;
   }
 
   inline void CAbstractPPM::ReleaseContext(Context release) {
+    DASHER_ASSERT(isValidContext(release));
+    const unsigned int iSlot = static_cast<unsigned int>((release & CONTEXT_INDEX_MASK) - 1);
+    ++m_vContextSlots[iSlot].iGeneration;
+    m_vFreeContextSlots.push_back(iSlot);
+  }
 
-    m_setContexts.erase(m_setContexts.find((CPPMContext *) release));
-
-    m_ContextAlloc.Free((CPPMContext *) release);
+  inline bool CAbstractPPM::isValidContext(const Context context) const {
+    const Context iIndex = context & CONTEXT_INDEX_MASK;
+    if (iIndex == 0 || iIndex > m_vContextSlots.size()) return false;
+    const unsigned int iGeneration = m_vContextSlots[iIndex - 1].iGeneration;
+    //compare only as many bits of the generation as the handle holds
+    return (iGeneration & 1) && (Context(iGeneration) << CONTEXT_INDEX_BITS) == (context & ~CONTEXT_INDEX_MASK);
   }
 }                               // end namespace Dasher
 
@@ -11,6 +11,7 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include "PPMPYLanguageModel.h"
+#include "../MemoryReport.h"
 #include "LanguageModel.h"
 #include "PPMLanguageModel.h"
 #include "DasherTypes.h"
@@ -160,7 +161,7 @@ void CPPMPYLanguageModel::GetPartProbs(Context context, std::vector<std::pair<sy
   //  std::cout<<"Norms is "<<norm<<std::endl;
   //  std::cout<<"iUniform is "<<iUniform<<std::endl;
 
-  const CPPMContext *ppmcontext = (const CPPMContext *)(context);
+  const CPPMContext *ppmcontext = &GetContext(context);
 
   //  DASHER_ASSERT(m_setContexts.count(ppmcontext) > 0);
 
@@ -270,7 +271,7 @@ void CPPMPYLanguageModel::GetPartProbs(Context context, std::vector<std::pair<sy
 // by an explicit cast to PPMPYLanguageModel whenever MandarinDasher was activated. Renaming
 // to GetProbs causes the normal (virtual) call to come straight here without any special-casing...
 void CPPMPYLanguageModel::GetProbs(Context context, std::vector<unsigned int> &probs, int norm, int iUniform) const {
-  const CPPMContext *ppmcontext = (const CPPMContext *)(context);
+  const CPPMContext *ppmcontext = &GetContext(context);
 
   //  std::cout<<"PPMCONTEXT symbol: "<<ppmcontext->head->symbol<<std::endl;
   /*
@@ -389,7 +390,7 @@ void CPPMPYLanguageModel::LearnPYSymbol(Context c, int pysym) {
     return;
 
   DASHER_ASSERT(pysym > 0 && pysym <= m_iNumPYsyms);
-  CPPMPYLanguageModel::CPPMContext & context = *(CPPMContext *) (c);
+  CPPMPYLanguageModel::CPPMContext & context = GetContext(c);
  
   //  std::cout<<"py learn context : "<<context.head->symbol<<std::endl;
   /*   CPPMPYnode * pNode = m_pRoot->child;
@@ -419,6 +420,18 @@ CPPMPYLanguageModel::CPPMPYnode *CPPMPYLanguageModel::makeNode(int sym) {
   return res;
 }
 
+void CPPMPYLanguageModel::ReportMemory(CMemoryReport &report) const {
+  CAbstractPPM::ReportMemory(report);
+  size_t iEntries = 0;
+  ForEachNode([&iEntries](const CPPMnode *pNode) {iEntries += static_cast<const CPPMPYnode *>(pNode)->pychild.size();});
+  //the root is allocated separately, all other nodes from the pool
+  report.Add(CMemoryReport::MEM_LANGUAGE_MODEL, "CPPMPYLanguageModel::CPPMPYnode", NodesAllocated + 1, (NodesAllocated + 1) * sizeof(CPPMPYnode));
+  report.Add(CMemoryReport::MEM_LANGUAGE_MODEL, "CSimplePooledAlloc<CPPMPYnode> (free)", 0,
+             m_NodeAlloc.GetBytesReserved() - NodesAllocated * sizeof(CPPMPYnode));
+  report.Add(CMemoryReport::MEM_LANGUAGE_MODEL, "CPPMPYLanguageModel::CPPMPYnode pinyin counts", iEntries,
+             iEntries * CMemoryReport::TreeNodeBytes<std::pair<const symbol, unsigned short int> >());
+}
+
 //Mandarin - PY not enabled for these read-write functions
 bool CPPMPYLanguageModel::WriteToFile(std::string strFilename) {
   return false;
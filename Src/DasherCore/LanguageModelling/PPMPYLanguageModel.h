@@ -64,6 +64,8 @@ namespace Dasher {
     virtual bool WriteToFile(std::string strFilename);
     virtual bool ReadFromFile(std::string strFilename);
 
+    void ReportMemory(CMemoryReport &report) const override;
+
   protected:
     class CPPMPYnode : public CPPMnode {
     public:
@@ -0,0 +1,239 @@
+// PPMSnapshotLanguageModel.cpp
+//
+/////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2024 The Dasher Team
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include "PPMSnapshotLanguageModel.h"
+#include "../MemoryReport.h"
+
+#include <cstring>
+#include <myassert.h>
+
+using namespace Dasher;
+using namespace Dasher::PPMSnapshot;
+
+void PPMSnapshot::WriteHeader(std::ostream &out, const SHeader &header) {
+  out.write(szMagic, sizeof(szMagic));
+  WriteLE16(out, iVersion);
+  WriteLE16(out, static_cast<uint16_t>(iHeaderSize));
+  WriteLE32(out, header.iNumSyms);
+  WriteLE32(out, header.iMaxOrder);
+  WriteLE32(out, header.iFlags);
+  WriteLE32(out, header.iNodeCount);
+  WriteLE32(out, 0);
+  WriteLE32(out, 0);
+}
+
+void PPMSnapshot::WriteNode(std::ostream &out, uint32_t iVine, uint32_t iFirstChild, uint32_t iNumChildren, symbol sym, unsigned short iCount) {
+  WriteLE32(out, iVine);
+  WriteLE32(out, iFirstChild);
+  WriteLE32(out, iNumChildren);
+  WriteLE32(out, static_cast<uint32_t>(sym));
+  WriteLE16(out, iCount);
+  WriteLE16(out, 0);
+}
+
+const unsigned char *PPMSnapshot::Validate(const unsigned char *pData, size_t iSize, SHeader &header) {
+  if (iSize < iHeaderSize || memcmp(pData, szMagic, sizeof(szMagic)) != 0) return NULL;
+  if (ReadLE16(pData + 4) != iVersion) return NULL;
+  const size_t iHdr = ReadLE16(pData + 6);
+  if (iHdr < iHeaderSize || iHdr > iSize) return NULL;
+
+  SHeader h;
+  h.iNumSyms = ReadLE32(pData + 8);
+  h.iMaxOrder = ReadLE32(pData + 12);
+  h.iFlags = ReadLE32(pData + 16);
+  h.iNodeCount = ReadLE32(pData + 20);
+  if (h.iNodeCount == 0 || h.iNodeCount == iNoNode) return NULL;
+  if (static_cast<uint64_t>(iSize - iHdr) != static_cast<uint64_t>(h.iNodeCount) * iNodeSize) return NULL;
+
+  const unsigned char *pNodes = pData + iHdr;
+  for (uint32_t i = 0; i < h.iNodeCount; i++) {
+    const unsigned char *pNode = pNodes + static_cast<size_t>(i) * iNodeSize;
+    const uint32_t iVine = Vine(pNode);
+    if (i == 0 ? iVine != iNoNode : iVine >= i) return NULL;
+    const uint32_t iNumChildren = NumChildren(pNode);
+    if (iNumChildren == 0) continue;
+    const uint32_t iFirst = FirstChild(pNode);
+    if (iFirst <= i || static_cast<uint64_t>(iFirst) + iNumChildren > h.iNodeCount) return NULL;
+    symbol prev = 0;
+    for (uint32_t c = iFirst; c < iFirst + iNumChildren; c++) {
+      const symbol sym = Symbol(pNodes + static_cast<size_t>(c) * iNodeSize);
+      if (sym <= prev || static_cast<uint32_t>(sym) > h.iNumSyms) return NULL;
+      prev = sym;
+    }
+  }
+  header = h;
+  return pNodes;
+}
+
+/////////////////////////////////////////////////////////////////////
+
+CPPMSnapshotLanguageModel::CPPMSnapshotLanguageModel(CSettingsStore *pSettingsStore, int iNumSyms)
+: CLanguageModel(iNumSyms), m_pSettingsStore(pSettingsStore),
+  m_iAlpha(pSettingsStore->GetLongParameter(LP_LM_ALPHA)), m_iBeta(pSettingsStore->GetLongParameter(LP_LM_BETA)),
+  m_pNodes(NULL), m_iMaxOrder(0), m_ContextAlloc(1024) {
+  m_header.iNumSyms = iNumSyms;
+  m_header.iMaxOrder = 0;
+  m_header.iFlags = 0;
+  m_header.iNodeCount = 0;
+  m_pSettingsStore->OnParameterChanged.Subscribe(this, [this](Parameter parameter) {
+    if (parameter == LP_LM_ALPHA)
+      m_iAlpha = m_pSettingsStore->GetLongParameter(LP_LM_ALPHA);
+    else if (parameter == LP_LM_BETA)
+      m_iBeta = m_pSettingsStore->GetLongParameter(LP_LM_BETA);
+  });
+}
+
+CPPMSnapshotLanguageModel::~CPPMSnapshotLanguageModel() {
+  m_pSettingsStore->OnParameterChanged.Unsubscribe(this);
+}
+
+bool CPPMSnapshotLanguageModel::ReadFromFile(std::string strFilename) {
+  //Existing contexts index into any previous snapshot, so cannot be carried across
+  DASHER_ASSERT(m_pNodes == NULL);
+  if (!m_file.Open(strFilename)) return false;
+  SHeader header;
+  const unsigned char *pNodes = Validate(m_file.Data(), m_file.Size(), header);
+  if (!pNodes || header.iNumSyms != static_cast<uint32_t>(m_iNumSyms)) {
+    m_file.Close();
+    return false;
+  }
+  m_header = header;
+  m_pNodes = pNodes;
+  m_iMaxOrder = static_cast<int>(header.iMaxOrder);
+  IncrementVersion();
+  return true;
+}
+
+bool CPPMSnapshotLanguageModel::GetContextKey(Context c, ContextKey &key) const {
+  if (!c) return false;
+  const SContext &context = *reinterpret_cast<const SContext *>(c);
+  key.iState = context.iHead;
+  key.iOrder = context.iOrder;
+  return true;
+}
+
+CLanguageModel::Context CPPMSnapshotLanguageModel::CreateEmptyContext() {
+  SContext *pCont = m_ContextAlloc.Alloc();
+  pCont->iHead = m_pNodes ? 0 : iNoNode;
+  pCont->iOrder = 0;
+  return reinterpret_cast<Context>(pCont);
+}
+
+CLanguageModel::Context CPPMSnapshotLanguageModel::CloneContext(Context context) {
+  SContext *pCont = m_ContextAlloc.Alloc();
+  *pCont = *reinterpret_cast<SContext *>(context);
+  return reinterpret_cast<Context>(pCont);
+}
+
+void CPPMSnapshotLanguageModel::ReleaseContext(Context context) {
+  m_ContextAlloc.Free(reinterpret_cast<SContext *>(context));
+}
+
+void CPPMSnapshotLanguageModel::ReportMemory(CMemoryReport &report) const {
+  report.Add(CMemoryReport::MEM_LANGUAGE_MODEL, "CPPMSnapshotLanguageModel (mapped snapshot)", GetNumNodes(), m_file.Size());
+  report.Add(CMemoryReport::MEM_CONTEXTS, "CPPMSnapshotLanguageModel::SContext", m_ContextAlloc.GetNumLive(), m_ContextAlloc.GetBytesReserved());
+}
+
+uint32_t CPPMSnapshotLanguageModel::FindSymbol(uint32_t iNode, symbol sym) const {
+  const unsigned char *pNode = Node(iNode);
+  //children are sorted by symbol, so binary search
+  uint32_t lo = FirstChild(pNode), hi = lo + NumChildren(pNode);
+  while (lo < hi) {
+    const uint32_t mid = lo + (hi - lo) / 2;
+    const symbol s = Symbol(Node(mid));
+    if (s == sym) return mid;
+    if (s < sym) lo = mid + 1; else hi = mid;
+  }
+  return iNoNode;
+}
+
+void CPPMSnapshotLanguageModel::EnterSymbol(Context c, int Symbol) {
+  if (Symbol == 0 || !m_pNodes)
+    return;
+
+  DASHER_ASSERT(Symbol >= 0 && Symbol < GetSize());
+
+  SContext &context = *reinterpret_cast<SContext *>(c);
+
+  //As CAbstractPPM::EnterSymbol: extend the context if possible, else follow vines to shorten it
+  while (context.iHead != iNoNode) {
+    if (context.iOrder < m_iMaxOrder) {
+      const uint32_t iFound = FindSymbol(context.iHead, Symbol);
+      if (iFound != iNoNode) {
+        context.iOrder++;
+        context.iHead = iFound;
+        return;
+      }
+    }
+    context.iOrder--;
+    context.iHead = Vine(Node(context.iHead));
+  }
+
+  context.iHead = 0;
+  context.iOrder = 0;
+}
+
+void CPPMSnapshotLanguageModel::GetProbs(Context context, std::vector<unsigned int> &probs, int norm, int iUniform) const {
+  const SContext *pContext = reinterpret_cast<const SContext *>(context);
+
+  const int iNumSymbols = GetSize();
+  probs.resize(iNumSymbols);
+
+  unsigned int iToSpend = norm;
+  unsigned int iUniformLeft = iUniform;
+
+  probs[0] = 0;
+  for (int i = 1; i < iNumSymbols; i++) {
+    probs[i] = iUniformLeft / (iNumSymbols - i);
+    iUniformLeft -= probs[i];
+    iToSpend -= probs[i];
+  }
+
+  DASHER_ASSERT(iUniformLeft == 0);
+
+  //Same arithmetic as CPPMLanguageModel::GetProbs (which never applies exclusions),
+  // so results are bit-for-bit identical
+  for (uint32_t iNode = pContext->iHead; iNode != iNoNode; iNode = Vine(Node(iNode))) {
+    const unsigned char *pNode = Node(iNode);
+    const uint32_t iFirst = FirstChild(pNode), iStop = iFirst + NumChildren(pNode);
+
+    int iTotal = 0;
+    for (uint32_t c = iFirst; c < iStop; c++)
+      iTotal += Count(Node(c));
+
+    if (iTotal) {
+      const unsigned int size_of_slice = iToSpend;
+      for (uint32_t c = iFirst; c < iStop; c++) {
+        const unsigned char *pChild = Node(c);
+        const unsigned int p = static_cast<myint>(size_of_slice) * (100 * Count(pChild) - m_iBeta) / (100 * iTotal + m_iAlpha);
+        probs[Symbol(pChild)] += p;
+        iToSpend -= p;
+      }
+    }
+  }
+
+  const unsigned int size_of_slice = iToSpend;
+  const int symbolsleft = iNumSymbols - 1;
+
+  for (int i = 1; i < iNumSymbols; i++) {
+    const unsigned int p = size_of_slice / symbolsleft;
+    probs[i] += p;
+    iToSpend -= p;
+  }
+
+  int iLeft = iNumSymbols - 1;
+
+  for (int i = 1; i < iNumSymbols; i++) {
+    const unsigned int p = iToSpend / iLeft;
+    probs[i] += p;
+    --iLeft;
+    iToSpend -= p;
+  }
+
+  DASHER_ASSERT(iToSpend == 0);
+}
@@ -0,0 +1,146 @@
+// PPMSnapshotLanguageModel.h
+//
+/////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2024 The Dasher Team
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "../../Common/NoClones.h"
+#include "../../Common/Allocators/PooledAlloc.h"
+
+#include "DasherTypes.h"
+#include "LanguageModel.h"
+#include "../MappedFile.h"
+#include "../SettingsStore.h"
+
+#include <cstdint>
+#include <ostream>
+
+namespace Dasher {
+
+  ///
+  /// \ingroup LM
+  /// @{
+
+  /// On-disk layout of a trained PPM trie, as written by CPPMLanguageModel::WriteToFile.
+  ///
+  /// All integers are little-endian regardless of host. The file is a fixed header
+  /// followed by an array of fixed-size node records in breadth-first order: node 0 is
+  /// the root, the children of each node are contiguous and sorted by symbol, and every
+  /// child and vine index refers to a record elsewhere in the array. Breadth-first order
+  /// also guarantees vine < node < first child, which readers validate once on load so
+  /// that walking a mapped file can never loop or run off the end.
+  namespace PPMSnapshot {
+    const char szMagic[4] = {'D','P','P','M'};
+    const uint16_t iVersion = 1;
+    const uint32_t iNoNode = 0xFFFFFFFFu;
+    ///Flag bit: trie was built with LP_LM_UPDATE_EXCLUSION on
+    const uint32_t iFlagUpdateExclusion = 1;
+
+    // Header: magic[4], version u16, header size u16, numSyms u32, maxOrder u32,
+    // flags u32, node count u32, 8 reserved bytes.
+    const size_t iHeaderSize = 32;
+    // Node: vine u32, first child u32, child count u32, symbol u32, count u16, 2 reserved bytes.
+    const size_t iNodeSize = 20;
+
+    struct SHeader {
+      uint32_t iNumSyms;
+      uint32_t iMaxOrder;
+      uint32_t iFlags;
+      uint32_t iNodeCount;
+    };
+
+    inline uint16_t ReadLE16(const unsigned char *p) {
+      return static_cast<uint16_t>(p[0] | (p[1] << 8));
+    }
+    inline uint32_t ReadLE32(const unsigned char *p) {
+      return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8)
+        | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+    inline void WriteLE16(std::ostream &out, uint16_t i) {
+      const unsigned char b[2] = {static_cast<unsigned char>(i), static_cast<unsigned char>(i >> 8)};
+      out.write(reinterpret_cast<const char *>(b), 2);
+    }
+    inline void WriteLE32(std::ostream &out, uint32_t i) {
+      const unsigned char b[4] = {static_cast<unsigned char>(i), static_cast<unsigned char>(i >> 8),
+                                  static_cast<unsigned char>(i >> 16), static_cast<unsigned char>(i >> 24)};
+      out.write(reinterpret_cast<const char *>(b), 4);
+    }
+
+    void WriteHeader(std::ostream &out, const SHeader &header);
+    void WriteNode(std::ostream &out, uint32_t iVine, uint32_t iFirstChild, uint32_t iNumChildren, symbol sym, unsigned short iCount);
+
+    ///Checks the header and every node record of a snapshot held in memory.
+    /// \param header filled in from the file if (and only if) it is valid
+    /// \return pointer to the first node record, or NULL if the data is not a valid snapshot
+    const unsigned char *Validate(const unsigned char *pData, size_t iSize, SHeader &header);
+
+    inline uint32_t Vine(const unsigned char *pNode) {return ReadLE32(pNode);}
+    inline uint32_t FirstChild(const unsigned char *pNode) {return ReadLE32(pNode + 4);}
+    inline uint32_t NumChildren(const unsigned char *pNode) {return ReadLE32(pNode + 8);}
+    inline symbol Symbol(const unsigned char *pNode) {return static_cast<symbol>(ReadLE32(pNode + 12));}
+    inline unsigned short Count(const unsigned char *pNode) {return ReadLE16(pNode + 16);}
+  }
+
+  /// Read-only PPM model that predicts straight from a memory-mapped snapshot file,
+  /// without building a trie: startup costs one validation pass, and processes using
+  /// the same snapshot share its pages. GetProbs gives exactly the same results as
+  /// CPPMLanguageModel on the trie the snapshot was written from.
+  ///
+  /// The model cannot learn; LearnSymbol only moves the context along, as EnterSymbol.
+  /// Load the snapshot into a CPPMLanguageModel (ReadFromFile) if adaptation is wanted.
+  class CPPMSnapshotLanguageModel : public CLanguageModel, private NoClones {
+  public:
+    CPPMSnapshotLanguageModel(CSettingsStore *pSettingsStore, int iNumSyms);
+    ~CPPMSnapshotLanguageModel();
+
+    ///Maps the snapshot; fails if it is invalid, or is for a different number of symbols.
+    virtual bool ReadFromFile(std::string strFilename);
+
+    Context CreateEmptyContext();
+    Context CloneContext(Context context);
+    void ReleaseContext(Context context);
+
+    virtual void EnterSymbol(Context context, int Symbol);
+    virtual void LearnSymbol(Context context, int Symbol) {
+      EnterSymbol(context, Symbol);
+    }
+
+    virtual void GetProbs(Context context, std::vector<unsigned int> &Probs, int iNorm, int iUniform) const;
+
+    ///Key is the context's head node index and order (the snapshot never changes once loaded)
+    bool GetContextKey(Context context, ContextKey &key) const;
+
+    int GetMaxOrder() const {return m_iMaxOrder;}
+    uint32_t GetNumNodes() const {return m_header.iNodeCount;}
+
+    ///The snapshot is reported as mapped memory, though pages are only resident once read
+    void ReportMemory(CMemoryReport &report) const override;
+
+  private:
+    struct SContext {
+      uint32_t iHead;
+      int iOrder;
+    };
+    const unsigned char *Node(uint32_t i) const {
+      return m_pNodes + static_cast<size_t>(i) * PPMSnapshot::iNodeSize;
+    }
+    ///Index of the child of iNode with the given symbol, or iNoNode
+    uint32_t FindSymbol(uint32_t iNode, symbol sym) const;
+
+    CSettingsStore *m_pSettingsStore;
+    ///LP_LM_ALPHA and LP_LM_BETA, kept up-to-date by a parameter-change listener
+    int m_iAlpha, m_iBeta;
+    CMappedFile m_file;
+    PPMSnapshot::SHeader m_header;
+    ///First node record in m_file, or NULL if no snapshot loaded (=> uniform predictions)
+    const unsigned char *m_pNodes;
+    int m_iMaxOrder;
+    CPooledAlloc<SContext> m_ContextAlloc;
+  };
+
+  /// @}
+}
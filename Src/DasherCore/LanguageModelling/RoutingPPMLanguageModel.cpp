@@ -7,6 +7,7 @@
 //
 
 #include "RoutingPPMLanguageModel.h"
+#include "../MemoryReport.h"
 
 #include <myassert.h>
 
@@ -20,7 +21,7 @@ CRoutingPPMLanguageModel::CRoutingPPMLanguageModel(CSettingsStore* pSettingsStor
 }
 
 void CRoutingPPMLanguageModel::GetProbs(Context context, std::vector<unsigned int> &probs, int norm, int iUniform) const {
-  const CPPMContext *ppmcontext = (const CPPMContext *)(context);
+  const CPPMContext *ppmcontext = &GetContext(context);
 
   const int iNumSymbols(static_cast<int>(m_pBaseSyms->size())); //i.e., the #routes - so loop from i=1 to <iNumSymbols
   probs.resize(iNumSymbols);
@@ -120,7 +121,7 @@ void CRoutingPPMLanguageModel::GetProbs(Context context, std::vector<unsigned in
 /////////////////////////////////////////////////////////////////////
 
 symbol CRoutingPPMLanguageModel::GetBestRoute(Context ctx) {
-  const CPPMContext *context = (const CPPMContext *)ctx;
+  const CPPMContext *context = &GetContext(ctx);
   DASHER_ASSERT(context->head && context->head != m_pRoot);
   
   std::map<symbol,unsigned int> probs; //of the routes leading to this base sym
@@ -171,7 +172,7 @@ void CRoutingPPMLanguageModel::LearnSymbol(Context ctx, int sym) {
   //ctx now updated, points to node for learnt base sym
   DASHER_ASSERT((*m_pRoutes)[base].size());
   if ((*m_pRoutes)[base].size()==1) return; //no need to store, saves computation if we don't
-  for (CPPMnode *node=((CPPMContext*)ctx)->head; node!=m_pRoot; node=node->vine) {
+  for (CPPMnode *node=GetContext(ctx).head; node!=m_pRoot; node=node->vine) {
     if (node->vine!=m_pRoot && !m_bRoutesContextSensitive) continue;
     else if (static_cast<CRoutingPPMnode*>(node)->m_routes[sym]++) //returns old value, i.e. 0 if not present
       if (bUpdateExclusion) break;
@@ -185,6 +186,18 @@ CRoutingPPMLanguageModel::CRoutingPPMnode *CRoutingPPMLanguageModel::makeNode(in
   return res;
 }
 
+void CRoutingPPMLanguageModel::ReportMemory(CMemoryReport &report) const {
+  CAbstractPPM::ReportMemory(report);
+  size_t iEntries = 0;
+  ForEachNode([&iEntries](const CPPMnode *pNode) {iEntries += static_cast<const CRoutingPPMnode *>(pNode)->m_routes.size();});
+  //the root is allocated separately, all other nodes from the pool
+  report.Add(CMemoryReport::MEM_LANGUAGE_MODEL, "CRoutingPPMLanguageModel::CRoutingPPMnode", NodesAllocated + 1, (NodesAllocated + 1) * sizeof(CRoutingPPMnode));
+  report.Add(CMemoryReport::MEM_LANGUAGE_MODEL, "CSimplePooledAlloc<CRoutingPPMnode> (free)", 0,
+             m_NodeAlloc.GetBytesReserved() - NodesAllocated * sizeof(CRoutingPPMnode));
+  report.Add(CMemoryReport::MEM_LANGUAGE_MODEL, "CRoutingPPMLanguageModel::CRoutingPPMnode route counts", iEntries,
+             iEntries * CMemoryReport::TreeNodeBytes<std::pair<const symbol, unsigned short int> >());
+}
+
 //Mandarin - PY not enabled for these read-write functions
 bool CRoutingPPMLanguageModel::WriteToFile(std::string strFilename) {
   return false;
@@ -62,6 +62,8 @@ namespace Dasher {
     ///disable file i/o
     virtual bool WriteToFile(std::string strFilename);
     virtual bool ReadFromFile(std::string strFilename);
+
+    void ReportMemory(CMemoryReport &report) const override;
     
   protected:
     ///Subclass to additionally store counts of route by which this context (i.e.
@@ -9,6 +9,7 @@
 #include "WordLanguageModel.h"
 #include "PPMLanguageModel.h"
 #include "../Alphabet/AlphabetMap.h"
+#include "../MemoryReport.h"
 
 
 #include <cstdlib>
@@ -168,6 +169,17 @@ CWordLanguageModel::~CWordLanguageModel() {
 
 }
 
+void CWordLanguageModel::ReportMemory(CMemoryReport &report) const {
+  report.Add(CMemoryReport::MEM_LANGUAGE_MODEL, "CWordLanguageModel::CWordnode", NodesAllocated, m_NodeAlloc.GetBytesReserved());
+  size_t iDictBytes = 0;
+  for (const auto &it : dict)
+    iDictBytes += CMemoryReport::TreeNodeBytes<std::pair<const std::string, int> >() + CMemoryReport::StringBytes(it.first);
+  report.Add(CMemoryReport::MEM_LANGUAGE_MODEL, "CWordLanguageModel dictionary", dict.size(), iDictBytes);
+  //excludes any heap storage of the contexts' current_word and oSpellingProbs
+  report.Add(CMemoryReport::MEM_CONTEXTS, "CWordLanguageModel::CWordContext", m_ContextAlloc.GetNumLive(), m_ContextAlloc.GetBytesReserved());
+  pSpellingModel->ReportMemory(report);
+}
+
 int CWordLanguageModel::lookup_word(const std::string &w) {
   if(dict[w] == 0) {
     dict[w] = nextid;
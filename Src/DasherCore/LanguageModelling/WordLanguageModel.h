@@ -42,6 +42,9 @@ namespace Dasher {
 
     virtual void EnterSymbol(Context context, int Symbol);
     virtual void LearnSymbol(Context context, int Symbol);
+
+    ///Includes the spelling model
+    void ReportMemory(CMemoryReport &report) const override;
   protected:
     CSettingsStore* m_pSettingsStore;
   private:
@@ -27,6 +27,8 @@
 #include "DasherInterfaceBase.h"
 #include "DasherNode.h"
 #include "NodeCreationManager.h"
+#include "MemoryReport.h"
+#include "TraceRecorder.h"
 
 #include <string.h>
 
@@ -189,6 +191,7 @@ symbol CMandarinAlphMgr::CMandarinTrainer::getPYsym(bool bHavePy, const std::str
 }
 
 void CMandarinAlphMgr::CMandarinTrainer::Train(CAlphabetMap::SymbolStream &syms) {
+  DASHER_TRACE_SPAN("CTrainer::Train", "training");
   CLanguageModel::Context trainContext = m_pLanguageModel->CreateEmptyContext();
   //store a set of CH symbols which need annotations but have appeared without them
   // in this training file. We do this to cut down on the number of error messages
@@ -247,6 +250,23 @@ void CMandarinAlphMgr::CMandarinTrainer::Train(CAlphabetMap::SymbolStream &syms)
 }
 
 
+void CMandarinAlphMgr::ReportMemory(CMemoryReport &report) const {
+  CAlphabetManager::ReportMemory(report);
+  ReportGroups(report, m_pPYgroups);
+  size_t iBytes = CMemoryReport::VectorBytes(m_vCHtext) + CMemoryReport::VectorBytes(m_vCHdisplayText)
+    + CMemoryReport::VectorBytes(m_vConversionsByGroup) + CMemoryReport::VectorBytes(m_vGroupsByConversion)
+    + CMemoryReport::VectorBytes(m_vGroupNames);
+  for (const std::string &str : m_vCHtext) iBytes += CMemoryReport::StringBytes(str);
+  for (const std::string &str : m_vCHdisplayText) iBytes += CMemoryReport::StringBytes(str);
+  for (const std::string &str : m_vGroupNames) iBytes += CMemoryReport::StringBytes(str);
+  for (const std::vector<symbol> &v : m_vConversionsByGroup) iBytes += CMemoryReport::VectorBytes(v);
+  for (const std::set<symbol> &s : m_vGroupsByConversion) iBytes += s.size() * CMemoryReport::TreeNodeBytes<symbol>();
+  report.Add(CMemoryReport::MEM_ALPHABET, "CMandarinAlphMgr conversion tables", m_vCHtext.size(), iBytes);
+
+  for (const CDasherScreen::Label *pLabel : m_vCHLabels) ReportLabel(report, pLabel);
+  report.Add(CMemoryReport::MEM_LABELS, "CAlphabetManager label tables", 0, CMemoryReport::VectorBytes(m_vCHLabels));
+}
+
 CTrainer *CMandarinAlphMgr::GetTrainer() {
   return new CMandarinTrainer(m_pInterface, this);
 }
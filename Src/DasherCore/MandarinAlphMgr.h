@@ -96,6 +96,9 @@ namespace Dasher {
     ///Disable game mode. The target sentence might appear in several places...!!
     CWordGeneratorBase *GetGameWords() {return NULL;}
 
+    ///Adds the chinese symbol tables and labels, and pinyin groups
+    void ReportMemory(CMemoryReport &report) const override;
+
   protected:
     ///Initializes all our data:
     /// *Chinese alphabet symbols are rehashed into m_vCHtext, m_vCHdisplayText, and m_vCHcolours;
@@ -138,6 +141,8 @@ namespace Dasher {
       CMandarinAlphMgr *mgr() const {return static_cast<CMandarinAlphMgr *>(CSymbolNode::mgr());}
       ///Symbol constructor: display text from (CH)Alphabet, colour as superclass = from GetColour
       CMandSym(int iOffset, CMandarinAlphMgr *pMgr, symbol iSymbol, symbol pyParent);
+      const char *ClassName() const override {return "CMandSym";}
+      std::size_t ObjectSize() const override {return sizeof(CMandSym);}
       CDasherNode *RebuildSymbol(CAlphNode *pParent, symbol iSymbol);
       CMandSym *RebuildCHSymbol(CConvRoot *pParent, symbol iNewSym);
     protected:
@@ -159,6 +164,8 @@ namespace Dasher {
     public:
       /// \param pySym symbol in pinyin alphabet; must have >1 possible chinese conversion.
       CConvRoot(int iOffset, CMandarinAlphMgr *pMgr, symbol pySym);
+      const char *ClassName() const override {return "CConvRoot";}
+      std::size_t ObjectSize() const override {return sizeof(CConvRoot);}
       CMandarinAlphMgr *mgr() const override {return static_cast<CMandarinAlphMgr *>(CAlphBase::mgr());}
       void PopulateChildren() override;
       void PopulateChildrenWithExisting(CMandSym *existing);
@@ -0,0 +1,106 @@
+#include "MappedFile.h"
+
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace Dasher;
+
+CMappedFile::~CMappedFile()
+{
+	Close();
+}
+
+bool CMappedFile::Open(const std::string& strPath)
+{
+	Close();
+#ifdef _WIN32
+	HANDLE hFile = CreateFileA(strPath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile != INVALID_HANDLE_VALUE)
+	{
+		LARGE_INTEGER size;
+		if (GetFileSizeEx(hFile, &size) && size.QuadPart > 0)
+		{
+			HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (hMapping)
+			{
+				if (void* pView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0))
+				{
+					m_hFile = hFile;
+					m_hMapping = hMapping;
+					m_pData = static_cast<const unsigned char*>(pView);
+					m_iSize = static_cast<size_t>(size.QuadPart);
+					return true;
+				}
+				CloseHandle(hMapping);
+			}
+		}
+		CloseHandle(hFile);
+	}
+#else
+	int fd = open(strPath.c_str(), O_RDONLY);
+	if (fd != -1)
+	{
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0)
+		{
+			void* pView = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+			if (pView != MAP_FAILED)
+			{
+				close(fd); //the mapping keeps its own reference
+				m_pData = static_cast<const unsigned char*>(pView);
+				m_iSize = static_cast<size_t>(st.st_size);
+				return true;
+			}
+		}
+		close(fd);
+	}
+#endif
+	//Mapping unavailable (e.g. unusual filesystem) - fall back to reading a private copy.
+	std::ifstream in(strPath.c_str(), std::ios::binary | std::ios::ate);
+	if (!in.is_open()) return false;
+	const std::streamoff iLen = in.tellg();
+	if (iLen <= 0) return false;
+	unsigned char* pBuf = new unsigned char[static_cast<size_t>(iLen)];
+	in.seekg(0);
+	if (!in.read(reinterpret_cast<char*>(pBuf), iLen))
+	{
+		delete[] pBuf;
+		return false;
+	}
+	m_pData = pBuf;
+	m_iSize = static_cast<size_t>(iLen);
+	m_bHeap = true;
+	return true;
+}
+
+void CMappedFile::Close()
+{
+	if (!m_pData) return;
+	if (m_bHeap)
+	{
+		delete[] m_pData;
+	}
+	else
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(m_pData);
+		CloseHandle(m_hMapping);
+		CloseHandle(m_hFile);
+		m_hMapping = m_hFile = nullptr;
+#else
+		munmap(const_cast<unsigned char*>(m_pData), m_iSize);
+#endif
+	}
+	m_pData = nullptr;
+	m_iSize = 0;
+	m_bHeap = false;
+}
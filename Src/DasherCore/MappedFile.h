@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace Dasher {
+
+/// Read-only view of a whole file, mapped into memory where the platform
+/// supports it (so several processes can share one page-cached copy), or
+/// else read into a heap buffer. The contents stay valid until Close() or
+/// destruction.
+class CMappedFile {
+public:
+	CMappedFile() = default;
+	~CMappedFile();
+	CMappedFile(const CMappedFile&) = delete;
+	CMappedFile& operator=(const CMappedFile&) = delete;
+
+	///Map the file at strPath, closing any file previously open.
+	/// \return false if the file could not be opened (or is empty).
+	bool Open(const std::string& strPath);
+	void Close();
+
+	bool IsOpen() const { return m_pData != nullptr; }
+	const unsigned char* Data() const { return m_pData; }
+	size_t Size() const { return m_iSize; }
+
+private:
+	const unsigned char* m_pData = nullptr;
+	size_t m_iSize = 0;
+	///true if m_pData is a heap copy (fallback), false if it is a mapping
+	bool m_bHeap = false;
+#ifdef _WIN32
+	void* m_hFile = nullptr;
+	void* m_hMapping = nullptr;
+#endif
+};
+
+}
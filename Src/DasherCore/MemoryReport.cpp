@@ -0,0 +1,90 @@
+// MemoryReport.cpp
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// This file is part of Dasher.
+//
+// Dasher is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Dasher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Dasher; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include "MemoryReport.h"
+
+#include <cstdio>
+
+using namespace Dasher;
+
+void CMemoryReport::Add(Subsystem subsystem, const std::string &strClass, std::size_t iCount, std::size_t iBytes) {
+  //few enough entries that a linear search is fine
+  for (SEntry &e : m_vEntries)
+    if (e.subsystem == subsystem && e.strClass == strClass) {
+      e.iCount += iCount;
+      e.iBytes += iBytes;
+      return;
+    }
+  m_vEntries.push_back(SEntry{subsystem, strClass, iCount, iBytes});
+}
+
+std::size_t CMemoryReport::GetTotalBytes() const {
+  std::size_t iTotal = 0;
+  for (const SEntry &e : m_vEntries) iTotal += e.iBytes;
+  return iTotal;
+}
+
+std::size_t CMemoryReport::GetTotalBytes(Subsystem subsystem) const {
+  std::size_t iTotal = 0;
+  for (const SEntry &e : m_vEntries)
+    if (e.subsystem == subsystem) iTotal += e.iBytes;
+  return iTotal;
+}
+
+const char *CMemoryReport::SubsystemName(Subsystem subsystem) {
+  switch (subsystem) {
+    case MEM_NODES: return "Node tree";
+    case MEM_LANGUAGE_MODEL: return "Language model";
+    case MEM_CONTEXTS: return "LM contexts";
+    case MEM_PROB_CACHE: return "Probability cache";
+    case MEM_ALPHABET: return "Alphabet";
+    case MEM_LABELS: return "Labels";
+    case MEM_USER_LOG: return "User log and training text";
+    case MEM_SETTINGS: return "Settings";
+    default: return "?";
+  }
+}
+
+std::size_t CMemoryReport::StringBytes(const std::string &str) {
+  const char *pData = str.data(), *pStr = reinterpret_cast<const char *>(&str);
+  if (pData >= pStr && pData < pStr + sizeof(str)) return 0; //short string optimization
+  return str.capacity() + 1;
+}
+
+std::string CMemoryReport::ToString() const {
+  std::string strRes;
+  char buf[256];
+  for (int s = 0; s < NUM_SUBSYSTEMS; s++) {
+    const Subsystem subsystem = static_cast<Subsystem>(s);
+    bool bAny = false;
+    for (const SEntry &e : m_vEntries) {
+      if (e.subsystem != subsystem) continue;
+      if (!bAny) {
+        snprintf(buf, sizeof(buf), "%s: %zu bytes\n", SubsystemName(subsystem), GetTotalBytes(subsystem));
+        strRes += buf;
+        bAny = true;
+      }
+      snprintf(buf, sizeof(buf), "  %-40s %10zu objects %12zu bytes\n", e.strClass.c_str(), e.iCount, e.iBytes);
+      strRes += buf;
+    }
+  }
+  snprintf(buf, sizeof(buf), "Total: %zu bytes\n", GetTotalBytes());
+  return strRes + buf;
+}
@@ -0,0 +1,90 @@
+// MemoryReport.h
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// This file is part of Dasher.
+//
+// Dasher is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Dasher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Dasher; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Dasher {
+/// \ingroup Core
+/// \{
+
+/// Memory footprint of Dasher's data structures, as a number of objects and bytes for
+/// each class within each subsystem; filled in by CDasherInterfaceBase::GetMemoryReport,
+/// which asks each owner (nodes, language model, alphabet manager, etc.) to add its own.
+///
+/// Byte counts are of memory held, i.e. including unused capacity of vectors and of
+/// allocator pools. Where the exact figure cannot be known portably (std::map and
+/// std::list node overheads, strings held by platform-specific subclasses) it is
+/// estimated from the standard types' sizes.
+class CMemoryReport {
+public:
+  enum Subsystem {
+    MEM_NODES,          ///< CDasherNode tree, inc. child arrays and slab allocator
+    MEM_LANGUAGE_MODEL, ///< LM tries and tables
+    MEM_CONTEXTS,       ///< LM contexts (including those held by nodes)
+    MEM_PROB_CACHE,     ///< Probabilities cached by the alphabet manager
+    MEM_ALPHABET,       ///< Alphabet maps and group trees
+    MEM_LABELS,         ///< CDasherScreen::Labels for symbols and groups
+    MEM_USER_LOG,       ///< User log, and training text not yet written out
+    MEM_SETTINGS,       ///< Settings store
+    NUM_SUBSYSTEMS
+  };
+
+  struct SEntry {
+    Subsystem subsystem;
+    std::string strClass;
+    ///Number of objects, where meaningful (0 for e.g. free space in a pool)
+    std::size_t iCount;
+    std::size_t iBytes;
+  };
+
+  ///Adds to the entry for the given subsystem and class, creating it if necessary
+  void Add(Subsystem subsystem, const std::string &strClass, std::size_t iCount, std::size_t iBytes);
+
+  ///Entries in the order first added
+  const std::vector<SEntry> &GetEntries() const {return m_vEntries;}
+
+  std::size_t GetTotalBytes() const;
+  std::size_t GetTotalBytes(Subsystem subsystem) const;
+
+  ///One line per entry, grouped by subsystem with subtotals, then the total
+  std::string ToString() const;
+
+  static const char *SubsystemName(Subsystem subsystem);
+
+  ///Heap bytes held by a string, i.e. 0 if its characters are stored inline
+  static std::size_t StringBytes(const std::string &str);
+  template<typename T> static std::size_t VectorBytes(const std::vector<T> &v) {
+    return v.capacity() * sizeof(T);
+  }
+  ///Estimated heap bytes of each node of a std::map, std::set or std::list
+  /// holding values of type T (the value plus two or three pointers and a colour)
+  template<typename T> static std::size_t TreeNodeBytes() {
+    return sizeof(T) + 4 * sizeof(void *);
+  }
+
+private:
+  std::vector<SEntry> m_vEntries;
+};
+/// \}
+}
@@ -8,7 +8,11 @@ void CMessageDisplay::FormatMessage(const char* format, va_list args)
 
   std::string lineToPrint;
 
-	int length = vsnprintf(nullptr, 0, format, args);
+	//measuring consumes the va_list, so measure a copy
+	va_list argsCopy;
+	va_copy(argsCopy, args);
+	int length = vsnprintf(nullptr, 0, format, argsCopy);
+	va_end(argsCopy);
 	lineToPrint.resize(length);
 	vsnprintf(&lineToPrint[0], length + 1, format, args);
 	
@@ -0,0 +1,85 @@
+// NodeBudgetController.cpp
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// This file is part of Dasher.
+//
+// Dasher is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Dasher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Dasher; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include "NodeBudgetController.h"
+
+#include <algorithm>
+
+using namespace Dasher;
+
+//Weight given to each new frame in the smoothed estimates
+static const double SMOOTHING = 0.2;
+//Fraction of the way the budget moves towards the ideal each frame
+static const double GAIN = 0.5;
+
+CNodeBudgetController::CNodeBudgetController(unsigned int iInitialBudget, double dTargetMs)
+: m_dTargetMs(dTargetMs) {
+  Reset(iInitialBudget);
+}
+
+void CNodeBudgetController::Reset(unsigned int iBudget) {
+  m_iBudget = std::min(MAX_BUDGET, std::max(MIN_BUDGET, iBudget));
+  m_bHaveEstimates = false;
+  m_dMsPerNode = m_dFixedMs = 0.0;
+  m_iFrames = 0;
+  m_lastDecision = SDecision();
+}
+
+unsigned int CNodeBudgetController::GetMaxExpands() const {
+  return std::max(1u, (500 + m_iBudget) / 1000);
+}
+
+const CNodeBudgetController::SDecision &CNodeBudgetController::Update(const SFrameCost &cost) {
+  SDecision &d(m_lastDecision);
+  d.iFrame = ++m_iFrames;
+  d.dFrameMs = 0.0;
+  for (int i = 0; i < NUM_PHASES; i++) d.dFrameMs += cost.dPhaseMs[i];
+  d.dNodeMs = cost.dPhaseMs[PHASE_RENDER] + cost.dPhaseMs[PHASE_EXPAND];
+  d.iNumNodes = cost.iNumNodes;
+  d.iOldBudget = m_iBudget;
+
+  if (cost.iNumNodes > 0) {
+    const double dMsPerNode = d.dNodeMs / cost.iNumNodes, dFixedMs = d.dFrameMs - d.dNodeMs;
+    if (m_bHaveEstimates) {
+      m_dMsPerNode += SMOOTHING * (dMsPerNode - m_dMsPerNode);
+      m_dFixedMs += SMOOTHING * (dFixedMs - m_dFixedMs);
+    } else {
+      m_dMsPerNode = dMsPerNode;
+      m_dFixedMs = dFixedMs;
+      m_bHaveEstimates = true;
+    }
+  }
+
+  if (m_bHaveEstimates && m_dMsPerNode > 0.0) {
+    const double dAvailable = m_dTargetMs - m_dFixedMs;
+    d.dIdealBudget = std::min<double>(MAX_BUDGET, std::max<double>(MIN_BUDGET, dAvailable / m_dMsPerNode));
+    //at most halve or double in one frame, in case of a one-off glitch in the measurements
+    const double dNew = std::min(2.0 * m_iBudget, std::max(0.5 * m_iBudget, m_iBudget + GAIN * (d.dIdealBudget - m_iBudget)));
+    m_iBudget = std::min(MAX_BUDGET, std::max(MIN_BUDGET, static_cast<unsigned int>(dNew + 0.5)));
+  } else
+    d.dIdealBudget = m_iBudget;
+
+  d.dMsPerNode = m_dMsPerNode;
+  d.dFixedMs = m_dFixedMs;
+  d.iNewBudget = m_iBudget;
+  d.iMaxExpands = GetMaxExpands();
+  OnDecision.Broadcast(d);
+  return d;
+}
@@ -0,0 +1,103 @@
+// NodeBudgetController.h
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// This file is part of Dasher.
+//
+// Dasher is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Dasher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Dasher; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+#pragma once
+
+#include "Event.h"
+
+namespace Dasher {
+/// \ingroup Model
+/// \{
+
+/// Chooses the node budget (and so, as per AmortizedPolicy, the number of expansions
+/// per frame) so that frames take a target time. Fed the cost of each frame's phases,
+/// it keeps smoothed estimates of the time per node (rendering and expanding, which
+/// scale with the number of nodes) and of the fixed time (everything else), and
+/// moves the budget part of the way towards that which would just fit the target.
+///
+/// Depends only on the costs passed to Update, so it can be driven by a synthetic
+/// cost model, and will then converge deterministically.
+class CNodeBudgetController {
+public:
+  ///Phases of CDasherInterfaceBase::NewFrame
+  enum Phase {
+    PHASE_INPUT,    ///< input filter and scheduled movement
+    PHASE_RENDER,   ///< CDasherModel::RenderToView
+    PHASE_EXPAND,   ///< CExpansionPolicy::apply
+    PHASE_DECORATE, ///< game module, input filter decorations
+    PHASE_DISPLAY,  ///< FinishRender and blitting to the display
+    NUM_PHASES
+  };
+
+  ///Measured cost of one frame
+  struct SFrameCost {
+    double dPhaseMs[NUM_PHASES];
+    ///Number of nodes in existence while rendering
+    int iNumNodes;
+  };
+
+  ///Everything the controller knew and decided after one frame, for logging
+  struct SDecision {
+    unsigned long iFrame;
+    ///Total of all phases, and of those which scale with nodes (render & expand)
+    double dFrameMs, dNodeMs;
+    ///Smoothed estimates after this frame
+    double dMsPerNode, dFixedMs;
+    ///Budget which would exactly fit the target, given the estimates
+    double dIdealBudget;
+    int iNumNodes;
+    unsigned int iOldBudget, iNewBudget, iMaxExpands;
+  };
+
+  static constexpr unsigned int MIN_BUDGET = 300;
+  static constexpr unsigned int MAX_BUDGET = 200000;
+
+  CNodeBudgetController(unsigned int iInitialBudget, double dTargetMs);
+
+  ///Take account of a frame; updates GetBudget and GetMaxExpands, and broadcasts OnDecision.
+  /// Frames with no nodes (i.e. in which nothing was rendered) should not be passed in.
+  const SDecision &Update(const SFrameCost &cost);
+
+  ///Forget all estimates and start again from the given budget
+  void Reset(unsigned int iBudget);
+
+  void SetTarget(double dTargetMs) {m_dTargetMs = dTargetMs;}
+  double GetTarget() const {return m_dTargetMs;}
+
+  unsigned int GetBudget() const {return m_iBudget;}
+  ///As AmortizedPolicy would use for the current budget
+  unsigned int GetMaxExpands() const;
+
+  ///Decision made by the last Update (all zero before the first)
+  const SDecision &GetLastDecision() const {return m_lastDecision;}
+
+  ///Broadcast with each decision made
+  Event<const SDecision &> OnDecision;
+
+private:
+  double m_dTargetMs;
+  unsigned int m_iBudget;
+  bool m_bHaveEstimates;
+  double m_dMsPerNode, m_dFixedMs;
+  unsigned long m_iFrames;
+  SDecision m_lastDecision;
+};
+/// \}
+}
@@ -7,6 +7,9 @@
 #include "MandarinAlphMgr.h"
 #include "RoutingAlphMgr.h"
 
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
 #include <string>
 
 using namespace Dasher;
@@ -36,10 +39,20 @@ public:
 	{
 		m_file_length = m_pInterface->GetFileSize(strFilename);
 		if (m_file_length == 0) return false;
-		return AbstractParser::ParseFile(strFilename, bUser);
+		//let the trainer open the file, so it can map it rather than stream it
+		return Train(bUser, [&]() {return m_pTrainer->ParseFile(strFilename, bUser);});
 	}
 
 	bool Parse(const std::string& strUrl, std::istream& in, bool bUser)
+	{
+		return Train(bUser, [&]() {return m_pTrainer->Parse(strUrl, in, bUser);});
+	}
+
+	bool has_parsed_from_user_dir(){return m_bUser;}
+	bool has_parsed_from_system_dir(){return m_bSystem;}
+
+private:
+	template<typename F> bool Train(bool bUser, F train)
 	{
 		m_strDisplay = bUser ? "Training on User Text" : "Training on System Text";
 		m_iPercent = 0;
@@ -47,7 +60,7 @@ public:
 		m_pInterface->SetLockStatus(m_strDisplay, m_iPercent);
 		m_pTrainer->SetProgressIndicator(this);
 
-		if (m_pTrainer->Parse(strUrl, in, bUser)){
+		if (train()){
 			m_bUser |= bUser;
 			m_bSystem |= !bUser;
 
@@ -59,10 +72,6 @@ public:
 		return false;
 	}
 
-	bool has_parsed_from_user_dir(){return m_bUser;}
-	bool has_parsed_from_system_dir(){return m_bSystem;}
-
-private:
 	bool m_bSystem, m_bUser;
 	CDasherInterfaceBase* m_pInterface;
 	CTrainer* m_pTrainer;
@@ -71,11 +80,119 @@ private:
 	std::string m_strDisplay;
 };
 
+//Reads the training files a ScanFiles finds without training on them, to hash their
+// contents (along with anything else added) with FNV-1a; or, if bStamp, just their
+// paths, sizes and modification times, which needs no reading.
+class TrainingHasher : public AbstractParser
+{
+public:
+	TrainingHasher(CMessageDisplay* pMsgs, bool bStamp = false) : AbstractParser(pMsgs), m_iHash(14695981039346656037ull), m_bSystem(false), m_bUser(false), m_bStamp(bStamp)
+	{
+	}
+
+	bool ParseFile(const std::string& strPath, bool bUser)
+	{
+		if (!m_bStamp) return AbstractParser::ParseFile(strPath, bUser);
+		//as CAlphabetCache stamps alphabet files; reading the file only if that fails
+		std::error_code ec;
+		const std::uintmax_t iSize = std::filesystem::file_size(strPath, ec);
+		if (ec) return AbstractParser::ParseFile(strPath, bUser);
+		const std::filesystem::file_time_type tModified = std::filesystem::last_write_time(strPath, ec);
+		if (ec) return AbstractParser::ParseFile(strPath, bUser);
+		Add(strPath);
+		Add(static_cast<long>(iSize));
+		Add(static_cast<long>(tModified.time_since_epoch().count()));
+		Add(bUser);
+		if (iSize > 0)
+		{
+			m_bUser |= bUser;
+			m_bSystem |= !bUser;
+		}
+		return true;
+	}
+
+	bool Parse(const std::string& strUrl, std::istream& in, bool bUser)
+	{
+		char buf[65536];
+		unsigned long long iLength = 0;
+		while (in.read(buf, sizeof(buf)) || in.gcount() > 0)
+		{
+			Add(buf, static_cast<size_t>(in.gcount()));
+			iLength += static_cast<unsigned long long>(in.gcount());
+		}
+		//the length delimits this file from the next
+		Add(static_cast<long>(iLength));
+		Add(bUser);
+		if (iLength > 0)
+		{
+			m_bUser |= bUser;
+			m_bSystem |= !bUser;
+		}
+		return true;
+	}
+
+	void Add(const void* pData, size_t iLength)
+	{
+		const unsigned char* p = static_cast<const unsigned char*>(pData);
+		for (size_t i = 0; i < iLength; i++)
+		{
+			m_iHash ^= p[i];
+			m_iHash *= 1099511628211ull;
+		}
+	}
+	void Add(long l)
+	{
+		//bytewise, so the hash doesn't depend on endianness
+		for (int i = 0; i < 8; i++)
+		{
+			const unsigned char c = static_cast<unsigned char>(static_cast<unsigned long long>(l) >> (8 * i));
+			Add(&c, 1);
+		}
+	}
+	void Add(const std::string& str)
+	{
+		Add(static_cast<long>(str.size()));
+		Add(str.data(), str.size());
+	}
+
+	///Adds the symbols, groups and training-file syntax of an alphabet
+	void AddAlphabet(const CAlphInfo* pAlphInfo)
+	{
+		Add(pAlphInfo->GetID());
+		Add(static_cast<long>(pAlphInfo->iEnd));
+		for (symbol i = 1; i < pAlphInfo->iEnd; i++) Add(pAlphInfo->GetText(i));
+		Add(pAlphInfo->GetContextEscapeChar());
+		Add(static_cast<long>(pAlphInfo->m_iConversionID));
+		Add(pAlphInfo->m_strConversionTrainStart);
+		Add(pAlphInfo->m_strConversionTrainStop);
+		AddGroups(pAlphInfo->pChild);
+		Add(0L);
+	}
+
+	unsigned long long m_iHash;
+	bool m_bSystem, m_bUser;
+
+private:
+	const bool m_bStamp;
+
+	void AddGroups(const SGroupInfo* pGroup)
+	{
+		for (; pGroup; pGroup = pGroup->pNext)
+		{
+			Add(pGroup->strName);
+			Add(static_cast<long>(pGroup->iStart));
+			Add(static_cast<long>(pGroup->iEnd));
+			AddGroups(pGroup->pChild);
+		}
+	}
+};
+
 CNodeCreationManager::CNodeCreationManager(
 	CSettingsStore* pSettingsStore,
 	CDasherInterfaceBase* pInterface,
-	const CAlphIO* pAlphIO
-): m_pInterface(pInterface), m_pScreen(nullptr), m_pSettingsStore(pSettingsStore)
+	const CAlphIO* pAlphIO,
+	bool bAllowReadOnlyModel
+): m_bReadOnlyModel(false), m_pInterface(pInterface), m_pScreen(nullptr), m_pSettingsStore(pSettingsStore)
 {
 	m_pSettingsStore->OnParameterChanged.Subscribe(this, [this](const Parameter p)
     {
@@ -107,16 +224,42 @@ CNodeCreationManager::CNodeCreationManager(
 	//all other configuration changes, etc., that might be necessary for a particular conversion mode,
 	// are implemented by AlphabetManager subclasses overriding the following two methods:
 	m_pAlphabetManager->Setup();
+
+	//Load the model trained last time, if nothing it depends on has changed since
+	bool bUser = false, bSystem = false;
+	const std::string strCacheFile(pAlphInfo->GetTrainingFile().empty() ? "" : GetModelCacheFile(pAlphInfo, bUser, bSystem));
+	const bool bCached = !strCacheFile.empty() && std::filesystem::exists(strCacheFile);
+	//A model which will never learn can predict straight from the saved file, which is
+	// just mapped, rather than rebuilding the whole model in memory. (Must be done
+	// before creating the trainer, which refers to the model.)
+	if (bCached && bAllowReadOnlyModel && !m_pSettingsStore->GetBoolParameter(BP_LM_ADAPTIVE))
+		m_bReadOnlyModel = m_pAlphabetManager->LoadModelSnapshot(strCacheFile);
+
 	m_pTrainer = m_pAlphabetManager->GetTrainer();
+	m_pTrainer->SetParallelism(m_pSettingsStore->GetLongParameter(LP_TRAINING_THREADS), m_pSettingsStore->GetBoolParameter(BP_DETERMINISTIC_TRAINING));
 
 	if (!pAlphInfo->GetTrainingFile().empty())
 	{
-		ProgressNotifier pn(pInterface, m_pTrainer);
-		pInterface->ScanFiles(&pn, pAlphInfo->GetTrainingFile());
-		if (!pn.has_parsed_from_user_dir())
+		//Otherwise the saved model must be read in full (ReadFromFile), into one which can learn
+		bool bLoaded = m_bReadOnlyModel;
+		if (!bLoaded && bCached)
+		{
+			pInterface->SetLockStatus("Loading Trained Language Model", 0);
+			bLoaded = m_pTrainer->GetLanguageModel()->ReadFromFile(strCacheFile);
+			pInterface->SetLockStatus("", -1);
+		}
+		if (!bLoaded)
+		{
+			ProgressNotifier pn(pInterface, m_pTrainer);
+			pInterface->ScanFiles(&pn, pAlphInfo->GetTrainingFile());
+			bUser = pn.has_parsed_from_user_dir();
+			bSystem = pn.has_parsed_from_system_dir();
+			if (!strCacheFile.empty()) SaveModelCache(strCacheFile);
+		}
+		if (!bUser)
 		{
 			///TRANSLATORS: These 3 messages will be displayed when the user has just chosen a new alphabet. The %s parameter will be the name of the alphabet.
-			if(pn.has_parsed_from_system_dir())
+			if(bSystem)
 			{
 				pInterface->FormatMessage("No user training text found - if you have written in \"%s\" before, this means Dasher may not be learning from previous sessions", pAlphInfo->GetID().c_str());
 			}
@@ -142,6 +285,85 @@ CNodeCreationManager::~CNodeCreationManager()
 	m_pSettingsStore->OnParameterChanged.Unsubscribe(this);
 }
 
+std::string CNodeCreationManager::GetModelCacheFile(const CAlphInfo* pAlphInfo, bool& bUser, bool& bSystem)
+{
+	const std::string strCacheDir(m_pInterface->GetCacheDirectory());
+	//a model that could not be saved will never be found in the cache either
+	if (strCacheDir.empty() || !m_pAlphabetManager->CanSaveModel()) return "";
+
+	//Name files by alphabet and type of model, so that saving a model replaces only
+	// those that (having been trained on other text or settings) it supersedes
+	TrainingHasher prefix(m_pInterface);
+	prefix.Add(pAlphInfo->GetID());
+	prefix.Add(m_pSettingsStore->GetLongParameter(LP_LANGUAGE_MODEL_ID));
+	char szPrefix[17];
+	snprintf(szPrefix, sizeof(szPrefix), "%016llx", prefix.m_iHash);
+	const std::string strModels(strCacheDir + "/models/");
+
+	auto hashTraining = [this, pAlphInfo](TrainingHasher& hasher)
+	{
+		hasher.AddAlphabet(pAlphInfo);
+		for (const Parameter p : {LP_LANGUAGE_MODEL_ID, LP_LM_MAX_ORDER, LP_LM_UPDATE_EXCLUSION, LP_LM_MEMORY_LIMIT, LP_TRAINING_THREADS})
+			hasher.Add(m_pSettingsStore->GetLongParameter(p));
+		hasher.Add(m_pSettingsStore->GetBoolParameter(BP_DETERMINISTIC_TRAINING));
+		m_pInterface->ScanFiles(&hasher, pAlphInfo->GetTrainingFile());
+	};
+	TrainingHasher stamp(m_pInterface, true);
+	hashTraining(stamp);
+	bUser = stamp.m_bUser;
+	bSystem = stamp.m_bSystem;
+
+	//The model is named by the hash of the training text's contents, so that it is
+	// found again however the files come to have the same contents. But reading them
+	// all takes time, so the hash is recorded along with the stamp it was computed
+	// for, and only recomputed when that changes.
+	const std::string strStampFile(strModels + szPrefix + ".stamp");
+	unsigned long long iStamp = 0, iContents = 0;
+	std::ifstream in(strStampFile);
+	if (!(in >> std::hex >> iStamp >> iContents) || iStamp != stamp.m_iHash)
+	{
+		TrainingHasher hasher(m_pInterface);
+		hashTraining(hasher);
+		iContents = hasher.m_iHash;
+		std::error_code ec;
+		std::filesystem::create_directories(strModels, ec);
+		std::ofstream out(strStampFile, std::ios::trunc);
+		out << std::hex << stamp.m_iHash << " " << iContents << "\n";
+	}
+
+	char szName[64];
+	snprintf(szName, sizeof(szName), "%s-%016llx.lm", szPrefix, iContents);
+	return strModels + szName;
+}
+
+bool CNodeCreationManager::SaveModelCache(const std::string& strFile)
+{
+	std::error_code ec;
+	const std::filesystem::path file(strFile), dir(file.parent_path());
+	std::filesystem::create_directories(dir, ec);
+	//write to a temporary file and rename it, so an interrupted write is never loaded
+	const std::string strTemp(strFile + ".tmp");
+	if (!m_pTrainer->GetLanguageModel()->WriteToFile(strTemp))
+	{
+		std::filesystem::remove(strTemp, ec);
+		return false;
+	}
+	std::filesystem::rename(strTemp, file, ec);
+	if (ec)
+	{
+		std::filesystem::remove(strTemp, ec);
+		return false;
+	}
+	const std::string strName(file.filename().string()), strPrefix(strName.substr(0, strName.find('-') + 1));
+	for (const auto& entry : std::filesystem::directory_iterator(dir, ec))
+	{
+		const std::string strOther(entry.path().filename().string());
+		if (strOther != strName && strOther.compare(0, strPrefix.size(), strPrefix) == 0)
+			std::filesystem::remove(entry.path(), ec);
+	}
+	return true;
+}
+
 void CNodeCreationManager::ChangeScreen(CDasherScreen* pScreen)
 {
 	if (m_pScreen == pScreen) return;
@@ -19,9 +19,13 @@ namespace Dasher {
 /// @{
 class CNodeCreationManager {
  public:
+  ///\param bAllowReadOnlyModel if BP_LM_ADAPTIVE is off, and a saved model can be
+  /// used in place of training, whether it may be used by a model which cannot learn
+  /// (see CAlphabetManager::LoadModelSnapshot) rather than loaded into one which can.
   CNodeCreationManager(Dasher::CSettingsStore* pSettingsStore,
                        Dasher::CDasherInterfaceBase *pInterface,
-                       const Dasher::CAlphIO *pAlphIO);
+                       const Dasher::CAlphIO *pAlphIO,
+                       bool bAllowReadOnlyModel = true);
   ~CNodeCreationManager();
   
   ///Tells us the screen on which all created node labels must be rendered
@@ -42,10 +46,31 @@ class CNodeCreationManager {
     return m_pAlphabetManager->GetAlphabet();
   }
 
+  ///Whether the language model was loaded read-only, so cannot learn (not even
+  /// from ImportTrainingText)
+  bool IsModelReadOnly() const {return m_bReadOnlyModel;}
+
   void ImportTrainingText(const std::string &strPath);
 
 private:
+  ///Identifies the model that training would produce, by hashing the alphabet, the
+  /// settings that affect the trained model, and the contents of the training files
+  /// (system and user) that ScanFiles finds; so a model saved under this name can
+  /// be loaded instead of training, until any of those change. The contents are
+  /// only read if the files' paths, sizes or modification times have changed since
+  /// the last call (for the same alphabet and model type).
+  /// \param bUser, bSystem set to whether any user/system training text was found
+  /// \return file to save the model in, or empty if not caching (see
+  /// CDasherInterfaceBase::GetCacheDirectory) or the model can't be saved
+  std::string GetModelCacheFile(const Dasher::CAlphInfo *pAlphInfo, bool &bUser, bool &bSystem);
+  ///Saves the trained model to a file from GetModelCacheFile, deleting those saved
+  /// from earlier training of the same alphabet and model type.
+  /// \return false if the model doesn't support saving (CLanguageModel::WriteToFile)
+  bool SaveModelCache(const std::string &strFile);
+
   Dasher::CTrainer *m_pTrainer;
+
+  bool m_bReadOnlyModel;
   
   Dasher::CDasherInterfaceBase *m_pInterface;
   
@@ -1,10 +1,19 @@
 #pragma once
+
+#include <vector>
+
 namespace Dasher {
-  
+  class CDasherNode;
+
   /// A marker class for anything that can be returned by CDasherNode::mgr()
   ///  - as a void* return type can't be covariantly overridden :-(
   class CNodeManager {
   public:
       virtual ~CNodeManager() = default;
+      ///Called (by CExpansionPolicy) with several of this manager's nodes which are
+      /// all about to be expanded, to compute together whatever their PopulateChildren
+      /// will need, where that is cheaper than doing so for one node at a time.
+      /// The default does nothing.
+      virtual void PrefetchChildren(const std::vector<CDasherNode *> &vNodes) {}
   };
 }
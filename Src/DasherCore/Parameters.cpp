@@ -43,6 +43,10 @@ namespace Dasher{
 		{BP_TWO_PUSH_RELEASE_TIME , Parameter_Value{"TwoPushReleaseTime"   , PARAM_BOOL, Persistence::PERSISTENT, false, "Use push and release times of single press rather than push times of two presses"}},
 		{BP_SLOW_CONTROL_BOX      , Parameter_Value{"SlowControlBox"       , PARAM_BOOL, Persistence::PERSISTENT, true , "Slow down when going through control box" }},
 		{BP_SIMULATE_TRANSPARENCY , Parameter_Value{"SimulateTransparency" , PARAM_BOOL, Persistence::PERSISTENT, false, "Enable the internal color mixing and thus the need to support alpha blending in the renderer." }},
+		{BP_DETERMINISTIC_TRAINING, Parameter_Value{"DeterministicTraining", PARAM_BOOL, Persistence::PERSISTENT, true , "Split training text into fixed-size shards, merged in order, so the trained model does not depend on the number of threads"}},
+		{BP_BACKGROUND_EXPANSION  , Parameter_Value{"BackgroundExpansion"  , PARAM_BOOL, Persistence::PERSISTENT, false, "Compute the predictions for nodes to be expanded on a worker thread, adding their children at the start of the next frame"}},
+		{BP_ADAPTIVE_NODE_BUDGET  , Parameter_Value{"AdaptiveNodeBudget"   , PARAM_BOOL, Persistence::PERSISTENT, false, "Adjust the node budget (starting from NodeBudget) every frame, so frames take TargetFrameTime"}},
+		{BP_HEAP_EXPANSION_POLICY , Parameter_Value{"HeapExpansionPolicy"  , PARAM_BOOL, Persistence::PERSISTENT, false, "Keep the nodes to expand or collapse in heaps from frame to frame, rather than sorting them all every frame"}},
 									 
 		{LP_ORIENTATION           , Parameter_Value{ "ScreenOrientation"         , PARAM_LONG, Persistence::PERSISTENT, -2l  , "Screen Orientation"}},
 		{LP_MAX_BITRATE           , Parameter_Value{ "MaxBitRateTimes100"        , PARAM_LONG, Persistence::PERSISTENT, 80l  , "Max Bit Rate Times 100"}},
@@ -121,6 +125,10 @@ namespace Dasher{
 		{LP_X_LIMIT_SPEED         , Parameter_Value{ "XLimitSpeed"               , PARAM_LONG, Persistence::PERSISTENT, 800l  , "X Co-ordinate at which maximum speed is reached (&lt;2048=xhair)"}},
 		{LP_GAME_HELP_DIST        , Parameter_Value{ "GameHelpDistance"          , PARAM_LONG, Persistence::PERSISTENT, 1920l , "Distance of sentence from center to decide user needs help"}},
 		{LP_GAME_HELP_TIME        , Parameter_Value{ "GameHelpTime"              , PARAM_LONG, Persistence::PERSISTENT, 0l    , "Time for which user must need help before help drawn"}},
+		{LP_TRAINING_THREADS      , Parameter_Value{ "TrainingThreads"           , PARAM_LONG, Persistence::PERSISTENT, 1l    , "Threads to use for training language models on large files (0 = one per processor, 1 = no parallel training)"}},
+		{LP_LM_MEMORY_LIMIT       , Parameter_Value{ "LMMemoryLimit"             , PARAM_LONG, Persistence::PERSISTENT, 0l    , "Max memory for the PPM language model, in KiB; when reached, counts are halved and rare contexts forgotten (0 = unlimited)"}},
+		{LP_PROB_CACHE_SIZE       , Parameter_Value{ "ProbCacheSize"             , PARAM_LONG, Persistence::PERSISTENT, 256l  , "Number of language model contexts whose predictions are cached for reuse by new nodes (0 = no caching)"}},
+		{LP_TARGET_FRAME_TIME     , Parameter_Value{ "TargetFrameTime"           , PARAM_LONG, Persistence::PERSISTENT, 20l   , "Time (in ms) each frame should take, when AdaptiveNodeBudget is on"}},
 								
 								
 		{SP_ALPHABET_ID          , Parameter_Value{ "AlphabetID"       , PARAM_STRING, Persistence::PERSISTENT, std::string("")              , "AlphabetID"}},
@@ -23,6 +23,8 @@ namespace Dasher
 		BP_COPY_ALL_ON_STOP, BP_SPEAK_ALL_ON_STOP, BP_SPEAK_WORDS,
 		BP_GAME_HELP_DRAW_PATH, BP_TWO_PUSH_RELEASE_TIME,
 		BP_SLOW_CONTROL_BOX, BP_SIMULATE_TRANSPARENCY,
+		BP_DETERMINISTIC_TRAINING, BP_BACKGROUND_EXPANSION, BP_ADAPTIVE_NODE_BUDGET,
+		BP_HEAP_EXPANSION_POLICY,
 		END_OF_BPS,
 
 		LP_ORIENTATION, LP_MAX_BITRATE, LP_FRAMERATE,
@@ -44,6 +46,7 @@ namespace Dasher
 		LP_DYNAMIC_SPEED_INC, LP_DYNAMIC_SPEED_FREQ, LP_DYNAMIC_SPEED_DEC,
 		LP_TAP_TIME, LP_MARGIN_WIDTH, LP_TARGET_OFFSET, LP_X_LIMIT_SPEED,
 		LP_GAME_HELP_DIST, LP_GAME_HELP_TIME,
+		LP_TRAINING_THREADS, LP_LM_MEMORY_LIMIT, LP_PROB_CACHE_SIZE, LP_TARGET_FRAME_TIME,
 		END_OF_LPS,
 
 
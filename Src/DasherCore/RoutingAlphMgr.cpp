@@ -12,6 +12,7 @@
 
 #include "DasherInterfaceBase.h"
 #include "LanguageModelling/RoutingPPMLanguageModel.h"
+#include "TraceRecorder.h"
 using namespace Dasher;
 
 
@@ -129,6 +130,7 @@ symbol CRoutingAlphMgr::CRoutingTrainer::getRoute(bool bHaveRoute, const std::st
 }
 
 void CRoutingAlphMgr::CRoutingTrainer::Train(CAlphabetMap::SymbolStream &syms) {
+  DASHER_TRACE_SPAN("CTrainer::Train", "training");
   CLanguageModel::Context trainContext = m_pLanguageModel->CreateEmptyContext();
   
   std::string strRoute; bool bHaveRoute(false);
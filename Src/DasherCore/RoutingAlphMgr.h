@@ -71,6 +71,8 @@ namespace Dasher {
     public:
       std::string trainText();
       CRoutedSym(int iOffset, CDasherScreen::Label *pLabel, CRoutingAlphMgr *pMgr, symbol iSymbol);
+      const char *ClassName() const override {return "CRoutedSym";}
+      std::size_t ObjectSize() const override {return sizeof(CRoutedSym);}
     protected:
       CRoutingAlphMgr *mgr() const {return static_cast<CRoutingAlphMgr*>(m_pMgr);}
     };
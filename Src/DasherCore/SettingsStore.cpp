@@ -7,6 +7,7 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include "SettingsStore.h"
+#include "MemoryReport.h"
 
 #include <cstdlib>
 #include <myassert.h>
@@ -61,9 +62,9 @@ const char * CSettingsStore::ClSet(const std::string &strKey, const std::string
 		if(strKey != value.name) continue;
 		switch (value.type) {
 			case Settings::PARAM_BOOL: 
-				if ((strValue == "0") || (strValue == "true") || (strValue == "True")){
+				if ((strValue == "0") || (strValue == "false") || (strValue == "False")){
 					SetBoolParameter(key, false);
-                }else if((strValue == "1") || (strValue == "false") || (strValue == "False")){
+                }else if((strValue == "1") || (strValue == "true") || (strValue == "True")){
 					SetBoolParameter(key, true);
                 }else{
 					// Note to translators: This message will be output for a command line
@@ -154,6 +155,17 @@ void CSettingsStore::ResetParameter(Parameter parameter) {
 	current_parameter->second.value = default_parameter->second.value;
 }
 
+void CSettingsStore::ReportMemory(CMemoryReport &report) const {
+  //hash table buckets, plus a node (value, next pointer and hash) per parameter
+  size_t iBytes = parameters_.bucket_count() * sizeof(void *);
+  for (const auto &it : parameters_) {
+    const Settings::Parameter_Value &param(it.second);
+    iBytes += sizeof(it) + 2 * sizeof(void *) + CMemoryReport::StringBytes(param.name) + CMemoryReport::StringBytes(param.human_readable);
+    if (const std::string *pValue = std::get_if<std::string>(&param.value)) iBytes += CMemoryReport::StringBytes(*pValue);
+  }
+  report.Add(CMemoryReport::MEM_SETTINGS, "CSettingsStore", parameters_.size(), iBytes);
+}
+
 /* Private functions -- Settings are not saved between sessions unless these
 functions are over-ridden.
 --------------------------------------------------------------------------*/
@@ -16,6 +16,7 @@
 #include "Parameters.h"
 
 namespace Dasher {
+class CMemoryReport;
 /// \ingroup Core
 /// @{
 
@@ -67,6 +68,9 @@ public:
     
   virtual bool IsParameterSaved(const std::string & Key) { return false; }; // avoid undef sub-classes error
 
+  ///Adds the table of parameter values to a memory report
+  void ReportMemory(CMemoryReport &report) const;
+
 protected:
     ///Loads all (persistent) prefs from disk, using+storing default values when no
     /// existing value stored; non-persistent prefs are reinitialized from defaults.
@@ -0,0 +1,90 @@
+// TraceRecorder.cpp
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// This file is part of Dasher.
+//
+// Dasher is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Dasher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Dasher; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include "TraceRecorder.h"
+
+#include <atomic>
+#include <cstdio>
+
+using namespace Dasher;
+
+CTraceRecorder *Dasher::g_pTraceRecorder = NULL;
+
+//Spans buffered before writing out
+static const size_t BUFFER_SPANS = 4096;
+
+CTraceRecorder::CTraceRecorder(const std::string &strFilename)
+: m_tEpoch(std::chrono::steady_clock::now()), m_file(strFilename, std::ios::out | std::ios::trunc), m_iNumSpans(0) {
+  m_bOpen = static_cast<bool>(m_file);
+  m_vBuffer.reserve(BUFFER_SPANS);
+  if (m_bOpen)
+    m_file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+              "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Dasher\"}}";
+}
+
+CTraceRecorder::~CTraceRecorder() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  WriteBuffer();
+  if (m_bOpen) m_file << "\n]}\n";
+}
+
+unsigned int CTraceRecorder::ThreadNumber() {
+  static std::atomic<unsigned int> iNextThread(1);
+  thread_local const unsigned int iThread = iNextThread++;
+  return iThread;
+}
+
+void CTraceRecorder::AddSpan(const char *szName, const char *szCategory,
+                             std::chrono::steady_clock::time_point tStart, std::chrono::steady_clock::time_point tEnd) {
+  SSpan span;
+  span.szName = szName;
+  span.szCategory = szCategory;
+  span.dStartUs = std::chrono::duration<double, std::micro>(tStart - m_tEpoch).count();
+  span.dDurationUs = std::chrono::duration<double, std::micro>(tEnd - tStart).count();
+  span.iThread = ThreadNumber();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_vBuffer.push_back(span);
+  m_iNumSpans++;
+  if (m_vBuffer.size() >= BUFFER_SPANS) WriteBuffer();
+}
+
+void CTraceRecorder::Flush() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  WriteBuffer();
+  if (m_bOpen) m_file.flush();
+}
+
+unsigned long CTraceRecorder::GetNumSpans() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_iNumSpans;
+}
+
+void CTraceRecorder::WriteBuffer() {
+  if (m_bOpen) {
+    //"X" (complete) events; times in microseconds, as the format requires
+    char buf[256];
+    for (const SSpan &span : m_vBuffer) {
+      snprintf(buf, sizeof(buf), ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+               span.szName, span.szCategory, span.dStartUs, span.dDurationUs, span.iThread);
+      m_file << buf;
+    }
+  }
+  m_vBuffer.clear();
+}
@@ -0,0 +1,112 @@
+// TraceRecorder.h
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// This file is part of Dasher.
+//
+// Dasher is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Dasher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Dasher; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+#pragma once
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Dasher {
+/// \ingroup Model
+/// \{
+
+/// Writes timed spans (node expansion, language model calls, training, alphabet
+/// parsing, saving settings...) to a file in the Chrome trace-event JSON format, as
+/// read by chrome://tracing and https://ui.perfetto.dev. Spans are only recorded if
+/// DASHER_TRACING is defined (the CMake option of the same name), and while
+/// g_pTraceRecorder points to a recorder; so, a host creates one to start tracing,
+/// and deletes it (which completes the file) to stop.
+///
+/// Spans may be recorded from any thread (e.g. CExpansionWorker, or CTrainer's
+/// workers). They are buffered, and written out in batches; the file stays open.
+class CTraceRecorder {
+public:
+  ///Opens (truncating) the file; check IsOpen.
+  CTraceRecorder(const std::string &strFilename);
+  ///Writes any buffered spans and completes the file.
+  ~CTraceRecorder();
+
+  bool IsOpen() const {return m_bOpen;}
+
+  ///Records a span, in the current thread; szName and szCategory must be string
+  /// literals (or otherwise outlive the recorder), and need no escaping for JSON.
+  void AddSpan(const char *szName, const char *szCategory,
+               std::chrono::steady_clock::time_point tStart, std::chrono::steady_clock::time_point tEnd);
+
+  ///Writes out buffered spans now
+  void Flush();
+
+  ///Number of spans recorded so far
+  unsigned long GetNumSpans() const;
+
+  ///Records a span from construction to destruction, if given a recorder (else nothing)
+  class ScopedSpan {
+  public:
+    ScopedSpan(CTraceRecorder *pRecorder, const char *szName, const char *szCategory)
+    : m_pRecorder(pRecorder), m_szName(szName), m_szCategory(szCategory) {
+      if (m_pRecorder) m_tStart = std::chrono::steady_clock::now();
+    }
+    ~ScopedSpan() {
+      if (m_pRecorder) m_pRecorder->AddSpan(m_szName, m_szCategory, m_tStart, std::chrono::steady_clock::now());
+    }
+  private:
+    CTraceRecorder * const m_pRecorder;
+    const char * const m_szName, * const m_szCategory;
+    std::chrono::steady_clock::time_point m_tStart;
+  };
+
+private:
+  struct SSpan {
+    const char *szName, *szCategory;
+    double dStartUs, dDurationUs;
+    unsigned int iThread;
+  };
+  ///Writes m_vBuffer to the file and empties it; must hold m_mutex
+  void WriteBuffer();
+  ///Small number identifying the calling thread (the first to record a span is 1)
+  static unsigned int ThreadNumber();
+
+  const std::chrono::steady_clock::time_point m_tEpoch;
+  mutable std::mutex m_mutex;
+  std::ofstream m_file;
+  bool m_bOpen;
+  std::vector<SSpan> m_vBuffer;
+  unsigned long m_iNumSpans;
+};
+
+///The recorder spans are written to, or NULL if not tracing. Set and reset only
+/// while nothing is being traced (i.e. between frames, and not during training).
+extern CTraceRecorder *g_pTraceRecorder;
+/// \}
+}
+
+/// DASHER_TRACE_SPAN(szName, szCategory) records the rest of the enclosing scope as a
+/// span in g_pTraceRecorder, if tracing is compiled in and a recorder exists.
+#ifdef DASHER_TRACING
+#define DASHER_TRACE_CONCAT2(a, b) a##b
+#define DASHER_TRACE_CONCAT(a, b) DASHER_TRACE_CONCAT2(a, b)
+#define DASHER_TRACE_SPAN(szName, szCategory) \
+  Dasher::CTraceRecorder::ScopedSpan DASHER_TRACE_CONCAT(traceSpan_, __LINE__)(Dasher::g_pTraceRecorder, szName, szCategory)
+#else
+#define DASHER_TRACE_SPAN(szName, szCategory)
+#endif
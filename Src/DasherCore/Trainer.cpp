@@ -1,8 +1,19 @@
 
 #include "Trainer.h"
+#include "MappedFile.h"
+#include "TraceRecorder.h"
 
 #include <I18n.h>
+#include <myassert.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <string>
 #include <istream>
@@ -11,7 +22,7 @@ using namespace Dasher;
 
 
 CTrainer::CTrainer(CMessageDisplay *pMsgs, CLanguageModel *pLanguageModel, const CAlphInfo *pInfo, const CAlphabetMap *pAlphabet)
-  : AbstractParser(pMsgs), m_pAlphabet(pAlphabet), m_pLanguageModel(pLanguageModel), m_pInfo(pInfo), m_pProg(NULL) {
+  : AbstractParser(pMsgs), m_pAlphabet(pAlphabet), m_pLanguageModel(pLanguageModel), m_pInfo(pInfo), m_pProg(NULL), m_iThreads(1), m_bDeterministic(true) {
     std::vector<symbol> syms;
     pAlphabet->GetSymbols(syms,pInfo->GetContextEscapeChar());
     if (syms.size()==1)
@@ -28,20 +39,25 @@ CTrainer::~CTrainer() {
 }
 
 void CTrainer::Train(CAlphabetMap::SymbolStream &syms) {
-  CLanguageModel::Context sContext = m_pLanguageModel->CreateEmptyContext();
+  Train(m_pLanguageModel, syms);
+}
+
+void CTrainer::Train(CLanguageModel *pModel, CAlphabetMap::SymbolStream &syms) {
+  DASHER_TRACE_SPAN("CTrainer::Train", "training");
+  CLanguageModel::Context sContext = pModel->CreateEmptyContext();
 
   for(symbol sym; (sym=syms.next(m_pAlphabet))!=-1;) {
     //check for context-switch commands.
     // (Will only ever be triggered if m_strEscape is a single unicode character, hence warning in c'tor)
-    if (readEscape(sContext, sym, syms)) continue;
+    if (readEscape(pModel, sContext, sym, syms)) continue;
     //either a non-escapecharacter, or a double escapecharacter, was read;
     //either way, sym identifies the symbol.
-    m_pLanguageModel->LearnSymbol(sContext, sym);
+    pModel->LearnSymbol(sContext, sym);
   }
-  m_pLanguageModel->ReleaseContext(sContext);
+  pModel->ReleaseContext(sContext);
 }
 
-bool CTrainer::readEscape(CLanguageModel::Context &sContext, symbol sym, CAlphabetMap::SymbolStream &syms) {
+bool CTrainer::readEscape(CLanguageModel *pModel, CLanguageModel::Context &sContext, symbol sym, CAlphabetMap::SymbolStream &syms) {
   if (sym != m_iCtxEsc) return false;
   
   //that was a quick check, to avoid calling slow peekBack() in most cases. Now make sure...
@@ -56,16 +72,16 @@ bool CTrainer::readEscape(CLanguageModel::Context &sContext, symbol sym, CAlphab
     return false;
   }
   //ok, so switch context. release the old, start a new...
-  m_pLanguageModel->ReleaseContext(sContext);
-  sContext = m_pLanguageModel->CreateEmptyContext();
+  pModel->ReleaseContext(sContext);
+  sContext = pModel->CreateEmptyContext();
   //enter the alphabet default context first...
   std::vector<symbol> defCtx;
   m_pAlphabet->GetSymbols(defCtx, m_pInfo->GetDefaultContext());
-  for (std::vector<symbol>::iterator it=defCtx.begin(); it!=defCtx.end(); it++) m_pLanguageModel->EnterSymbol(sContext, *it);
+  for (std::vector<symbol>::iterator it=defCtx.begin(); it!=defCtx.end(); it++) pModel->EnterSymbol(sContext, *it);
   //and read the first delimiter; everything until the second occurrence of this, is _context_ only.
   for (symbol sym; (sym=syms.next(m_pAlphabet))!=-1; ) {
     if (syms.peekBack()==delim) break;
-    m_pLanguageModel->EnterSymbol(sContext, sym);
+    pModel->EnterSymbol(sContext, sym);
   }
   return true;  
 }
@@ -74,6 +90,8 @@ class ProgressStream : public CAlphabetMap::SymbolStream {
 public:
   ProgressStream(std::istream &_in, CTrainer::ProgressIndicator *pProg, CMessageDisplay *pMsgs, off_t iStart=0) : SymbolStream(_in,pMsgs), m_iLastPos(iStart), m_pProg(pProg) {
   }
+  ProgressStream(const char *pData, size_t iLength, CTrainer::ProgressIndicator *pProg, CMessageDisplay *pMsgs) : SymbolStream(pData,iLength,pMsgs), m_iLastPos(0), m_pProg(pProg) {
+  }
   void bytesRead(off_t num) {
     if (m_pProg) m_pProg->bytesRead(m_iLastPos += num);
   }
@@ -82,6 +100,23 @@ private:
   CTrainer::ProgressIndicator *m_pProg;
 };
 
+///Stream for one shard of parallel training: counts bytes read into an atomic, for the
+/// calling thread to report; doesn't report encoding errors (CMessageDisplay is not thread-safe)
+class ShardStream : public CAlphabetMap::SymbolStream {
+public:
+  ShardStream(const char *pData, size_t iLength, std::atomic<off_t> &iRead) : SymbolStream(pData, iLength), m_iRead(iRead) {
+  }
+  void bytesRead(off_t num) {
+    m_iRead += num;
+  }
+private:
+  std::atomic<off_t> &m_iRead;
+};
+
+///Shards of a deterministic split are this long (extended to the end of a line);
+/// anything shorter than two shards is trained sequentially.
+static const size_t SHARD_BYTES = 1 << 20;
+
 bool Dasher::CTrainer::Parse(const std::string &strDesc, std::istream &in, bool bUser) {
   if (in.fail()) {
     m_pMsgs->FormatMessage("Unable to open file \"%s\" for reading",strDesc.c_str());
@@ -90,8 +125,131 @@ bool Dasher::CTrainer::Parse(const std::string &strDesc, std::istream &in, bool
   ///easy enough to be re-entrant, so might as well
   std::string oldDesc=m_strDesc;
   m_strDesc = strDesc;
-  ProgressStream syms(in,m_pProg,m_pMsgs);
-  Train(syms);
+  CLanguageModel *pShard = (m_iThreads == 1) ? NULL : m_pLanguageModel->CreateShard();
+  if (pShard) {
+    const std::string strText((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    TrainText(strText.data(), strText.size(), pShard);
+  } else {
+    ProgressStream syms(in,m_pProg,m_pMsgs);
+    Train(syms);
+  }
   m_strDesc=oldDesc;
   return true;
+}
+
+bool Dasher::CTrainer::ParseFile(const std::string &strPath, bool bUser) {
+  CMappedFile file;
+  //can't map empty files, so let the stream version deal with those (and errors)
+  if (!file.Open(strPath)) return AbstractParser::ParseFile(strPath, bUser);
+  std::string oldDesc=m_strDesc;
+  m_strDesc = strPath;
+  TrainText(reinterpret_cast<const char *>(file.Data()), file.Size(), (m_iThreads == 1) ? NULL : m_pLanguageModel->CreateShard());
+  m_strDesc=oldDesc;
+  return true;
+}
+
+void CTrainer::TrainText(const char *pText, size_t iLength, CLanguageModel *pFirstShard) {
+  if (pFirstShard && TrainSharded(pText, iLength, pFirstShard)) return;
+  ProgressStream syms(pText,iLength,m_pProg,m_pMsgs);
+  Train(syms);
+}
+
+bool CTrainer::TrainSharded(const char *pText, size_t iLength, CLanguageModel *pFirstShard) {
+  const size_t iThreads = (m_iThreads > 0) ? m_iThreads : std::max(1u, std::thread::hardware_concurrency());
+  const size_t iShardLen = m_bDeterministic ? SHARD_BYTES : std::max(SHARD_BYTES, iLength / iThreads + 1);
+
+  //Shard i is [vBounds[i], vBounds[i+1]); split after newlines, so never within a character
+  std::vector<size_t> vBounds(1, 0);
+  while (vBounds.back() < iLength) {
+    size_t iEnd = vBounds.back() + iShardLen;
+    const char *pNewline = (iEnd >= iLength) ? NULL : static_cast<const char *>(memchr(pText + iEnd, '\n', iLength - iEnd));
+    iEnd = pNewline ? (pNewline - pText) + 1 : iLength;
+    vBounds.push_back(iEnd);
+  }
+  const size_t iShards = vBounds.size() - 1;
+  if (iThreads == 1 || iShards < 2) {
+    delete pFirstShard;
+    return false;
+  }
+
+  struct SShard {
+    CLanguageModel *pModel = NULL;
+    bool bDone = false, bMerged = false;
+    std::atomic<off_t> iRead{0};
+  };
+  std::vector<SShard> vShards(iShards);
+  vShards[0].pModel = pFirstShard;
+
+  //Guards the following, and the above bools & pModels:
+  std::mutex mutex;
+  std::condition_variable cond;
+  size_t iNextToTrain = 0, iNumCreated = 1;
+
+  //Workers train shards in file order, as models become available
+  auto worker = [&]() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      cond.wait(lock, [&] {return iNextToTrain == iShards || iNextToTrain < iNumCreated;});
+      if (iNextToTrain == iShards) return;
+      const size_t i = iNextToTrain++;
+      lock.unlock();
+      ShardStream syms(pText + vBounds[i], vBounds[i + 1] - vBounds[i], vShards[i].iRead);
+      Train(vShards[i].pModel, syms);
+      lock.lock();
+      vShards[i].bDone = true;
+      cond.notify_all();
+    }
+  };
+  std::vector<std::thread> vWorkers;
+  for (size_t i = 0; i < std::min(iThreads, iShards); i++)
+    vWorkers.emplace_back(worker);
+
+  //Meanwhile, on this thread: create models for upcoming shards (a few ahead, to bound
+  // memory use), merge finished shards into the real model, and report progress.
+  const size_t iMaxUnmerged = 2 * iThreads;
+  std::unique_lock<std::mutex> lock(mutex);
+  for (size_t iNumMerged = 0; iNumMerged < iShards;) {
+    if (iNumCreated < iShards && iNumCreated < iNumMerged + iMaxUnmerged) {
+      lock.unlock();
+      CLanguageModel *pModel = m_pLanguageModel->CreateShard();
+      DASHER_ASSERT(pModel); //settings can't have changed since the first
+      lock.lock();
+      vShards[iNumCreated++].pModel = pModel;
+      cond.notify_all();
+      continue;
+    }
+    size_t iMerge = iShards;
+    if (m_bDeterministic) {
+      if (vShards[iNumMerged].bDone) iMerge = iNumMerged;
+    } else {
+      for (size_t i = 0; i < iNumCreated; i++)
+        if (vShards[i].bDone && !vShards[i].bMerged) {
+          iMerge = i;
+          break;
+        }
+    }
+    if (iMerge == iShards) {
+      cond.wait_for(lock, std::chrono::milliseconds(50));
+      if (m_pProg) {
+        off_t iRead = 0;
+        for (const SShard &shard : vShards) iRead += shard.iRead;
+        m_pProg->bytesRead(iRead);
+      }
+      continue;
+    }
+    lock.unlock();
+    //can't fail, as the shard came from the same model's CreateShard
+    {
+      DASHER_TRACE_SPAN("CLanguageModel::MergeShard", "training");
+      m_pLanguageModel->MergeShard(vShards[iMerge].pModel);
+    }
+    delete vShards[iMerge].pModel;
+    lock.lock();
+    vShards[iMerge].pModel = NULL;
+    vShards[iMerge].bMerged = true;
+    iNumMerged++;
+  }
+  lock.unlock();
+  for (std::thread &t : vWorkers) t.join();
+  return true;
 }
\ No newline at end of file
@@ -18,12 +18,43 @@ namespace Dasher {
     
     void SetProgressIndicator(ProgressIndicator *pProg) {m_pProg = pProg;}
 
+    ///The model this trains
+    CLanguageModel *GetLanguageModel() const {return m_pLanguageModel;}
+
+    ///Configures training on large files in parallel (see Parse).
+    /// \param iThreads number of worker threads; 0 means one per hardware thread,
+    /// 1 means always train sequentially on the calling thread.
+    /// \param bDeterministic if true, shard boundaries depend only on the file, and
+    /// shards are merged in file order, so the trained model is the same whatever
+    /// the number of threads; if false, there is one shard per thread, merged as
+    /// soon as each finishes.
+    void SetParallelism(int iThreads, bool bDeterministic) {
+      m_iThreads = iThreads;
+      m_bDeterministic = bDeterministic;
+    }
+
     ///Parses a text file; bUser ignored.
+    /// If parallel training is enabled, the language model supports it (CLanguageModel::
+    /// CreateShard), and the file is large enough, the text is split at line breaks into
+    /// shards which are learnt into separate models by worker threads, then merged into
+    /// the language model on the calling thread (which also reports progress). Contexts
+    /// do not carry across shard boundaries, and update exclusion applies only within
+    /// each shard, so the result differs slightly from learning the file sequentially.
     bool Parse(const std::string &strDesc, std::istream &in, bool bUser);
+
+    ///Trains on a file as Parse, but memory-maps it (if possible) rather than reading
+    /// it through a stream, so symbols are decoded straight out of the file's pages.
+    bool ParseFile(const std::string &strPath, bool bUser) override;
   
   protected:
 
+    ///Learns a whole file sequentially. Not called when a file is trained in shards;
+    /// subclasses overriding this should use models which don't support CreateShard.
     virtual void Train(CAlphabetMap::SymbolStream &syms);
+
+    ///Learns all symbols from a stream into a model, obeying context-switch commands
+    /// (i.e. as the default Train(), but for any model)
+    void Train(CLanguageModel *pModel, CAlphabetMap::SymbolStream &syms);
     
     ///Try to read a context-switch escape sequence from the symbolstream.
     /// \param sContext context to be reinitialized if a context-switch command is found
@@ -37,7 +68,11 @@ namespace Dasher {
     ///  character is desired to be fed into the LanguageModel, this method returns false
     ///  with the stream positioned just after the second ctx-switch character
     ///  (ready to continue reading as per normal)
-    bool readEscape(CLanguageModel::Context &sContext, symbol sym, CAlphabetMap::SymbolStream &syms);
+    bool readEscape(CLanguageModel::Context &sContext, symbol sym, CAlphabetMap::SymbolStream &syms) {
+      return readEscape(m_pLanguageModel, sContext, sym, syms);
+    }
+    ///As above, but for a context in the specified model
+    bool readEscape(CLanguageModel *pModel, CLanguageModel::Context &sContext, symbol sym, CAlphabetMap::SymbolStream &syms);
 
     ///Returns the description of the file as passed to Parse()
     /// (usually a filename)
@@ -48,8 +83,21 @@ namespace Dasher {
     // symbol number in alphabet of the context-switch character (maybe 0 if not in alphabet!)
     int m_iCtxEsc;
   private:
+    ///Trains on text in memory: in shards if pFirstShard is non-NULL (see TrainSharded),
+    /// else (or if sharding would be pointless) sequentially.
+    void TrainText(const char *pText, size_t iLength, CLanguageModel *pFirstShard);
+
+    ///Splits the text into shards, trains them on worker threads & merges them into
+    /// m_pLanguageModel.
+    /// \param pFirstShard result of m_pLanguageModel->CreateShard(), to use for the first
+    /// shard; deleted by this method in all cases.
+    /// \return false, having done nothing, if there would be only one shard or thread.
+    bool TrainSharded(const char *pText, size_t iLength, CLanguageModel *pFirstShard);
+
     ProgressIndicator *m_pProg;
     std::string m_strDesc;
+    int m_iThreads;
+    bool m_bDeterministic;
   };
 
 }
@@ -0,0 +1,357 @@
+// TrainingJournal.cpp
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// This file is part of Dasher.
+//
+// Dasher is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Dasher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Dasher; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include "TrainingJournal.h"
+#include "TraceRecorder.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace Dasher;
+
+namespace {
+  //Each record: magic, path length u32, offset u64, text length u32, path, text,
+  // then an FNV-1a checksum (u32) of all the preceding bytes of the record.
+  // All integers little-endian.
+  const char szMagic[4] = {'D','T','J','R'};
+  const size_t iFixedSize = 4 + 4 + 8 + 4;
+
+  uint32_t Checksum(const char *p, size_t iLen) {
+    uint32_t iHash = 2166136261u;
+    for (const char *pEnd = p + iLen; p != pEnd; p++)
+      iHash = (iHash ^ static_cast<unsigned char>(*p)) * 16777619u;
+    return iHash;
+  }
+
+  void PutU32(std::string &strOut, uint32_t i) {
+    for (int b = 0; b < 32; b += 8) strOut += static_cast<char>(i >> b);
+  }
+  void PutU64(std::string &strOut, uint64_t i) {
+    PutU32(strOut, static_cast<uint32_t>(i));
+    PutU32(strOut, static_cast<uint32_t>(i >> 32));
+  }
+  uint32_t GetU32(const char *p) {
+    uint32_t i = 0;
+    for (int b = 3; b >= 0; b--) i = (i << 8) | static_cast<unsigned char>(p[b]);
+    return i;
+  }
+  uint64_t GetU64(const char *p) {
+    return GetU32(p) | (static_cast<uint64_t>(GetU32(p + 4)) << 32);
+  }
+
+  void EncodeRecord(std::string &strOut, const std::string &strFile, uint64_t iOffset, const std::string &strText) {
+    const size_t iStart = strOut.size();
+    strOut.append(szMagic, 4);
+    PutU32(strOut, static_cast<uint32_t>(strFile.size()));
+    PutU64(strOut, iOffset);
+    PutU32(strOut, static_cast<uint32_t>(strText.size()));
+    strOut += strFile;
+    strOut += strText;
+    PutU32(strOut, Checksum(&strOut[iStart], strOut.size() - iStart));
+  }
+
+  ///Size of a file, or 0 if it doesn't exist
+  uint64_t FileSize(const std::string &strFile) {
+    std::error_code ec;
+    const uintmax_t iSize = std::filesystem::file_size(strFile, ec);
+    return ec ? 0 : static_cast<uint64_t>(iSize);
+  }
+
+  //Thin wrappers over the (POSIX, or Windows CRT) file descriptor calls, as neither
+  // iostreams nor stdio can sync a file to disk.
+
+  ///Opens a file for writing (and if bAppend, only at its end), creating it if
+  /// necessary; -1 on failure
+  int OpenFile(const std::string &strFile, bool bAppend) {
+#ifdef _WIN32
+    return _open(strFile.c_str(), _O_WRONLY | _O_CREAT | _O_BINARY | (bAppend ? _O_APPEND : 0), _S_IREAD | _S_IWRITE);
+#else
+    return open(strFile.c_str(), O_WRONLY | O_CREAT | (bAppend ? O_APPEND : 0), 0666);
+#endif
+  }
+
+  bool WriteAll(int fd, const char *p, size_t iLen) {
+    while (iLen) {
+#ifdef _WIN32
+      const int iWritten = _write(fd, p, static_cast<unsigned int>(std::min<size_t>(iLen, 1 << 30)));
+#else
+      const ssize_t iWritten = write(fd, p, iLen);
+      if (iWritten < 0 && errno == EINTR) continue;
+#endif
+      if (iWritten <= 0) return false;
+      p += iWritten;
+      iLen -= static_cast<size_t>(iWritten);
+    }
+    return true;
+  }
+
+  bool SeekTo(int fd, uint64_t iOffset) {
+#ifdef _WIN32
+    return _lseeki64(fd, static_cast<__int64>(iOffset), SEEK_SET) != -1;
+#else
+    return lseek(fd, static_cast<off_t>(iOffset), SEEK_SET) != static_cast<off_t>(-1);
+#endif
+  }
+
+  bool Truncate(int fd, uint64_t iSize) {
+#ifdef _WIN32
+    return _chsize_s(fd, static_cast<__int64>(iSize)) == 0;
+#else
+    return ftruncate(fd, static_cast<off_t>(iSize)) == 0;
+#endif
+  }
+
+  bool Sync(int fd) {
+#ifdef _WIN32
+    return _commit(fd) == 0;
+#else
+    return fsync(fd) == 0;
+#endif
+  }
+
+  void CloseFile(int fd) {
+#ifdef _WIN32
+    _close(fd);
+#else
+    close(fd);
+#endif
+  }
+
+  ///Opens, fsyncs and closes a file
+  bool SyncFile(const std::string &strFile) {
+    const int fd = OpenFile(strFile, true);
+    if (fd == -1) return false;
+    const bool bOk = Sync(fd);
+    CloseFile(fd);
+    return bOk;
+  }
+
+  ///Truncates a file to iSize bytes and fsyncs it
+  bool TruncateFile(const std::string &strFile, uint64_t iSize) {
+    const int fd = OpenFile(strFile, true);
+    if (fd == -1) return false;
+    const bool bOk = Truncate(fd, iSize) && Sync(fd);
+    CloseFile(fd);
+    return bOk;
+  }
+
+  ///Whether a file holds strText at iOffset
+  bool HasTextAt(const std::string &strFile, uint64_t iOffset, const std::string &strText) {
+    std::ifstream in(strFile.c_str(), std::ios::binary);
+    if (!in.seekg(static_cast<std::streamoff>(iOffset))) return false;
+    std::string strOld(strText.size(), '\0');
+    return in.read(&strOld[0], static_cast<std::streamsize>(strOld.size())) && strOld == strText;
+  }
+}
+
+CTrainingJournal::CTrainingJournal(const std::string &strJournalFile, size_t iFlushBytes,
+                                   unsigned int iFlushMs, uint64_t iCheckpointBytes)
+: m_strJournalFile(strJournalFile), m_iFlushBytes(iFlushBytes), m_flushDelay(iFlushMs),
+  m_iCheckpointBytes(iCheckpointBytes), m_iQueuedBytes(0), m_iAppended(0), m_iWritten(0), m_iFlushTarget(0),
+  m_bStop(false), m_bFailed(false), m_iJournalBytes(0) {
+  //if the journal couldn't be emptied, its records are all applied now; new ones can
+  // follow them, and it'll be emptied at the next checkpoint.
+  if (Replay(m_strJournalFile) < 0) {
+    m_bFailed = true;
+    m_iJournalBytes = FileSize(m_strJournalFile);
+  }
+  m_thread = std::thread(&CTrainingJournal::Run, this);
+}
+
+CTrainingJournal::~CTrainingJournal() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_bStop = true;
+  }
+  m_condWork.notify_one();
+  m_thread.join();
+  //Anything still queued, we write out ourselves
+  if (WriteBatch(m_vQueue, true) && m_iJournalBytes == 0) {
+    //nothing to replay, so don't leave an empty journal lying around
+    std::error_code ec;
+    std::filesystem::remove(m_strJournalFile, ec);
+  }
+}
+
+void CTrainingJournal::Append(const std::string &strFile, const std::string &strText) {
+  if (strText.empty()) return;
+  bool bNotify;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_vQueue.empty()) m_tOldest = std::chrono::steady_clock::now();
+    m_vQueue.push_back(SRecord{strFile, strText});
+    m_iQueuedBytes += strText.size();
+    m_iAppended++;
+    //the first record sets the thread's deadline; after that, only the size limit matters
+    bNotify = m_vQueue.size() == 1 || m_iQueuedBytes >= m_iFlushBytes;
+  }
+  if (bNotify) m_condWork.notify_one();
+}
+
+bool CTrainingJournal::Flush() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  const unsigned long iTarget = m_iAppended;
+  if (m_iWritten < iTarget) {
+    m_iFlushTarget = std::max(m_iFlushTarget, iTarget);
+    m_condWork.notify_one();
+    m_condWritten.wait(lock, [this, iTarget] {return m_iWritten >= iTarget;});
+  }
+  return !m_bFailed;
+}
+
+void CTrainingJournal::Run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_bStop) {
+    if (m_vQueue.empty()) {
+      m_condWork.wait(lock);
+      continue;
+    }
+    if (m_iQueuedBytes < m_iFlushBytes && m_iFlushTarget <= m_iWritten
+        && m_condWork.wait_until(lock, m_tOldest + m_flushDelay) == std::cv_status::no_timeout)
+      continue; //woken early: recheck whether to write yet, or stop
+    if (m_bStop) break;
+    std::vector<SRecord> vBatch;
+    vBatch.swap(m_vQueue);
+    m_iQueuedBytes = 0;
+    const unsigned long iBatchEnd = m_iAppended;
+    lock.unlock();
+    const bool bOk = WriteBatch(vBatch, false);
+    lock.lock();
+    if (!bOk) m_bFailed = true;
+    m_iWritten = iBatchEnd;
+    m_condWritten.notify_all();
+  }
+}
+
+bool CTrainingJournal::WriteBatch(std::vector<SRecord> &vBatch, bool bCheckpoint) {
+  bool bOk = true;
+  if (!vBatch.empty()) {
+    //Journal the records, each with the size its file will have before it is applied.
+    std::map<std::string, uint64_t> mapSizes;
+    //Text for each file, all at once
+    std::map<std::string, std::string> mapText;
+    std::string strJournal;
+    for (const SRecord &rec : vBatch) {
+      auto it = mapSizes.find(rec.strFile);
+      if (it == mapSizes.end()) it = mapSizes.emplace(rec.strFile, FileSize(rec.strFile)).first;
+      EncodeRecord(strJournal, rec.strFile, it->second, rec.strText);
+      it->second += rec.strText.size();
+      mapText[rec.strFile] += rec.strText;
+    }
+    std::error_code ec;
+    const std::filesystem::path parent(std::filesystem::path(m_strJournalFile).parent_path());
+    if (!parent.empty()) std::filesystem::create_directories(parent, ec);
+    const int fd = OpenFile(m_strJournalFile, true);
+    bool bJournalled = false;
+    if (fd != -1) {
+      bJournalled = WriteAll(fd, strJournal.data(), strJournal.size()) && Sync(fd);
+      //don't leave part of a record, which would hide any after it from Replay
+      if (!bJournalled) Truncate(fd, m_iJournalBytes);
+      CloseFile(fd);
+    }
+    if (bJournalled)
+      m_iJournalBytes += strJournal.size();
+    else
+      bOk = false; //but still append the text, as without a journal
+
+    for (const auto &file : mapText) {
+      const int fdTarget = OpenFile(file.first, true);
+      if (fdTarget == -1) {
+        bOk = false;
+        continue;
+      }
+      if (!WriteAll(fdTarget, file.second.data(), file.second.size())) bOk = false;
+      CloseFile(fdTarget);
+      m_setUnsynced.insert(file.first);
+    }
+    vBatch.clear();
+  }
+  if (bCheckpoint || m_iJournalBytes >= m_iCheckpointBytes)
+    if (!Checkpoint()) bOk = false;
+  return bOk;
+}
+
+bool CTrainingJournal::Checkpoint() {
+  for (auto it = m_setUnsynced.begin(); it != m_setUnsynced.end();) {
+    //keep any we can't sync, and the journal too, so they can be replayed
+    if (!SyncFile(*it)) return false;
+    it = m_setUnsynced.erase(it);
+  }
+  if (m_iJournalBytes == 0) return true;
+  if (!TruncateFile(m_strJournalFile, 0)) return false;
+  m_iJournalBytes = 0;
+  return true;
+}
+
+int CTrainingJournal::Replay(const std::string &strJournalFile) {
+  std::string strData;
+  {
+    std::ifstream in(strJournalFile.c_str(), std::ios::binary);
+    if (!in) return 0;
+    strData.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+  if (strData.empty()) return 0;
+  DASHER_TRACE_SPAN("CTrainingJournal::Replay", "io");
+
+  int iApplied = 0;
+  bool bOk = true;
+  std::set<std::string> setTargets;
+  for (size_t iPos = 0; strData.size() - iPos >= iFixedSize;) {
+    const char *pRecord = &strData[iPos];
+    if (memcmp(pRecord, szMagic, 4)) break;
+    const uint32_t iFileLen = GetU32(pRecord + 4);
+    const uint64_t iOffset = GetU64(pRecord + 8);
+    const uint32_t iTextLen = GetU32(pRecord + 16);
+    const uint64_t iSize = static_cast<uint64_t>(iFixedSize) + iFileLen + iTextLen;
+    //stop at the first incomplete or corrupt record: anything after it is garbage
+    if (strData.size() - iPos < iSize + 4 || GetU32(pRecord + iSize) != Checksum(pRecord, static_cast<size_t>(iSize)))
+      break;
+    const std::string strFile(pRecord + iFixedSize, iFileLen), strText(pRecord + iFixedSize + iFileLen, iTextLen);
+    iPos += static_cast<size_t>(iSize) + 4;
+
+    const uint64_t iFileSize = FileSize(strFile);
+    if (iFileSize < iOffset) continue; //file has been changed since
+    if (iFileSize >= iOffset + iTextLen && HasTextAt(strFile, iOffset, strText)) continue; //applied already
+    const int fd = OpenFile(strFile, false);
+    if (fd == -1 || !SeekTo(fd, iOffset) || !WriteAll(fd, strText.data(), strText.size())) bOk = false;
+    if (fd != -1) CloseFile(fd);
+    setTargets.insert(strFile);
+    iApplied++;
+  }
+  for (const std::string &strFile : setTargets)
+    if (!SyncFile(strFile)) bOk = false;
+  //only forget the records once they're safely in the targets
+  if (!bOk || !TruncateFile(strJournalFile, 0)) return -1;
+  return iApplied;
+}
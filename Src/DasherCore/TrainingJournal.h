@@ -0,0 +1,128 @@
+// TrainingJournal.h
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// This file is part of Dasher.
+//
+// Dasher is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Dasher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Dasher; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+#pragma once
+
+#include "../Common/NoClones.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Dasher {
+/// \ingroup Model
+/// \{
+
+/// Write-behind for text appended to the user's training files, so that committing
+/// text (CDasherInterfaceBase::WriteTrainFile) never waits for the disk. Append just
+/// queues the text in memory; a background thread writes it out once enough has
+/// built up, or the oldest text has waited long enough, or Flush is called.
+///
+/// Each batch is first appended to a journal file, as records giving the target
+/// file, the size that file should have before the text is added, the text, and a
+/// checksum; the journal is fsync'd (once per batch), and only then is the text
+/// appended to the targets, which are not synced. Once the journal has grown past a
+/// limit, and when the CTrainingJournal is deleted, the targets are fsync'd and the journal
+/// emptied (a checkpoint). So, after an unclean shutdown, the journal holds every
+/// batch since the last checkpoint, and Replay (done by the constructor) redoes
+/// those the targets lack: each record's text is written at its offset in the
+/// target, unless the target already holds it there, or (as the target must then
+/// have been changed by something else) ends before it. Replaying is thus
+/// idempotent. A record cut short by the crash was never applied, and is ignored.
+///
+/// Text waiting in memory (at most the size or time limits' worth) is lost if
+/// Dasher crashes; text in the journal is not.
+class CTrainingJournal : private NoClones {
+public:
+  ///Replays any records left in the journal by a previous run, then starts the
+  /// background thread.
+  /// \param strJournalFile file to keep the journal in; created when first needed
+  /// \param iFlushBytes write out queued text once at least this much is waiting
+  /// \param iFlushMs ...or once the oldest queued text has waited this long
+  /// \param iCheckpointBytes checkpoint once the journal is at least this big
+  CTrainingJournal(const std::string &strJournalFile, size_t iFlushBytes = 4096,
+                   unsigned int iFlushMs = 2000, uint64_t iCheckpointBytes = 1 << 20);
+  ///Writes out all queued text, checkpoints (deleting the then-empty journal), and
+  /// stops the thread.
+  ~CTrainingJournal();
+
+  ///Queues text to be appended to a file. Does no I/O, so returns immediately.
+  /// \param strFile full path of the file, so replaying doesn't depend on the working
+  /// directory (CDasherInterfaceBase::WriteTrainFile resolves it with FileUtils)
+  void Append(const std::string &strFile, const std::string &strText);
+
+  ///Blocks until all text appended so far has been journalled and written to its
+  /// file (so, e.g., the file can be read); does not checkpoint.
+  /// \return false if any write has failed since the journal was created
+  bool Flush();
+
+  ///Applies the records in a journal file to their targets, as described above,
+  /// fsyncs the targets, then empties the journal.
+  /// \return number of records which had to be (wholly or partly) applied, or -1 if
+  /// the journal could not be emptied afterwards.
+  static int Replay(const std::string &strJournalFile);
+
+private:
+  struct SRecord {
+    std::string strFile, strText;
+  };
+  void Run();
+  ///Journals and applies a batch of records (on the background thread, or during
+  /// destruction), then checkpoints if the journal is big enough or bCheckpoint.
+  /// \return false if anything failed
+  bool WriteBatch(std::vector<SRecord> &vBatch, bool bCheckpoint);
+  ///fsyncs every target written since the last checkpoint, then empties the journal
+  bool Checkpoint();
+
+  const std::string m_strJournalFile;
+  const size_t m_iFlushBytes;
+  const std::chrono::milliseconds m_flushDelay;
+  const uint64_t m_iCheckpointBytes;
+
+  std::mutex m_mutex;
+  ///Signalled when there is text to write, a Flush, or we should stop
+  std::condition_variable m_condWork;
+  ///Signalled when a batch has been written (for Flush)
+  std::condition_variable m_condWritten;
+  std::vector<SRecord> m_vQueue;
+  size_t m_iQueuedBytes;
+  ///When the oldest text in m_vQueue was appended
+  std::chrono::steady_clock::time_point m_tOldest;
+  ///Records appended, and records written out, since creation
+  unsigned long m_iAppended, m_iWritten;
+  ///Number of records Flush is waiting for to be written
+  unsigned long m_iFlushTarget;
+  bool m_bStop, m_bFailed;
+
+  //Only used by the thread writing batches (the background thread, then the destructor)
+  ///Size of the journal file, i.e. written since the last checkpoint
+  uint64_t m_iJournalBytes;
+  ///Targets written since the last checkpoint
+  std::set<std::string> m_setUnsynced;
+
+  std::thread m_thread;
+};
+/// \}
+}
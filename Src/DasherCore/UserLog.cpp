@@ -7,6 +7,7 @@
 
 #include "FileLogger.h"
 #include "FileUtils.h"
+#include "MemoryReport.h"
 
 
 using namespace std::chrono;
@@ -339,6 +340,18 @@ void CUserLog::DeleteSymbols(int iNumToDelete, eUserLogEventType iEvent)
   }
 }
 
+void CUserLog::ReportMemory(CMemoryReport &report) const
+{
+  CUserLogBase::ReportMemory(report);
+  size_t iBytes = sizeof(CUserLog) + CMemoryReport::StringBytes(m_strFilename) + CMemoryReport::StringBytes(m_strCurrentTrialFilename)
+    + CMemoryReport::VectorBytes(m_vpTrials) + CMemoryReport::VectorBytes(m_vParams) + SymbolProbBytes(m_vCycleHistory);
+  for (const CUserLogParam *pParam : m_vParams)
+    iBytes += pParam->GetMemoryUsage();
+  report.Add(CMemoryReport::MEM_USER_LOG, "CUserLog", 1, iBytes);
+  for (const CUserLogTrial *pTrial : m_vpTrials)
+    pTrial->ReportMemory(report);
+}
+
 void CUserLog::NewTrial()
 {
   //CFunctionLogger f1("CUserLog::NewTrial", g_pLogger);
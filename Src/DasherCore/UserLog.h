@@ -97,6 +97,7 @@ public:
   void SetOuputFilename(const std::string& strFilename = "") override;
   int  GetLogLevelMask() override;
   void KeyDown(Dasher::Keys::VirtualKey Key, int iType, int iEffect) override;
+  void ReportMemory(Dasher::CMemoryReport &report) const override;
 
 protected:
   CTimeSpan*								            m_pApplicationSpan;         // How long the application has been up
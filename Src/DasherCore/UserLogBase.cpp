@@ -11,6 +11,7 @@
 #include "Event.h"
 #include "DasherNode.h"
 #include "DasherInterfaceBase.h"
+#include "MemoryReport.h"
 
 using namespace Dasher;
 
@@ -48,3 +49,13 @@ void CUserLogBase::FrameEnded() {
     m_vAdded.clear();
   }
 }
+
+void CUserLogBase::ReportMemory(CMemoryReport &report) const {
+  report.Add(CMemoryReport::MEM_USER_LOG, "CUserLogBase pending symbols", m_vAdded.size(), SymbolProbBytes(m_vAdded));
+}
+
+size_t CUserLogBase::SymbolProbBytes(const VECTOR_SYMBOL_PROB &vSymbols) {
+  size_t iBytes = CMemoryReport::VectorBytes(vSymbols);
+  for (const SymbolProb &sym : vSymbols) iBytes += CMemoryReport::StringBytes(sym.strDisplay);
+  return iBytes;
+}
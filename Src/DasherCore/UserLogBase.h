@@ -9,6 +9,7 @@
 
 namespace Dasher {
   class CDasherInterfaceBase;
+  class CMemoryReport;
 }
 
 /// \defgroup Logging Logging routines
@@ -41,6 +42,11 @@ class CUserLogBase {
   virtual void HandleEvent(const Dasher::CEditEvent *pEvent);
   ///Passes record of symbols added/deleted to AddSymbols/DeleteSymbols
   void FrameEnded();
+  ///Adds the log's buffers to a memory report (CMemoryReport::MEM_USER_LOG).
+  /// The default reports only symbols awaiting FrameEnded; subclasses should extend.
+  virtual void ReportMemory(Dasher::CMemoryReport &report) const;
+  ///Heap bytes used by the elements of a vector of SymbolProbs, inc. their strings
+  static size_t SymbolProbBytes(const Dasher::VECTOR_SYMBOL_PROB &vSymbols);
 protected:
   virtual void AddSymbols(Dasher::VECTOR_SYMBOL_PROB* pVectorNewSymbolProbs, eUserLogEventType iEvent = userLogEventMouse) = 0;
   virtual void DeleteSymbols(int iNumToDelete, eUserLogEventType iEvent = userLogEventMouse) = 0;  
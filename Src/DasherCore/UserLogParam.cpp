@@ -1,4 +1,5 @@
 #include "UserLogParam.h"
+#include "MemoryReport.h"
 
 // Needed so we can sort() vectors of parameters
 bool CUserLogParam::ComparePtr(CUserLogParam* pA, CUserLogParam* pB)
@@ -18,4 +19,8 @@ bool CUserLogParam::ComparePtr(CUserLogParam* pA, CUserLogParam* pB)
   return false;
 }
 
-
+size_t CUserLogParam::GetMemoryUsage() const
+{
+  return sizeof(CUserLogParam) + Dasher::CMemoryReport::StringBytes(strName)
+    + Dasher::CMemoryReport::StringBytes(strValue) + Dasher::CMemoryReport::StringBytes(strTimeStamp);
+}
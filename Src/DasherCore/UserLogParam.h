@@ -46,6 +46,9 @@ public:
   int             options;                // The options that were used on the parameter
 
   static bool     ComparePtr(CUserLogParam* pA, CUserLogParam* pB);
+
+  // Heap bytes used by this object (allocated by new) and its strings
+  size_t          GetMemoryUsage() const;
 };
 /// @}
 
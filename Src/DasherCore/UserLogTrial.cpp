@@ -1,5 +1,7 @@
 #include <cstring>
 #include "UserLogTrial.h"
+#include "UserLogBase.h"
+#include "MemoryReport.h"
 
 #include <algorithm>
 #include <fstream>
@@ -1497,4 +1499,35 @@ DENSITY_GRID CUserLogTrial::MergeGrids(int iGridSize, DENSITY_GRID ppGridA, DENS
   return ppResult;
 }
 
-
+void CUserLogTrial::ReportMemory(Dasher::CMemoryReport &report) const
+{
+  using Dasher::CMemoryReport;
+  size_t iBytes = sizeof(CUserLogTrial) + CMemoryReport::StringBytes(m_strCurrentTrial) + CMemoryReport::StringBytes(m_strCurrentTrialFilename)
+    + CUserLogBase::SymbolProbBytes(m_vHistory) + CMemoryReport::VectorBytes(m_vpParams) + CMemoryReport::VectorBytes(m_vpNavCycles);
+  if (m_pSpan)
+    iBytes += sizeof(CTimeSpan);
+  for (const CUserLogParam *pParam : m_vpParams)
+    iBytes += pParam->GetMemoryUsage();
+  report.Add(CMemoryReport::MEM_USER_LOG, "CUserLogTrial", 1, iBytes);
+
+  // Time stamps in locations and buttons are short enough to be held inline
+  size_t iLocations = 0, iLocationBytes = 0, iMice = 0, iButtons = 0, iCycleBytes = 0;
+  for (const NavCycle *pCycle : m_vpNavCycles)
+  {
+    iCycleBytes += sizeof(NavCycle) + (pCycle->pSpan ? sizeof(CTimeSpan) : 0) + CMemoryReport::VectorBytes(pCycle->vectorNavLocations)
+      + CMemoryReport::VectorBytes(pCycle->vectorMouseLocations) + CMemoryReport::VectorBytes(pCycle->vectorButtons);
+    for (const NavLocation *pLocation : pCycle->vectorNavLocations)
+    {
+      iLocationBytes += sizeof(NavLocation) + CMemoryReport::StringBytes(pLocation->strHistory) + (pLocation->span ? sizeof(CTimeSpan) : 0);
+      if (pLocation->pVectorAdded)
+        iLocationBytes += sizeof(Dasher::VECTOR_SYMBOL_PROB) + CUserLogBase::SymbolProbBytes(*pLocation->pVectorAdded);
+    }
+    iLocations += pCycle->vectorNavLocations.size();
+    iMice += pCycle->vectorMouseLocations.size();
+    iButtons += pCycle->vectorButtons.size();
+  }
+  report.Add(CMemoryReport::MEM_USER_LOG, "NavCycle", m_vpNavCycles.size(), iCycleBytes);
+  report.Add(CMemoryReport::MEM_USER_LOG, "NavLocation", iLocations, iLocationBytes);
+  report.Add(CMemoryReport::MEM_USER_LOG, "CUserLocation", iMice, iMice * sizeof(CUserLocation));
+  report.Add(CMemoryReport::MEM_USER_LOG, "CUserButton", iButtons, iButtons * sizeof(CUserButton));
+}
@@ -27,6 +27,10 @@ typedef std::vector<VECTOR_VECTOR_DENSITY_GRIDS>::iterator   VECTOR_VECTOR_VECTO
 
 extern CFileLogger* g_pLogger;
 
+namespace Dasher {
+  class CMemoryReport;
+}
+
 class CUserLogTrial;
 
 typedef std::vector<CUserLogTrial>               VECTOR_USER_LOG_TRIAL;
@@ -106,6 +110,9 @@ public:
   int GetButtonCount();
   double GetTotalBits();
 
+  // Adds this trial's history, navigation cycles and parameters to a memory report
+  void                        ReportMemory(Dasher::CMemoryReport &report) const;
+
   // Methods used by utility that can post-process the log files:
   CUserLogTrial(const std::string& strXML, int iIgnored);
   static VECTOR_USER_LOG_PARAM_PTR    ParseParamsXML(const std::string& strXML);
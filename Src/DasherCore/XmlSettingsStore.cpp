@@ -1,6 +1,7 @@
 #include "XmlSettingsStore.h"
 #include "DasherInterfaceBase.h"
 #include "FileUtils.h"
+#include "TraceRecorder.h"
 
 
 namespace Dasher {
@@ -25,6 +26,7 @@ XmlSettingsStore::XmlSettingsStore(const std::string& filename, CMessageDisplay*
 
 void XmlSettingsStore::Load()
 {
+	DASHER_TRACE_SPAN("XmlSettingsStore::Load", "io");
 	Dasher::FileUtils::ScanFiles(this, last_mutable_filepath);
 	// Load all the settings or create defaults for the ones that don't exist.
 	// The superclass 'ParseFile' saves default settings if not found.
@@ -77,6 +79,7 @@ void XmlSettingsStore::SaveIfNeeded()
 }
 
 bool XmlSettingsStore::Save() {
+	DASHER_TRACE_SPAN("XmlSettingsStore::Save", "io");
 	if (!modified_) {
 		return true;
 	}
@@ -0,0 +1,215 @@
+// CoreCheck.cpp
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// Checks behaviour of DasherCore, outside the language models (see LanguageModelCheck),
+// that is not visible in Dasher's output. Each check prints a line starting PASS or
+// FAIL; the exit status is nonzero if any failed. Checks:
+//
+//   messages  CMessageDisplay::FormatMessage formats all its arguments, including
+//             when the message is longer than any internal buffer
+//   settings  CSettingsStore::ClSet, as used for command-line settings, sets boolean
+//             parameters to the values named (true/True/1, false/False/0), and
+//             rejects any other value
+//   default-alphabet  the built-in Default alphabet, used when no alphabet can be
+//             read, gives every character actions to output and undo its text (as
+//             outputting a symbol without them crashes)
+//   model-cache  starting Dasher loads the model saved by the last start, rather than
+//             training, while the training file is unchanged or only touched; trusts
+//             a file whose path, size and modification time are unchanged without
+//             reading it; and trains again once its contents change. Also that no
+//             cache is kept for a model which can't be saved
+//
+// Usage: CoreCheck [CHECK]...
+// With no checks named, all are run.
+
+#include "HeadlessDasher.h"
+#include "Messages.h"
+#include "Alphabet/AlphIO.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace Dasher;
+
+namespace {
+  void Usage(const char *szProg) {
+    fprintf(stderr, "Usage: %s [CHECK]...\n"
+                    "Checks: messages settings default-alphabet model-cache\n", szProg);
+  }
+
+  bool Report(const char *szCheck, bool bPass, const std::string &strDetail) {
+    printf("%s %s: %s\n", bPass ? "PASS" : "FAIL", szCheck, strDetail.c_str());
+    return bPass;
+  }
+
+  ///Records messages rather than showing them
+  class CRecordingMessages : public CMessageDisplay {
+  public:
+    void Message(const std::string &strText, bool bInterrupt) override {m_vMessages.push_back(strText);}
+    std::vector<std::string> m_vMessages;
+  };
+
+  bool CheckMessages() {
+    CRecordingMessages msgs;
+    msgs.FormatMessage("Could not parse alphabet \"%s\" from %s (%d)", "English", "alphabet.english.xml", 42);
+    const std::string strLong(5000, 'x');
+    msgs.FormatMessage("%s|%d", strLong.c_str(), 7);
+    const std::string vExpected[] = {"Could not parse alphabet \"English\" from alphabet.english.xml (42)", strLong + "|7"};
+    bool bPass = msgs.m_vMessages.size() == 2;
+    for (std::size_t i = 0; bPass && i < 2; i++) bPass = (msgs.m_vMessages[i] == vExpected[i]);
+    return Report("messages", bPass, bPass ? "both messages formatted as expected"
+                  : "got \"" + (msgs.m_vMessages.empty() ? std::string() : msgs.m_vMessages[0].substr(0, 100)) + "\"");
+  }
+
+  bool CheckSettings() {
+    CHeadlessSettingsStore settings;
+    const std::string strName(Settings::GetParameterName(BP_DETERMINISTIC_TRAINING));
+    const std::pair<const char *, bool> values[] = {
+      {"true", true}, {"True", true}, {"1", true}, {"false", false}, {"False", false}, {"0", false},
+    };
+    std::ostringstream detail;
+    bool bPass = true;
+    for (const auto &value : values) {
+      //start from the opposite value, so the setting must change
+      settings.SetBoolParameter(BP_DETERMINISTIC_TRAINING, !value.second);
+      const char *szError = settings.ClSet(strName, value.first);
+      if (szError || settings.GetBoolParameter(BP_DETERMINISTIC_TRAINING) != value.second) {
+        detail << strName << "=" << value.first << " gave " << (szError ? szError : settings.GetBoolParameter(BP_DETERMINISTIC_TRAINING) ? "true" : "false") << "; ";
+        bPass = false;
+      }
+    }
+    settings.SetBoolParameter(BP_DETERMINISTIC_TRAINING, true);
+    if (!settings.ClSet(strName, "yes") || !settings.GetBoolParameter(BP_DETERMINISTIC_TRAINING)) {
+      detail << strName << "=yes was accepted; ";
+      bPass = false;
+    }
+    return Report("settings", bPass, bPass ? "boolean values set as named, others rejected" : detail.str());
+  }
+
+  bool CheckDefaultAlphabet() {
+    CRecordingMessages msgs;
+    CAlphIO alphIO(&msgs);
+    const CAlphInfo *pAlph = alphIO.GetInfo("Default");
+    std::ostringstream detail;
+    bool bPass = pAlph && pAlph->GetID() == "Default";
+    if (!bPass) detail << "no Default alphabet";
+    for (symbol s = 1; bPass && s < pAlph->iEnd; s++)
+      if (pAlph->GetCharDoActions(s).empty() || pAlph->GetCharUndoActions(s).empty()) {
+        detail << "symbol " << s << " (\"" << pAlph->GetText(s) << "\") has no "
+               << (pAlph->GetCharDoActions(s).empty() ? "output" : "undo") << " action";
+        bPass = false;
+      }
+    if (bPass) detail << "all " << pAlph->iEnd - 1 << " characters have output and undo actions";
+    return Report("default-alphabet", bPass, detail.str());
+  }
+
+  ///Keeps its cache in a given directory, and records whether it trained a model
+  class CCacheInterface : public CHeadlessInterface {
+  public:
+    CCacheInterface(CSettingsStore *pSettingsStore, const std::vector<std::string> &vDataDirs, CCoordStreamInput *pInput, const std::string &strCacheDir)
+      : CHeadlessInterface(pSettingsStore, vDataDirs, pInput), m_strCacheDir(strCacheDir), m_bTrained(false) {}
+    using CHeadlessInterface::Realize;
+    std::string GetCacheDirectory() override {return m_strCacheDir;}
+    void SetLockStatus(const std::string &strText, int iPercent) override {
+      //as CNodeCreationManager's ProgressNotifier
+      if (strText.compare(0, 11, "Training on") == 0) m_bTrained = true;
+      CHeadlessInterface::SetLockStatus(strText, iPercent);
+    }
+    const std::string m_strCacheDir;
+    bool m_bTrained;
+  };
+
+  ///Starts Dasher, as a host would, on the given data and cache directories
+  /// \return true if it trained a model, false if it loaded one
+  bool StartTrains(const std::filesystem::path &data, const std::filesystem::path &cache, long iLanguageModel = 0) {
+    CHeadlessSettingsStore settings;
+    settings.SetStringParameter(SP_INPUT_DEVICE, CCoordStreamInput::NAME);
+    settings.SetLongParameter(LP_LANGUAGE_MODEL_ID, iLanguageModel);
+    CCoordStreamInput input(std::vector<SCoordSample>(1, SCoordSample{0, 2048, 2048}));
+    CCacheInterface intf(&settings, std::vector<std::string>(1, data.string()), &input, cache.string());
+    intf.Realize(0);
+    return intf.m_bTrained;
+  }
+
+  bool CheckModelCache() {
+    std::error_code ec;
+    const std::filesystem::path dir(std::filesystem::temp_directory_path() / "CoreCheck.model-cache");
+    const std::filesystem::path data(dir / "data"), cache(dir / "cache");
+    std::filesystem::remove_all(dir, ec);
+    std::filesystem::create_directories(data, ec);
+    //no alphabet files, so the built-in Default alphabet, with its training file
+    const std::filesystem::path text(data / "training_english_GB.txt");
+    auto writeText = [&text](char cFirst) {
+      std::ofstream out(text, std::ios::binary | std::ios::trunc);
+      for (int i = 0; i < 20000; i++) out << static_cast<char>('a' + (cFirst - 'a' + i * i % 7 + i / 5) % 26);
+    };
+    writeText('a');
+
+    std::ostringstream detail;
+    bool bPass = true;
+    auto expect = [&](const char *szWhen, bool bTrains, bool bExpected) {
+      if (bTrains == bExpected) return;
+      detail << (bExpected ? "did not train " : "trained ") << szWhen << "; ";
+      bPass = false;
+    };
+    expect("on first start", StartTrains(data, cache), true);
+    expect("with the text unchanged", StartTrains(data, cache), false);
+    const std::filesystem::file_time_type tModified(std::filesystem::last_write_time(text));
+    std::filesystem::last_write_time(text, tModified + std::chrono::seconds(10));
+    expect("with the text touched", StartTrains(data, cache), false);
+    //same size and time, so the cache must trust it without reading it...
+    writeText('b');
+    std::filesystem::last_write_time(text, tModified + std::chrono::seconds(10));
+    expect("with the text changed but its size and time kept", StartTrains(data, cache), false);
+    //...until the time changes
+    std::filesystem::last_write_time(text, tModified + std::chrono::seconds(20));
+    expect("with the text changed", StartTrains(data, cache), true);
+
+    //the mixture model can't be saved, so must not leave anything in the cache
+    const std::filesystem::path mixtureCache(dir / "mixture-cache");
+    expect("the mixture model", StartTrains(data, mixtureCache, 3), true);
+    if (std::filesystem::exists(mixtureCache)) {
+      detail << "kept a cache for the mixture model; ";
+      bPass = false;
+    }
+    std::filesystem::remove_all(dir, ec);
+    return Report("model-cache", bPass, bPass ? "model loaded or trained as the training file changed" : detail.str());
+  }
+
+  struct SCheck {
+    const char *szName;
+    bool (*pCheck)();
+  };
+  const SCheck checks[] = {
+    {"messages", &CheckMessages},
+    {"settings", &CheckSettings},
+    {"default-alphabet", &CheckDefaultAlphabet},
+    {"model-cache", &CheckModelCache},
+  };
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> vChecks;
+  for (int i = 1; i < argc; i++) {
+    if (argv[i][0] != '-' && std::any_of(std::begin(checks), std::end(checks), [&](const SCheck &check) {return !strcmp(check.szName, argv[i]);}))
+      vChecks.push_back(argv[i]);
+    else {
+      Usage(argv[0]);
+      return 1;
+    }
+  }
+
+  bool bPass = true;
+  for (const SCheck &check : checks)
+    if (vChecks.empty() || std::find(vChecks.begin(), vChecks.end(), check.szName) != vChecks.end())
+      bPass &= check.pCheck();
+  return bPass ? 0 : 1;
+}
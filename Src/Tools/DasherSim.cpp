@@ -0,0 +1,189 @@
+// DasherSim.cpp
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// Runs Dasher headless (see CSimulation) on a recorded or scripted stream of input
+// coordinates, with a virtual clock, and reports the frame rate the core could
+// sustain, nodes created and deleted per frame, language model GetProbs calls, and
+// the characters written per simulated minute; and, if the core was built with
+// DASHER_FRAME_PROFILER, the time taken by each phase of the frames. Apart from
+// timings, the results of a run depend only on the options and data files, so can
+// be compared between builds.
+//
+// Usage: DasherSim [--data DIR]... [--alphabet ID] [--set NAME=VALUE]...
+//                  [--input FILE | --script SECONDS] [--write-input FILE]
+//                  [--frame-ms N] [--duration SECONDS] [--size WxH] [--csv FILE] [--text]
+//                  [--trace FILE]
+// Data directories (default ./Data) are searched recursively for alphabets, colours
+// and training text. An input file has one sample per line, "time x y" (ms, Dasher
+// coordinates); without one, a scripted stream of 60s (or as given) is used.
+// --trace writes Chrome trace events for the whole run, if the core was built with
+// DASHER_TRACING.
+
+#include "Simulation.h"
+#include "TraceRecorder.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace Dasher;
+
+namespace {
+  void Usage(const char *szProg) {
+    fprintf(stderr, "Usage: %s [--data DIR]... [--alphabet ID] [--set NAME=VALUE]...\n"
+                    "          [--input FILE | --script SECONDS] [--write-input FILE]\n"
+                    "          [--frame-ms N] [--duration SECONDS] [--size WxH] [--csv FILE] [--text]\n"
+                    "          [--trace FILE]\n", szProg);
+  }
+
+  void PrintStat(const char *szName, std::vector<double> v) {
+    if (v.empty()) return;
+    std::sort(v.begin(), v.end());
+    double dTotal = 0;
+    for (double d : v) dTotal += d;
+    printf("  %-22s mean %10.3f  median %10.3f  p95 %10.3f  max %10.3f\n", szName,
+           dTotal / v.size(), v[v.size() / 2], v[(v.size() * 95) / 100], v.back());
+  }
+}
+
+int main(int argc, char **argv) {
+  CSimulation::SOptions options;
+  std::string strInput, strWriteInput, strCsv, strTrace;
+  unsigned long iScriptMs = 60000;
+  bool bText = false;
+  for (int i = 1; i < argc; i++) {
+    const bool bArg = i + 1 < argc;
+    if (!strcmp(argv[i], "--data") && bArg) options.vDataDirs.push_back(argv[++i]);
+    else if (!strcmp(argv[i], "--alphabet") && bArg) options.strAlphabet = argv[++i];
+    else if (!strcmp(argv[i], "--set") && bArg) {
+      const std::string strSet(argv[++i]);
+      const std::string::size_type iEq = strSet.find('=');
+      if (iEq == std::string::npos) {
+        Usage(argv[0]);
+        return 1;
+      }
+      options.vSettings.push_back(std::make_pair(strSet.substr(0, iEq), strSet.substr(iEq + 1)));
+    }
+    else if (!strcmp(argv[i], "--input") && bArg) strInput = argv[++i];
+    else if (!strcmp(argv[i], "--script") && bArg) iScriptMs = static_cast<unsigned long>(atof(argv[++i]) * 1000);
+    else if (!strcmp(argv[i], "--write-input") && bArg) strWriteInput = argv[++i];
+    else if (!strcmp(argv[i], "--frame-ms") && bArg) options.iFrameMs = std::max(1, atoi(argv[++i]));
+    else if (!strcmp(argv[i], "--duration") && bArg) options.iDurationMs = static_cast<unsigned long>(atof(argv[++i]) * 1000);
+    else if (!strcmp(argv[i], "--size") && bArg) {
+      if (sscanf(argv[++i], "%dx%d", &options.iScreenWidth, &options.iScreenHeight) != 2) {
+        Usage(argv[0]);
+        return 1;
+      }
+    }
+    else if (!strcmp(argv[i], "--csv") && bArg) strCsv = argv[++i];
+    else if (!strcmp(argv[i], "--text")) bText = true;
+    else if (!strcmp(argv[i], "--trace") && bArg) strTrace = argv[++i];
+    else {
+      Usage(argv[0]);
+      return 1;
+    }
+  }
+  if (options.vDataDirs.empty()) options.vDataDirs.push_back("Data");
+
+  std::vector<SCoordSample> vInput;
+  if (!strInput.empty()) {
+    if (!CCoordStreamInput::ReadStream(strInput, vInput)) {
+      fprintf(stderr, "Could not read input stream %s\n", strInput.c_str());
+      return 1;
+    }
+  } else
+    vInput = CCoordStreamInput::ScriptedStream(iScriptMs, options.iFrameMs);
+  if (!strWriteInput.empty() && !CCoordStreamInput::WriteStream(strWriteInput, vInput)) {
+    fprintf(stderr, "Could not write input stream %s\n", strWriteInput.c_str());
+    return 1;
+  }
+
+  if (!strTrace.empty()) {
+#ifdef DASHER_TRACING
+    g_pTraceRecorder = new CTraceRecorder(strTrace);
+    if (!g_pTraceRecorder->IsOpen()) {
+      fprintf(stderr, "Could not write trace %s\n", strTrace.c_str());
+      return 1;
+    }
+#else
+    fprintf(stderr, "--trace needs DasherCore built with DASHER_TRACING\n");
+    return 1;
+#endif
+  }
+
+  CSimulation::SResult result;
+  std::string strError;
+  const bool bRan = CSimulation::Run(options, vInput, result, strError);
+  if (g_pTraceRecorder) {
+    const unsigned long iSpans = g_pTraceRecorder->GetNumSpans();
+    delete g_pTraceRecorder;
+    g_pTraceRecorder = NULL;
+    printf("Wrote %lu trace spans to %s\n", iSpans, strTrace.c_str());
+  }
+  if (!bRan) {
+    fprintf(stderr, "%s\n", strError.c_str());
+    return 1;
+  }
+
+  const size_t iFrames = result.vFrames.size();
+  double dWallMs = 0;
+  unsigned long iCreated = 0, iDeleted = 0, iProbs = 0;
+  std::vector<double> vWall, vCreated, vDeleted, vProbs;
+  for (const CSimulation::SFrame &frame : result.vFrames) {
+    dWallMs += frame.dWallMs;
+    iCreated += frame.iNodesCreated;
+    iDeleted += frame.iNodesDeleted;
+    iProbs += frame.iProbsCalls;
+    vWall.push_back(frame.dWallMs);
+    vCreated.push_back(frame.iNodesCreated);
+    vDeleted.push_back(frame.iNodesDeleted);
+    vProbs.push_back(frame.iProbsCalls);
+  }
+  const double dSimMinutes = iFrames * options.iFrameMs / 60000.0;
+  const long iNet = static_cast<long>(result.iCharsOutput) - static_cast<long>(result.iCharsDeleted);
+
+  printf("Alphabet \"%s\", %dx%d, %zu frames of %lu ms (%.1f s simulated)\n", result.strAlphabet.c_str(),
+         options.iScreenWidth, options.iScreenHeight, iFrames, options.iFrameMs, dSimMinutes * 60);
+  printf("Startup (alphabet, training) %.1f ms\n", result.dStartupMs);
+  printf("Frames: %.1f ms wall-clock in total, %.1f frames per second\n", dWallMs, iFrames / (dWallMs / 1000));
+  PrintStat("frame time (ms)", vWall);
+  PrintStat("nodes created", vCreated);
+  PrintStat("nodes deleted", vDeleted);
+  PrintStat("GetProbs calls", vProbs);
+  if (result.bProfiled) {
+    printf("Time per phase (ms):\n");
+    for (int i = 0; i < CFrameProfiler::NUM_PHASES; i++) {
+      std::vector<double> vPhase;
+      for (const CSimulation::SFrame &frame : result.vFrames) vPhase.push_back(frame.dPhaseMs[i]);
+      PrintStat(CFrameProfiler::PhaseName(static_cast<CFrameProfiler::Phase>(i)), vPhase);
+    }
+  }
+  printf("Nodes created %lu, deleted %lu, live at end %lu; GetProbs calls %lu; %lu drawing calls\n",
+         iCreated, iDeleted, iFrames ? result.vFrames.back().iNodesLive : 0, iProbs, result.iPrimitives);
+  printf("Characters output %lu, deleted %lu, net %ld: %.1f per simulated minute\n",
+         result.iCharsOutput, result.iCharsDeleted, iNet, dSimMinutes > 0 ? iNet / dSimMinutes : 0.0);
+  if (!result.vMessages.empty()) printf("%zu messages, the first: %s\n", result.vMessages.size(), result.vMessages[0].c_str());
+  if (bText) printf("Text: %s\n", result.strText.c_str());
+
+  if (!strCsv.empty()) {
+    std::ofstream csv(strCsv);
+    csv << "time,wall_ms,nodes_created,nodes_deleted,nodes_live,getprobs_calls,chars_change";
+    if (result.bProfiled)
+      for (int i = 0; i < CFrameProfiler::NUM_PHASES; i++)
+        csv << "," << CFrameProfiler::PhaseName(static_cast<CFrameProfiler::Phase>(i)) << "_ms";
+    csv << "\n";
+    for (const CSimulation::SFrame &frame : result.vFrames) {
+      csv << frame.iTime << "," << frame.dWallMs << "," << frame.iNodesCreated << "," << frame.iNodesDeleted << ","
+          << frame.iNodesLive << "," << frame.iProbsCalls << "," << frame.iCharsChange;
+      if (result.bProfiled)
+        for (int i = 0; i < CFrameProfiler::NUM_PHASES; i++) csv << "," << frame.dPhaseMs[i];
+      csv << "\n";
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,202 @@
+// ExpansionPolicyBenchmark.cpp
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// Compares the CPU time taken by the two expansion policies Dasher can use,
+// AmortizedPolicy and HeapPolicy (BP_HEAP_EXPANSION_POLICY), over a zoom trace: a
+// sequence of root node coordinates, one per frame, as CDasherModel would pass to
+// the view. Nodes are synthetic (a fixed number of children with skewed
+// probabilities, no language model), and rendering is simulated by a traversal
+// making the same calls on the policy as CDasherViewSquare does, so the times are
+// those of the policy itself.
+//
+// Usage: ExpansionPolicyBenchmark [--budget N] [--branch N] [--min-size N] [--trace FILE] [--write-trace FILE] [--check]
+// A trace file has one frame per line, "rootmin rootmax" in Dasher Y coordinates
+// (the screen spanning 0-4096); without one, a trace is generated that drifts
+// and zooms in and out, with pauses. --check breaks ties between nodes of equal cost
+// by their position, as the two policies may order them differently, and so should
+// make the same choices: the exit status is then nonzero if they ever have different
+// numbers of nodes after a frame.
+
+#include "DasherModel.h"
+#include "DasherNode.h"
+#include "ExpansionPolicy.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace Dasher;
+
+namespace {
+  const myint MAX_Y = 4096, CROSSHAIR_Y = 2048;
+  ///As LP_MIN_NODE_SIZE
+  myint iMinNodeSize = 50;
+
+  class CBenchNode : public CDasherNode {
+  public:
+    CBenchNode(unsigned int iSeed, int iBranch) : CDasherNode(0, NULL), m_iSeed(iSeed), m_iBranch(iBranch) {}
+    CNodeManager *mgr() const override {return NULL;}
+    const char *ClassName() const override {return "CBenchNode";}
+    std::size_t ObjectSize() const override {return sizeof(CBenchNode);}
+    int ExpectedNumChildren() override {return m_iBranch;}
+    void PopulateChildren() override {
+      //Zipf-like weights, permuted differently for each node
+      std::vector<double> vWeights(m_iBranch);
+      double dTotal = 0;
+      for (int i = 0; i < m_iBranch; i++)
+        dTotal += vWeights[i] = 1.0 / (1 + (m_iSeed + i * 7919u) % m_iBranch);
+      unsigned int iLbnd = 0;
+      double dCum = 0;
+      for (int i = 0; i < m_iBranch; i++) {
+        dCum += vWeights[i];
+        unsigned int iHbnd = (i == m_iBranch - 1) ? CDasherModel::NORMALIZATION
+          : static_cast<unsigned int>(dCum / dTotal * CDasherModel::NORMALIZATION);
+        CBenchNode *pChild = new CBenchNode(m_iSeed * 31 + i + 1, m_iBranch);
+        pChild->Reparent(this, iLbnd, iHbnd);
+        iLbnd = iHbnd;
+      }
+    }
+    const ColorPalette::Color &getLabelColor(const ColorPalette *) override {return ColorPalette::noColor;}
+    const ColorPalette::Color &getOutlineColor(const ColorPalette *) override {return ColorPalette::noColor;}
+    const ColorPalette::Color &getNodeColor(const ColorPalette *) override {return ColorPalette::noColor;}
+  private:
+    const unsigned int m_iSeed;
+    const int m_iBranch;
+  };
+
+  ///As CDasherViewSquare::NewRender, minus the drawing
+  void Render(CDasherNode *pNode, myint y1, myint y2, CExpansionPolicy &policy, double dMaxCost) {
+    const bool bCrosshair = y1 <= CROSSHAIR_Y && y2 > CROSSHAIR_Y;
+    if (pNode->ChildCount() == 0) {
+      if (!bCrosshair) {
+        policy.pushNode(pNode, static_cast<int>(y1), static_cast<int>(y2), true, dMaxCost);
+        return;
+      }
+      policy.ExpandNode(pNode);
+    } else if (!bCrosshair)
+      dMaxCost = policy.pushNode(pNode, static_cast<int>(y1), static_cast<int>(y2), false, dMaxCost);
+
+    const myint iRange = y2 - y1;
+    for (CDasherNode *pChild : pNode->GetChildren()) {
+      const myint newy1 = y1 + (iRange * pChild->Lbnd()) / CDasherModel::NORMALIZATION;
+      const myint newy2 = y1 + (iRange * pChild->Hbnd()) / CDasherModel::NORMALIZATION;
+      if (newy2 - newy1 >= iMinNodeSize && newy1 <= MAX_Y && newy2 >= 0)
+        Render(pChild, newy1, newy2, policy, dMaxCost);
+      else
+        pChild->DeleteChildren();
+    }
+  }
+
+  std::vector<std::pair<myint, myint> > GenerateTrace() {
+    std::vector<std::pair<myint, myint> > vTrace;
+    const int iFrames = 3000;
+    for (int t = 0; t < iFrames; t++) {
+      //pause for 100 frames in every 500
+      const int iT = (t % 500 < 100) ? t - t % 500 : t;
+      const double dZoom = std::exp(4.0 * (1 - std::cos(2 * 3.14159265358979 * iT / 1500.0)));
+      const double dTarget = MAX_Y / 2 + 1500 * std::sin(iT / 300.0);
+      const myint iMin = static_cast<myint>(CROSSHAIR_Y - dTarget * dZoom);
+      vTrace.push_back(std::make_pair(iMin, iMin + static_cast<myint>(MAX_Y * dZoom)));
+    }
+    return vTrace;
+  }
+
+  ///For --check: the policy, but with ties between costs broken by node position
+  template<typename Policy> class CTieBroken : public Policy {
+  public:
+    CTieBroken(CDasherModel *pModel, unsigned int iNodeBudget) : Policy(pModel, iNodeBudget) {}
+  protected:
+    double getCost(CDasherNode *pNode, int iMin, int iMax) override {
+      //less than 0.01, so never reorders nodes of different (integer) costs
+      return Policy::getCost(pNode, iMin, iMax) + ((iMin & 0xfffff) + 3 * (iMax & 0xfffff)) % 1000003 * 1e-8;
+    }
+  };
+
+  struct SResult {
+    double dFrameMs, dApplyMs;
+    int iFinalNodes, iPeakNodes;
+    ///Number of nodes after each frame
+    std::vector<int> vNodes;
+  };
+
+  SResult Run(const char *szName, CExpansionPolicy &policy, CDasherModel &model, int iBranch,
+              const std::vector<std::pair<myint, myint> > &vTrace) {
+    CBenchNode *pRoot = new CBenchNode(0, iBranch);
+    model.ExpandNode(pRoot);
+    SResult res{0, 0, 0, 0, {}};
+    for (const auto &frame : vTrace) {
+      auto start = std::chrono::steady_clock::now();
+      Render(pRoot, frame.first, frame.second, policy, std::numeric_limits<double>::infinity());
+      auto rendered = std::chrono::steady_clock::now();
+      policy.apply();
+      auto end = std::chrono::steady_clock::now();
+      res.dFrameMs += std::chrono::duration<double, std::milli>(end - start).count();
+      res.dApplyMs += std::chrono::duration<double, std::milli>(end - rendered).count();
+      res.iPeakNodes = std::max(res.iPeakNodes, currentNumNodeObjects());
+      res.vNodes.push_back(currentNumNodeObjects());
+    }
+    res.iFinalNodes = currentNumNodeObjects();
+    delete pRoot;
+    printf("%-16s frames %zu  total %9.1f ms  in apply() %9.1f ms  (%.3f ms/frame)  nodes peak %d final %d\n",
+           szName, vTrace.size(), res.dFrameMs, res.dApplyMs, res.dApplyMs / vTrace.size(), res.iPeakNodes, res.iFinalNodes);
+    return res;
+  }
+}
+
+int main(int argc, char **argv) {
+  unsigned int iBudget = 20000;
+  int iBranch = 30;
+  std::vector<std::pair<myint, myint> > vTrace;
+  const char *szWriteTrace = NULL;
+  bool bCheck = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--budget") && i + 1 < argc) iBudget = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--branch") && i + 1 < argc) iBranch = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--min-size") && i + 1 < argc) iMinNodeSize = std::max(1, atoi(argv[++i]));
+    else if (!strcmp(argv[i], "--write-trace") && i + 1 < argc) szWriteTrace = argv[++i];
+    else if (!strcmp(argv[i], "--check")) bCheck = true;
+    else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+      std::ifstream in(argv[++i]);
+      myint iMin, iMax;
+      while (in >> iMin >> iMax) vTrace.push_back(std::make_pair(iMin, iMax));
+      if (vTrace.empty()) {
+        fprintf(stderr, "Could not read trace %s\n", argv[i]);
+        return 1;
+      }
+    } else {
+      fprintf(stderr, "Usage: %s [--budget N] [--branch N] [--min-size N] [--trace FILE] [--write-trace FILE] [--check]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (vTrace.empty()) vTrace = GenerateTrace();
+  if (szWriteTrace) {
+    std::ofstream out(szWriteTrace);
+    for (const auto &frame : vTrace) out << frame.first << " " << frame.second << "\n";
+  }
+  if (iBranch < 2) iBranch = 2;
+
+  printf("Node budget %u, %d children per node, min node size %d\n", iBudget, iBranch, static_cast<int>(iMinNodeSize));
+  CDasherModel model;
+  AmortizedPolicy amortized(&model, iBudget);
+  HeapPolicy heap(&model, iBudget);
+  CTieBroken<AmortizedPolicy> amortizedTieBroken(&model, iBudget);
+  CTieBroken<HeapPolicy> heapTieBroken(&model, iBudget);
+  SResult a = Run("AmortizedPolicy", bCheck ? amortizedTieBroken : amortized, model, iBranch, vTrace);
+  SResult h = Run("HeapPolicy", bCheck ? heapTieBroken : heap, model, iBranch, vTrace);
+  printf("HeapPolicy apply() time: %.0f%% of AmortizedPolicy's\n", 100.0 * h.dApplyMs / a.dApplyMs);
+  if (bCheck && h.vNodes != a.vNodes) {
+    const size_t iFrame = std::mismatch(a.vNodes.begin(), a.vNodes.end(), h.vNodes.begin()).first - a.vNodes.begin();
+    printf("FAIL: the policies made different choices, first in frame %zu\n", iFrame + 1);
+    return 1;
+  }
+  return 0;
+}
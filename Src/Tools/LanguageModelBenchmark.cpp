@@ -0,0 +1,390 @@
+// LanguageModelBenchmark.cpp
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// Trains each kind of language model CAlphabetManager can create (as selected by
+// LP_LANGUAGE_MODEL_ID), for each of a list of LP_LM_MAX_ORDERs, on the training
+// text of an alphabet, holding back the end of each file. For each it reports the
+// training throughput (symbols per second, learning sequentially as CTrainer does),
+// the memory the model reports afterwards (its tables only grow while training, so
+// this is also their peak), the latency of GetProbs (percentiles, over the contexts
+// of the held-out text) and the cross-entropy of the held-out text in bits per
+// character, computed from the probabilities Dasher would give the nodes (i.e.
+// including LP_UNIFORM), and the peak resident set size while the model was built
+// and queried (each model is run in a child process, where fork is available, so
+// this is not inflated by the models run before it; it includes the text, and
+// whatever else the benchmark itself holds). Everything but the times and sizes
+// depends only on the options and data files, so can be compared between builds.
+//
+// Usage: LanguageModelBenchmark [--data DIR]... [--alphabet ID] [--text FILE]...
+//                               [--models ID,...] [--orders N,...] [--set NAME=VALUE]...
+//                               [--held-out FRACTION] [--threads N] [--adaptive] [--csv FILE]
+// Data directories (default ./Data) are searched recursively for alphabets and the
+// alphabet's training file, unless text files are given. Models default to all (0 PPM,
+// 2 word, 3 mixture, 4 CTW, 5 compact PPM); orders to the LP_LM_MAX_ORDER setting.
+// With --adaptive, the held-out text is learnt as it is scored, as when writing with
+// BP_LM_ADAPTIVE; otherwise the model is left unchanged.
+
+#include "HeadlessDasher.h"
+
+#include "AlphabetManager.h"
+#include "DasherModel.h"
+#include "MemoryReport.h"
+#include "Trainer.h"
+#include "Alphabet/AlphIO.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace Dasher;
+
+namespace {
+  void Usage(const char *szProg) {
+    fprintf(stderr, "Usage: %s [--data DIR]... [--alphabet ID] [--text FILE]...\n"
+                    "          [--models ID,...] [--orders N,...] [--set NAME=VALUE]...\n"
+                    "          [--held-out FRACTION] [--threads N] [--adaptive] [--csv FILE]\n", szProg);
+  }
+
+  const char *ModelName(long iModelID) {
+    switch (iModelID) {
+      case 0: return "PPM";
+      case 2: return "Word";
+      case 3: return "Mixture";
+      case 4: return "CTW";
+      case 5: return "CompactPPM";
+      default: return "?";
+    }
+  }
+
+  ///Parses a comma-separated list of integers; false if empty or malformed
+  bool ParseList(const char *szList, std::vector<long> &vValues) {
+    std::istringstream in(szList);
+    std::string strItem;
+    while (std::getline(in, strItem, ',')) {
+      char *szEnd;
+      vValues.push_back(strtol(strItem.c_str(), &szEnd, 10));
+      if (strItem.empty() || *szEnd) return false;
+    }
+    return !vValues.empty();
+  }
+
+  class CStderrMessages : public CMessageDisplay {
+  public:
+    void Message(const std::string &strText, bool bInterrupt) override {
+      fprintf(stderr, "%s\n", strText.c_str());
+    }
+  };
+
+  ///Reads whole files, as found by ScanDataDirs
+  class CTextCollector : public AbstractParser {
+  public:
+    CTextCollector(CMessageDisplay *pMsgs) : AbstractParser(pMsgs) {}
+    bool Parse(const std::string &strDesc, std::istream &in, bool bUser) override {
+      m_vTexts.push_back(std::make_pair(strDesc, std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>())));
+      return true;
+    }
+    std::vector<std::pair<std::string, std::string> > m_vTexts;
+  };
+
+  ///A text, split at a line break into the part to train on and the part held out
+  struct SCorpus {
+    std::string strName, strTrain, strHeldOut;
+  };
+
+  struct SRun {
+    long iModelID, iMaxOrder;
+    unsigned long iTrainSymbols;
+    double dTrainMs;
+    std::size_t iModelBytes, iContextBytes;
+    ///Held-out characters scored, and those not in the alphabet (which reset the context)
+    unsigned long iScored, iUnknown;
+    double dBits;
+    ///GetProbs latencies, in microseconds
+    double dProbsMean, dProbs50, dProbs95, dProbs99, dProbsMax;
+    ///Peak resident set size of the process running the model, in bytes; 0 if unknown
+    std::size_t iPeakRSS;
+  };
+
+  double MsSince(std::chrono::steady_clock::time_point tStart) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count();
+  }
+
+  ///Peak resident set size of the process so far, in bytes; 0 if unknown
+  std::size_t PeakRSS() {
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+#ifdef __APPLE__
+      return static_cast<std::size_t>(usage.ru_maxrss);
+#else
+      return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+    return 0;
+  }
+
+  SRun RunModel(long iModelID, long iMaxOrder, CSettingsStore *pSettings, CMessageDisplay *pMsgs, const CAlphInfo *pAlph,
+                const CAlphabetMap *pMap, const std::vector<SCorpus> &vCorpora, int iThreads, bool bAdaptive) {
+    SRun run = SRun();
+    run.iModelID = iModelID;
+    run.iMaxOrder = iMaxOrder;
+    pSettings->SetLongParameter(LP_LM_MAX_ORDER, iMaxOrder);
+    CLanguageModel *pLM = CAlphabetManager::NewLanguageModel(iModelID, pSettings, pAlph, pMap);
+
+    //Training: symbols are counted beforehand, so the time is just that of CTrainer
+    for (const SCorpus &corpus : vCorpora) {
+      std::istringstream count(corpus.strTrain);
+      CAlphabetMap::SymbolStream syms(count);
+      while (syms.next(pMap) != -1) run.iTrainSymbols++;
+    }
+    {
+      CTrainer trainer(pMsgs, pLM, pAlph, pMap);
+      trainer.SetParallelism(iThreads, true);
+      const auto tStart = std::chrono::steady_clock::now();
+      for (const SCorpus &corpus : vCorpora) {
+        std::istringstream in(corpus.strTrain);
+        trainer.Parse(corpus.strName, in, false);
+      }
+      run.dTrainMs = MsSince(tStart);
+    }
+    CMemoryReport report;
+    pLM->ReportMemory(report);
+    run.iModelBytes = report.GetTotalBytes(CMemoryReport::MEM_LANGUAGE_MODEL);
+    run.iContextBytes = report.GetTotalBytes(CMemoryReport::MEM_CONTEXTS);
+
+    //Scoring, with the probabilities CAlphabetManager::GetProbs would give
+    const unsigned int iSymbols = pAlph->iEnd - 1;
+    const unsigned long iNorm = CDasherModel::NORMALIZATION;
+    const unsigned int iUniformAdd = std::max(1ul, ((iNorm * pSettings->GetLongParameter(LP_UNIFORM)) / 1000) / iSymbols);
+    const unsigned long iNonUniformNorm = iNorm - iSymbols * iUniformAdd;
+    std::vector<unsigned int> vProbs;
+    std::vector<double> vMicros;
+    for (const SCorpus &corpus : vCorpora) {
+      std::vector<symbol> vSyms;
+      pMap->GetSymbols(vSyms, corpus.strHeldOut);
+      CLanguageModel::Context context = pLM->CreateEmptyContext();
+      for (symbol sym : vSyms) {
+        if (sym <= 0 || sym > static_cast<symbol>(iSymbols)) {
+          run.iUnknown++;
+          pLM->ReleaseContext(context);
+          context = pLM->CreateEmptyContext();
+          continue;
+        }
+        const auto tStart = std::chrono::steady_clock::now();
+        pLM->GetProbs(context, vProbs, iNonUniformNorm, 0);
+        vMicros.push_back(MsSince(tStart) * 1000);
+        run.dBits -= std::log2(static_cast<double>(vProbs[sym] + iUniformAdd) / iNorm);
+        run.iScored++;
+        if (bAdaptive)
+          pLM->LearnSymbol(context, sym);
+        else
+          pLM->EnterSymbol(context, sym);
+      }
+      pLM->ReleaseContext(context);
+    }
+    if (!vMicros.empty()) {
+      double dTotal = 0;
+      for (double d : vMicros) dTotal += d;
+      std::sort(vMicros.begin(), vMicros.end());
+      run.dProbsMean = dTotal / vMicros.size();
+      run.dProbs50 = vMicros[vMicros.size() / 2];
+      run.dProbs95 = vMicros[(vMicros.size() * 95) / 100];
+      run.dProbs99 = vMicros[(vMicros.size() * 99) / 100];
+      run.dProbsMax = vMicros.back();
+    }
+    delete pLM;
+    return run;
+  }
+
+  ///RunModel in a forked child, which sends back the SRun (plain data) through a
+  /// pipe; so the peak RSS is that of this model alone, and memory it leaves
+  /// fragmented does not slow or inflate the next. Runs in this process if fork is
+  /// unavailable or fails, when the peak RSS includes the models run before.
+  SRun RunModelIsolated(long iModelID, long iMaxOrder, CSettingsStore *pSettings, CMessageDisplay *pMsgs, const CAlphInfo *pAlph,
+                        const CAlphabetMap *pMap, const std::vector<SCorpus> &vCorpora, int iThreads, bool bAdaptive) {
+#ifndef _WIN32
+    int fds[2];
+    if (pipe(fds) == 0) {
+      fflush(stdout);
+      fflush(stderr);
+      const pid_t pid = fork();
+      if (pid == 0) {
+        close(fds[0]);
+        SRun run = RunModel(iModelID, iMaxOrder, pSettings, pMsgs, pAlph, pMap, vCorpora, iThreads, bAdaptive);
+        run.iPeakRSS = PeakRSS();
+        const char *pData = reinterpret_cast<const char *>(&run);
+        for (std::size_t iDone = 0; iDone < sizeof(run);) {
+          const ssize_t iWritten = write(fds[1], pData + iDone, sizeof(run) - iDone);
+          if (iWritten <= 0) _exit(1);
+          iDone += iWritten;
+        }
+        _exit(0);
+      }
+      close(fds[1]);
+      if (pid > 0) {
+        SRun run;
+        char *pData = reinterpret_cast<char *>(&run);
+        std::size_t iDone = 0;
+        for (ssize_t iRead; iDone < sizeof(run) && (iRead = read(fds[0], pData + iDone, sizeof(run) - iDone)) > 0;)
+          iDone += iRead;
+        close(fds[0]);
+        int iStatus;
+        waitpid(pid, &iStatus, 0);
+        if (iDone == sizeof(run) && WIFEXITED(iStatus) && WEXITSTATUS(iStatus) == 0) return run;
+        fprintf(stderr, "%s order %ld failed in child process; running it here\n", ModelName(iModelID), iMaxOrder);
+      } else
+        close(fds[0]);
+    }
+#endif
+    SRun run = RunModel(iModelID, iMaxOrder, pSettings, pMsgs, pAlph, pMap, vCorpora, iThreads, bAdaptive);
+    run.iPeakRSS = PeakRSS();
+    return run;
+  }
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> vDataDirs, vTextFiles;
+  std::vector<std::pair<std::string, std::string> > vSettings;
+  std::vector<long> vModels, vOrders;
+  std::string strAlphabet, strCsv;
+  double dHeldOut = 0.1;
+  int iThreads = 1;
+  bool bAdaptive = false;
+  for (int i = 1; i < argc; i++) {
+    const bool bArg = i + 1 < argc;
+    if (!strcmp(argv[i], "--data") && bArg) vDataDirs.push_back(argv[++i]);
+    else if (!strcmp(argv[i], "--alphabet") && bArg) strAlphabet = argv[++i];
+    else if (!strcmp(argv[i], "--text") && bArg) vTextFiles.push_back(argv[++i]);
+    else if (!strcmp(argv[i], "--models") && bArg) {
+      if (!ParseList(argv[++i], vModels)) {
+        Usage(argv[0]);
+        return 1;
+      }
+    }
+    else if (!strcmp(argv[i], "--orders") && bArg) {
+      if (!ParseList(argv[++i], vOrders)) {
+        Usage(argv[0]);
+        return 1;
+      }
+    }
+    else if (!strcmp(argv[i], "--set") && bArg) {
+      const std::string strSet(argv[++i]);
+      const std::string::size_type iEq = strSet.find('=');
+      if (iEq == std::string::npos) {
+        Usage(argv[0]);
+        return 1;
+      }
+      vSettings.push_back(std::make_pair(strSet.substr(0, iEq), strSet.substr(iEq + 1)));
+    }
+    else if (!strcmp(argv[i], "--held-out") && bArg) dHeldOut = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--threads") && bArg) iThreads = std::max(0, atoi(argv[++i]));
+    else if (!strcmp(argv[i], "--adaptive")) bAdaptive = true;
+    else if (!strcmp(argv[i], "--csv") && bArg) strCsv = argv[++i];
+    else {
+      Usage(argv[0]);
+      return 1;
+    }
+  }
+  if (dHeldOut <= 0 || dHeldOut >= 1) {
+    fprintf(stderr, "--held-out must be between 0 and 1\n");
+    return 1;
+  }
+  if (vDataDirs.empty()) vDataDirs.push_back("Data");
+  if (vModels.empty()) vModels = {0, 2, 3, 4, 5};
+
+  CHeadlessSettingsStore settings;
+  for (const auto &setting : vSettings)
+    if (const char *szError = settings.ClSet(setting.first, setting.second)) {
+      fprintf(stderr, "%s: %s\n", setting.first.c_str(), szError);
+      return 1;
+    }
+  if (vOrders.empty()) vOrders.push_back(settings.GetLongParameter(LP_LM_MAX_ORDER));
+
+  CStderrMessages msgs;
+  CAlphIO alphIO(&msgs);
+  ScanDataDirs(&alphIO, vDataDirs, "alphabet.*.xml");
+  const CAlphInfo *pAlph = alphIO.GetInfo(strAlphabet.empty() ? alphIO.GetDefault() : strAlphabet);
+  //As CAlphabetManager::InitMap
+  CAlphabetMap map;
+  for (int i = 1; i < pAlph->iEnd; i++) {
+    if (pAlph->SymbolPrintsNewLineCharacter(i))
+      map.AddParagraphSymbol(i);
+    else
+      map.Add(pAlph->GetText(i), i);
+  }
+
+  CTextCollector texts(&msgs);
+  if (vTextFiles.empty())
+    ScanDataDirs(&texts, vDataDirs, pAlph->GetTrainingFile());
+  else
+    for (const std::string &strFile : vTextFiles)
+      texts.ParseFile(strFile, false);
+  std::vector<SCorpus> vCorpora;
+  std::size_t iHeldOutBytes = 0;
+  for (const auto &text : texts.m_vTexts) {
+    //hold out from the first line break after the split point, so as not to divide a character
+    std::string::size_type iSplit = text.second.find('\n', static_cast<std::string::size_type>(text.second.size() * (1 - dHeldOut)));
+    if (iSplit == std::string::npos) continue;
+    SCorpus corpus;
+    corpus.strName = text.first;
+    corpus.strTrain = text.second.substr(0, iSplit + 1);
+    corpus.strHeldOut = text.second.substr(iSplit + 1);
+    iHeldOutBytes += corpus.strHeldOut.size();
+    vCorpora.push_back(corpus);
+  }
+  if (vCorpora.empty()) {
+    fprintf(stderr, "No training text %s found\n", vTextFiles.empty() ? pAlph->GetTrainingFile().c_str() : "");
+    return 1;
+  }
+
+  printf("Alphabet \"%s\" (%d symbols), %zu text(s), %zu bytes held out; %s scoring\n", pAlph->GetID().c_str(),
+         pAlph->iEnd - 1, vCorpora.size(), iHeldOutBytes, bAdaptive ? "adaptive" : "static");
+  printf("Peak resident set size before running any model %.1f MB\n", PeakRSS() / (1024.0 * 1024.0));
+  printf("%-10s %5s %9s %12s %10s %10s %8s %8s %8s %8s %8s %8s\n", "model", "order", "symbols", "train sym/s", "model KB",
+         "ctx KB", "bits/ch", "p50 us", "p95 us", "p99 us", "max us", "peak MB");
+  std::vector<SRun> vRuns;
+  for (long iModelID : vModels)
+    for (long iOrder : vOrders) {
+      const SRun run = RunModelIsolated(iModelID, iOrder, &settings, &msgs, pAlph, &map, vCorpora, iThreads, bAdaptive);
+      printf("%-10s %5ld %9lu %12.0f %10.1f %10.1f %8.4f %8.2f %8.2f %8.2f %8.2f %8.1f\n", ModelName(iModelID), iOrder,
+             run.iTrainSymbols, run.dTrainMs > 0 ? run.iTrainSymbols / (run.dTrainMs / 1000) : 0.0,
+             run.iModelBytes / 1024.0, run.iContextBytes / 1024.0, run.iScored ? run.dBits / run.iScored : 0.0,
+             run.dProbs50, run.dProbs95, run.dProbs99, run.dProbsMax, run.iPeakRSS / (1024.0 * 1024.0));
+      vRuns.push_back(run);
+    }
+  if (vRuns.back().iUnknown)
+    printf("%lu held-out characters not in the alphabet were skipped (restarting the context)\n", vRuns.back().iUnknown);
+
+  if (!strCsv.empty()) {
+    std::ofstream csv(strCsv);
+    csv << "model_id,model,max_order,train_symbols,train_ms,train_symbols_per_s,model_bytes,context_bytes,"
+           "heldout_chars,heldout_unknown,bits_per_char,getprobs_mean_us,getprobs_p50_us,getprobs_p95_us,getprobs_p99_us,getprobs_max_us,peak_rss_bytes\n";
+    for (const SRun &run : vRuns)
+      csv << run.iModelID << "," << ModelName(run.iModelID) << "," << run.iMaxOrder << "," << run.iTrainSymbols << ","
+          << run.dTrainMs << "," << (run.dTrainMs > 0 ? run.iTrainSymbols / (run.dTrainMs / 1000) : 0.0) << ","
+          << run.iModelBytes << "," << run.iContextBytes << "," << run.iScored << "," << run.iUnknown << ","
+          << (run.iScored ? run.dBits / run.iScored : 0.0) << "," << run.dProbsMean << "," << run.dProbs50 << ","
+          << run.dProbs95 << "," << run.dProbs99 << "," << run.dProbsMax << "," << run.iPeakRSS << "\n";
+    if (!csv) {
+      fprintf(stderr, "Could not write %s\n", strCsv.c_str());
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,506 @@
+// LanguageModelCheck.cpp
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// Checks properties of the language models which are not visible in Dasher's output,
+// training them on (the start of) an alphabet's training text. Each check prints a
+// line starting PASS or FAIL; the exit status is nonzero if any failed. Checks:
+//
+//   compact  CCompactPPMLanguageModel builds the same trie as CPPMLanguageModel
+//            (CCompactPPMLanguageModel::eq) and gives identical GetProbs in every
+//            context of the text, with and without LP_LM_UPDATE_EXCLUSION, after
+//            LP_LM_ALPHA and LP_LM_BETA are changed, and when counts reach their
+//            storage limit
+//   snapshot CPPMSnapshotLanguageModel, mapping the file a CPPMLanguageModel writes,
+//            gives identical GetProbs in every context of the text, also after
+//            LP_LM_ALPHA and LP_LM_BETA are changed
+//   batch    GetProbsBatch gives the same rows as GetProbs, with and without a uniform
+//            part, for PPM, compact PPM, Dict and Mixture; and the uniform part is
+//            spread over the symbols, the rest as if there were none
+//   sharded  CPPMLanguageModel learns the same from a shard (CreateShard) merged into
+//            it, as directly; and deterministic parallel training (CTrainer::
+//            SetParallelism) gives the same model whatever the number of threads,
+//            comparing WriteToFile output and GetProbs
+//   allocations  GetProbs makes no heap allocations (counted by replacing the global
+//            operator new), once the vector it fills is big enough, for the models
+//            which promise that: PPM, compact PPM, Dict and Mixture
+//   soak     CMixtureLanguageModel's context pools stay the same size, and no memory
+//            is allocated, over 1M cycles of cloning, extending and releasing
+//            contexts (with GetProbs on some) while the number live is constant
+//
+// Usage: LanguageModelCheck [--data DIR]... [--alphabet ID] [--text FILE]... [--bytes N] [CHECK]...
+// Data directories (default ./Data) are searched recursively for alphabets and the
+// alphabet's training file, unless text files are given; at most N bytes of text
+// (default 1MB) are used. With no checks named, all are run.
+
+#include "HeadlessDasher.h"
+
+#include "AlphabetMap.h"
+#include "MemoryReport.h"
+#include "Trainer.h"
+#include "Alphabet/AlphIO.h"
+#include "LanguageModelling/CompactPPMLanguageModel.h"
+#include "LanguageModelling/PPMSnapshotLanguageModel.h"
+#include "LanguageModelling/DictLanguageModel.h"
+#include "LanguageModelling/MixtureLanguageModel.h"
+#include "LanguageModelling/PPMLanguageModel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace Dasher;
+
+namespace {
+  ///Calls to the global operator new (and so new[]), by any thread
+  std::atomic<unsigned long> g_iAllocations(0);
+}
+
+void *operator new(std::size_t iSize) {
+  g_iAllocations++;
+  if (void *p = malloc(iSize ? iSize : 1)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept {free(p);}
+void operator delete(void *p, std::size_t) noexcept {free(p);}
+
+namespace {
+  void Usage(const char *szProg) {
+    fprintf(stderr, "Usage: %s [--data DIR]... [--alphabet ID] [--text FILE]... [--bytes N] [CHECK]...\n"
+                    "Checks: compact snapshot batch sharded allocations soak\n", szProg);
+  }
+
+  class CStderrMessages : public CMessageDisplay {
+  public:
+    void Message(const std::string &strText, bool bInterrupt) override {
+      fprintf(stderr, "%s\n", strText.c_str());
+    }
+  };
+
+  ///Reads whole files, as found by ScanDataDirs, into one string
+  class CTextCollector : public AbstractParser {
+  public:
+    CTextCollector(CMessageDisplay *pMsgs) : AbstractParser(pMsgs) {}
+    bool Parse(const std::string &strDesc, std::istream &in, bool bUser) override {
+      m_strText.append(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+      return true;
+    }
+    std::string m_strText;
+  };
+
+  ///What every check trains and tests on
+  struct SData {
+    CSettingsStore *pSettings;
+    CMessageDisplay *pMsgs;
+    const CAlphInfo *pAlph;
+    const CAlphabetMap *pMap;
+    std::string strText;
+    ///strText as symbols
+    std::vector<symbol> vSyms;
+  };
+
+  bool Report(const char *szCheck, bool bPass, const std::string &strDetail) {
+    printf("%s %s: %s\n", bPass ? "PASS" : "FAIL", szCheck, strDetail.c_str());
+    return bPass;
+  }
+
+  void Train(const SData &data, CLanguageModel *pLM, const std::string &strText, int iThreads = 1) {
+    CTrainer trainer(data.pMsgs, pLM, data.pAlph, data.pMap);
+    trainer.SetParallelism(iThreads, true);
+    std::istringstream in(strText);
+    trainer.Parse("check", in, false);
+  }
+
+  ///Contents of the file a model writes with WriteToFile; empty if it failed
+  std::string Snapshot(CLanguageModel *pLM) {
+    const std::filesystem::path path(std::filesystem::temp_directory_path() / "LanguageModelCheck.tmp");
+    std::string strData;
+    if (pLM->WriteToFile(path.string())) {
+      std::ifstream in(path, std::ios::binary);
+      strData.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    return strData;
+  }
+
+  ///Walks two models along a sequence of symbols (resetting the context at any not in
+  /// the alphabet), comparing their predictions before each.
+  /// \return number of contexts where they differed
+  unsigned long CompareProbs(const SData &data, CLanguageModel *pA, CLanguageModel *pB, const std::vector<symbol> &vSyms) {
+    const int iNorm = 1 << 16;
+    const symbol iSymbols = data.pAlph->iEnd - 1;
+    std::vector<unsigned int> vA, vB;
+    unsigned long iDiffs = 0;
+    CLanguageModel::Context a = pA->CreateEmptyContext(), b = pB->CreateEmptyContext();
+    for (symbol sym : vSyms) {
+      pA->GetProbs(a, vA, iNorm, 0);
+      pB->GetProbs(b, vB, iNorm, 0);
+      if (vA != vB) iDiffs++;
+      if (sym <= 0 || sym > iSymbols) {
+        pA->ReleaseContext(a);
+        pB->ReleaseContext(b);
+        a = pA->CreateEmptyContext();
+        b = pB->CreateEmptyContext();
+      } else {
+        pA->EnterSymbol(a, sym);
+        pB->EnterSymbol(b, sym);
+      }
+    }
+    pA->ReleaseContext(a);
+    pB->ReleaseContext(b);
+    return iDiffs;
+  }
+
+  bool CheckCompact(const SData &data) {
+    bool bPass = true;
+    const long iOldExclusion = data.pSettings->GetLongParameter(LP_LM_UPDATE_EXCLUSION);
+    for (long iExclusion = 0; iExclusion <= 1; iExclusion++) {
+      data.pSettings->SetLongParameter(LP_LM_UPDATE_EXCLUSION, iExclusion);
+      CPPMLanguageModel ppm(data.pSettings, data.pAlph->iEnd - 1);
+      CCompactPPMLanguageModel compact(data.pSettings, data.pAlph->iEnd - 1);
+      Train(data, &ppm, data.strText);
+      Train(data, &compact, data.strText);
+      const bool bEq = compact.eq(&ppm);
+      const unsigned long iDiffs = CompareProbs(data, &ppm, &compact, data.vSyms);
+      std::ostringstream detail;
+      detail << "update exclusion " << iExclusion << ", " << compact.GetNumNodes() << " nodes, trie "
+             << (bEq ? "identical" : "differs") << ", GetProbs differs in " << iDiffs << " of " << data.vSyms.size() << " contexts";
+      bPass &= Report("compact", bEq && iDiffs == 0, detail.str());
+
+      //Both models must follow changes to the settings made after they were created
+      const long iOldAlpha = data.pSettings->GetLongParameter(LP_LM_ALPHA), iOldBeta = data.pSettings->GetLongParameter(LP_LM_BETA);
+      data.pSettings->SetLongParameter(LP_LM_ALPHA, iOldAlpha * 2 + 1);
+      data.pSettings->SetLongParameter(LP_LM_BETA, iOldBeta / 2 + 7);
+      const unsigned long iParamDiffs = CompareProbs(data, &ppm, &compact, data.vSyms);
+      data.pSettings->SetLongParameter(LP_LM_ALPHA, iOldAlpha);
+      data.pSettings->SetLongParameter(LP_LM_BETA, iOldBeta);
+      std::ostringstream paramDetail;
+      paramDetail << "update exclusion " << iExclusion << ", alpha " << iOldAlpha * 2 + 1 << " beta " << iOldBeta / 2 + 7
+                  << ", GetProbs differs in " << iParamDiffs << " of " << data.vSyms.size() << " contexts";
+      bPass &= Report("compact", iParamDiffs == 0, paramDetail.str());
+
+      //Learning one symbol over and over takes its counts past what a node can hold
+      std::vector<symbol> vRepeat(70000, 1);
+      CLanguageModel::Context p = ppm.CreateEmptyContext(), c = compact.CreateEmptyContext();
+      for (symbol sym : vRepeat) {
+        ppm.LearnSymbol(p, sym);
+        compact.LearnSymbol(c, sym);
+      }
+      ppm.ReleaseContext(p);
+      compact.ReleaseContext(c);
+      const bool bSatEq = compact.eq(&ppm);
+      vRepeat.resize(100);
+      const unsigned long iSatDiffs = CompareProbs(data, &ppm, &compact, vRepeat);
+      std::ostringstream satDetail;
+      satDetail << "update exclusion " << iExclusion << ", " << vRepeat.size() << " contexts after saturating counts, trie "
+                << (bSatEq ? "identical" : "differs") << ", GetProbs differs in " << iSatDiffs;
+      bPass &= Report("compact", bSatEq && iSatDiffs == 0, satDetail.str());
+    }
+    data.pSettings->SetLongParameter(LP_LM_UPDATE_EXCLUSION, iOldExclusion);
+    return bPass;
+  }
+
+  bool CheckSnapshot(const SData &data) {
+    CPPMLanguageModel ppm(data.pSettings, data.pAlph->iEnd - 1);
+    Train(data, &ppm, data.strText);
+    const std::filesystem::path path(std::filesystem::temp_directory_path() / "LanguageModelCheck.snapshot.tmp");
+    bool bPass = ppm.WriteToFile(path.string());
+    {
+      CPPMSnapshotLanguageModel snapshot(data.pSettings, data.pAlph->iEnd - 1);
+      bPass &= snapshot.ReadFromFile(path.string());
+      const long iOldAlpha = data.pSettings->GetLongParameter(LP_LM_ALPHA), iOldBeta = data.pSettings->GetLongParameter(LP_LM_BETA);
+      //the settings as loaded, then changed while both models exist
+      const long params[][2] = {{iOldAlpha, iOldBeta}, {iOldAlpha * 2 + 1, iOldBeta / 2 + 7}};
+      for (const auto &param : params) {
+        data.pSettings->SetLongParameter(LP_LM_ALPHA, param[0]);
+        data.pSettings->SetLongParameter(LP_LM_BETA, param[1]);
+        const unsigned long iDiffs = CompareProbs(data, &ppm, &snapshot, data.vSyms);
+        std::ostringstream detail;
+        detail << "alpha " << param[0] << " beta " << param[1] << ", " << snapshot.GetNumNodes() << " nodes, GetProbs differs in "
+               << iDiffs << " of " << data.vSyms.size() << " contexts";
+        bPass &= Report("snapshot", snapshot.GetNumNodes() > 0 && iDiffs == 0, detail.str());
+      }
+      data.pSettings->SetLongParameter(LP_LM_ALPHA, iOldAlpha);
+      data.pSettings->SetLongParameter(LP_LM_BETA, iOldBeta);
+    }
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    return bPass;
+  }
+
+  bool CheckSharded(const SData &data) {
+    const int iSymbols = data.pAlph->iEnd - 1;
+    //One shard: learning into a shard then merging it into an empty model, vs. directly
+    CPPMLanguageModel direct(data.pSettings, iSymbols), merged(data.pSettings, iSymbols);
+    Train(data, &direct, data.strText);
+    CLanguageModel *pShard = merged.CreateShard();
+    Train(data, pShard, data.strText);
+    const bool bMerged = merged.MergeShard(pShard);
+    delete pShard;
+    const std::string strDirect(Snapshot(&direct));
+    bool bSame = bMerged && !strDirect.empty() && Snapshot(&merged) == strDirect;
+    unsigned long iDiffs = CompareProbs(data, &direct, &merged, data.vSyms);
+    std::ostringstream detail;
+    detail << "1 shard merged: snapshot " << (bSame ? "identical" : "differs") << ", GetProbs differs in " << iDiffs
+           << " of " << data.vSyms.size() << " contexts";
+    bool bPass = Report("sharded", bSame && iDiffs == 0, detail.str());
+
+    //Many shards: enough text for several of those (1MB each) into which CTrainer splits
+    // deterministic training, trained on different numbers of threads
+    std::string strText;
+    while (strText.size() < (4 << 20)) strText += data.strText;
+    CPPMLanguageModel reference(data.pSettings, iSymbols);
+    Train(data, &reference, strText, 2);
+    const std::string strReference(Snapshot(&reference));
+    for (int iThreads : {3, 4, 8}) {
+      CPPMLanguageModel parallel(data.pSettings, iSymbols);
+      Train(data, &parallel, strText, iThreads);
+      bSame = !strReference.empty() && Snapshot(&parallel) == strReference;
+      iDiffs = CompareProbs(data, &reference, &parallel, data.vSyms);
+      std::ostringstream threadDetail;
+      threadDetail << strText.size() << " bytes on " << iThreads << " vs. 2 threads: snapshot " << (bSame ? "identical" : "differs")
+                   << ", GetProbs differs in " << iDiffs << " of " << data.vSyms.size() << " contexts";
+      bPass &= Report("sharded", bSame && iDiffs == 0, threadDetail.str());
+    }
+    return bPass;
+  }
+
+  bool CheckBatch(const SData &data) {
+    struct SModel {
+      const char *szName;
+      CLanguageModel *pLM;
+      ///Whether the model gives each symbol its share of iUniform (CDictLanguageModel ignores it)
+      bool bUniform;
+    };
+    const SModel models[] = {
+      {"PPM", new CPPMLanguageModel(data.pSettings, data.pAlph->iEnd - 1), true},
+      {"CompactPPM", new CCompactPPMLanguageModel(data.pSettings, data.pAlph->iEnd - 1), true},
+      {"Dict", new CDictLanguageModel(data.pSettings, data.pAlph, data.pMap), false},
+      {"Mixture", new CMixtureLanguageModel(data.pSettings, data.pAlph, data.pMap), true},
+    };
+    const int iNorm = 1 << 16;
+    //Contexts per batch, as many as a frame might expand
+    const size_t iBatch = 32;
+    bool bPass = true;
+    for (const SModel &model : models) {
+      Train(data, model.pLM, data.strText);
+      //contexts along the text, every 7th symbol
+      std::vector<CLanguageModel::Context> vContexts;
+      CLanguageModel::Context context = model.pLM->CreateEmptyContext();
+      for (size_t i = 0; i < data.vSyms.size() && vContexts.size() < iBatch * 64; i++) {
+        const symbol sym = data.vSyms[i];
+        if (sym <= 0 || sym >= data.pAlph->iEnd) {
+          model.pLM->ReleaseContext(context);
+          context = model.pLM->CreateEmptyContext();
+        } else
+          model.pLM->EnterSymbol(context, sym);
+        if (i % 7 == 0) vContexts.push_back(model.pLM->CloneContext(context));
+      }
+      model.pLM->ReleaseContext(context);
+      for (int iUniform : {0, iNorm / 20}) {
+        //each symbol's share of the uniform part, spread as CPPMLanguageModel does
+        std::vector<unsigned int> vShares(data.pAlph->iEnd, 0);
+        unsigned int iUniformLeft = model.bUniform ? iUniform : 0;
+        for (int j = 1; j < data.pAlph->iEnd; j++) {
+          vShares[j] = iUniformLeft / (data.pAlph->iEnd - j);
+          iUniformLeft -= vShares[j];
+        }
+        unsigned long iDiffs = 0, iNotUniform = 0;
+        std::vector<unsigned int> vBatch, vRow, vRest;
+        for (size_t iStart = 0; iStart < vContexts.size(); iStart += iBatch) {
+          const size_t iNum = std::min(iBatch, vContexts.size() - iStart);
+          const size_t iRowLen = model.pLM->GetProbsBatch(&vContexts[iStart], iNum, vBatch, iNorm, iUniform);
+          for (size_t i = 0; i < iNum; i++) {
+            model.pLM->GetProbs(vContexts[iStart + i], vRow, iNorm, iUniform);
+            //...which should be the rest of the norm, distributed as without a uniform part
+            model.pLM->GetProbs(vContexts[iStart + i], vRest, iNorm - (model.bUniform ? iUniform : 0), 0);
+            //element 0 (no symbol) is not part of the distribution
+            bool bSame = vRow.size() == iRowLen, bUniform = vRow.size() == vRest.size();
+            for (size_t j = 1; j < vRow.size(); j++) {
+              if (bSame && vRow[j] != vBatch[i * iRowLen + j]) bSame = false;
+              if (bUniform && vRow[j] != vRest[j] + vShares[j]) bUniform = false;
+            }
+            if (!bSame) iDiffs++;
+            if (!bUniform) iNotUniform++;
+          }
+        }
+        std::ostringstream detail;
+        detail << model.szName << ", uniform " << iUniform << ": batch differs in " << iDiffs << " of " << vContexts.size()
+               << " contexts, uniform part not added as expected in " << iNotUniform;
+        bPass &= Report("batch", iDiffs == 0 && iNotUniform == 0, detail.str());
+      }
+      for (CLanguageModel::Context c : vContexts) model.pLM->ReleaseContext(c);
+      delete model.pLM;
+    }
+    return bPass;
+  }
+
+  bool CheckAllocations(const SData &data) {
+    struct SModel {
+      const char *szName;
+      CLanguageModel *pLM;
+    };
+    const SModel models[] = {
+      {"PPM", new CPPMLanguageModel(data.pSettings, data.pAlph->iEnd - 1)},
+      {"CompactPPM", new CCompactPPMLanguageModel(data.pSettings, data.pAlph->iEnd - 1)},
+      {"Dict", new CDictLanguageModel(data.pSettings, data.pAlph, data.pMap)},
+      {"Mixture", new CMixtureLanguageModel(data.pSettings, data.pAlph, data.pMap)},
+    };
+    //Time for anything allocated lazily (buffers, pools) to have reached its size
+    const size_t iWarmUp = 1000;
+    bool bPass = true;
+    for (const SModel &model : models) {
+      Train(data, model.pLM, data.strText);
+      std::vector<unsigned int> vProbs;
+      unsigned long iCalls = 0, iAllocations = 0;
+      CLanguageModel::Context context = model.pLM->CreateEmptyContext();
+      for (size_t i = 0; i < data.vSyms.size(); i++) {
+        const unsigned long iBefore = g_iAllocations;
+        model.pLM->GetProbs(context, vProbs, 1 << 16, 0);
+        if (i >= iWarmUp) {
+          iAllocations += g_iAllocations - iBefore;
+          iCalls++;
+        }
+        const symbol sym = data.vSyms[i];
+        if (sym <= 0 || sym >= data.pAlph->iEnd) {
+          model.pLM->ReleaseContext(context);
+          context = model.pLM->CreateEmptyContext();
+        } else
+          model.pLM->EnterSymbol(context, sym);
+      }
+      model.pLM->ReleaseContext(context);
+      delete model.pLM;
+      std::ostringstream detail;
+      detail << model.szName << ": " << iAllocations << " allocations in " << iCalls << " GetProbs calls after " << iWarmUp << " to warm up";
+      bPass &= Report("allocations", iCalls > 0 && iAllocations == 0, detail.str());
+    }
+    return bPass;
+  }
+
+  bool CheckSoak(const SData &data) {
+    const size_t iLive = 2000;
+    const unsigned long iCycles = 1000000, iWarmUp = 10000;
+    CMixtureLanguageModel mixture(data.pSettings, data.pAlph, data.pMap);
+    Train(data, &mixture, data.strText);
+    std::vector<CLanguageModel::Context> vContexts;
+    for (size_t i = 0; i < iLive; i++) vContexts.push_back(mixture.CreateEmptyContext());
+    std::vector<unsigned int> vProbs;
+    //A fixed sequence (from a linear congruential generator), so runs are repeatable
+    unsigned long iRandom = 12345;
+    std::size_t iWarmBytes = 0;
+    unsigned long iWarmAllocations = 0;
+    for (unsigned long i = 0; i < iCycles; i++) {
+      if (i == iWarmUp) {
+        CMemoryReport report;
+        mixture.ReportMemory(report);
+        iWarmBytes = report.GetTotalBytes(CMemoryReport::MEM_CONTEXTS);
+        iWarmAllocations = g_iAllocations;
+      }
+      iRandom = iRandom * 1103515245 + 12345;
+      //replace a context with an extended clone of another, as when expanding a node
+      // whose parent's sibling is collapsed
+      const size_t iFrom = (iRandom >> 8) % iLive, iTo = (iRandom >> 24) % iLive;
+      CLanguageModel::Context clone = mixture.CloneContext(vContexts[iFrom]);
+      mixture.EnterSymbol(clone, 1 + static_cast<int>((iRandom >> 16) % (data.pAlph->iEnd - 1)));
+      mixture.ReleaseContext(vContexts[iTo]);
+      vContexts[iTo] = clone;
+      if (i % 16 == 0) mixture.GetProbs(clone, vProbs, 1 << 16, 0);
+    }
+    const unsigned long iAllocations = g_iAllocations - iWarmAllocations;
+    CMemoryReport report;
+    mixture.ReportMemory(report);
+    const std::size_t iBytes = report.GetTotalBytes(CMemoryReport::MEM_CONTEXTS);
+    for (CLanguageModel::Context context : vContexts) mixture.ReleaseContext(context);
+    std::ostringstream detail;
+    detail << iCycles << " cycles with " << iLive << " contexts live: context pools " << iWarmBytes << " bytes after "
+           << iWarmUp << ", " << iBytes << " at end; " << iAllocations << " allocations in between";
+    return Report("soak", iBytes == iWarmBytes && iAllocations == 0, detail.str());
+  }
+
+  struct SCheck {
+    const char *szName;
+    bool (*pCheck)(const SData &data);
+  };
+  const SCheck checks[] = {
+    {"compact", &CheckCompact},
+    {"snapshot", &CheckSnapshot},
+    {"batch", &CheckBatch},
+    {"sharded", &CheckSharded},
+    {"allocations", &CheckAllocations},
+    {"soak", &CheckSoak},
+  };
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> vDataDirs, vTextFiles, vChecks;
+  std::string strAlphabet;
+  std::size_t iMaxBytes = 1 << 20;
+  for (int i = 1; i < argc; i++) {
+    const bool bArg = i + 1 < argc;
+    if (!strcmp(argv[i], "--data") && bArg) vDataDirs.push_back(argv[++i]);
+    else if (!strcmp(argv[i], "--alphabet") && bArg) strAlphabet = argv[++i];
+    else if (!strcmp(argv[i], "--text") && bArg) vTextFiles.push_back(argv[++i]);
+    else if (!strcmp(argv[i], "--bytes") && bArg) iMaxBytes = strtoul(argv[++i], NULL, 10);
+    else if (argv[i][0] != '-' && std::any_of(std::begin(checks), std::end(checks), [&](const SCheck &check) {return !strcmp(check.szName, argv[i]);}))
+      vChecks.push_back(argv[i]);
+    else {
+      Usage(argv[0]);
+      return 1;
+    }
+  }
+  if (vDataDirs.empty()) vDataDirs.push_back("Data");
+
+  CHeadlessSettingsStore settings;
+  CStderrMessages msgs;
+  CAlphIO alphIO(&msgs);
+  ScanDataDirs(&alphIO, vDataDirs, "alphabet.*.xml");
+  const CAlphInfo *pAlph = alphIO.GetInfo(strAlphabet.empty() ? alphIO.GetDefault() : strAlphabet);
+  //As CAlphabetManager::InitMap
+  CAlphabetMap map;
+  for (int i = 1; i < pAlph->iEnd; i++) {
+    if (pAlph->SymbolPrintsNewLineCharacter(i))
+      map.AddParagraphSymbol(i);
+    else
+      map.Add(pAlph->GetText(i), i);
+  }
+
+  CTextCollector texts(&msgs);
+  if (vTextFiles.empty())
+    ScanDataDirs(&texts, vDataDirs, pAlph->GetTrainingFile());
+  else
+    for (const std::string &strFile : vTextFiles)
+      texts.ParseFile(strFile, false);
+  SData data;
+  data.pSettings = &settings;
+  data.pMsgs = &msgs;
+  data.pAlph = pAlph;
+  data.pMap = &map;
+  data.strText = texts.m_strText;
+  if (data.strText.size() > iMaxBytes) {
+    //cut at a line break, so as not to divide a character
+    const std::string::size_type iCut = data.strText.rfind('\n', iMaxBytes);
+    data.strText.resize(iCut == std::string::npos ? 0 : iCut + 1);
+  }
+  if (data.strText.empty()) {
+    fprintf(stderr, "No training text %s found\n", vTextFiles.empty() ? pAlph->GetTrainingFile().c_str() : "");
+    return 1;
+  }
+  map.GetSymbols(data.vSyms, data.strText);
+  printf("Alphabet \"%s\" (%d symbols), %zu bytes of text\n", pAlph->GetID().c_str(), pAlph->iEnd - 1, data.strText.size());
+
+  bool bPass = true;
+  for (const SCheck &check : checks)
+    if (vChecks.empty() || std::find(vChecks.begin(), vChecks.end(), check.szName) != vChecks.end())
+      bPass &= check.pCheck(data);
+  return bPass ? 0 : 1;
+}
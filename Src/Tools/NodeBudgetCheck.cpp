@@ -0,0 +1,125 @@
+// NodeBudgetCheck.cpp
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// Drives CNodeBudgetController with frame costs from a synthetic machine, whose
+// frames take a fixed time plus a time per node (each with a little deterministic
+// jitter), and whose number of nodes follows the budget with a lag, as nodes are
+// expanded or collapsed over several frames. For each scenario, checks that frame
+// times settle within a band around the target, within a limit on the number of
+// frames, and stay there; and that the final budget is within the same band around
+// that which would exactly fit the target without jitter. Prints a line starting
+// PASS or FAIL per scenario; the exit status is nonzero if any failed.
+//
+// Usage: NodeBudgetCheck [--band FRACTION] [--verbose]
+// --band sets the allowed deviation from the target (default 0.1, i.e. +-10%);
+// --verbose prints every decision.
+
+#include "NodeBudgetController.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace Dasher;
+
+namespace {
+  ///A machine on which frames cost dFixedMs + dMsPerNode * (number of nodes); from
+  /// frame iChangeFrame (if nonzero), nodes cost dChangedMsPerNode instead, e.g. as
+  /// when the user moves into a part of the tree using a slower language model.
+  struct SScenario {
+    const char *szName;
+    double dTargetMs;
+    unsigned int iInitialBudget;
+    double dFixedMs, dMsPerNode;
+    unsigned long iChangeFrame;
+    double dChangedMsPerNode;
+  };
+
+  const SScenario scenarios[] = {
+    {"fast-machine", 20.0, 3000, 2.0, 0.0005, 0, 0},
+    {"slow-machine", 40.0, 20000, 10.0, 0.02, 0, 0},
+    {"from-minimum", 25.0, CNodeBudgetController::MIN_BUDGET, 5.0, 0.001, 0, 0},
+    {"from-maximum", 25.0, CNodeBudgetController::MAX_BUDGET, 5.0, 0.004, 0, 0},
+    {"cost-doubles", 30.0, 5000, 6.0, 0.002, 300, 0.004},
+    {"cost-halves", 30.0, 5000, 6.0, 0.004, 300, 0.002},
+  };
+
+  ///Frames allowed for frame times to enter the band, from the start or a change in cost
+  const unsigned long SETTLE_FRAMES = 60;
+  const unsigned long NUM_FRAMES = 600;
+  ///Fraction by which each frame's node and fixed times vary
+  const double JITTER = 0.03;
+  ///Fraction of the way the number of nodes moves towards the budget each frame
+  const double NODE_LAG = 0.3;
+
+  double dBand = 0.1;
+  bool bVerbose = false;
+
+  bool Run(const SScenario &s) {
+    CNodeBudgetController controller(s.iInitialBudget, s.dTargetMs);
+    //A fixed sequence (from a linear congruential generator), so runs are repeatable
+    unsigned long iRandom = 12345;
+    auto jitter = [&iRandom]() {
+      iRandom = (iRandom * 1103515245 + 12345) & 0x7fffffff;
+      return 1.0 + JITTER * (2.0 * (iRandom >> 8) / (0x7fffffff >> 8) - 1.0);
+    };
+    double dNodes = s.iInitialBudget;
+    //Last frame outside the band, and since when frames had to settle
+    unsigned long iLastOutside = 0, iSettleFrom = 0;
+    bool bPass = true;
+    double dWorst = 0.0;
+    for (unsigned long iFrame = 1; iFrame <= NUM_FRAMES; iFrame++) {
+      if (iFrame == s.iChangeFrame) iSettleFrom = iFrame - 1;
+      const double dMsPerNode = (s.iChangeFrame && iFrame >= s.iChangeFrame) ? s.dChangedMsPerNode : s.dMsPerNode;
+      dNodes += NODE_LAG * (controller.GetBudget() - dNodes);
+      CNodeBudgetController::SFrameCost cost;
+      std::fill(cost.dPhaseMs, cost.dPhaseMs + CNodeBudgetController::NUM_PHASES, 0.0);
+      cost.iNumNodes = static_cast<int>(dNodes + 0.5);
+      const double dNodeMs = dMsPerNode * cost.iNumNodes * jitter();
+      //most of the per-node time is rendering, the rest expanding
+      cost.dPhaseMs[CNodeBudgetController::PHASE_RENDER] = 0.8 * dNodeMs;
+      cost.dPhaseMs[CNodeBudgetController::PHASE_EXPAND] = 0.2 * dNodeMs;
+      cost.dPhaseMs[CNodeBudgetController::PHASE_DISPLAY] = s.dFixedMs * jitter();
+      const CNodeBudgetController::SDecision &d(controller.Update(cost));
+      if (bVerbose)
+        printf("%s frame %lu: %.2f ms for %d nodes; estimates %.5f ms/node + %.2f ms; budget %u -> %u\n", s.szName,
+               d.iFrame, d.dFrameMs, d.iNumNodes, d.dMsPerNode, d.dFixedMs, d.iOldBudget, d.iNewBudget);
+      const double dError = std::fabs(d.dFrameMs - s.dTargetMs) / s.dTargetMs;
+      if (dError <= dBand) continue;
+      iLastOutside = iFrame;
+      if (iFrame > iSettleFrom + SETTLE_FRAMES) {
+        bPass = false;
+        dWorst = std::max(dWorst, dError);
+      }
+    }
+    const double dIdeal = (s.dTargetMs - s.dFixedMs) / (s.iChangeFrame ? s.dChangedMsPerNode : s.dMsPerNode);
+    if (std::fabs(controller.GetBudget() - dIdeal) > dBand * dIdeal) {
+      printf("FAIL %s: final budget %u, not within %.0f%% of %.0f\n", s.szName, controller.GetBudget(), 100 * dBand, dIdeal);
+      return false;
+    }
+    if (bPass)
+      printf("PASS %s: frame times within %.0f%% of %.1f ms from frame %lu, final budget %u\n", s.szName,
+             100 * dBand, s.dTargetMs, iLastOutside + 1, controller.GetBudget());
+    else
+      printf("FAIL %s: frame times still up to %.0f%% from %.1f ms at frame %lu (allowed %.0f%% after %lu frames), final budget %u\n",
+             s.szName, 100 * dWorst, s.dTargetMs, iLastOutside, 100 * dBand, SETTLE_FRAMES, controller.GetBudget());
+    return bPass;
+  }
+}
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--band") && i + 1 < argc) dBand = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--verbose")) bVerbose = true;
+    else {
+      fprintf(stderr, "Usage: %s [--band FRACTION] [--verbose]\n", argv[0]);
+      return 1;
+    }
+  }
+  bool bPass = true;
+  for (const SScenario &s : scenarios) bPass &= Run(s);
+  return bPass ? 0 : 1;
+}
@@ -0,0 +1,220 @@
+// HeadlessDasher.cpp
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// This file is part of Dasher.
+//
+// Dasher is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Dasher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Dasher; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include "HeadlessDasher.h"
+
+#include "AbstractXMLParser.h"
+#include "DasherModel.h"
+#include "ModuleManager.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <regex>
+#include <sstream>
+
+using namespace Dasher;
+
+namespace {
+  ///Number of code points in a UTF-8 string
+  std::size_t NumChars(const std::string &str) {
+    std::size_t iChars = 0;
+    for (unsigned char c : str)
+      if ((c & 0xC0) != 0x80) iChars++;
+    return iChars;
+  }
+
+  ///Byte offset of the iChar'th code point of a UTF-8 string (or its length, if fewer)
+  std::size_t ByteOffset(const std::string &str, std::size_t iChar) {
+    std::size_t i = 0;
+    for (; i < str.size(); i++)
+      if ((static_cast<unsigned char>(str[i]) & 0xC0) != 0x80 && iChar-- == 0) break;
+    return i;
+  }
+}
+
+std::pair<screenint, screenint> CNullScreen::TextSize(Label *label, unsigned int iFontSize) {
+  return std::make_pair(static_cast<screenint>(NumChars(label->m_strText) * iFontSize * 6 / 10),
+                        static_cast<screenint>(iFontSize));
+}
+
+const char *const CCoordStreamInput::NAME = "Coordinate Stream";
+
+CCoordStreamInput::CCoordStreamInput(const std::vector<SCoordSample> &vSamples)
+: CDasherCoordInput(NAME), m_vSamples(vSamples), m_iCurrent(0) {
+  DASHER_ASSERT(!m_vSamples.empty());
+}
+
+void CCoordStreamInput::SetTime(unsigned long iTime) {
+  //Time normally only advances, so search onwards from the last sample
+  if (iTime < m_vSamples[m_iCurrent].iTime) m_iCurrent = 0;
+  while (m_iCurrent + 1 < m_vSamples.size() && m_vSamples[m_iCurrent + 1].iTime <= iTime)
+    m_iCurrent++;
+}
+
+bool CCoordStreamInput::GetDasherCoords(myint &iDasherX, myint &iDasherY, CDasherView *pView) {
+  iDasherX = m_vSamples[m_iCurrent].iDasherX;
+  iDasherY = m_vSamples[m_iCurrent].iDasherY;
+  return true;
+}
+
+unsigned long CCoordStreamInput::GetEndTime() const {
+  return m_vSamples.back().iTime;
+}
+
+bool CCoordStreamInput::ReadStream(const std::string &strFilename, std::vector<SCoordSample> &vSamples) {
+  std::ifstream in(strFilename);
+  if (!in) return false;
+  std::string strLine;
+  while (std::getline(in, strLine)) {
+    if (strLine.empty() || strLine[0] == '#') continue;
+    std::istringstream line(strLine);
+    SCoordSample sample;
+    if (!(line >> sample.iTime >> sample.iDasherX >> sample.iDasherY)) return false;
+    if (!vSamples.empty() && sample.iTime < vSamples.back().iTime) return false;
+    vSamples.push_back(sample);
+  }
+  return !vSamples.empty();
+}
+
+bool CCoordStreamInput::WriteStream(const std::string &strFilename, const std::vector<SCoordSample> &vSamples) {
+  std::ofstream out(strFilename);
+  if (!out) return false;
+  for (const SCoordSample &sample : vSamples)
+    out << sample.iTime << " " << sample.iDasherX << " " << sample.iDasherY << "\n";
+  return static_cast<bool>(out);
+}
+
+std::vector<SCoordSample> CCoordStreamInput::ScriptedStream(unsigned long iDurationMs, unsigned long iStepMs) {
+  const double PI = 3.14159265358979;
+  std::vector<SCoordSample> vSamples;
+  for (unsigned long t = 0; t <= iDurationMs; t += iStepMs) {
+    SCoordSample sample;
+    sample.iTime = t;
+    if (t % 20000 >= 19000) {
+      //back off (to the right of the crosshair), deleting what was written
+      sample.iDasherX = CDasherModel::ORIGIN_X * 3 / 2;
+      sample.iDasherY = CDasherModel::ORIGIN_Y;
+    } else {
+      //two incommensurate sweeps, so the path through the alphabet doesn't repeat
+      sample.iDasherX = CDasherModel::ORIGIN_X / 3;
+      sample.iDasherY = static_cast<myint>(CDasherModel::ORIGIN_Y
+        + 1200 * std::sin(2 * PI * t / 7000.0) + 500 * std::sin(2 * PI * t / 1900.0));
+    }
+    vSamples.push_back(sample);
+  }
+  return vSamples;
+}
+
+void Dasher::ScanDataDirs(AbstractParser *parser, const std::vector<std::string> &vDirs, const std::string &strPattern) {
+  std::error_code ec;
+  if (std::filesystem::is_regular_file(strPattern, ec)) {
+    parser->ParseFile(strPattern, false);
+    return;
+  }
+  const std::regex pattern(strPattern);
+  for (const std::string &strDir : vDirs) {
+    //sort, so files are always parsed in the same order
+    std::vector<std::filesystem::path> vFiles;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(strDir, ec))
+      if (entry.is_regular_file() && std::regex_search(entry.path().filename().string(), pattern))
+        vFiles.push_back(entry.path());
+    std::sort(vFiles.begin(), vFiles.end());
+    for (const std::filesystem::path &file : vFiles)
+      parser->ParseFile(file.string(), false);
+  }
+}
+
+CHeadlessInterface::CHeadlessInterface(CSettingsStore *pSettingsStore, const std::vector<std::string> &vDataDirs, CCoordStreamInput *pInput)
+: CDashIntfScreenMsgs(pSettingsStore), m_vDataDirs(vDataDirs), m_pStreamInput(pInput),
+  m_iCharsOutput(0), m_iCharsDeleted(0), m_iTrainBytes(0) {
+}
+
+void CHeadlessInterface::CreateModules() {
+  CDashIntfScreenMsgs::CreateModules();
+  GetModuleManager()->RegisterInputDeviceModule(m_pStreamInput, true);
+}
+
+void CHeadlessInterface::ScanFiles(AbstractParser *parser, const std::string &strPattern) {
+  ScanDataDirs(parser, m_vDataDirs, strPattern);
+}
+
+void CHeadlessInterface::WriteTrainFile(const std::string &filename, const std::string &strNewText) {
+  m_iTrainBytes += strNewText.size();
+}
+
+void CHeadlessInterface::Message(const std::string &strText, bool bInterrupt) {
+  //Not shown, so modal messages do not pause either
+  m_vMessages.push_back(strText);
+}
+
+unsigned int CHeadlessInterface::ctrlMove(bool bForwards, EditDistance dist) {
+  //The cursor stays at the end of the buffer
+  return GetAllContextLenght();
+}
+
+unsigned int CHeadlessInterface::ctrlDelete(bool bForwards, EditDistance dist) {
+  if (!bForwards && !m_strBuffer.empty()) {
+    std::size_t iFrom;
+    switch (dist) {
+      case EDIT_CHAR:
+        iFrom = ByteOffset(m_strBuffer, NumChars(m_strBuffer) - 1);
+        break;
+      case EDIT_WORD:
+      case EDIT_LINE:
+      case EDIT_SENTENCE:
+      case EDIT_PARAGRAPH: {
+        const char *szSep = dist == EDIT_WORD ? " \n" : dist == EDIT_SENTENCE ? ".!?\n" : "\n";
+        const std::size_t iSep = m_strBuffer.find_last_of(szSep, m_strBuffer.size() - 2);
+        iFrom = (iSep == std::string::npos || m_strBuffer.size() < 2) ? 0 : iSep + 1;
+        break;
+      }
+      default:
+        iFrom = 0;
+    }
+    m_strBuffer.erase(iFrom);
+  }
+  return GetAllContextLenght();
+}
+
+std::string CHeadlessInterface::GetContext(unsigned int iStart, unsigned int iLength) {
+  const std::size_t iFrom = ByteOffset(m_strBuffer, iStart);
+  return m_strBuffer.substr(iFrom, ByteOffset(m_strBuffer, iStart + iLength) - iFrom);
+}
+
+int CHeadlessInterface::GetAllContextLenght() {
+  return static_cast<int>(NumChars(m_strBuffer));
+}
+
+void CHeadlessInterface::editOutput(const std::string &strText, CDasherNode *pCause) {
+  m_strBuffer += strText;
+  m_iCharsOutput += NumChars(strText);
+  CDashIntfScreenMsgs::editOutput(strText, pCause);
+}
+
+void CHeadlessInterface::editDelete(const std::string &strText, CDasherNode *pCause) {
+  //Deletes are always of the text most recently output
+  DASHER_ASSERT(m_strBuffer.size() >= strText.size()
+                && m_strBuffer.compare(m_strBuffer.size() - strText.size(), strText.size(), strText) == 0);
+  m_strBuffer.erase(m_strBuffer.size() - std::min(strText.size(), m_strBuffer.size()));
+  m_iCharsDeleted += NumChars(strText);
+  CDashIntfScreenMsgs::editDelete(strText, pCause);
+}
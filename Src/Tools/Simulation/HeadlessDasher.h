@@ -0,0 +1,162 @@
+// HeadlessDasher.h
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// This file is part of Dasher.
+//
+// Dasher is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Dasher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Dasher; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+#pragma once
+
+#include "DashIntfScreenMsgs.h"
+#include "DasherInput.h"
+#include "DasherScreen.h"
+#include "SettingsStore.h"
+
+#include <string>
+#include <vector>
+
+namespace Dasher {
+/// \defgroup Simulation Headless simulation
+/// Classes for running the core without a GUI host, e.g. for benchmarking.
+/// \{
+
+/// Screen which draws nothing, but counts the primitives it is asked to draw.
+/// Labels are measured as if every character were 0.6 of the font size wide.
+class CNullScreen : public CDasherScreen {
+public:
+  CNullScreen(screenint iWidth, screenint iHeight) : CDasherScreen(iWidth, iHeight), m_iPrimitives(0) {}
+
+  std::pair<screenint, screenint> TextSize(Label *label, unsigned int iFontSize) override;
+  void DrawString(Label *label, screenint x, screenint y, unsigned int iFontSize, const ColorPalette::Color &color) override {m_iPrimitives++;}
+  void DrawRectangle(screenint x1, screenint y1, screenint x2, screenint y2, const ColorPalette::Color &color, const ColorPalette::Color &outlineColor, int iThickness) override {m_iPrimitives++;}
+  void DrawCircle(screenint iCX, screenint iCY, screenint iR, const ColorPalette::Color &fillColor, const ColorPalette::Color &lineColor, int iLineWidth) override {m_iPrimitives++;}
+  void Polyline(point *Points, int Number, int iWidth, const ColorPalette::Color &color) override {m_iPrimitives++;}
+  void Polygon(point *Points, int Number, const ColorPalette::Color &fillColor, const ColorPalette::Color &outlineColor, int lineWidth) override {m_iPrimitives++;}
+  void Display() override {}
+  bool IsPointVisible(screenint x, screenint y) override {return true;}
+
+  ///Number of drawing calls made since construction
+  unsigned long GetNumPrimitives() const {return m_iPrimitives;}
+
+private:
+  unsigned long m_iPrimitives;
+};
+
+/// One sample of an input coordinate stream: the position, in Dasher coordinates,
+/// from the given time (in ms) until that of the next sample.
+struct SCoordSample {
+  unsigned long iTime;
+  myint iDasherX, iDasherY;
+};
+
+/// Input device replaying a stream of coordinates against a clock set by the caller
+/// (i.e. a virtual clock), so that the same stream always produces the same input.
+class CCoordStreamInput : public CDasherCoordInput {
+public:
+  ///Name by which the device is registered, for SP_INPUT_DEVICE
+  static const char *const NAME;
+
+  ///\param vSamples in increasing order of time
+  CCoordStreamInput(const std::vector<SCoordSample> &vSamples);
+
+  ///Set the current time; GetDasherCoords will return the last sample at or before it.
+  void SetTime(unsigned long iTime);
+
+  bool GetDasherCoords(myint &iDasherX, myint &iDasherY, CDasherView *pView) override;
+
+  ///Time of the last sample
+  unsigned long GetEndTime() const;
+
+  ///Reads a recorded stream: one sample per line, "time x y" (ms, Dasher coordinates);
+  /// blank lines and lines starting '#' are ignored.
+  /// \return false if the file could not be read or contained no samples
+  static bool ReadStream(const std::string &strFilename, std::vector<SCoordSample> &vSamples);
+  ///Writes a stream in the format read by ReadStream
+  static bool WriteStream(const std::string &strFilename, const std::vector<SCoordSample> &vSamples);
+
+  ///A scripted stream of the given length: steering forwards while sweeping up and
+  /// down over the alphabet, and backing off for a second every 20s, so as to
+  /// both write and delete text.
+  static std::vector<SCoordSample> ScriptedStream(unsigned long iDurationMs, unsigned long iStepMs);
+
+private:
+  const std::vector<SCoordSample> m_vSamples;
+  std::size_t m_iCurrent;
+};
+
+/// Parses (with bUser=false) every file in the given directories, and their subdirectories,
+/// whose name matches a regular expression; or, if the pattern names an existing file,
+/// just that file. Files in each directory tree are parsed in sorted order.
+void ScanDataDirs(AbstractParser *parser, const std::vector<std::string> &vDirs, const std::string &strPattern);
+
+/// Settings store with the default values, that loads and saves nothing.
+class CHeadlessSettingsStore : public CSettingsStore {
+public:
+  CHeadlessSettingsStore() {LoadPersistent();}
+};
+
+/// Interface for running the core without a GUI: reads alphabets, colours and training
+/// text from given directories (and their subdirectories), keeps the edit buffer as a
+/// string with the cursor always at the end, records messages rather than showing
+/// them, and discards (but counts) text which would be written to the user's
+/// training file, so that runs do not affect each other.
+class CHeadlessInterface : public CDashIntfScreenMsgs {
+public:
+  ///\param vDataDirs directories to search for data files, in order
+  ///\param pInput input device to register (not owned; must outlive the interface)
+  CHeadlessInterface(CSettingsStore *pSettingsStore, const std::vector<std::string> &vDataDirs, CCoordStreamInput *pInput);
+
+  ///For the driver, as for a platform's main loop
+  using CDashIntfScreenMsgs::Realize;
+  using CDashIntfScreenMsgs::NewFrame;
+
+  ///Registers the input device given to the constructor as the default
+  void CreateModules() override;
+
+  void ScanFiles(AbstractParser *parser, const std::string &strPattern) override;
+  void WriteTrainFile(const std::string &filename, const std::string &strNewText) override;
+  ///None, as training text is discarded (and a user's journal must not be replayed)
+  std::string GetTrainingJournalFile() override {return std::string();}
+
+  void Message(const std::string &strText, bool bInterrupt) override;
+
+  unsigned int ctrlMove(bool bForwards, EditDistance dist) override;
+  unsigned int ctrlDelete(bool bForwards, EditDistance dist) override;
+  std::string GetContext(unsigned int iStart, unsigned int iLength) override;
+  std::string GetAllContext() override {return m_strBuffer;}
+  int GetAllContextLenght() override;
+
+  void editOutput(const std::string &strText, CDasherNode *pCause) override;
+  void editDelete(const std::string &strText, CDasherNode *pCause) override;
+
+  ///Messages given to Message, in order
+  const std::vector<std::string> &GetMessages() const {return m_vMessages;}
+  ///Number of characters (Unicode code points) output and deleted so far
+  unsigned long GetNumCharsOutput() const {return m_iCharsOutput;}
+  unsigned long GetNumCharsDeleted() const {return m_iCharsDeleted;}
+  ///Bytes passed to WriteTrainFile (and discarded)
+  std::size_t GetTrainBytesDiscarded() const {return m_iTrainBytes;}
+
+private:
+  const std::vector<std::string> m_vDataDirs;
+  CCoordStreamInput *m_pStreamInput;
+  std::string m_strBuffer;
+  std::vector<std::string> m_vMessages;
+  unsigned long m_iCharsOutput, m_iCharsDeleted;
+  std::size_t m_iTrainBytes;
+};
+/// \}
+}
@@ -0,0 +1,112 @@
+// Simulation.cpp
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// This file is part of Dasher.
+//
+// Dasher is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Dasher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Dasher; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include "Simulation.h"
+
+#include "AlphabetManager.h"
+#include "DasherNode.h"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace Dasher;
+
+namespace {
+  double MsSince(std::chrono::steady_clock::time_point tStart) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count();
+  }
+}
+
+bool CSimulation::Run(const SOptions &options, const std::vector<SCoordSample> &vInput, SResult &result, std::string &strError) {
+  if (vInput.empty()) {
+    strError = "No input";
+    return false;
+  }
+  CHeadlessSettingsStore settings;
+  settings.SetStringParameter(SP_INPUT_DEVICE, CCoordStreamInput::NAME);
+  if (!options.strAlphabet.empty()) settings.SetStringParameter(SP_ALPHABET_ID, options.strAlphabet);
+  for (const auto &setting : options.vSettings)
+    if (const char *szError = settings.ClSet(setting.first, setting.second)) {
+      strError = setting.first + ": " + szError;
+      return false;
+    }
+
+  CCoordStreamInput input(vInput);
+  CNullScreen screen(options.iScreenWidth, options.iScreenHeight);
+  result = SResult();
+  {
+    CHeadlessInterface intf(&settings, options.vDataDirs, &input);
+    auto tStart = std::chrono::steady_clock::now();
+    intf.Realize(0);
+    intf.ChangeScreen(&screen);
+    result.dStartupMs = MsSince(tStart);
+    const CAlphabetManager *pAlphMgr = intf.GetAlphabetManager();
+    if (!pAlphMgr) {
+      strError = "No alphabet";
+      return false;
+    }
+    result.strAlphabet = pAlphMgr->GetAlphabet()->GetID();
+    result.bProfiled = intf.GetFrameProfiler() != NULL;
+
+    const unsigned long iEnd = options.iDurationMs ? options.iDurationMs : input.GetEndTime();
+    NodeAllocStats lastStats(currentNodeAllocStats());
+    unsigned long iLastProbs = pAlphMgr->GetNumProbsCalls();
+    long iLastChars = intf.GetAllContextLenght();
+    for (unsigned long iTime = 0; iTime <= iEnd; iTime += options.iFrameMs) {
+      input.SetTime(iTime);
+      tStart = std::chrono::steady_clock::now();
+      intf.NewFrame(iTime, false);
+      if (iTime == 0) {
+        //start moving, as clicking would
+        intf.KeyDown(iTime, Keys::Primary_Input);
+        intf.KeyUp(iTime, Keys::Primary_Input);
+      }
+      SFrame frame;
+      frame.iTime = iTime;
+      frame.dWallMs = MsSince(tStart);
+      if (CFrameProfiler *pProfiler = intf.GetFrameProfiler()) {
+        const CFrameProfiler::SFrame &profile(pProfiler->GetFrame(pProfiler->GetNumFrames() - 1));
+        std::copy(profile.dPhaseMs, profile.dPhaseMs + CFrameProfiler::NUM_PHASES, frame.dPhaseMs);
+      } else
+        std::fill(frame.dPhaseMs, frame.dPhaseMs + CFrameProfiler::NUM_PHASES, 0.0);
+      //the alphabet manager is replaced if the alphabet or LM settings change
+      pAlphMgr = intf.GetAlphabetManager();
+      const NodeAllocStats stats(currentNodeAllocStats());
+      frame.iNodesCreated = static_cast<unsigned long>(stats.iTotalAllocated - lastStats.iTotalAllocated);
+      frame.iNodesDeleted = static_cast<unsigned long>(frame.iNodesCreated + lastStats.iLive - stats.iLive);
+      frame.iNodesLive = static_cast<unsigned long>(stats.iLive);
+      const unsigned long iProbs = pAlphMgr->GetNumProbsCalls();
+      frame.iProbsCalls = iProbs >= iLastProbs ? iProbs - iLastProbs : iProbs;
+      const long iChars = intf.GetAllContextLenght();
+      frame.iCharsChange = iChars - iLastChars;
+      result.vFrames.push_back(frame);
+      lastStats = stats;
+      iLastProbs = iProbs;
+      iLastChars = iChars;
+    }
+
+    result.iCharsOutput = intf.GetNumCharsOutput();
+    result.iCharsDeleted = intf.GetNumCharsDeleted();
+    result.strText = intf.GetAllContext();
+    result.vMessages = intf.GetMessages();
+  }
+  result.iPrimitives = screen.GetNumPrimitives();
+  return true;
+}
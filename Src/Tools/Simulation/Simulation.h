@@ -0,0 +1,85 @@
+// Simulation.h
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// This file is part of Dasher.
+//
+// Dasher is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Dasher is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Dasher; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+#pragma once
+
+#include "HeadlessDasher.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Dasher {
+/// \ingroup Simulation
+/// \{
+
+/// Runs the full frame pipeline (input filter, model, view, expansion policy) of a
+/// CHeadlessInterface on a CNullScreen, driven by a coordinate stream and a virtual
+/// clock advancing a fixed time per frame. Everything but the wall-clock times is
+/// determined by the options and the data files, so runs can be compared exactly.
+class CSimulation {
+public:
+  struct SOptions {
+    ///Directories to search for alphabets, colours and training text
+    std::vector<std::string> vDataDirs;
+    ///Alphabet to use (SP_ALPHABET_ID); empty for the default
+    std::string strAlphabet;
+    ///Further settings, as (name, value) pairs for CSettingsStore::ClSet
+    std::vector<std::pair<std::string, std::string> > vSettings;
+    int iScreenWidth = 800, iScreenHeight = 600;
+    ///Virtual time between frames
+    unsigned long iFrameMs = 20;
+    ///Simulated duration; 0 means until the end of the input stream
+    unsigned long iDurationMs = 0;
+  };
+
+  ///Measurements of one frame
+  struct SFrame {
+    ///Virtual time passed to NewFrame
+    unsigned long iTime;
+    ///Wall-clock time NewFrame took
+    double dWallMs;
+    unsigned long iNodesCreated, iNodesDeleted, iNodesLive;
+    unsigned long iProbsCalls;
+    ///Net change in the length of the edit buffer (characters)
+    long iCharsChange;
+    ///Time in each phase of NewFrame, if SResult::bProfiled
+    double dPhaseMs[CFrameProfiler::NUM_PHASES];
+  };
+
+  struct SResult {
+    std::vector<SFrame> vFrames;
+    ///Whether the core was built with DASHER_FRAME_PROFILER, so SFrame::dPhaseMs are filled in
+    bool bProfiled;
+    ///Time spent in Realize (loading the alphabet, training the language model)
+    double dStartupMs;
+    ///ID of the alphabet used
+    std::string strAlphabet;
+    unsigned long iCharsOutput, iCharsDeleted;
+    std::string strText;
+    std::vector<std::string> vMessages;
+    unsigned long iPrimitives;
+  };
+
+  ///Returns false (with an explanation in strError) if the settings or alphabet are invalid
+  static bool Run(const SOptions &options, const std::vector<SCoordSample> &vInput, SResult &result, std::string &strError);
+};
+/// \}
+}
@@ -0,0 +1,209 @@
+// SymbolStreamBenchmark.cpp
+//
+// Copyright (c) 2024 The Dasher Team
+//
+// Measures how fast training text is turned into symbols by CAlphabetMap::SymbolStream,
+// reading each file both through a std::ifstream (refilling the stream's small buffer)
+// and from a memory-mapped copy (decoding in place), in MB (of UTF-8) and millions of
+// symbols per second. Each file is decoded several times per mode and the fastest pass
+// reported, as the first will include reading the file from disk. Both modes must give
+// the same symbols, which is checked. With --train, also times CTrainer training a PPM
+// model from each file, streamed (CTrainer::Parse) and mapped (CTrainer::ParseFile).
+//
+// Usage: SymbolStreamBenchmark [--data DIR]... [--alphabet ID] [--text FILE]... [--repeat N] [--train]
+// Data directories (default ./Data) are searched recursively for alphabets and the
+// alphabet's training file, unless text files are given.
+
+#include "HeadlessDasher.h"
+
+#include "AlphabetMap.h"
+#include "MappedFile.h"
+#include "Trainer.h"
+#include "Alphabet/AlphIO.h"
+#include "LanguageModelling/PPMLanguageModel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace Dasher;
+
+namespace {
+  void Usage(const char *szProg) {
+    fprintf(stderr, "Usage: %s [--data DIR]... [--alphabet ID] [--text FILE]... [--repeat N] [--train]\n", szProg);
+  }
+
+  class CStderrMessages : public CMessageDisplay {
+  public:
+    void Message(const std::string &strText, bool bInterrupt) override {
+      fprintf(stderr, "%s\n", strText.c_str());
+    }
+  };
+
+  ///Records the names of files found by ScanDataDirs, without reading them
+  class CFileLister : public AbstractParser {
+  public:
+    CFileLister(CMessageDisplay *pMsgs) : AbstractParser(pMsgs) {}
+    bool ParseFile(const std::string &strPath, bool bUser) override {
+      m_vFiles.push_back(strPath);
+      return true;
+    }
+    bool Parse(const std::string &strDesc, std::istream &in, bool bUser) override {
+      return false;
+    }
+    std::vector<std::string> m_vFiles;
+  };
+
+  ///Result of decoding a file once
+  struct SPass {
+    unsigned long iSymbols = 0, iUnknown = 0;
+    ///Order-dependent hash of the symbols, to check the modes agree
+    unsigned long long iHash = 0;
+    double dMs = 0;
+  };
+
+  double MsSince(std::chrono::steady_clock::time_point tStart) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count();
+  }
+
+  void Decode(CAlphabetMap::SymbolStream &syms, const CAlphabetMap *pMap, SPass &pass) {
+    //Count in locals, so the stream's state needn't be reloaded after every store
+    unsigned long iSymbols = 0, iUnknown = 0;
+    unsigned long long iHash = 0;
+    for (symbol sym; (sym = syms.next(pMap)) != -1;) {
+      iSymbols++;
+      if (sym == 0) iUnknown++;
+      iHash = iHash * 31 + static_cast<unsigned long long>(sym);
+    }
+    pass.iSymbols = iSymbols;
+    pass.iUnknown = iUnknown;
+    pass.iHash = iHash;
+  }
+
+  SPass DecodeStream(const std::string &strFile, const CAlphabetMap *pMap) {
+    SPass pass;
+    const auto tStart = std::chrono::steady_clock::now();
+    std::ifstream in(strFile.c_str(), std::ios::binary);
+    CAlphabetMap::SymbolStream syms(in);
+    Decode(syms, pMap, pass);
+    pass.dMs = MsSince(tStart);
+    return pass;
+  }
+
+  SPass DecodeMapped(const std::string &strFile, const CAlphabetMap *pMap) {
+    SPass pass;
+    const auto tStart = std::chrono::steady_clock::now();
+    CMappedFile file;
+    if (file.Open(strFile)) {
+      CAlphabetMap::SymbolStream syms(reinterpret_cast<const char *>(file.Data()), file.Size());
+      Decode(syms, pMap, pass);
+    }
+    pass.dMs = MsSince(tStart);
+    return pass;
+  }
+
+  ///Time to train a fresh PPM model on the file, streamed or mapped
+  double TimeTraining(const std::string &strFile, bool bMapped, CSettingsStore *pSettings, CMessageDisplay *pMsgs,
+                      const CAlphInfo *pAlph, const CAlphabetMap *pMap) {
+    CPPMLanguageModel model(pSettings, pAlph->iEnd - 1);
+    CTrainer trainer(pMsgs, &model, pAlph, pMap);
+    const auto tStart = std::chrono::steady_clock::now();
+    if (bMapped)
+      trainer.ParseFile(strFile, false);
+    else {
+      std::ifstream in(strFile.c_str(), std::ios::binary);
+      trainer.Parse(strFile, in, false);
+    }
+    return MsSince(tStart);
+  }
+
+  ///Best (least) time of several
+  template<typename F> SPass Fastest(int iRepeat, F pass) {
+    SPass best = pass();
+    for (int i = 1; i < iRepeat; i++) {
+      const SPass next = pass();
+      if (next.dMs < best.dMs) best = next;
+    }
+    return best;
+  }
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> vDataDirs, vTextFiles;
+  std::string strAlphabet;
+  int iRepeat = 5;
+  bool bTrain = false;
+  for (int i = 1; i < argc; i++) {
+    const bool bArg = i + 1 < argc;
+    if (!strcmp(argv[i], "--data") && bArg) vDataDirs.push_back(argv[++i]);
+    else if (!strcmp(argv[i], "--alphabet") && bArg) strAlphabet = argv[++i];
+    else if (!strcmp(argv[i], "--text") && bArg) vTextFiles.push_back(argv[++i]);
+    else if (!strcmp(argv[i], "--repeat") && bArg) iRepeat = std::max(1, atoi(argv[++i]));
+    else if (!strcmp(argv[i], "--train")) bTrain = true;
+    else {
+      Usage(argv[0]);
+      return 1;
+    }
+  }
+  if (vDataDirs.empty()) vDataDirs.push_back("Data");
+
+  CHeadlessSettingsStore settings;
+  CStderrMessages msgs;
+  CAlphIO alphIO(&msgs);
+  ScanDataDirs(&alphIO, vDataDirs, "alphabet.*.xml");
+  const CAlphInfo *pAlph = alphIO.GetInfo(strAlphabet.empty() ? alphIO.GetDefault() : strAlphabet);
+  //As CAlphabetManager::InitMap
+  CAlphabetMap map;
+  for (int i = 1; i < pAlph->iEnd; i++) {
+    if (pAlph->SymbolPrintsNewLineCharacter(i))
+      map.AddParagraphSymbol(i);
+    else
+      map.Add(pAlph->GetText(i), i);
+  }
+
+  CFileLister files(&msgs);
+  if (vTextFiles.empty())
+    ScanDataDirs(&files, vDataDirs, pAlph->GetTrainingFile());
+  else
+    files.m_vFiles = vTextFiles;
+  if (files.m_vFiles.empty()) {
+    fprintf(stderr, "No training text %s found\n", pAlph->GetTrainingFile().c_str());
+    return 1;
+  }
+
+  printf("Alphabet \"%s\" (%d symbols); best of %d passes\n", pAlph->GetID().c_str(), pAlph->iEnd - 1, iRepeat);
+  printf("%-40s %8s %9s %9s %12s %12s %14s %8s\n", "file", "MB", "Msymbols", "unknown", "stream MB/s", "mapped MB/s",
+         "mapped Msym/s", "speedup");
+  bool bAgree = true;
+  for (const std::string &strFile : files.m_vFiles) {
+    std::error_code ec;
+    const double dMB = static_cast<double>(std::filesystem::file_size(strFile, ec)) / (1024 * 1024);
+    const SPass stream = Fastest(iRepeat, [&]() {return DecodeStream(strFile, &map);});
+    const SPass mapped = Fastest(iRepeat, [&]() {return DecodeMapped(strFile, &map);});
+    if (stream.iSymbols != mapped.iSymbols || stream.iHash != mapped.iHash) {
+      fprintf(stderr, "%s: streamed and mapped symbols differ\n", strFile.c_str());
+      bAgree = false;
+    }
+    const std::string strName(std::filesystem::path(strFile).filename().string());
+    printf("%-40s %8.2f %9.3f %9lu %12.1f %12.1f %14.2f %7.2fx\n", strName.c_str(), dMB, mapped.iSymbols / 1e6,
+           mapped.iUnknown, dMB / (stream.dMs / 1000), dMB / (mapped.dMs / 1000), mapped.iSymbols / 1e3 / mapped.dMs,
+           stream.dMs / mapped.dMs);
+    if (bTrain) {
+      double dStreamMs = TimeTraining(strFile, false, &settings, &msgs, pAlph, &map);
+      double dMappedMs = TimeTraining(strFile, true, &settings, &msgs, pAlph, &map);
+      for (int i = 1; i < iRepeat; i++) {
+        dStreamMs = std::min(dStreamMs, TimeTraining(strFile, false, &settings, &msgs, pAlph, &map));
+        dMappedMs = std::min(dMappedMs, TimeTraining(strFile, true, &settings, &msgs, pAlph, &map));
+      }
+      printf("%-40s PPM training: streamed %.1f MB/s, mapped %.1f MB/s\n", "", dMB / (dStreamMs / 1000),
+             dMB / (dMappedMs / 1000));
+    }
+  }
+  return bAgree ? 0 : 1;
+}